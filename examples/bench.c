@@ -0,0 +1,369 @@
+// hammer-bench: times the example grammars with every backend.
+//
+// Usage: hammer-bench [-f text|json|csv] GRAMMAR FILE...
+//        hammer-bench -c [-f text|json|csv] [-b BASELINE [-t PERCENT]] [GRAMMAR...]
+//
+// The first form runs GRAMMAR on the given files, each of which is one
+// test case. The second runs the generated corpus (see corpus.c) of the
+// given grammars, or of all of them.
+//
+// The expected result of each input is the one the packrat backend gives;
+// inputs that packrat rejects are left out. The grammar is then compiled
+// for every backend, and each backend that agrees with packrat on all
+// the inputs is timed (see h_benchmark). The report goes to stdout, and
+// the progress to stderr.
+//
+// With -b, the median times of a corpus run are compared to those of a
+// baseline, saved from an earlier run with -f csv. A case that became
+// slower by more than PERCENT (default 10) is flagged as a regression,
+// as is a backend that no longer compiles or agrees with packrat; the
+// exit status is then 1.
+
+#define _GNU_SOURCE // open_memstream
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/hammer.h"
+#include "corpus.h"
+
+static void usage(void) {
+  fprintf(stderr, "Usage: hammer-bench [-f text|json|csv] GRAMMAR FILE...\n"
+                  "       hammer-bench -c [-f text|json|csv] [-b BASELINE [-t PERCENT]] [GRAMMAR...]\n");
+  fprintf(stderr, "Grammars:\n");
+  for (size_t i = 0; i < n_bench_grammars; i++)
+    fprintf(stderr, "  %-10s %s%s\n", bench_grammars[i].name, bench_grammars[i].about,
+            bench_grammars[i].generate ? "" : " (no corpus)");
+  exit(2);
+}
+
+static const struct bench_grammar *find_grammar(const char *name) {
+  for (size_t i = 0; i < n_bench_grammars; i++) {
+    if (strcmp(name, bench_grammars[i].name) == 0)
+      return &bench_grammars[i];
+  }
+  fprintf(stderr, "Unknown grammar %s\n", name);
+  usage();
+  return NULL;
+}
+
+// the contents of path, or NULL
+static uint8_t *read_file(const char *path, size_t *length) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  size_t cap = 4096, len = 0, n;
+  uint8_t *buf = malloc(cap);
+  while (buf && (n = fread(buf + len, 1, cap - len, f)) > 0) {
+    len += n;
+    if (len == cap) {
+      uint8_t *more = realloc(buf, cap *= 2);
+      if (!more)
+        free(buf);
+      buf = more;
+    }
+  }
+  fclose(f);
+  *length = len;
+  return buf;
+}
+
+// Adds input to cases, with packrat's result, if packrat accepts it;
+// otherwise frees it. Returns the new number of cases.
+static size_t add_case(HParser *parser, HParserTestcase *cases, size_t n,
+                       const char *name, uint8_t *input, size_t length) {
+  HParseResult *res = h_parse(parser, input, length);
+  if (!res) {
+    fprintf(stderr, "%s: does not parse; left out\n", name);
+    free(input);
+    return n;
+  }
+  fprintf(stderr, "Case %zu: %s, %zu bytes\n", n, name, length);
+  cases[n].input = input;
+  cases[n].length = length;
+  cases[n].output_unambiguous = h_write_result_unamb(res->ast);
+  h_parse_result_free(res);
+  return n + 1;
+}
+
+static void free_cases(HParserTestcase *cases) {
+  for (HParserTestcase *tc = cases; tc->input; tc++) {
+    free(tc->input);
+    free(tc->output_unambiguous);
+  }
+  free(cases);
+}
+
+
+///
+// Baselines
+///
+
+// The key of a CSV row: the grammar, backend and case columns.
+#define KEY_LEN 64
+
+struct row {
+  char key[KEY_LEN];
+  char backend[16];
+  size_t kase;              // (size_t)-1 for a backend without cases
+  double median;
+};
+
+struct baseline {
+  struct row *rows;
+  size_t n;
+};
+
+// Splits a line of the corpus CSV into r. Returns false for the header.
+static bool parse_row(char *line, struct row *r) {
+  char *col[13];
+  size_t n = 0;
+  for (char *p = line; n < 13; p++) {
+    col[n++] = p;
+    p = strpbrk(p, ",\n");
+    if (!p)
+      break;
+    *p = '\0';
+  }
+  if (n < 13 || strcmp(col[0], "grammar") == 0)
+    return false;
+  // grammar, backend, case
+  snprintf(r->key, KEY_LEN, "%s,%s,%s", col[0], col[1], col[4]);
+  snprintf(r->backend, sizeof(r->backend), "%s", col[1]);
+  r->kase = *col[4] ? strtoul(col[4], NULL, 10) : (size_t)-1;
+  r->median = strtod(col[7], NULL);
+  return true;
+}
+
+static void read_baseline(const char *path, struct baseline *base) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  char line[512];
+  size_t cap = 0;
+  base->rows = NULL;
+  base->n = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (base->n == cap) {
+      cap = cap ? 2 * cap : 64;
+      base->rows = realloc(base->rows, cap * sizeof(struct row));
+      if (!base->rows) {
+        perror("hammer-bench");
+        exit(1);
+      }
+    }
+    if (parse_row(line, &base->rows[base->n]))
+      base->n++;
+  }
+  fclose(f);
+}
+
+// Compares the rows of one grammar's results to the baseline, and reports
+// to stderr. Returns the number of regressions.
+static size_t compare(const char *grammar, const char *rows, const struct baseline *base,
+                      double percent) {
+  size_t regressions = 0;
+  size_t glen = strlen(grammar);
+
+  // every case of the baseline should still be there, and not be slower
+  for (size_t i = 0; i < base->n; i++) {
+    const struct row *b = &base->rows[i];
+    if (strncmp(b->key, grammar, glen) != 0 || b->key[glen] != ',' || b->kase == (size_t)-1)
+      continue;
+    bool found = false;
+    for (const char *p = rows; *p && !found; ) {
+      const char *eol = strchr(p, '\n');
+      size_t len = eol ? (size_t)(eol - p) : strlen(p);
+      char line[512];
+      struct row r;
+      snprintf(line, sizeof(line), "%s,%.*s\n", grammar, (int)len, p);
+      p += len + (eol != NULL);
+      if (!parse_row(line, &r) || strcmp(r.key, b->key) != 0)
+        continue;
+      found = true;
+      double change = b->median > 0 ? (r.median - b->median) * 100 / b->median : 0;
+      if (change > percent) {
+        fprintf(stderr, "REGRESSION %s/%s case %zu: median %.0f ns -> %.0f ns (%+.1f%%)\n",
+                grammar, r.backend, r.kase, b->median, r.median, change);
+        regressions++;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "REGRESSION %s/%s case %zu: no longer benchmarked\n",
+              grammar, b->backend, b->kase);
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+
+///
+// Main program
+///
+
+// Times parser on the cases, and writes the report; with base, compares.
+// Returns the number of regressions.
+static size_t run(const char *grammar, HParser *parser, HParserTestcase *cases,
+                  HBenchmarkFormat format, bool first, bool corpus,
+                  const struct baseline *base, double percent) {
+  HBenchmarkResults *results = h_benchmark(parser, cases);
+  if (!corpus) {
+    h_benchmark_report_format(stdout, results, format);
+    return 0;
+  }
+
+  char *csv = NULL;
+  size_t size = 0;
+  FILE *mem = open_memstream(&csv, &size);
+  h_benchmark_report_format(mem, results, H_BENCHMARK_CSV);
+  fclose(mem);
+  const char *rows = strchr(csv, '\n') + 1;   // without the header
+
+  switch (format) {
+  case H_BENCHMARK_TEXT:
+    printf("== %s\n", grammar);
+    h_benchmark_report_format(stdout, results, format);
+    break;
+  case H_BENCHMARK_JSON:
+    printf("%s\n  {\"grammar\": \"%s\", \"lengths\": [", first ? "" : ",", grammar);
+    for (HParserTestcase *tc = cases; tc->input; tc++)
+      printf("%s%zu", tc == cases ? "" : ", ", tc->length);
+    printf("], \"results\": ");
+    h_benchmark_report_format(stdout, results, format);
+    printf("  }");
+    break;
+  case H_BENCHMARK_CSV:
+    if (first)
+      printf("grammar,%.*s", (int)(rows - csv), csv);
+    for (const char *p = rows; *p; ) {
+      const char *eol = strchr(p, '\n');
+      size_t len = eol ? (size_t)(eol - p + 1) : strlen(p);
+      printf("%s,%.*s", grammar, (int)len, p);
+      p += len;
+    }
+    break;
+  }
+
+  size_t regressions = base ? compare(grammar, rows, base, percent) : 0;
+  free(csv);
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  HBenchmarkFormat format = H_BENCHMARK_TEXT;
+  bool corpus = false;
+  struct baseline base = {NULL, 0};
+  const char *baseline = NULL;
+  double percent = 10;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "cf:b:t:")) != -1) {
+    switch (opt) {
+    case 'c':
+      corpus = true;
+      break;
+    case 'f':
+      if (strcmp(optarg, "text") == 0)
+        format = H_BENCHMARK_TEXT;
+      else if (strcmp(optarg, "json") == 0)
+        format = H_BENCHMARK_JSON;
+      else if (strcmp(optarg, "csv") == 0)
+        format = H_BENCHMARK_CSV;
+      else
+        usage();
+      break;
+    case 'b':
+      baseline = optarg;
+      break;
+    case 't':
+      percent = strtod(optarg, NULL);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (!corpus && (baseline || argc - optind < 2))
+    usage();
+
+  if (!corpus) {
+    // one grammar, on files
+    HParser *parser = find_grammar(argv[optind])->grammar();
+    HParserTestcase *cases = calloc(argc - optind, sizeof(HParserTestcase));
+    size_t n = 0;
+    h_compile(parser, PB_PACKRAT, NULL);
+    for (int i = optind + 1; i < argc; i++) {
+      size_t length;
+      uint8_t *input = read_file(argv[i], &length);
+      if (!input) {
+        perror(argv[i]);
+        return 1;
+      }
+      n = add_case(parser, cases, n, argv[i], input, length);
+    }
+    if (n == 0) {
+      fprintf(stderr, "No input parses\n");
+      return 1;
+    }
+    run(argv[optind], parser, cases, format, true, false, NULL, 0);
+    free_cases(cases);
+    return 0;
+  }
+
+  if (baseline)
+    read_baseline(baseline, &base);
+  if (format == H_BENCHMARK_JSON)
+    printf("{\"corpus\": [");
+
+  size_t regressions = 0;
+  bool first = true;
+  for (size_t g = 0; g < n_bench_grammars; g++) {
+    const struct bench_grammar *bg = &bench_grammars[g];
+    if (optind < argc) {
+      bool listed = false;
+      for (int i = optind; i < argc; i++)
+        listed |= (find_grammar(argv[i]) == bg);
+      if (!listed)
+        continue;
+    }
+    if (!bg->generate)
+      continue;
+
+    fprintf(stderr, "== %s: %s\n", bg->name, bg->about);
+    HParser *parser = bg->grammar();
+    h_compile(parser, PB_PACKRAT, NULL);
+    size_t max = 0, n = 0, length;
+    uint8_t *input;
+    HParserTestcase *cases = NULL;
+    for (unsigned int i = 0; (input = bg->generate(i, &length)); i++) {
+      cases = realloc(cases, (i + 2) * sizeof(HParserTestcase));
+      char name[32];
+      snprintf(name, sizeof(name), "%s/%u", bg->name, i);
+      n = add_case(parser, cases, n, name, input, length);
+      max = i + 1;
+    }
+    if (n < max) {
+      // a generated input that packrat rejects is a bug, in corpus.c or hammer
+      fprintf(stderr, "%s: %zu of %zu inputs do not parse\n", bg->name, max - n, max);
+      regressions++;
+    }
+    if (n == 0)
+      continue;
+    memset(&cases[n], 0, sizeof(HParserTestcase));
+    regressions += run(bg->name, parser, cases, format, first, true,
+                       baseline ? &base : NULL, percent);
+    first = false;
+    free_cases(cases);
+  }
+
+  if (format == H_BENCHMARK_JSON)
+    printf("\n]}\n");
+  if (baseline) {
+    fprintf(stderr, "%zu regressions against %s (threshold %.1f%%)\n",
+            regressions, baseline, percent);
+  }
+  free(base.rows);
+  return regressions > 0;
+}
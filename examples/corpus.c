@@ -0,0 +1,442 @@
+// The grammars of hammer-bench, and the inputs generated for them.
+//
+// The grammars are those of the other examples, without their semantic
+// actions (h_benchmark compares results by h_write_result_unamb, which
+// cannot print user tokens), and a few that stress one backend each. The
+// inputs come from a fixed-seed generator, so that the timings of two
+// runs are comparable.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/glue.h"
+#include "corpus.h"
+
+
+///
+// Generated input
+///
+
+struct buf {
+  uint8_t *p;
+  size_t len, cap;
+};
+
+static void put(struct buf *b, const void *data, size_t n) {
+  if (b->len + n > b->cap) {
+    b->cap = 2 * (b->len + n);
+    b->p = realloc(b->p, b->cap);
+    if (!b->p) {
+      perror("hammer-bench");
+      exit(1);
+    }
+  }
+  memcpy(b->p + b->len, data, n);
+  b->len += n;
+}
+
+static void put8(struct buf *b, uint8_t x) {
+  put(b, &x, 1);
+}
+
+static void put16(struct buf *b, uint16_t x) {
+  put8(b, x >> 8);
+  put8(b, x & 0xff);
+}
+
+static void put32(struct buf *b, uint32_t x) {
+  put16(b, x >> 16);
+  put16(b, x & 0xffff);
+}
+
+// xorshift64; the same numbers on every platform
+static uint64_t next(uint64_t *s) {
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+// a random number in [lo, hi]
+static unsigned int between(uint64_t *s, unsigned int lo, unsigned int hi) {
+  return lo + next(s) % (hi - lo + 1);
+}
+
+static uint64_t seed(unsigned int i) {
+  return 0x9e3779b97f4a7c15ULL * (i + 1);
+}
+
+// a domain name in the text form of examples/dns_common.c
+static void put_domain(struct buf *b, uint64_t *s) {
+  unsigned int labels = between(s, 2, 4);
+  for (unsigned int i = 0; i < labels; i++) {
+    if (i > 0)
+      put8(b, '.');
+    unsigned int len = between(s, 1, 10);
+    for (unsigned int j = 0; j < len; j++)
+      put8(b, between(s, 'a', 'z'));
+  }
+}
+
+// a <character-string> of RFC 1035
+static void put_cstr(struct buf *b, uint64_t *s) {
+  unsigned int len = between(s, 0, 20);
+  put8(b, len);
+  for (unsigned int j = 0; j < len; j++)
+    put8(b, between(s, ' ', '~'));
+}
+
+static uint8_t *done(struct buf *b, size_t *length) {
+  *length = b->len;
+  return b->p;
+}
+
+
+///
+// examples/base64.c
+///
+
+static HParser *base64(void) {
+  H_RULE(digit,       h_ch_range(0x30, 0x39));
+  H_RULE(alpha,       h_choice(h_ch_range(0x41, 0x5a), h_ch_range(0x61, 0x7a), NULL));
+  H_RULE(bsfdig,      h_choice(alpha, digit, h_ch('+'), h_ch('/'), NULL));
+  H_RULE(bsfdig_4bit, h_in((uint8_t *)"AEIMQUYcgkosw048", 16));
+  H_RULE(bsfdig_2bit, h_in((uint8_t *)"AQgw", 4));
+  H_RULE(equals,      h_ch('='));
+  H_RULE(quad,        h_sequence(bsfdig, bsfdig, bsfdig, bsfdig, NULL));
+  H_RULE(base64_2,    h_sequence(bsfdig, bsfdig, bsfdig_4bit, equals, NULL));
+  H_RULE(base64_1,    h_sequence(bsfdig, bsfdig_2bit, equals, equals, NULL));
+  H_RULE(document,    h_sequence(h_many(quad),
+                                 h_optional(h_choice(base64_2, base64_1, NULL)),
+                                 h_end_p(), NULL));
+  return document;
+}
+
+// blobs of random bytes, with both kinds of padding
+static uint8_t *gen_base64(unsigned int i, size_t *length) {
+  static const size_t sizes[] = {256, 1024, 4097};
+  static const char digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  uint64_t s = seed(i);
+  struct buf b = {NULL, 0, 0};
+  for (size_t n = 0; n < sizes[i]; n += 3) {
+    uint32_t x = next(&s) & 0xffffff;
+    size_t k = sizes[i] - n < 3 ? sizes[i] - n : 3;  // bytes in this quad
+    for (size_t j = 0; j < 4; j++)
+      put8(&b, j <= k ? digits[(x >> (18 - 6 * j)) & 0x3f] : '=');
+    if (k < 3) {
+      // the unused bits of the last digit are zero
+      b.p[b.len - 4 + k] = digits[(x >> (18 - 6 * k)) & (k == 1 ? 0x30 : 0x3c)];
+    }
+  }
+  return done(&b, length);
+}
+
+
+///
+// examples/dns.c, with the domain names of examples/dns_common.c
+///
+
+// The label of dns_common.c, letter [[ldh-str] let-dig], cannot match more
+// than one letter under packrat: ldh-str takes the final let-dig as well.
+// This is the same language, in a form every backend parses.
+static HParser *domain(void) {
+  H_RULE(letter,    h_choice(h_ch_range('a','z'), h_ch_range('A','Z'), NULL));
+  H_RULE(let_dig,   h_choice(letter, h_ch_range('0','9'), NULL));
+  H_RULE(label,     h_sequence(letter,
+                               h_many(h_choice(let_dig,
+                                               h_sequence(h_many1(h_ch('-')), let_dig, NULL),
+                                               NULL)),
+                               NULL));
+  H_RULE(subdomain, h_sepBy1(label, h_ch('.')));
+  H_RULE(domain,    h_choice(subdomain, h_ch(' '), NULL));
+  return domain;
+}
+
+static HParser *dns(void) {
+  H_RULE(header,    h_sequence(h_bits(16, false), // ID
+                               h_bits(1, false),  // QR
+                               h_bits(4, false),  // opcode
+                               h_bits(1, false),  // AA
+                               h_bits(1, false),  // TC
+                               h_bits(1, false),  // RD
+                               h_bits(1, false),  // RA
+                               h_bits(3, false),  // Z
+                               h_bits(4, false),  // RCODE
+                               h_uint16(),        // QDCOUNT
+                               h_uint16(),        // ANCOUNT
+                               h_uint16(),        // NSCOUNT
+                               h_uint16(),        // ARCOUNT
+                               NULL));
+  H_RULE(type,      h_int_range(h_uint16(), 1, 16));
+  H_RULE(qtype,     h_choice(type, h_int_range(h_uint16(), 252, 255), NULL));
+  H_RULE(class,     h_int_range(h_uint16(), 1, 4));
+  H_RULE(qclass,    h_choice(class, h_int_range(h_uint16(), 255, 255), NULL));
+  H_RULE(len,       h_int_range(h_uint8(), 1, 255));
+  H_RULE(qlabel,    h_length_value(len, h_uint8()));
+  H_RULE(qname,     h_sequence(h_many1(qlabel), h_ch('\x00'), NULL));
+  H_RULE(question,  h_sequence(qname, qtype, qclass, NULL));
+  H_RULE(rdata,     h_length_value(h_uint16(), h_uint8()));
+  H_RULE(rr,        h_sequence(domain(), type, class, h_uint32(), rdata, NULL));
+  H_RULE(message,   h_sequence(header, h_many(question), h_many(rr), h_end_p(), NULL));
+  return message;
+}
+
+// a query, and responses with few and many records
+static uint8_t *gen_dns(unsigned int i, size_t *length) {
+  static const struct { unsigned int questions, answers; } sizes[] = {
+    {1, 0}, {1, 20}, {4, 200},
+  };
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  uint64_t s = seed(i);
+  struct buf b = {NULL, 0, 0};
+  put16(&b, next(&s));                              // ID
+  put16(&b, sizes[i].answers ? 0x8180 : 0x0100);    // flags
+  put16(&b, sizes[i].questions);
+  put16(&b, sizes[i].answers);
+  put16(&b, 0);
+  put16(&b, 0);
+  for (unsigned int q = 0; q < sizes[i].questions; q++) {
+    unsigned int labels = between(&s, 2, 4);
+    for (unsigned int j = 0; j < labels; j++) {
+      unsigned int len = between(&s, 1, 12);
+      put8(&b, len);
+      for (unsigned int k = 0; k < len; k++)
+        put8(&b, between(&s, 'a', 'z'));
+    }
+    put8(&b, 0);
+    put16(&b, between(&s, 1, 16));                  // QTYPE
+    put16(&b, 1);                                   // QCLASS
+  }
+  for (unsigned int a = 0; a < sizes[i].answers; a++) {
+    put_domain(&b, &s);
+    put16(&b, 1);                                   // A
+    put16(&b, 1);                                   // IN
+    put32(&b, between(&s, 60, 86400));              // TTL
+    put16(&b, 4);
+    put32(&b, next(&s));
+  }
+  return done(&b, length);
+}
+
+
+///
+// The RDATA formats of examples/rr.c, one record after another: each
+// starts with its type, and domain names end in a NUL.
+///
+
+static HParser *rr(void) {
+#define TAG(t) h_int_range(h_uint16(), t, t)
+  H_RULE(name,    h_sequence(domain(), h_ch('\0'), NULL));
+  H_RULE(cstr,    h_length_value(h_uint8(), h_uint8()));
+  H_RULE(a,       h_sequence(TAG(1), h_uint32(), NULL));
+  H_RULE(soa,     h_sequence(TAG(6),
+                             name,       // MNAME
+                             name,       // RNAME
+                             h_uint32(), // SERIAL
+                             h_uint32(), // REFRESH
+                             h_uint32(), // RETRY
+                             h_uint32(), // EXPIRE
+                             h_uint32(), // MINIMUM
+                             NULL));
+  H_RULE(hinfo,   h_sequence(TAG(13), cstr, cstr, NULL));
+  H_RULE(mx,      h_sequence(TAG(15), h_uint16(), name, NULL));
+  H_RULE(txt,     h_sequence(TAG(16), h_length_value(h_int_range(h_uint8(), 1, 255), cstr),
+                             NULL));
+  H_RULE(record,  h_choice(a, soa, hinfo, mx, txt, NULL));
+  H_RULE(records, h_sequence(h_many(record), h_end_p(), NULL));
+  return records;
+#undef TAG
+}
+
+static uint8_t *gen_rr(unsigned int i, size_t *length) {
+  static const unsigned int sizes[] = {100, 1000, 5000};
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  uint64_t s = seed(i);
+  struct buf b = {NULL, 0, 0};
+  for (unsigned int n = 0; n < sizes[i]; n++) {
+    switch (between(&s, 0, 4)) {
+    case 0:
+      put16(&b, 1);
+      put32(&b, next(&s));
+      break;
+    case 1:
+      put16(&b, 6);
+      put_domain(&b, &s);
+      put8(&b, 0);
+      put_domain(&b, &s);
+      put8(&b, 0);
+      for (int k = 0; k < 5; k++)
+        put32(&b, next(&s));
+      break;
+    case 2:
+      put16(&b, 13);
+      put_cstr(&b, &s);
+      put_cstr(&b, &s);
+      break;
+    case 3:
+      put16(&b, 15);
+      put16(&b, between(&s, 0, 100));
+      put_domain(&b, &s);
+      put8(&b, 0);
+      break;
+    default: {
+      unsigned int count = between(&s, 1, 4);
+      put16(&b, 16);
+      put8(&b, count);
+      for (unsigned int k = 0; k < count; k++)
+        put_cstr(&b, &s);
+      break;
+    }
+    }
+  }
+  return done(&b, length);
+}
+
+
+///
+// examples/ties.c, cfExample: E -> E '-' T | T ;  T -> '(' E ')' | 'n'
+// Left-recursive, which packrat has to grow its way through; the deep
+// nesting gives the LR stacks some height.
+///
+
+static HParser *expr(void) {
+  HParser *E = h_indirect();
+  H_RULE(T, h_choice(h_sequence(h_ch('('), E, h_ch(')'), NULL), h_ch('n'), NULL));
+  h_bind_indirect(E, h_choice(h_sequence(E, h_ch('-'), T, NULL), T, NULL));
+  H_RULE(document, h_sequence(E, h_end_p(), NULL));
+  return document;
+}
+
+static uint8_t *gen_expr(unsigned int i, size_t *length) {
+  static const struct { unsigned int terms, depth; } sizes[] = {
+    {1000, 0}, {10000, 0}, {1, 100}, {1, 1000}, {100, 20},
+  };
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  struct buf b = {NULL, 0, 0};
+  for (unsigned int n = 0; n < sizes[i].terms; n++) {
+    if (n > 0)
+      put8(&b, '-');
+    for (unsigned int d = 0; d < sizes[i].depth; d++)
+      put(&b, d % 2 ? "n-(" : "(", d % 2 ? 3 : 1);
+    put8(&b, 'n');
+    for (unsigned int d = 0; d < sizes[i].depth; d++)
+      put8(&b, ')');
+  }
+  return done(&b, length);
+}
+
+
+///
+// examples/ties.c, finkmao
+///
+
+static HParser *finkmao(void) {
+  HParser *L = h_ch('L'), *R = h_ch('R'), *C = h_ch('C'), *U = h_ch('U');
+  HParser *Lnext = h_indirect(), *Rnext = h_indirect(), *Cnext = h_indirect();
+  h_bind_indirect(Lnext, h_choice(h_sequence(R, Rnext, NULL),
+                                  h_sequence(C, Cnext, NULL),
+                                  h_sequence(R, C, U, NULL), NULL));
+  h_bind_indirect(Rnext, h_choice(h_sequence(L, Lnext, NULL),
+                                  h_sequence(C, Cnext, NULL),
+                                  h_sequence(L, C, U, NULL), NULL));
+  h_bind_indirect(Cnext, h_choice(h_sequence(R, Rnext, NULL),
+                                  h_sequence(L, Lnext, NULL), NULL));
+  H_RULE(tie, h_sequence(L, Lnext, h_end_p(), NULL));
+  return tie;
+}
+
+
+///
+// S -> S S | 'a', which has a Catalan number of derivations of a^n: the
+// worst case for GLR and Earley. The value is ignored, so that every
+// backend gives the same result whichever derivation it picks.
+///
+
+static HParser *ambiguous(void) {
+  HParser *S = h_indirect();
+  h_bind_indirect(S, h_choice(h_sequence(S, S, NULL), h_ch('a'), NULL));
+  H_RULE(document, h_sequence(h_ignore(S), h_end_p(), NULL));
+  return document;
+}
+
+static uint8_t *gen_ambiguous(unsigned int i, size_t *length) {
+  static const size_t sizes[] = {10, 20, 40};
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  struct buf b = {NULL, 0, 0};
+  for (size_t n = 0; n < sizes[i]; n++)
+    put8(&b, 'a');
+  return done(&b, length);
+}
+
+
+///
+// A long alternation of literal words, separated by spaces; what the
+// regular expression backend is best at.
+///
+
+#define N_KEYWORDS 256
+
+// keyword k, of 3 to 10 letters
+static size_t keyword(unsigned int k, char *word) {
+  uint64_t s = seed(1000 + k);
+  size_t len = between(&s, 3, 10);
+  for (size_t j = 0; j < len; j++)
+    word[j] = between(&s, 'a', 'z');
+  return len;
+}
+
+static int longer(const void *p, const void *q) {
+  return (int)strlen(*(char * const *)q) - (int)strlen(*(char * const *)p);
+}
+
+static HParser *keywords(void) {
+  // the longest first, so that no keyword stops packrat at its prefix
+  static char words[N_KEYWORDS][11];
+  char *sorted[N_KEYWORDS];
+  for (unsigned int k = 0; k < N_KEYWORDS; k++) {
+    words[k][keyword(k, words[k])] = '\0';
+    sorted[k] = words[k];
+  }
+  qsort(sorted, N_KEYWORDS, sizeof(char *), longer);
+
+  HParser *alts[N_KEYWORDS + 1];
+  for (unsigned int k = 0; k < N_KEYWORDS; k++)
+    alts[k] = h_token((uint8_t *)sorted[k], strlen(sorted[k]));
+  alts[N_KEYWORDS] = NULL;
+  H_RULE(keyword,  h_choice__a((void **)alts));
+  H_RULE(document, h_sequence(h_many(h_sequence(keyword, h_ch(' '), NULL)), h_end_p(), NULL));
+  return document;
+}
+
+static uint8_t *gen_keywords(unsigned int i, size_t *length) {
+  static const unsigned int sizes[] = {1000, 10000};
+  if (i >= sizeof(sizes) / sizeof(sizes[0]))
+    return NULL;
+  uint64_t s = seed(i);
+  struct buf b = {NULL, 0, 0};
+  char word[10];
+  for (unsigned int n = 0; n < sizes[i]; n++) {
+    put(&b, word, keyword(between(&s, 0, N_KEYWORDS - 1), word));
+    put8(&b, ' ');
+  }
+  return done(&b, length);
+}
+
+
+const struct bench_grammar bench_grammars[] = {
+  {"base64",    "examples/base64.c",                          base64,    gen_base64},
+  {"dns",       "examples/dns.c, without its actions",        dns,       gen_dns},
+  {"rr",        "the RDATA formats of examples/rr.c",         rr,        gen_rr},
+  {"expr",      "left-recursive and deeply nested (ties.c)",  expr,      gen_expr},
+  {"finkmao",   "examples/ties.c",                            finkmao,   NULL},
+  {"ambiguous", "S -> S S | 'a'",                             ambiguous, gen_ambiguous},
+  {"keywords",  "an alternation of 256 literals",             keywords,  gen_keywords},
+};
+const size_t n_bench_grammars = sizeof(bench_grammars) / sizeof(bench_grammars[0]);
@@ -0,0 +1,22 @@
+#ifndef HAMMER_EXAMPLES_CORPUS__H
+#define HAMMER_EXAMPLES_CORPUS__H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../src/hammer.h"
+
+// A grammar for hammer-bench, with a generator for its benchmark corpus.
+struct bench_grammar {
+  const char *name;
+  const char *about;
+  HParser *(*grammar)(void);
+  // Generates the input of case i of the corpus, in a malloc'd buffer.
+  // Returns NULL when there is no case i. The inputs are the same on every
+  // run. NULL for grammars that are only run on files.
+  uint8_t *(*generate)(unsigned int i, size_t *length);
+};
+
+extern const struct bench_grammar bench_grammars[];
+extern const size_t n_bench_grammars;
+
+#endif
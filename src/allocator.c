@@ -36,8 +36,15 @@ struct arena_link {
   uint8_t rest[];
 } ;
 
+struct arena_cleanup {
+  void (*fn)(void *env);
+  void *env;
+  struct arena_cleanup *next;
+};
+
 struct HArena_ {
   struct arena_link *head;
+  struct arena_cleanup *cleanups; // lives in the arena itself
   struct HAllocator_ *mm__;
   size_t block_size;
   size_t used;
@@ -58,6 +65,7 @@ HArena *h_new_arena(HAllocator* mm__, size_t block_size) {
   link->used = 0;
   link->next = NULL;
   ret->head = link;
+  ret->cleanups = NULL;
   ret->block_size = block_size;
   ret->used = 0;
   ret->mm__ = mm__;
@@ -112,6 +120,8 @@ void h_arena_free(HArena *arena, void* ptr) {
 
 void h_delete_arena(HArena *arena) {
   HAllocator *mm__ = arena->mm__;
+  for (struct arena_cleanup *c = arena->cleanups; c; c = c->next)
+    c->fn(c->env);
   struct arena_link *link = arena->head;
   while (link) {
     struct arena_link *next = link->next; 
@@ -124,6 +134,35 @@ void h_delete_arena(HArena *arena) {
   h_free(arena);
 }
 
+void h_arena_adopt(HArena *arena, HArena *other) {
+  assert(arena->mm__ == other->mm__);
+  HAllocator *mm__ = other->mm__;
+  // other's blocks go behind arena's current one, which stays in use.
+  struct arena_link *tail = other->head;
+  while (tail->next)
+    tail = tail->next;
+  tail->next = arena->head->next;
+  arena->head->next = other->head;
+  arena->used += other->used;
+  arena->wasted += other->wasted;
+  struct arena_cleanup **c = &arena->cleanups;
+  while (*c)
+    c = &(*c)->next;
+  *c = other->cleanups;
+  h_free(other);
+}
+
+int h_arena_on_delete(HArena *arena, void (*fn)(void *env), void *env) {
+  struct arena_cleanup *c = h_arena_malloc(arena, sizeof(struct arena_cleanup));
+  if (!c)
+    return -1;
+  c->fn = fn;
+  c->env = env;
+  c->next = arena->cleanups;
+  arena->cleanups = c;
+  return 0;
+}
+
 void h_allocator_stats(HArena *arena, HArenaStats *stats) {
   stats->used = arena->used;
   stats->wasted = arena->wasted;
@@ -51,6 +51,12 @@ HArena *h_new_arena(HAllocator* allocator, size_t block_size); // pass 0 for def
 void* h_arena_malloc(HArena *arena, size_t count) ATTR_MALLOC(2);
 void h_arena_free(HArena *arena, void* ptr); // For future expansion, with alternate memory managers.
 void h_delete_arena(HArena *arena);
+// Move all of other's memory into arena, to be freed along with it, and free other.
+// Both arenas must come from the same allocator.
+void h_arena_adopt(HArena *arena, HArena *other);
+// Call fn(env) when arena is deleted, before its memory is freed. Returns -1
+// if that cannot be arranged (fn is then not called).
+int h_arena_on_delete(HArena *arena, void (*fn)(void *env), void *env);
 
 typedef struct {
   size_t used;
@@ -59,6 +65,35 @@ typedef struct {
 
 void h_allocator_stats(HArena *arena, HArenaStats *stats);
 
+// An allocator that counts what it passes on to another one, to be given
+// to the __m functions. It can also refuse allocations past a limit. Its
+// functions may be called from several threads at once.
+
+#define H_ALLOCATOR_BUCKETS 16
+
+typedef struct {
+  size_t allocs;    // calls of alloc, and of realloc with NULL
+  size_t reallocs;
+  size_t frees;     // calls of free, with NULL or not
+  size_t failures;  // allocations refused, by the limit or the other allocator
+  size_t bytes;     // allocated and not yet freed
+  size_t peak;      // the most bytes allocated at once
+  size_t total;     // bytes allocated, realloc'd blocks counted again
+  // Sizes of alloc and realloc: bucket 0 counts the sizes up to 16 bytes,
+  // bucket i those up to 16 << i, and the last one all larger ones.
+  size_t histogram[H_ALLOCATOR_BUCKETS];
+} HAllocatorStats;
+
+// Counts the calls of the allocator backing, or of malloc if that is NULL.
+// With a nonzero limit, alloc and realloc return NULL rather than allocate
+// more than limit bytes at once. Returns NULL if out of memory.
+HAllocator *h_counting_allocator_new(HAllocator *backing, size_t limit);
+// Frees the counting allocator. What it allocated must be freed first.
+void h_counting_allocator_free(HAllocator *counting);
+void h_counting_allocator_stats(HAllocator *counting, HAllocatorStats *stats);
+// Sets the peak to the bytes allocated now, to find the peak of what follows.
+void h_counting_allocator_reset_peak(HAllocator *counting);
+
 #ifdef __cplusplus
 }
 #endif
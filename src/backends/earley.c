@@ -0,0 +1,916 @@
+/* Earley parser backend
+ *
+ * Recognizes any context-free grammar, ambiguous or left-recursive ones
+ * included, in O(n^3) time in the worst case, O(n^2) for unambiguous grammars
+ * and O(n) for LR-regular grammars. The latter bound covers right recursion
+ * thanks to Joop Leo's optimization [1], which completes deterministic chains
+ * of right-recursive items in one step instead of one per level.
+ *
+ * Like the LR backends, the parser reads input for as long as it can still be
+ * the prefix of a sentence. The parse succeeds if the input read up to that
+ * point is a sentence. If the grammar is ambiguous, an arbitrary (but fixed)
+ * derivation is chosen.
+ *
+ * [1] J. M. I. M. Leo. A general context-free parsing algorithm running in
+ *     linear time on every LR(k) grammar without using lookahead.
+ *     Theoretical Computer Science 82 (1991), 165-176.
+ */
+
+#include <assert.h>
+#include "../internal.h"
+#include "../cfgrammar.h"
+#include "../parsers/parser_internal.h"
+
+
+/* Compiling the grammar into a compact table */
+
+// values of HEarleyTable.dotsym
+#define H_EARLEY_TERM  0x80000000u  // terminal symbol; low bits index 'terms'
+#define H_EARLEY_DONE  0x7fffffffu  // end of rule
+// (other values are nonterminal numbers)
+
+/* The grammar, flattened into arrays. The right-hand sides of all rules are
+ * laid out one after the other in 'dotsym', each followed by H_EARLEY_DONE.
+ * A dotted rule is then a single number, the index of the symbol right of the
+ * dot, and an Earley item is just the pair (dot, origin).
+ *
+ * The nonterminals are numbered as in the HCFGrammar, i.e. the start symbol
+ * is 0. An extra nonterminal, numbered last, is the augmented start symbol
+ * S' with the single rule S' -> S.
+ */
+typedef struct HEarleyTable_ {
+  size_t     nnts;      // number of nonterminals, including S'
+  HCFChoice  **nts;     // their HCFChoices; NULL for S'
+  uint32_t   *ntrules;  // the rules of nt n are ntrules[n] .. ntrules[n+1]-1
+  uint32_t   *rulelhs;  // nonterminal of each rule
+  uint32_t   *rulestart;// first dot of each rule
+  uint32_t   *dotsym;   // symbol right of each dot
+  uint32_t   *dotrule;  // rule of each dot
+  HCFChoice  **terms;   // terminal symbols (HCF_CHAR, HCF_CHARSET, HCF_END)
+  uint32_t   accept;    // the dot of S' -> S., which accepts the input
+  HArena     *arena;
+  HAllocator *mm__;
+} HEarleyTable;
+
+static void h_earleytable_free(HEarleyTable *table)
+{
+  if(table == NULL)
+    return;
+  HAllocator *mm__ = table->mm__;
+  h_delete_arena(table->arena);
+  h_free(table);
+}
+
+// helper: the number of a symbol in the table, adding terminals as needed
+static uint32_t symbol_number(HCFGrammar *g, HHashTable *termnums, size_t *nterms,
+                              const HCFChoice *x)
+{
+  if(x->type == HCF_CHOICE)
+    return (uintptr_t)h_hashtable_get(g->nts, x);
+
+  uintptr_t n = (uintptr_t)h_hashtable_get(termnums, x);
+  if(n == 0) {
+    n = ++*nterms;
+    h_hashtable_put(termnums, x, (void *)n);
+  }
+  return H_EARLEY_TERM | (n - 1);
+}
+
+static HEarleyTable *earley_table(HAllocator *mm__, HCFGrammar *g)
+{
+  HEarleyTable *table = h_new(HEarleyTable, 1);
+  HArena *arena = h_new_arena(mm__, 0);
+  table->mm__ = mm__;
+  table->arena = arena;
+
+  // collect the nonterminals in order of their numbers
+  size_t nnts = g->nts->used + 1;
+  HCFChoice **nts = h_arena_malloc(arena, nnts * sizeof(HCFChoice *));
+  for(size_t i=0; i < g->nts->capacity; i++) {
+    for(HHashTableEntry *hte = &g->nts->contents[i]; hte; hte = hte->next) {
+      if(hte->key == NULL)
+        continue;
+      nts[(uintptr_t)hte->value] = (HCFChoice *)hte->key;
+    }
+  }
+  nts[nnts-1] = NULL;   // S'
+  assert(nts[0] == g->start);
+
+  // count rules and dots
+  size_t nrules = 1, ndots = 2;     // S' -> S
+  for(size_t n=0; n < nnts-1; n++) {
+    for(HCFSequence **p = nts[n]->seq; *p; p++) {
+      nrules++;
+      for(HCFChoice **x = (*p)->items; *x; x++)
+        ndots++;
+      ndots++;
+    }
+  }
+
+  table->nnts = nnts;
+  table->nts = nts;
+  table->ntrules = h_arena_malloc(arena, (nnts + 1) * sizeof(uint32_t));
+  table->rulelhs = h_arena_malloc(arena, nrules * sizeof(uint32_t));
+  table->rulestart = h_arena_malloc(arena, nrules * sizeof(uint32_t));
+  table->dotsym = h_arena_malloc(arena, ndots * sizeof(uint32_t));
+  table->dotrule = h_arena_malloc(arena, ndots * sizeof(uint32_t));
+
+  // lay out the rules, nonterminal by nonterminal
+  HHashTable *termnums = h_hashtable_new(g->arena, h_eq_ptr, h_hash_ptr);
+  size_t nterms = 0;
+  uint32_t r = 0, d = 0;
+  for(size_t n=0; n < nnts; n++) {
+    table->ntrules[n] = r;
+    if(nts[n] == NULL) {                // S' -> S
+      table->rulelhs[r] = n;
+      table->rulestart[r] = d;
+      table->dotrule[d] = r;
+      table->dotsym[d++] = 0;
+      table->accept = d;
+      table->dotrule[d] = r;
+      table->dotsym[d++] = H_EARLEY_DONE;
+      r++;
+      continue;
+    }
+    for(HCFSequence **p = nts[n]->seq; *p; p++) {
+      table->rulelhs[r] = n;
+      table->rulestart[r] = d;
+      for(HCFChoice **x = (*p)->items; *x; x++) {
+        table->dotrule[d] = r;
+        table->dotsym[d++] = symbol_number(g, termnums, &nterms, *x);
+      }
+      table->dotrule[d] = r;
+      table->dotsym[d++] = H_EARLEY_DONE;
+      r++;
+    }
+  }
+  table->ntrules[nnts] = r;
+  assert(r == nrules);
+  assert(d == ndots);
+
+  table->terms = h_arena_malloc(arena, (nterms > 0 ? nterms : 1) * sizeof(HCFChoice *));
+  for(size_t i=0; i < termnums->capacity; i++) {
+    for(HHashTableEntry *hte = &termnums->contents[i]; hte; hte = hte->next) {
+      if(hte->key == NULL)
+        continue;
+      table->terms[(uintptr_t)hte->value - 1] = (HCFChoice *)hte->key;
+    }
+  }
+
+  return table;
+}
+
+int h_earley_compile(HAllocator* mm__, HParser* parser, const void* params)
+{
+  HCFGrammar *g = h_cfgrammar(mm__, parser);
+  if(g == NULL)
+    return -1;      // backend not suitable (language not context-free)
+
+  parser->backend_data = earley_table(mm__, g);
+
+  // free grammar and its arena.
+  // desugared parsers (HCFChoice and HCFSequence) are unaffected by this.
+  h_cfgrammar_free(g);
+
+  return 0;
+}
+
+void h_earley_free(HParser *parser)
+{
+  HEarleyTable *table = parser->backend_data;
+  h_earleytable_free(table);
+  parser->backend_data = NULL;
+  parser->backend = PB_PACKRAT;
+}
+
+
+
+/* Recognizer */
+
+#define NONE ((uint32_t)-1)
+#define LEO  ((uint32_t)-2)
+
+/* The items of all Earley sets are kept in one array, set after set. Besides
+ * (dot, origin), each item records how it came about, which is enough to
+ * recover one derivation after recognition.
+ */
+typedef struct HEarleyItem_ {
+  uint32_t dot;
+  uint32_t origin;  // number of the set where the item's rule was predicted
+  uint32_t pred;    // item this one was advanced from; NONE if predicted,
+                    // LEO if added by Leo's rule
+  uint32_t link;    // completed item of the symbol left of the dot, or the
+                    // input byte if that is a terminal. if pred is LEO, the
+                    // completed item that triggered the rule.
+  uint32_t next;    // next item of the same set waiting for the same symbol
+} HEarleyItem;
+
+/* What a set knows about one of the nonterminals predicted in it. */
+typedef struct HEarleyWaits_ {
+  uint32_t set;       // key: set number (NONE for a free slot)...
+  uint32_t nt;        // ...and nonterminal
+  uint32_t head;      // list of items waiting for nt, linked by 'next'
+  uint32_t count;     // length of that list
+  uint32_t empty;     // completed item of nt with origin 'set', if any
+  uint32_t topdot;    // the topmost item of Leo's rule (see leo_top)
+  uint32_t toporigin;
+  enum { LEO_UNKNOWN, LEO_NONE, LEO_BUSY, LEO_SOME } leo;
+} HEarleyWaits;
+
+/* Items of the current set, by (dot, origin). Slots from other sets are
+ * recognized by their stamp and count as free.
+ */
+typedef struct HEarleySlot_ {
+  uint32_t stamp;     // set number + 1
+  uint32_t item;
+} HEarleySlot;
+
+typedef struct HEarleyState_ {
+  const HEarleyTable *table;
+
+  HEarleyItem *items;
+  size_t      nitems, itemcap;
+  uint32_t    *sets;        // index of the first item of each set
+  size_t      nsets, setcap;// the current set is nsets-1
+  size_t      cursor;       // next item of the current set to process
+
+  HEarleySlot *slots;       // dedup for the current set
+  size_t      slotcap, slotused;
+  HEarleyWaits *waits;      // hash table by (set, nt)
+  size_t      waitcap, waitused;
+
+  uint32_t    accept;       // accepting item of the longest prefix, or NONE
+  size_t      acceptpos;    // its set number, i.e. the length of the prefix
+  size_t      last;         // the last nonempty set, once done
+  bool        error;        // out of memory
+
+  HAllocator  *mm__;
+} HEarleyState;
+
+static inline HHashValue item_hash(uint32_t dot, uint32_t origin)
+{
+  return dot * 0x9e3779b1u ^ origin * 0x85ebca6bu;
+}
+
+// helper: double the capacity of a mm__-allocated array as needed
+static bool ensure_cap(HAllocator *mm__, void **p, size_t *cap, size_t n,
+                       size_t size)
+{
+  if(n <= *cap)
+    return true;
+  size_t newcap = *cap * 2;
+  if(newcap < n)
+    newcap = n;
+  void *q = mm__->realloc(mm__, *p, newcap * size);
+  if(q == NULL)
+    return false;
+  *p = q;
+  *cap = newcap;
+  return true;
+}
+
+static bool slots_rehash(HEarleyState *s, size_t cap)
+{
+  HAllocator *mm__ = s->mm__;
+  HEarleySlot *slots = h_new(HEarleySlot, cap);
+  if(slots == NULL)
+    return false;
+  memset(slots, 0, cap * sizeof(HEarleySlot));
+  if(s->slots)
+    h_free(s->slots);
+  s->slots = slots;
+  s->slotcap = cap;
+
+  // reinsert the items of the current set
+  uint32_t stamp = s->nsets;
+  size_t begin = (s->nsets > 0)? s->sets[s->nsets-1] : s->nitems;
+  for(size_t x = begin; x < s->nitems; x++) {
+    HHashValue h = item_hash(s->items[x].dot, s->items[x].origin);
+    size_t i;
+    for(i = h & (cap-1); slots[i].stamp == stamp; i = (i+1) & (cap-1));
+    slots[i].stamp = stamp;
+    slots[i].item = x;
+  }
+  return true;
+}
+
+/* Add an item to the current set unless it is already there. */
+static void add_item(HEarleyState *s, uint32_t dot, uint32_t origin,
+                     uint32_t pred, uint32_t link)
+{
+  if(s->error)
+    return;
+
+  uint32_t stamp = s->nsets;
+  if(2 * (s->slotused + 1) > s->slotcap
+     && !slots_rehash(s, 2 * s->slotcap)) {
+    s->error = true;
+    return;
+  }
+
+  HEarleySlot *slots = s->slots;
+  size_t mask = s->slotcap - 1;
+  size_t i;
+  for(i = item_hash(dot, origin) & mask; slots[i].stamp == stamp; i = (i+1) & mask) {
+    const HEarleyItem *x = &s->items[slots[i].item];
+    if(x->dot == dot && x->origin == origin)
+      return;   // already present
+  }
+
+  if(s->nitems >= NONE - 1
+     || !ensure_cap(s->mm__, (void **)&s->items, &s->itemcap, s->nitems + 1,
+                    sizeof(HEarleyItem))) {
+    s->error = true;
+    return;
+  }
+
+  uint32_t x = s->nitems++;
+  s->items[x].dot = dot;
+  s->items[x].origin = origin;
+  s->items[x].pred = pred;
+  s->items[x].link = link;
+  s->items[x].next = NONE;
+  slots[i].stamp = stamp;
+  slots[i].item = x;
+  s->slotused++;
+
+  if(dot == s->table->accept) {
+    assert(origin == 0);
+    s->accept = x;
+    s->acceptpos = s->nsets - 1;
+  }
+}
+
+/* Begin a new (empty) set. */
+static void new_set(HEarleyState *s)
+{
+  if(!ensure_cap(s->mm__, (void **)&s->sets, &s->setcap, s->nsets + 1,
+                 sizeof(uint32_t))) {
+    s->error = true;
+    return;
+  }
+  s->sets[s->nsets++] = s->nitems;
+  s->cursor = s->nitems;
+  s->slotused = 0;
+}
+
+static HEarleyWaits *waits_lookup(const HEarleyState *s, uint32_t set, uint32_t nt)
+{
+  size_t mask = s->waitcap - 1;
+  for(size_t i = item_hash(nt, set) & mask; s->waits[i].set != NONE; i = (i+1) & mask) {
+    if(s->waits[i].set == set && s->waits[i].nt == nt)
+      return &s->waits[i];
+  }
+  return NULL;
+}
+
+static bool waits_rehash(HEarleyState *s, size_t cap)
+{
+  HAllocator *mm__ = s->mm__;
+  HEarleyWaits *old = s->waits;
+  size_t oldcap = s->waitcap;
+
+  s->waits = h_new(HEarleyWaits, cap);
+  if(s->waits == NULL) {
+    s->waits = old;
+    return false;
+  }
+  s->waitcap = cap;
+  for(size_t i=0; i<cap; i++)
+    s->waits[i].set = NONE;
+  for(size_t i=0; i<oldcap; i++) {
+    if(old[i].set == NONE)
+      continue;
+    size_t j;
+    for(j = item_hash(old[i].nt, old[i].set) & (cap-1); s->waits[j].set != NONE;
+        j = (j+1) & (cap-1));
+    s->waits[j] = old[i];
+  }
+  if(old)
+    h_free(old);
+  return true;
+}
+
+/* Find or make the waits entry for a nonterminal in the current set.
+ * Sets *fresh if it was made.
+ */
+static HEarleyWaits *waits_get(HEarleyState *s, uint32_t nt, bool *fresh)
+{
+  uint32_t set = s->nsets - 1;
+  HEarleyWaits *w = waits_lookup(s, set, nt);
+
+  *fresh = (w == NULL);
+  if(w)
+    return w;
+
+  if(2 * (s->waitused + 1) > s->waitcap && !waits_rehash(s, 2 * s->waitcap)) {
+    s->error = true;
+    return NULL;
+  }
+  size_t mask = s->waitcap - 1;
+  size_t i;
+  for(i = item_hash(nt, set) & mask; s->waits[i].set != NONE; i = (i+1) & mask);
+  w = &s->waits[i];
+  w->set = set;
+  w->nt = nt;
+  w->head = NONE;
+  w->count = 0;
+  w->empty = NONE;
+  w->leo = LEO_UNKNOWN;
+  s->waitused++;
+  return w;
+}
+
+/* Leo's rule: if set j holds exactly one item waiting for nt, and that item
+ * has nt as its last symbol, a completion of nt with origin j makes that item
+ * complete, which completes its own left-hand side, and so on. Instead of
+ * adding each item of such a chain, only the last one (the "topmost") is
+ * added. It is memoized in the waits entry of (j, nt).
+ *
+ * The chain can be as long as the input, so it is walked in a loop rather
+ * than by recursion: down to its top, marking the entries on the way as
+ * busy and keeping their next step in topdot/toporigin, then again from
+ * the start to memoize the top in each of them.
+ *
+ * Returns false if the rule does not apply.
+ */
+static bool leo_top(HEarleyState *s, uint32_t j, uint32_t nt,
+                    uint32_t *topdot, uint32_t *toporigin)
+{
+  const HEarleyTable *t = s->table;
+  HEarleyWaits *w = waits_lookup(s, j, nt);
+
+  if(w == NULL)
+    return false;
+  switch(w->leo) {
+  case LEO_SOME:
+    *topdot = w->topdot;
+    *toporigin = w->toporigin;
+    return true;
+  case LEO_NONE:
+  case LEO_BUSY:    // cyclic chain
+    return false;
+  case LEO_UNKNOWN:
+    break;
+  }
+
+  // NB: the waits entries stay where they are; the walks only look them up.
+  uint32_t dot = NONE, origin = NONE;
+  for(HEarleyWaits *v = w; v != NULL; ) {
+    if(v->leo == LEO_SOME) {
+      dot = v->topdot;
+      origin = v->toporigin;
+      break;
+    }
+    if(v->leo != LEO_UNKNOWN)   // no further step, or a cyclic chain
+      break;
+    const HEarleyItem *y = &s->items[v->head];
+    if(v->count != 1 || t->dotsym[y->dot + 1] != H_EARLEY_DONE) {
+      v->leo = LEO_NONE;
+      break;
+    }
+    dot = y->dot + 1;
+    origin = y->origin;
+    v->leo = LEO_BUSY;
+    v->topdot = dot;
+    v->toporigin = origin;
+    v = waits_lookup(s, origin, t->rulelhs[t->dotrule[dot]]);
+  }
+  if(w->leo == LEO_NONE)
+    return false;
+
+  for(HEarleyWaits *v = w; v != NULL && v->leo == LEO_BUSY; ) {
+    uint32_t next = v->toporigin;
+    uint32_t lhs = t->rulelhs[t->dotrule[v->topdot]];
+    v->leo = LEO_SOME;
+    v->topdot = dot;
+    v->toporigin = origin;
+    v = waits_lookup(s, next, lhs);
+  }
+  *topdot = dot;
+  *toporigin = origin;
+  return true;
+}
+
+static void predict(HEarleyState *s, uint32_t x, uint32_t nt)
+{
+  const HEarleyTable *t = s->table;
+  uint32_t set = s->nsets - 1;
+  bool fresh;
+
+  HEarleyWaits *w = waits_get(s, nt, &fresh);
+  if(w == NULL)
+    return;
+  s->items[x].next = w->head;
+  w->head = x;
+  w->count++;
+  uint32_t empty = w->empty;
+
+  if(fresh) {
+    for(uint32_t r = t->ntrules[nt]; r < t->ntrules[nt+1]; r++)
+      add_item(s, t->rulestart[r], set, NONE, NONE);
+  }
+
+  // nt may have been completed in this set already (it derives epsilon)
+  if(empty != NONE)
+    add_item(s, s->items[x].dot + 1, s->items[x].origin, x, empty);
+}
+
+static void complete(HEarleyState *s, uint32_t x)
+{
+  const HEarleyTable *t = s->table;
+  uint32_t set = s->nsets - 1;
+  uint32_t origin = s->items[x].origin;
+  uint32_t nt = t->rulelhs[t->dotrule[s->items[x].dot]];
+
+  HEarleyWaits *w = waits_lookup(s, origin, nt);
+  if(w == NULL) {
+    assert(nt == t->nnts - 1);  // S' is never predicted
+    return;
+  }
+
+  uint32_t topdot, toporigin;
+  if(origin == set) {
+    // empty derivation; remember it for items yet to wait for nt
+    if(w->empty == NONE)
+      w->empty = x;
+  } else if(leo_top(s, origin, nt, &topdot, &toporigin)) {
+    add_item(s, topdot, toporigin, LEO, x);
+    return;
+  }
+
+  for(uint32_t y = w->head; y != NONE; y = s->items[y].next)
+    add_item(s, s->items[y].dot + 1, s->items[y].origin, y, x);
+}
+
+/* Process the unprocessed items of the current set. If 'end' is set, the
+ * input ends here.
+ */
+static void closure(HEarleyState *s, bool end)
+{
+  const HEarleyTable *t = s->table;
+
+  while(s->cursor < s->nitems && !s->error) {
+    uint32_t x = s->cursor++;
+    uint32_t sym = t->dotsym[s->items[x].dot];
+
+    if(sym == H_EARLEY_DONE)
+      complete(s, x);
+    else if(!(sym & H_EARLEY_TERM))
+      predict(s, x, sym);
+    else if(end && t->terms[sym & ~H_EARLEY_TERM]->type == HCF_END)
+      add_item(s, s->items[x].dot + 1, s->items[x].origin, x, NONE);
+  }
+}
+
+static inline bool term_matches(const HCFChoice *x, uint8_t c)
+{
+  switch(x->type) {
+  case HCF_CHAR:    return (x->chr == c);
+  case HCF_CHARSET: return charset_isset(x->charset, c);
+  default:          return false;
+  }
+}
+
+/* Start the next set with the items of the current set that accept c.
+ * Returns false if there are none.
+ */
+static bool scan(HEarleyState *s, uint8_t c)
+{
+  const HEarleyTable *t = s->table;
+  size_t begin = s->sets[s->nsets-1];
+  size_t end = s->nitems;
+
+  new_set(s);
+  for(size_t x = begin; x < end && !s->error; x++) {
+    uint32_t sym = t->dotsym[s->items[x].dot];
+    if((sym & H_EARLEY_TERM) && term_matches(t->terms[sym & ~H_EARLEY_TERM], c))
+      add_item(s, s->items[x].dot + 1, s->items[x].origin, x, c);
+  }
+
+  return (s->nitems > end);
+}
+
+static HEarleyState *earley_start(HAllocator *mm__, const HParser *parser)
+{
+  const HEarleyTable *table = parser->backend_data;
+  assert(table != NULL);
+
+  HEarleyState *s = h_new(HEarleyState, 1);
+  memset(s, 0, sizeof(HEarleyState));
+  s->table = table;
+  s->mm__ = mm__;
+  s->accept = NONE;
+
+  s->itemcap = 64;
+  s->items = h_new(HEarleyItem, s->itemcap);
+  s->setcap = 64;
+  s->sets = h_new(uint32_t, s->setcap);
+  if(s->items == NULL || s->sets == NULL
+     || !slots_rehash(s, 64) || !waits_rehash(s, 64)) {
+    s->error = true;
+    return s;
+  }
+
+  // set 0 holds S' -> .S
+  new_set(s);
+  add_item(s, table->rulestart[table->ntrules[table->nnts-1]], 0, NONE, NONE);
+  closure(s, false);
+
+  return s;
+}
+
+/* Feed a chunk of input to the recognizer. Returns true when done. */
+static bool earley_chunk(HEarleyState *s, HInputStream *stream)
+{
+  assert(stream->bit_offset == 0);
+
+  while(stream->index < stream->length && !s->error) {
+    size_t before = s->nitems;
+    uint8_t c = h_read_byte(stream);
+    if(!scan(s, c)) {
+      // no item survives c; the parse is over. leave c unconsumed.
+      s->last = s->nsets - 2;
+      assert(s->last == stream->pos + stream->index - 1);
+      stream->index--;
+      return true;
+    }
+    closure(s, false);
+    h_limit_steps(stream, s->nitems - before);
+  }
+
+  if(s->error)
+    return true;
+  h_limit_end(stream);
+  if(stream->last_chunk) {
+    // advance the items of the last set that expect the end of input
+    const HEarleyTable *t = s->table;
+    size_t end = s->nitems;
+    for(size_t x = s->sets[s->nsets-1]; x < end; x++) {
+      uint32_t sym = t->dotsym[s->items[x].dot];
+      if((sym & H_EARLEY_TERM) && t->terms[sym & ~H_EARLEY_TERM]->type == HCF_END)
+        add_item(s, s->items[x].dot + 1, s->items[x].origin, x, NONE);
+    }
+    closure(s, true);
+    s->last = s->nsets - 1;
+    return true;
+  }
+  return false;
+}
+
+
+
+/* Recovering the derivation */
+
+/* Replace the Leo link of item x by an ordinary one, adding the items of the
+ * chain between x and the completed item that triggered it.
+ */
+static void leo_expand(HEarleyState *s, uint32_t x)
+{
+  const HEarleyTable *t = s->table;
+  uint32_t child = s->items[x].link;
+
+  for(;;) {
+    const HEarleyItem *c = &s->items[child];
+    HEarleyWaits *w = waits_lookup(s, c->origin, t->rulelhs[t->dotrule[c->dot]]);
+    assert(w != NULL && w->count == 1);
+    uint32_t y = w->head;
+    uint32_t dot = s->items[y].dot + 1;
+    uint32_t origin = s->items[y].origin;
+
+    if(dot == s->items[x].dot && origin == s->items[x].origin) {
+      s->items[x].pred = y;
+      s->items[x].link = child;
+      return;
+    }
+
+    // append an intermediate item, outside of any set
+    if(!ensure_cap(s->mm__, (void **)&s->items, &s->itemcap, s->nitems + 1,
+                   sizeof(HEarleyItem))) {
+      s->error = true;
+      return;
+    }
+    uint32_t n = s->nitems++;
+    s->items[n].dot = dot;
+    s->items[n].origin = origin;
+    s->items[n].pred = y;
+    s->items[n].link = child;
+    s->items[n].next = NONE;
+    child = n;
+  }
+}
+
+// a symbol of a completed rule, with what it matched
+typedef struct HEarleyKid_ {
+  uint32_t sym;     // as in HEarleyTable.dotsym
+  uint32_t item;    // completed item if sym is a nonterminal, else input byte
+  size_t   pos;     // input position of a terminal, end of a nonterminal
+} HEarleyKid;
+
+// a completed item whose semantic value is under construction
+typedef struct HEarleyFrame_ {
+  uint32_t item;
+  HEarleyKid *kids;
+  size_t nkids, next;
+  HCountedArray *seq;
+  struct HEarleyFrame_ *up;
+} HEarleyFrame;
+
+static HEarleyFrame *open_frame(HEarleyState *s, HArena *arena, HArena *tarena,
+                                uint32_t x, size_t end, HEarleyFrame *up)
+{
+  const HEarleyTable *t = s->table;
+
+  if(s->items[x].pred == LEO)
+    leo_expand(s, x);
+  if(s->error)
+    return NULL;
+
+  uint32_t rs = t->rulestart[t->dotrule[s->items[x].dot]];
+  HEarleyFrame *f = h_arena_malloc(tarena, sizeof(HEarleyFrame));
+  f->item = x;
+  f->nkids = s->items[x].dot - rs;
+  f->next = 0;
+  f->kids = h_arena_malloc(tarena, (f->nkids > 0 ? f->nkids : 1) * sizeof(HEarleyKid));
+  f->seq = h_carray_new_sized(arena, f->nkids);
+  f->up = up;
+
+  // walk back along the predecessors, right to left
+  uint32_t y = x;
+  for(size_t i = f->nkids; i > 0; i--) {
+    const HEarleyItem *it = &s->items[y];
+    HEarleyKid *k = &f->kids[i-1];
+    k->sym = t->dotsym[it->dot - 1];
+    k->item = it->link;
+    if(!(k->sym & H_EARLEY_TERM)) {
+      k->pos = end;
+      end = s->items[it->link].origin;
+    } else if(t->terms[k->sym & ~H_EARLEY_TERM]->type == HCF_END) {
+      k->pos = end;
+    } else {
+      k->pos = --end;
+    }
+    y = it->pred;
+  }
+  assert(y == NONE || s->items[y].dot == rs);
+
+  return f;
+}
+
+/* Apply the reshape, validation and semantic action of symbol x to tok, as
+ * the LL(k) driver does. Returns false if validation fails.
+ */
+static bool apply_attrs(HArena *arena, HArena *tarena, const HCFChoice *x,
+                        HParsedToken **tok)
+{
+  HParsedToken *t = *tok;
+
+  if(x->reshape) {
+    HParsedToken *r = x->reshape(make_result(arena, t), x->user_data);
+    if(r && t) {
+      r->index = t->index;
+      r->bit_offset = t->bit_offset;
+    }
+    t = r;
+  }
+  if(x->pred && !x->pred(make_result(tarena, t), x->user_data))
+    return false;
+  if(x->action)
+    t = (HParsedToken *)x->action(make_result(arena, t), x->user_data);
+
+  *tok = t;
+  return true;
+}
+
+/* Build the semantic value of the accepted prefix. Returns NULL on failed
+ * validation; *ok tells that apart from a NULL value.
+ */
+static HParsedToken *derivation(HEarleyState *s, HArena *arena, HArena *tarena,
+                                bool *ok)
+{
+  const HEarleyTable *t = s->table;
+  HParsedToken *tok = NULL;
+
+  // the value of S' -> S. is that of S
+  if(s->items[s->accept].pred == LEO)
+    leo_expand(s, s->accept);
+  uint32_t root = s->items[s->accept].link;
+  HEarleyFrame *f = open_frame(s, arena, tarena, root, s->acceptpos, NULL);
+
+  while(f != NULL) {
+    if(f->next < f->nkids) {
+      HEarleyKid *k = &f->kids[f->next++];
+      if(!(k->sym & H_EARLEY_TERM)) {
+        f = open_frame(s, arena, tarena, k->item, k->pos, f);
+        if(f == NULL)
+          goto fail;
+        continue;
+      }
+
+      // terminal
+      const HCFChoice *x = t->terms[k->sym & ~H_EARLEY_TERM];
+      if(x->type == HCF_END) {
+        tok = NULL;
+      } else {
+        tok = h_arena_malloc(arena, sizeof(HParsedToken));
+        tok->token_type = TT_UINT;
+        tok->uint = k->item;
+        tok->index = k->pos;
+        tok->bit_offset = 0;
+      }
+      if(!apply_attrs(arena, tarena, x, &tok))
+        goto fail;
+      h_carray_append(f->seq, tok);
+      continue;
+    }
+
+    // all kids done; wrap up the nonterminal
+    const HEarleyItem *it = &s->items[f->item];
+    tok = h_arena_malloc(arena, sizeof(HParsedToken));
+    tok->token_type = TT_SEQUENCE;
+    tok->seq = f->seq;
+    tok->index = it->origin;
+    tok->bit_offset = 0;
+    if(!apply_attrs(arena, tarena, t->nts[t->rulelhs[t->dotrule[it->dot]]], &tok))
+      goto fail;
+
+    f = f->up;
+    if(f)
+      h_carray_append(f->seq, tok);
+  }
+
+  *ok = true;
+  return tok;
+
+ fail:
+  *ok = false;
+  return NULL;
+}
+
+static HParseResult *earley_finish(HEarleyState *s)
+{
+  HAllocator *mm__ = s->mm__;
+  HParseResult *res = NULL;
+
+  if(s->accept != NONE && s->acceptpos == s->last && !s->error) {
+    HArena *arena = h_new_arena(mm__, 0);   // will hold the result
+    HArena *tarena = h_new_arena(mm__, 0);  // tmp, deleted after parse
+    bool ok;
+
+    HParsedToken *tok = derivation(s, arena, tarena, &ok);
+    if(ok && !s->error) {
+      res = make_result(arena, tok);
+      res->bit_length = s->acceptpos * 8;
+    } else {
+      h_delete_arena(arena);
+    }
+    h_delete_arena(tarena);
+  }
+
+  if(s->items) h_free(s->items);
+  if(s->sets)  h_free(s->sets);
+  if(s->slots) h_free(s->slots);
+  if(s->waits) h_free(s->waits);
+  h_free(s);
+  return res;
+}
+
+HParseResult *h_earley_parse(HAllocator* mm__, const HParser* parser, HInputStream* stream)
+{
+  HEarleyState *s = earley_start(mm__, parser);
+
+  assert(stream->last_chunk);
+  earley_chunk(s, stream);
+
+  return earley_finish(s);
+}
+
+void h_earley_parse_start(HSuspendedParser *s)
+{
+  s->backend_state = earley_start(s->mm__, s->parser);
+}
+
+bool h_earley_parse_chunk(HSuspendedParser *s, HInputStream *input)
+{
+  HEarleyState *state = s->backend_state;
+
+  if(state->error)
+    return true;
+  return earley_chunk(state, input);
+}
+
+HParseResult *h_earley_parse_finish(HSuspendedParser *s)
+{
+  return earley_finish(s->backend_state);
+}
+
+
+HParserBackendVTable h__earley_backend_vtable = {
+  .compile = h_earley_compile,
+  .parse = h_earley_parse,
+  .free = h_earley_free,
+
+  .parse_start = h_earley_parse_start,
+  .parse_chunk = h_earley_parse_chunk,
+  .parse_finish = h_earley_parse_finish
+};
@@ -7,12 +7,13 @@ static bool glr_step(HParseResult **result, HSlist *engines,
 
 /* GLR compilation (LALR w/o failing on conflict) */
 
-int h_glr_compile(HAllocator* mm__, HParser* parser, const void* params)
+int h_glr_compile_threads(HAllocator* mm__, HParser* parser,
+                          const void* params, unsigned int threads)
 {
   if (!parser->vtable->isValidCF(parser->env)) {
     return -1;
   }
-  int result = h_lalr_compile(mm__, parser, params);
+  int result = h_lalr_compile_threads(mm__, parser, params, threads);
 
   if(result == -1 && parser->backend_data) {
     // table is there, just has conflicts? nevermind, that's okay.
@@ -22,6 +23,11 @@ int h_glr_compile(HAllocator* mm__, HParser* parser, const void* params)
   return result;
 }
 
+int h_glr_compile(HAllocator* mm__, HParser* parser, const void* params)
+{
+  return h_glr_compile_threads(mm__, parser, params, 1);
+}
+
 void h_glr_free(HParser *parser)
 {
   h_lalr_free(parser);
@@ -233,6 +239,7 @@ HParseResult *h_glr_parse(HAllocator* mm__, const HParser* parser, HInputStream*
 
 HParserBackendVTable h__glr_backend_vtable = {
   .compile = h_glr_compile,
+  .compile_threads = h_glr_compile_threads,
   .parse = h_glr_parse,
   .free = h_glr_free
 };
@@ -174,18 +174,21 @@ static int terminals_put(HStringMap *tmap, const HStringMap *fs, HLRAction *acti
     }
   }
 
-  H_FOREACH(fs->char_branches, void *key, HStringMap *fs_)
-    HStringMap *tmap_ = h_hashtable_get(tmap->char_branches, key);
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *fs_;
+  while ((fs_ = h_stringmap_next_branch(fs, &i, &c))) {
+    HStringMap *tmap_ = h_stringmap_get_char(tmap, c);
 
     if (!tmap_) {
       tmap_ = h_stringmap_new(tmap->arena);
-      h_hashtable_put(tmap->char_branches, key, tmap_);
+      h_stringmap_put_after(tmap, c, tmap_);
     }
 
     if (terminals_put(tmap_, fs_, action) < 0) {
       ret = -1;
     }
-  H_END_FOREACH
+  }
 
   return ret;
 }
@@ -267,7 +270,64 @@ HCFChoice *h_desugar_augmented(HAllocator *mm__, HParser *parser)
   return augmented;
 }
 
-int h_lalr_compile(HAllocator* mm__, HParser* parser, const void* params)
+// the lookahead that one enhanced production contributes to a reducible item.
+// the contributions for a state are collected (in parallel, if so desired)
+// before any of them are entered into the table.
+typedef struct HLRLookahead_ {
+  const HLRItem *item;
+  const HStringMap *fs;         // follow set of the enhanced lhs
+  struct HLRLookahead_ *next;
+} HLRLookahead;
+
+typedef struct {
+  const HLRTable *table;
+  const HLRDFA *dfa;
+  HLREnhGrammar *eg;
+  size_t *states;               // the inadequate states
+  HLRLookahead **lookahead;     // contributions for each element of states
+  HCFGrammar **grammars;        // per thread: eg->grammar or a fork of it
+} HLALRJob;
+
+static int collect_lookahead(void *env, unsigned int worker, size_t i)
+{
+  HLALRJob *job = env;
+  HCFGrammar *g = job->grammars[worker];
+  HLREnhGrammar *eg = job->eg;
+  size_t state = job->states[i];
+  HLRLookahead **tail = &job->lookahead[i];
+
+  // go through each reducible item of state
+  H_FOREACH_KEY(job->dfa->states[state], HLRItem *item)
+    if(item->mark < item->len)
+      continue;
+
+    // find all LR(0)-enhanced productions matching item
+    HHashSet *lhss = h_hashtable_get(eg->corr, item->lhs);
+    assert(lhss != NULL);
+    H_FOREACH_KEY(lhss, HCFChoice *lhs)
+      if(match_any_production(job->table, eg, lhs, item->rhs, state)) {
+        // the left-hand symbol's follow set is this production's
+        // contribution to the lookahead
+        const HStringMap *fs = h_follow(1, g, lhs);
+        assert(fs != NULL);
+        assert(fs->epsilon_branch == NULL);
+        assert(!h_stringmap_empty(fs));
+
+        HLRLookahead *la = h_arena_malloc(g->arena, sizeof(HLRLookahead));
+        la->item = item;
+        la->fs = fs;
+        la->next = NULL;
+        *tail = la;
+        tail = &la->next;
+      }
+    H_END_FOREACH // enhanced production
+  H_END_FOREACH  // reducible item
+
+  return 0;
+}
+
+int h_lalr_compile_threads(HAllocator* mm__, HParser* parser,
+                           const void* params, unsigned int threads)
 {
   // generate (augmented) CFG from parser
   // construct LR(0) DFA
@@ -306,52 +366,80 @@ int h_lalr_compile(HAllocator* mm__, HParser* parser, const void* params)
     // go through the inadequate states; replace inadeq with a new list
     HSlist *inadeq = table->inadeq;
     table->inadeq = h_slist_new(arena);
-    
-    for(HSlistNode *x=inadeq->head; x; x=x->next) {
-      size_t state = (uintptr_t)x->elem;
+
+    size_t n = 0;
+    for(HSlistNode *x=inadeq->head; x; x=x->next)
+      n++;
+    if(threads > n)
+      threads = n;
+    if(threads < 1)
+      threads = 1;
+
+    HLALRJob job = {
+      .table = table,
+      .dfa = dfa,
+      .eg = eg,
+      .states = h_arena_malloc(g->arena, n * sizeof(size_t)),
+      .lookahead = h_arena_malloc(g->arena, n * sizeof(HLRLookahead *)),
+      .grammars = h_arena_malloc(g->arena, threads * sizeof(HCFGrammar *))
+    };
+    size_t i = 0;
+    for(HSlistNode *x=inadeq->head; x; x=x->next, i++) {
+      job.states[i] = (uintptr_t)x->elem;
+      job.lookahead[i] = NULL;
+    }
+
+    // the follow sets are memoized in the grammar, which is not safe to share
+    // between threads. with more than one, each gets a fork.
+    job.grammars[0] = eg->grammar;
+    for(unsigned int w=1; w<threads; w++)
+      job.grammars[w] = h_cfgrammar_fork(eg->grammar);
+    if(threads > 1)
+      job.grammars[0] = h_cfgrammar_fork(eg->grammar);
+
+    h_parallel_for(threads, n, collect_lookahead, &job);
+
+    for(i=0; i<n; i++) {
+      size_t state = job.states[i];
       bool inadeq = false;
-      
+
       // clear old forall entry, it's being replaced by more fine-grained ones
       table->forall[state] = NULL;
 
-      // go through each reducible item of state
-      H_FOREACH_KEY(dfa->states[state], HLRItem *item)
-        if(item->mark < item->len)
-          continue;
-
-        // action to place in the table cells indicated by lookahead
-        HLRAction *action = h_reduce_action(arena, item);
-
-        // find all LR(0)-enhanced productions matching item
-        HHashSet *lhss = h_hashtable_get(eg->corr, item->lhs);
-        assert(lhss != NULL);
-        H_FOREACH_KEY(lhss, HCFChoice *lhs)
-          if(match_any_production(table, eg, lhs, item->rhs, state)) {
-            // the left-hand symbol's follow set is this production's
-            // contribution to the lookahead
-            const HStringMap *fs = h_follow(1, eg->grammar, lhs);
-            assert(fs != NULL);
-            assert(fs->epsilon_branch == NULL);
-            assert(!h_stringmap_empty(fs));
-
-            // for each lookahead symbol, put action into table cell
-            if(terminals_put(table->tmap[state], fs, action) < 0)
-              inadeq = true;
-          }
-        H_END_FOREACH // enhanced production
-      H_END_FOREACH  // reducible item
+      // for each lookahead symbol, put the item's action into table cell
+      const HLRItem *item = NULL;
+      HLRAction *action = NULL;
+      for(HLRLookahead *la = job.lookahead[i]; la; la = la->next) {
+        if(la->item != item) {
+          item = la->item;
+          action = h_reduce_action(arena, item);
+        }
+        if(terminals_put(table->tmap[state], la->fs, action) < 0)
+          inadeq = true;
+      }
 
       if(inadeq) {
         h_slist_push(table->inadeq, (void *)(uintptr_t)state);
       }
     }
+
+    if(threads > 1) {
+      for(unsigned int w=0; w<threads; w++)
+        h_cfgrammar_free(job.grammars[w]);
+    }
   }
 
+  table->preds = h_cfgrammar_has_preds(g);
   h_cfgrammar_free(g);
   parser->backend_data = table;
   return has_conflicts(table)? -1 : 0;
 }
 
+int h_lalr_compile(HAllocator* mm__, HParser* parser, const void* params)
+{
+  return h_lalr_compile_threads(mm__, parser, params, 1);
+}
+
 void h_lalr_free(HParser *parser)
 {
   HLRTable *table = parser->backend_data;
@@ -364,11 +452,16 @@ void h_lalr_free(HParser *parser)
 
 HParserBackendVTable h__lalr_backend_vtable = {
   .compile = h_lalr_compile,
+  .compile_threads = h_lalr_compile_threads,
   .parse = h_lr_parse,
   .free = h_lalr_free,
   .parse_start = h_lr_parse_start,
   .parse_chunk = h_lr_parse_chunk,
-  .parse_finish = h_lr_parse_finish
+  .parse_finish = h_lr_parse_finish,
+
+  .dump_code = h_lr_dump_code,
+
+  .parse_events = h_lr_parse_events
 };
 
 
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "../internal.h"
 #include "../cfgrammar.h"
+#include "../codegen.h"
 #include "../parsers/parser_internal.h"
 
 static const size_t DEFAULT_KMAX = 1;
@@ -15,6 +16,7 @@ typedef struct HLLkTable_ {
   size_t     kmax;
   HHashTable *rows;
   HCFChoice  *start;    // start symbol
+  bool       preds;     // does the grammar have validations (h_attr_bool)?
   HArena     *arena;
   HAllocator *mm__;
 } HLLkTable;
@@ -48,6 +50,7 @@ HLLkTable *h_llktable_new(HAllocator *mm__)
   table->mm__  = mm__;
   table->arena = arena;
   table->rows  = rows;
+  table->preds = false;
 
   return table;
 }
@@ -106,26 +109,18 @@ static void stringmap_merge(HHashSet *workset, HStringMap *dst, HStringMap *src)
       dst->end_branch = src->end_branch;
   }
 
-  // iterate over src->char_branches
-  const HHashTable *ht = src->char_branches;
-  for(size_t i=0; i < ht->capacity; i++) {
-    for(HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
-      if(hte->key == NULL)
-        continue;
-
-      HCharKey c = (HCharKey)hte->key;
-      HStringMap *src_ = hte->value;
-
-      if(src_) {
-        HStringMap *dst_ = h_hashtable_get(dst->char_branches, (void *)c);
-        if(dst_) {
-          stringmap_merge(workset, dst_, src_);
-        } else {
-          if(src_->arena != dst->arena)
-            src_ = h_stringmap_copy(dst->arena, src_);
-          h_hashtable_put(dst->char_branches, (void *)c, src_);
-        }
-      }
+  // iterate over the branches of src
+  size_t i = 0;
+  uint8_t c;
+  HStringMap *src_;
+  while((src_ = h_stringmap_next_branch(src, &i, &c))) {
+    HStringMap *dst_ = h_stringmap_get_char(dst, c);
+    if(dst_) {
+      stringmap_merge(workset, dst_, src_);
+    } else {
+      if(src_->arena != dst->arena)
+        src_ = h_stringmap_copy(dst->arena, src_);
+      h_stringmap_put_after(dst, c, src_);
     }
   }
 }
@@ -184,41 +179,103 @@ static int fill_table_row(size_t kmax, HCFGrammar *g, HStringMap *row,
   return (k>kmax)? -1 : 0;
 }
 
-/* Generate the LL(k) parse table from the given grammar.
+// per-thread state of fill_table
+typedef struct {
+  HCFGrammar *g;        // grammar (fork) to compute predict sets with
+  HArena     *arena;    // where to build rows
+} HLLkWorker;
+
+typedef struct {
+  size_t         kmax;
+  const HCFChoice **nts;
+  HStringMap     **rows;  // the row for each element of nts
+  HLLkWorker     *workers;
+} HLLkJob;
+
+static int fill_table_job(void *env, unsigned int worker, size_t i)
+{
+  HLLkJob *job = env;
+  HLLkWorker *w = &job->workers[worker];
+
+  job->rows[i] = h_stringmap_new(w->arena);
+  return fill_table_row(job->kmax, w->g, job->rows[i], job->nts[i]);
+}
+
+/* Generate the LL(k) parse table from the given grammar, computing the rows
+ * for several nonterminals at once if threads > 1.
  * Returns -1 on error, 0 on success.
  */
-static int fill_table(size_t kmax, HCFGrammar *g, HLLkTable *table)
+static int fill_table(size_t kmax, HCFGrammar *g, HLLkTable *table,
+                      unsigned int threads)
 {
+  HAllocator *mm__ = g->mm__;
   table->kmax = kmax;
   table->start = g->start;
 
-  // iterate over g->nts
-  size_t i;
-  HHashTableEntry *hte;
-  for(i=0; i < g->nts->capacity; i++) {
-    for(hte = &g->nts->contents[i]; hte; hte = hte->next) {
+  // collect g->nts
+  size_t n = g->nts->used;
+  const HCFChoice **nts = h_arena_malloc(g->arena, n * sizeof(HCFChoice *));
+  size_t j = 0;
+  for(size_t i=0; i < g->nts->capacity; i++) {
+    for(HHashTableEntry *hte = &g->nts->contents[i]; hte; hte = hte->next) {
       if(hte->key == NULL)
         continue;
-      const HCFChoice *a = hte->key;        // production's left-hand symbol
-      assert(a->type == HCF_CHOICE);
-
-      // create table row for this nonterminal
-      HStringMap *row = h_stringmap_new(table->arena);
-      h_hashtable_put(table->rows, a, row);
-
-      if(fill_table_row(kmax, g, row, a) < 0) {
-        // unresolvable conflicts in row
-        // NB we don't worry about deallocating anything, h_llk_compile will
-        //    delete the whole arena for us.
-        return -1;
-      }
+      nts[j++] = hte->key;    // production's left-hand symbol
+      assert(((HCFChoice *)hte->key)->type == HCF_CHOICE);
     }
   }
-  
-  return 0;
+  assert(j == n);
+
+  if(threads > n)
+    threads = n;
+  if(threads < 1)
+    threads = 1;
+
+  // the memo tables of g are not safe to share between threads, so with more
+  // than one, each gets a fork of g and builds its rows in a private arena.
+  HLLkWorker *workers = h_new(HLLkWorker, threads);
+  if(threads == 1) {
+    workers[0].g = g;
+    workers[0].arena = table->arena;
+  } else {
+    for(unsigned int w=0; w<threads; w++) {
+      workers[w].g = h_cfgrammar_fork(g);
+      workers[w].arena = h_new_arena(mm__, 0);
+    }
+  }
+
+  HLLkJob job = {
+    .kmax = kmax,
+    .nts = nts,
+    .rows = h_arena_malloc(g->arena, n * sizeof(HStringMap *)),
+    .workers = workers
+  };
+  int ret = h_parallel_for(threads, n, fill_table_job, &job);
+  // NB on a conflict we don't worry about deallocating anything,
+  //    h_llk_compile will delete the whole table for us.
+
+  if(ret == 0) {
+    for(size_t i=0; i<n; i++) {
+      HStringMap *row = job.rows[i];
+      if(threads > 1)
+        row = h_stringmap_copy(table->arena, row);
+      h_hashtable_put(table->rows, nts[i], row);
+    }
+  }
+
+  if(threads > 1) {
+    for(unsigned int w=0; w<threads; w++) {
+      h_cfgrammar_free(workers[w].g);
+      h_delete_arena(workers[w].arena);
+    }
+  }
+  h_free(workers);
+
+  return ret;
 }
 
-int h_llk_compile(HAllocator* mm__, HParser* parser, const void* params)
+int h_llk_compile_threads(HAllocator* mm__, HParser* parser,
+                          const void* params, unsigned int threads)
 {
   size_t kmax = params? (uintptr_t)params : DEFAULT_KMAX;
   assert(kmax>0);
@@ -234,12 +291,13 @@ int h_llk_compile(HAllocator* mm__, HParser* parser, const void* params)
 
   // generate table and store in parser->backend_data.
   HLLkTable *table = h_llktable_new(mm__);
-  if(fill_table(kmax, grammar, table) < 0) {
+  if(fill_table(kmax, grammar, table, threads) < 0) {
     // the table was ambiguous
     h_cfgrammar_free(grammar);
     h_llktable_free(table);
     return -1;
   }
+  table->preds = h_cfgrammar_has_preds(grammar);
   parser->backend_data = table;
 
   // free grammar and its arena.
@@ -249,6 +307,11 @@ int h_llk_compile(HAllocator* mm__, HParser* parser, const void* params)
   return 0;
 }
 
+int h_llk_compile(HAllocator* mm__, HParser* parser, const void* params)
+{
+  return h_llk_compile_threads(mm__, parser, params, 1);
+}
+
 void h_llk_free(HParser *parser)
 {
   HLLkTable *table = parser->backend_data;
@@ -259,6 +322,243 @@ void h_llk_free(HParser *parser)
 
 
 
+/* Generating C code from the parse table */
+
+// helper for h_cg_emit_lookahead: table entries are productions
+static void emit_prediction(FILE *f, const void *value, unsigned int indent,
+                            void *env)
+{
+  const HHashTable *prods = env;
+  uintptr_t p = (uintptr_t)h_hashtable_get(prods, value);
+  assert(p > 0);
+  fprintf(f, "%*sreturn %zu;\n", indent, "", (size_t)(p - 1));
+}
+
+/* Write the table of a compiled parser as C source: a predict function that
+ * switches over the lookahead for each nonterminal, production tables, and a
+ * driver loop with the symbol stack of llk_parse_chunk_.
+ */
+static int h_llk_dump_code(FILE *f, const HParser *parser, const char *prefix)
+{
+  const HLLkTable *table = parser->backend_data;
+  HAllocator *mm__ = table->mm__;
+  HArena *arena = h_new_arena(mm__, 0);
+  const char *p = prefix;
+
+  HCGSymbols *syms = h_cg_symbols(arena, parser->desugared);
+  size_t start = h_cg_symbol_id(syms, table->start);
+  if(start == H_CG_NOSYM)
+    start = 0;  // start is a wrapper around the desugared parser
+
+  // number the productions in order of their symbols
+  HHashTable *prods = h_hashtable_new(arena, h_eq_ptr, h_hash_ptr);
+  size_t nprods = 0;
+  for(size_t i=0; i<syms->n; i++) {
+    HCFChoice *x = syms->syms[i];
+    if(x->type == HCF_CHOICE) {
+      for(HCFSequence **s = x->seq; *s; s++)
+        h_hashtable_put(prods, *s, (void *)(uintptr_t)++nprods);
+    }
+  }
+
+  bool any_nt = false, any_cs = false, any_attrs = false;
+  for(size_t i=0; i<syms->n; i++) {
+    any_nt |= (syms->syms[i]->type == HCF_CHOICE);
+    any_cs |= (syms->syms[i]->type == HCF_CHARSET);
+    any_attrs |= h_cg_has_attrs(syms->syms[i]);
+  }
+
+  h_cg_emit_preamble(f, p, "LL(k)", syms->n);
+  h_cg_emit_helpers(f, p, any_attrs);
+
+  // production tables
+  fprintf(f, "static const uint32_t %s_rhs[] = {", p);
+  size_t off = 0;
+  for(size_t i=0; i<syms->n; i++) {
+    HCFChoice *x = syms->syms[i];
+    if(x->type != HCF_CHOICE)
+      continue;
+    for(HCFSequence **s = x->seq; *s; s++) {
+      for(HCFChoice **y = (*s)->items; *y; y++)
+        fprintf(f, "%s%zu,", (y == (*s)->items)? "\n  " : " ",
+                h_cg_symbol_id(syms, *y));
+    }
+  }
+  fprintf(f, "\n  0    // unused\n};\n\n");
+
+  fprintf(f, "static const uint32_t %s_prod[][2] = {   // offset, length\n", p);
+  for(size_t i=0; i<syms->n; i++) {
+    HCFChoice *x = syms->syms[i];
+    if(x->type != HCF_CHOICE)
+      continue;
+    for(HCFSequence **s = x->seq; *s; s++) {
+      size_t len = 0;
+      for(HCFChoice **y = (*s)->items; *y; y++)
+        len++;
+      fprintf(f, "  {%zu, %zu},\n", off, len);
+      off += len;
+    }
+  }
+  fprintf(f, "  {0, 0}    // unused\n};\n\n");
+
+  for(size_t i=0; i<syms->n; i++) {
+    if(syms->syms[i]->type == HCF_CHARSET)
+      h_cg_emit_charset(f, p, i, syms->syms[i]->charset);
+  }
+
+  // predict function
+  if(any_nt)
+    fprintf(f, "\nstatic int %s_predict(uint32_t nt, const uint8_t *input,"
+               " size_t length, size_t pos)\n{\n  switch(nt) {\n", p);
+  for(size_t i=0; any_nt && i<syms->n; i++) {
+    const HCFChoice *x = syms->syms[i];
+    if(x->type != HCF_CHOICE)
+      continue;
+    const HStringMap *row = h_hashtable_get(table->rows, x);
+    fprintf(f, "  case %zu:\n", i);
+    if(row)
+      h_cg_emit_lookahead(f, row, 0, 4, "return -1;", emit_prediction, prods);
+    else
+      fprintf(f, "    return -1;\n");
+  }
+  if(any_nt)
+    fprintf(f, "  }\n  return -1;\n}\n");
+
+  // driver
+  fprintf(f,
+    "\n"
+    "HParseResult *%s_parse__m(HAllocator *mm__, const uint8_t *input, size_t length)\n"
+    "{\n"
+    "  HArena *arena = h_new_arena(mm__, 0);    // will hold the results\n"
+    "  HArena *tarena = h_new_arena(mm__, 0);   // tmp, deleted after parse\n"
+    "  struct { long sym; HCountedArray *seq; } *stack;\n"
+    "  size_t cap = 64, sp = 0, pos = 0;\n"
+    "  HCountedArray *seq = h_carray_new(arena);\n"
+    "  HParsedToken *tok = NULL;\n"
+    "  long x;\n"
+    "%s%s"
+    "\n"
+    "  // negative entries delimit production frames, see llk_parse_chunk_\n"
+    "  stack = mm__->alloc(mm__, cap * sizeof(*stack));\n"
+    "  stack[sp++].sym = %zu;\n"
+    "\n"
+    "  while(sp > 0) {\n"
+    "    x = stack[--sp].sym;\n"
+    "    if(x < 0) {\n"
+    "      // end of a frame, wrap the accumulated sequence\n"
+    "      tok = h_arena_malloc(arena, sizeof(HParsedToken));\n"
+    "      tok->token_type = TT_SEQUENCE;\n"
+    "      tok->seq = seq;\n"
+    "      seq = stack[sp].seq;\n"
+    "      x = -1 - x;\n"
+    "    } else {\n"
+    "      switch(x) {\n", p, any_cs? "  int c;\n" : "", any_nt? "  int p;\n" : "", start);
+
+  // nonterminals
+  bool any = false;
+  for(size_t i=0; i<syms->n; i++) {
+    if(syms->syms[i]->type != HCF_CHOICE)
+      continue;
+    fprintf(f, "%s%zu:", any? " case " : "      case ", i);
+    any = true;
+  }
+  if(any) {
+    fprintf(f, "\n"
+      "        p = %s_predict(x, input, length, pos);\n"
+      "        if(p < 0)\n"
+      "          goto no_parse;\n"
+      "        if(sp + 1 + %s_prod[p][1] > cap) {\n"
+      "          cap = 2 * (sp + 1 + %s_prod[p][1]);\n"
+      "          stack = mm__->realloc(mm__, stack, cap * sizeof(*stack));\n"
+      "        }\n"
+      "        stack[sp].sym = -1 - x;\n"
+      "        stack[sp].seq = seq;\n"
+      "        sp++;\n"
+      "        seq = h_carray_new(arena);\n"
+      "        for(size_t i = %s_prod[p][1]; i > 0; i--)\n"
+      "          stack[sp++].sym = %s_rhs[%s_prod[p][0] + i - 1];\n"
+      "        continue;\n", p, p, p, p, p, p);
+  }
+
+  // terminals
+  for(size_t i=0; i<syms->n; i++) {
+    const HCFChoice *x = syms->syms[i];
+    switch(x->type) {
+    case HCF_CHAR:
+      fprintf(f, "      case %zu:\n        if(LA(0) != ", i);
+      h_cg_emit_byte(f, x->chr);
+      fprintf(f, ")\n          goto no_parse;\n");
+      break;
+    case HCF_CHARSET:
+      fprintf(f, "      case %zu:\n"
+                 "        if((c = LA(0)) < 0 || !(%s_cs%zu[c >> 3] & (1 << (c & 7))))\n"
+                 "          goto no_parse;\n", i, p, i);
+      break;
+    case HCF_END:
+      fprintf(f, "      case %zu:\n"
+                 "        if(pos < length)\n"
+                 "          goto no_parse;\n"
+                 "        tok = NULL;\n"
+                 "        break;\n", i);
+      continue;
+    default:
+      continue;
+    }
+    fprintf(f, "        tok = %s_uint(arena, input[pos], pos);\n"
+               "        pos++;\n"
+               "        break;\n", p);
+  }
+  fprintf(f, "      default:\n"
+             "        goto no_parse;\n"
+             "      }\n"
+             "    }\n"
+             "\n");
+
+  // semantic actions
+  any = false;
+  for(size_t i=0; i<syms->n; i++) {
+    if(!h_cg_has_attrs(syms->syms[i]))
+      continue;
+    fprintf(f, "%s%zu:", any? " case " : "    switch(x) {\n    case ", i);
+    any = true;
+  }
+  if(any) {
+    fprintf(f, "\n"
+      "      if(!%s_apply(arena, tarena, %s_syms[x], true, &tok))\n"
+      "        goto no_parse;\n"
+      "      break;\n"
+      "    }\n", p, p);
+  }
+
+  fprintf(f,
+    "    h_carray_append(seq, tok);\n"
+    "  }\n"
+    "\n"
+    "  mm__->free(mm__, stack);\n"
+    "  h_delete_arena(tarena);\n"
+    "  HParseResult *res = make_result(arena, seq->elements[0]);\n"
+    "  res->bit_length = pos * 8;\n"
+    "  return res;\n"
+    "\n"
+    " no_parse:\n"
+    "  mm__->free(mm__, stack);\n"
+    "  h_delete_arena(tarena);\n"
+    "  h_delete_arena(arena);\n"
+    "  return NULL;\n"
+    "}\n"
+    "\n"
+    "HParseResult *%s_parse(const uint8_t *input, size_t length)\n"
+    "{\n"
+    "  return %s_parse__m(&system_allocator, input, length);\n"
+    "}\n"
+    "\n"
+    "#undef LA\n", p, p);
+
+  h_delete_arena(arena);
+  return 0;
+}
+
+
 /* LL(k) driver */
 
 typedef struct {
@@ -273,6 +573,9 @@ typedef struct {
                         // ( 0  ... kmax ...  2*kmax-1 )
                         //   \_old_/\______new_______/
   HInputStream win;     // win.length is set to 0 when not in use
+#ifdef HAMMER_PROFILE
+  HProfileScope *prof;  // NULL if not profiling
+#endif
 } HLLkState;
 
 // in order to construct the parse tree, we delimit the symbol stack into
@@ -305,6 +608,9 @@ static HLLkState *llk_parse_start_(HAllocator* mm__, const HParser* parser)
   // initialize with the start symbol on the stack.
   h_slist_push(s->stack, table->start);
 
+#ifdef HAMMER_PROFILE
+  s->prof = h_profile_begin(mm__, parser);
+#endif
   return s;
 }
 
@@ -399,6 +705,7 @@ static HCountedArray *llk_parse_chunk_(HLLkState *s, const HParser* parser,
   // when we empty the stack, the parse is complete.
   while(!h_slist_empty(stack)) {
     tok = NULL;
+    h_limit_steps(chunk, 1);
 
     // pop top of stack for inspection
     x = h_slist_pop(stack);
@@ -419,6 +726,14 @@ static HCountedArray *llk_parse_chunk_(HLLkState *s, const HParser* parser,
       // an infinite loop case that shouldn't happen
       assert(!p->items[0] || p->items[0] != x);
 
+#ifdef HAMMER_PROFILE
+      if(s->prof) {
+        size_t i;
+        for(i=0; x->seq[i] && x->seq[i] != p; i++);
+        h_profile_entry(s->prof, H_PROFILE_PRODUCTION, x, i, x->parser)->count++;
+      }
+#endif
+
       // push stack frame
       h_slist_push(stack, seq);           // save current partial value
       h_slist_push(stack, x);             // save the nonterminal
@@ -457,7 +772,7 @@ static HCountedArray *llk_parse_chunk_(HLLkState *s, const HParser* parser,
       tok->bit_offset = stream->bit_offset;
 
       // consume the input token
-      uint8_t input = h_read_bits(stream, 8, false);
+      uint8_t input = h_read_byte(stream);
 
       // when old chunk consumed from window, switch to new chunk
       if(s->win.length > 0 && s->win.index >= kmax) {
@@ -552,6 +867,9 @@ static HParseResult *llk_parse_finish_(HAllocator *mm__, HLLkState *s)
     res = make_result(s->arena, s->seq->elements[0]);
   }
 
+#ifdef HAMMER_PROFILE
+  h_profile_end(s->prof);
+#endif
   h_delete_arena(s->tarena);
   h_free(s);
   return res;
@@ -571,6 +889,96 @@ HParseResult *h_llk_parse(HAllocator* mm__, const HParser* parser, HInputStream*
   return res;
 }
 
+// the same derivation as llk_parse_chunk_, reported to the sink instead of
+// building the parse tree. frames (start position, nonterminal, MARK) are
+// only pushed for nonterminals that a parser is named by, so the stack stays
+// the same size across the repetitions of h_many and friends.
+int h_llk_parse_events(HAllocator* mm__, const HParser* parser,
+                       HInputStream* stream, HParseEventSink* sink)
+{
+  const HLLkTable *table = parser->backend_data;
+  assert(table != NULL);
+  if(table->preds)
+    return -1;  // validations need the semantic values
+
+  size_t cap = 64, n = 0;
+  const void **stack = h_new(const void *, cap);
+  if(!stack)
+    return -1;
+  stack[n++] = table->start;
+
+  while(n > 0) {
+    const HCFChoice *x = stack[--n];
+    size_t pos = stream->pos + stream->index;
+
+    if(x == MARK) {
+      // end of a named nonterminal's frame
+      x = stack[--n];
+      size_t start = (uintptr_t)stack[--n];
+      if(sink->exit_rule)
+        sink->exit_rule(sink, x->parser, start, pos);
+      continue;
+    }
+
+    if(x->type == HCF_CHOICE) {
+      const HCFSequence *p = h_llk_lookup(table, x, stream);
+      if(p == NULL || p == NEED_INPUT)
+        goto no_parse;
+
+      size_t len;
+      for(len=0; p->items[len]; len++);
+      if(n + len + 3 > cap) {
+        const void **stack2 = mm__->realloc(mm__, stack, 2 * (n + len + 3) * sizeof(void *));
+        if(!stack2)
+          goto no_parse;
+        stack = stack2;
+        cap = 2 * (n + len + 3);
+      }
+
+      if(x->parser) {
+        if(sink->enter_rule)
+          sink->enter_rule(sink, x->parser, pos);
+        stack[n++] = (void *)(uintptr_t)pos;
+        stack[n++] = x;
+        stack[n++] = MARK;
+      }
+      while(len > 0)
+        stack[n++] = p->items[--len];
+      continue;
+    }
+
+    // x is a terminal or simple charset; match against input
+    uint8_t input = h_read_byte(stream);
+    switch(x->type) {
+    case HCF_END:
+      if(!stream->overrun)
+        goto no_parse;
+      break;
+
+    case HCF_CHAR:
+    case HCF_CHARSET:
+      if(stream->overrun)
+        goto no_parse;
+      if(x->type == HCF_CHAR ? input != x->chr : !charset_isset(x->charset, input))
+        goto no_parse;
+      if(sink->terminal)
+        sink->terminal(sink, input, pos);
+      break;
+
+    default: // should not be reached
+      assert_message(0, "unknown HCFChoice type");
+      goto no_parse;
+    }
+  }
+
+  h_free(stack);
+  return 0;
+
+ no_parse:
+  h_free(stack);
+  return -1;
+}
+
 void h_llk_parse_start(HSuspendedParser *s)
 {
   s->backend_state = llk_parse_start_(s->mm__, s->parser);
@@ -593,12 +1001,17 @@ HParseResult *h_llk_parse_finish(HSuspendedParser *s)
 
 HParserBackendVTable h__llk_backend_vtable = {
   .compile = h_llk_compile,
+  .compile_threads = h_llk_compile_threads,
   .parse = h_llk_parse,
   .free = h_llk_free,
 
   .parse_start = h_llk_parse_start,
   .parse_chunk = h_llk_parse_chunk,
-  .parse_finish = h_llk_parse_finish
+  .parse_finish = h_llk_parse_finish,
+
+  .dump_code = h_llk_dump_code,
+
+  .parse_events = h_llk_parse_events
 };
 
 
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include "../parsers/parser_internal.h"
+#include "../codegen.h"
 #include "lr.h"
 
 
@@ -123,6 +124,7 @@ HLRTable *h_lrtable_new(HAllocator *mm__, size_t nrows)
   ret->tmap = h_arena_malloc(arena, nrows * sizeof(HStringMap *));
   ret->forall = h_arena_malloc(arena, nrows * sizeof(HLRAction *));
   ret->inadeq = h_slist_new(arena);
+  ret->preds = false;
   ret->arena = arena;
   ret->mm__ = mm__;
 
@@ -158,6 +160,13 @@ HLRAction *h_reduce_action(HArena *arena, const HLRItem *item)
   action->production.length = item->len;
 #ifndef NDEBUG
   action->production.rhs = item->rhs;
+#endif
+#ifdef HAMMER_PROFILE
+  // a charset's single-character items are not among its productions
+  size_t i = 0;
+  if(item->lhs->type == HCF_CHOICE)
+    for(; item->lhs->seq[i] && item->lhs->seq[i]->items != item->rhs; i++);
+  action->production.index = i;
 #endif
   return action;
 }
@@ -207,10 +216,19 @@ HLREngine *h_lrengine_new_(HArena *arena, HArena *tarena, const HLRTable *table)
   engine->table = table;
   engine->state = 0;
   engine->stack = h_slist_new(tarena);
+  engine->vstates = NULL;
+  engine->values = NULL;
+  engine->vdepth = 0;
+  engine->vcap = 0;
+  engine->scratch = NULL;
+  engine->scratchcap = 0;
   engine->merged[0] = NULL;
   engine->merged[1] = NULL;
   engine->arena = arena;
   engine->tarena = tarena;
+#ifdef HAMMER_PROFILE
+  engine->prof = NULL;
+#endif
 
   return engine;
 }
@@ -223,6 +241,114 @@ HLREngine *h_lrengine_new(HArena *arena, HArena *tarena, const HLRTable *table,
   return engine;
 }
 
+// switch a fresh engine to the contiguous stack. not for GLR.
+static void use_vstack(HLREngine *engine)
+{
+  assert(h_slist_empty(engine->stack));
+  engine->vcap = 64;
+  engine->vstates = h_arena_malloc(engine->tarena, engine->vcap * sizeof(size_t));
+  engine->values = h_arena_malloc(engine->tarena,
+                                  engine->vcap * sizeof(HParsedToken *));
+}
+
+static void stack_push(HLREngine *engine, HParsedToken *value)
+{
+  if(engine->vcap == 0) {
+    h_slist_push(engine->stack, (void *)(uintptr_t)engine->state);
+    h_slist_push(engine->stack, value);
+    return;
+  }
+
+  if(engine->vdepth == engine->vcap) {
+    HArena *tarena = engine->tarena;
+    size_t n = engine->vdepth;
+    size_t *states = h_arena_malloc(tarena, 2 * n * sizeof(size_t));
+    HParsedToken **values = h_arena_malloc(tarena, 2 * n * sizeof(HParsedToken *));
+    memcpy(states, engine->vstates, n * sizeof(size_t));
+    memcpy(values, engine->values, n * sizeof(HParsedToken *));
+    h_arena_free(tarena, engine->vstates);
+    h_arena_free(tarena, engine->values);
+    engine->vstates = states;
+    engine->values = values;
+    engine->vcap *= 2;
+  }
+  engine->vstates[engine->vdepth] = engine->state;
+  engine->values[engine->vdepth] = value;
+  engine->vdepth++;
+}
+
+// allocate a TT_SEQUENCE token with room for cap elements, including its
+// HCountedArray and element array, as a single block.
+static HParsedToken *new_sequence(HArena *arena, size_t cap)
+{
+  if(cap == 0)
+    cap = 1;    // cf. h_carray_new_sized
+  HParsedToken *tok = h_arena_malloc(arena, sizeof(HParsedToken)
+                                            + sizeof(HCountedArray)
+                                            + cap * sizeof(HParsedToken *));
+  HCountedArray *seq = (HCountedArray *)(tok + 1);
+
+  seq->capacity = cap;
+  seq->used = 0;
+  seq->arena = arena;
+  seq->elements = (HParsedToken **)(seq + 1);
+  tok->token_type = TT_SEQUENCE;
+  tok->seq = seq;
+
+  return tok;
+}
+
+// pop the right-hand side of a reduction off the stack and return it as a
+// sequence, rewinding the state accordingly. if 'scratch' is set, the
+// sequence is only valid until the next reduction.
+static HParsedToken *stack_reduce(HLREngine *engine, size_t len, bool scratch)
+{
+  HParsedToken *value;
+
+  if(!scratch) {
+    value = new_sequence(engine->arena, len);
+  } else {
+    if(engine->scratch == NULL || engine->scratchcap < len) {
+      size_t cap = 2 * engine->scratchcap;
+      if(cap < len)
+        cap = len;
+      engine->scratch = new_sequence(engine->tarena, cap);
+      engine->scratchcap = cap;
+    }
+    value = engine->scratch;
+  }
+  value->seq->used = len;
+  HParsedToken **elements = value->seq->elements;
+
+  if(engine->vcap > 0) {
+    assert(len <= engine->vdepth);
+    if(len > 0) {
+      engine->vdepth -= len;
+      memcpy(elements, engine->values + engine->vdepth,
+             len * sizeof(HParsedToken *));
+      engine->state = engine->vstates[engine->vdepth];
+    }
+  } else {
+    for(size_t i=0; i<len; i++) {
+      elements[len-1-i] = h_slist_drop(engine->stack);
+      engine->state = (uintptr_t)h_slist_drop(engine->stack);
+    }
+  }
+
+  HParsedToken *v = len > 0 ? elements[0] : NULL;
+  if(v) {
+    // result position equals position of left-most symbol
+    value->index = v->index;
+    value->bit_offset = v->bit_offset;
+  } else {
+    // result position is current input position  XXX ?
+    value->index = engine->input.pos + engine->input.index;
+    value->bit_offset = engine->input.bit_offset;
+  }
+
+  return value;
+}
+
 static const HLRAction *
 terminal_lookup(const HLREngine *engine, const HInputStream *stream)
 {
@@ -259,7 +385,7 @@ static HParsedToken *consume_input(HLREngine *engine)
 {
   HParsedToken *v;
 
-  uint8_t c = h_read_bits(&engine->input, 8, false);
+  uint8_t c = h_read_byte(&engine->input);
 
   if(engine->input.overrun) {     // end of input
     v = NULL;
@@ -274,11 +400,27 @@ static HParsedToken *consume_input(HLREngine *engine)
   return v;
 }
 
+// does the given reshape never keep a reference to the sequence it is called
+// on? these are the ones the desugaring uses for most symbols.
+static inline bool reshape_discards(HAction reshape)
+{
+  return (reshape == h_act_first || reshape == h_act_second
+          || reshape == h_act_last || reshape == h_act_ignore);
+}
+
+#ifdef HAMMER_PROFILE
+static void count_state(HLREngine *engine)
+{
+  const HParser *root = h_profile_root(engine->prof);
+  h_profile_entry(engine->prof, H_PROFILE_STATE, engine->table, engine->state,
+                  root)->count++;
+}
+#endif
+
 // run LR parser for one round; returns false when finished
 bool h_lrengine_step(HLREngine *engine, const HLRAction *action)
 {
   // short-hand names
-  HSlist *stack = engine->stack;
   HArena *arena = engine->arena;
   HArena *tarena = engine->tarena;
 
@@ -286,54 +428,52 @@ bool h_lrengine_step(HLREngine *engine, const HLRAction *action)
     return false;   // no handle recognizable in input, terminate
 
   assert(action->type == HLR_SHIFT || action->type == HLR_REDUCE);
+  h_limit_steps(&engine->input, 1);
 
   if(action->type == HLR_REDUCE) {
     size_t len = action->production.length;
     HCFChoice *symbol = action->production.lhs;
+#ifdef HAMMER_PROFILE
+    if(engine->prof)
+      h_profile_entry(engine->prof, H_PROFILE_PRODUCTION, symbol,
+                      action->production.index, symbol->parser)->count++;
+#endif
 
-    // semantic value of the reduction result
-    HParsedToken *value = h_arena_malloc(arena, sizeof(HParsedToken));
-    value->token_type = TT_SEQUENCE;
-    value->seq = h_carray_new_sized(arena, len);
-    
-    // pull values off the stack, rewinding state accordingly
-    HParsedToken *v = NULL;
-    for(size_t i=0; i<len; i++) {
-      v = h_slist_drop(stack);
-      engine->state = (uintptr_t)h_slist_drop(stack);
-
-      // collect values in result sequence
-      value->seq->elements[len-1-i] = v;
-      value->seq->used++;
-    }
-    if(v) {
-      // result position equals position of left-most symbol
-      value->index = v->index;
-      value->bit_offset = v->bit_offset;
-    } else {
-      // result position is current input position  XXX ?
-      value->index = engine->input.pos + engine->input.index;
-      value->bit_offset = engine->input.bit_offset;
-    }
+    // a charset reduces from its single character (see h_lr0_dfa)
+    HAction reshape = symbol->type == HCF_CHARSET ? h_act_first : symbol->reshape;
+
+    // semantic value of the reduction result. if the reshape is known to
+    // just pick an element, the sequence itself is garbage afterwards.
+    HParsedToken *value = stack_reduce(engine, len, reshape_discards(reshape));
+
+    // the common case of a symbol without attributes needs nothing more
+    if(reshape || symbol->pred || symbol->action) {
+      // the callbacks get a result wrapper on the C stack instead of one
+      // from make_result; none of them may keep a pointer to it.
+      HParseResult res = {.ast = value, .bit_length = 0, .arena = arena};
+      HParsedToken *v;
+
+      // perform token reshape if indicated
+      if(reshape) {
+        v = reshape(&res, symbol->user_data);
+        if(v) {
+          v->index = value->index;
+          v->bit_offset = value->bit_offset;
+        }
+        value = v;
+        res.ast = v;
+      }
 
-    // perform token reshape if indicated
-    if(symbol->reshape) {
-      v = symbol->reshape(make_result(arena, value), symbol->user_data);
-      if(v) {
-        v->index = value->index;
-        v->bit_offset = value->bit_offset;
-      } else {
-        h_arena_free(arena, value);
+      // call validation and semantic action, if present
+      if(symbol->pred) {
+        HParseResult tres = {.ast = value, .bit_length = 0, .arena = tarena};
+        if(!symbol->pred(&tres, symbol->user_data))
+          return false;     // validation failed -> no parse; terminate
       }
-      value = v;
+      if(symbol->action)
+        value = (HParsedToken *)symbol->action(&res, symbol->user_data);
     }
 
-    // call validation and semantic action, if present
-    if(symbol->pred && !symbol->pred(make_result(tarena, value), symbol->user_data))
-      return false;     // validation failed -> no parse; terminate
-    if(symbol->action)
-      value = symbol->action(make_result(arena, value), symbol->user_data);
-
     // this is LR, building a right-most derivation bottom-up, so no reduce can
     // follow a reduce. we can also assume no conflict follows for GLR if we
     // use LALR tables, because only terminal symbols (lookahead) get reduces.
@@ -343,9 +483,12 @@ bool h_lrengine_step(HLREngine *engine, const HLRAction *action)
     assert(shift->type == HLR_SHIFT);
 
     // piggy-back the shift right here, never touching the input
-    h_slist_push(stack, (void *)(uintptr_t)engine->state);
-    h_slist_push(stack, value);
+    stack_push(engine, value);
     engine->state = shift->nextstate;
+#ifdef HAMMER_PROFILE
+    if(engine->prof && engine->state != HLR_SUCCESS)
+      count_state(engine);
+#endif
 
     // check for success
     if(engine->state == HLR_SUCCESS) {
@@ -355,9 +498,12 @@ bool h_lrengine_step(HLREngine *engine, const HLRAction *action)
   } else {
     assert(action->type == HLR_SHIFT);
     HParsedToken *value = consume_input(engine);
-    h_slist_push(stack, (void *)(uintptr_t)engine->state);
-    h_slist_push(stack, value);
+    stack_push(engine, value);
     engine->state = action->nextstate;
+#ifdef HAMMER_PROFILE
+    if(engine->prof)
+      count_state(engine);
+#endif
   }
 
   return true;
@@ -368,8 +514,14 @@ HParseResult *h_lrengine_result(HLREngine *engine)
   // parsing was successful iff the engine reaches the end state
   if(engine->state == HLR_SUCCESS) {
     // on top of the stack is the start symbol's semantic value
-    assert(!h_slist_empty(engine->stack));
-    HParsedToken *tok = engine->stack->head->elem;
+    HParsedToken *tok;
+    if(engine->vcap > 0) {
+      assert(engine->vdepth > 0);
+      tok = engine->values[engine->vdepth - 1];
+    } else {
+      assert(!h_slist_empty(engine->stack));
+      tok = engine->stack->head->elem;
+    }
     HParseResult *res =  make_result(engine->arena, tok);
     res->bit_length = (engine->input.pos + engine->input.index) * 8;
     return res;
@@ -387,9 +539,18 @@ HParseResult *h_lr_parse(HAllocator* mm__, const HParser* parser, HInputStream*
   HArena *arena  = h_new_arena(mm__, 0);    // will hold the results
   HArena *tarena = h_new_arena(mm__, 0);    // tmp, deleted after parse
   HLREngine *engine = h_lrengine_new(arena, tarena, table, stream);
+  use_vstack(engine);
+#ifdef HAMMER_PROFILE
+  engine->prof = h_profile_begin(mm__, parser);
+  if(engine->prof)
+    count_state(engine);
+#endif
 
   // iterate engine to completion
   while(h_lrengine_step(engine, h_lrengine_action(engine)));
+#ifdef HAMMER_PROFILE
+  h_profile_end(engine->prof);
+#endif
 
   HParseResult *result = h_lrengine_result(engine);
   if(!result)
@@ -406,6 +567,12 @@ void h_lr_parse_start(HSuspendedParser *s)
   HArena *arena  = h_new_arena(s->mm__, 0); // will hold the results
   HArena *tarena = h_new_arena(s->mm__, 0); // tmp, deleted after parse
   HLREngine *engine = h_lrengine_new_(arena, tarena, table);
+  use_vstack(engine);
+#ifdef HAMMER_PROFILE
+  engine->prof = h_profile_begin(s->mm__, s->parser);
+  if(engine->prof)
+    count_state(engine);
+#endif
 
   s->backend_state = engine;
 }
@@ -440,12 +607,371 @@ HParseResult *h_lr_parse_finish(HSuspendedParser *s)
   HLREngine *engine = s->backend_state;
 
   HParseResult *result = h_lrengine_result(engine);
+#ifdef HAMMER_PROFILE
+  h_profile_end(engine->prof);
+#endif
   if(!result)
     h_delete_arena(engine->arena);
   h_delete_arena(engine->tarena);
   return result;
 }
 
+// the deterministic driver, reporting to the sink instead of building
+// semantic values. the stack holds the state and start position of each
+// symbol. a nonterminal is only recognized when it is reduced, so its
+// enter_rule comes right before its exit_rule.
+int h_lr_parse_events(HAllocator* mm__, const HParser* parser,
+                      HInputStream* stream, HParseEventSink* sink)
+{
+  HLRTable *table = parser->backend_data;
+  if(!table || table->preds)
+    return -1;  // validations need the semantic values
+
+  HArena *tarena = h_new_arena(mm__, 0);
+  HLREngine *engine = h_lrengine_new(tarena, tarena, table, stream);
+  size_t cap = 64, depth = 0;
+  size_t *states = h_new(size_t, cap);
+  size_t *starts = h_new(size_t, cap);
+  int ret = -1;
+
+  while(states && starts) {
+    const HLRAction *action = h_lrengine_action(engine);
+    if(action == NULL)
+      break;        // no handle recognizable in input
+    assert(action->type == HLR_SHIFT || action->type == HLR_REDUCE);
+
+    size_t pos = engine->input.pos + engine->input.index;
+    size_t start = pos;
+    if(action->type == HLR_REDUCE) {
+      size_t len = action->production.length;
+      const HCFChoice *symbol = action->production.lhs;
+
+      assert(len <= depth);
+      if(len > 0) {
+        depth -= len;
+        start = starts[depth];
+        engine->state = states[depth];
+      }
+      if(symbol->type == HCF_CHOICE && symbol->parser && symbol != table->start) {
+        if(sink->enter_rule)
+          sink->enter_rule(sink, symbol->parser, start);
+        if(sink->exit_rule)
+          sink->exit_rule(sink, symbol->parser, start, pos);
+      }
+
+      action = nonterminal_lookup(engine, symbol);
+      if(action == NULL)
+        break;      // parse error
+    } else {
+      uint8_t c = h_read_byte(&engine->input);
+      if(!engine->input.overrun && sink->terminal)
+        sink->terminal(sink, c, pos);
+    }
+    assert(action->type == HLR_SHIFT);
+
+    if(depth == cap) {
+      size_t *states2 = mm__->realloc(mm__, states, 2 * cap * sizeof(size_t));
+      if(states2)
+        states = states2;
+      size_t *starts2 = mm__->realloc(mm__, starts, 2 * cap * sizeof(size_t));
+      if(starts2)
+        starts = starts2;
+      if(!states2 || !starts2)
+        break;
+      cap *= 2;
+    }
+    states[depth] = engine->state;
+    starts[depth] = start;
+    depth++;
+    engine->state = action->nextstate;
+
+    if(engine->state == HLR_SUCCESS) {
+      ret = 0;
+      break;
+    }
+  }
+
+  if(states)
+    h_free(states);
+  if(starts)
+    h_free(starts);
+  h_delete_arena(tarena);
+  return ret;
+}
+
+/* Generating C code from the parse table */
+
+typedef struct {
+  const HCGSymbols *syms;
+  const HCFChoice *start;
+  HLRAction **rules;  // reduce actions, one per distinct production
+  size_t nrules;
+  size_t cap;
+  HArena *arena;
+} HLRCodegen;
+
+static size_t rule_number(HLRCodegen *cg, const HLRAction *action)
+{
+  for(size_t i=0; i<cg->nrules; i++) {
+    if(cg->rules[i]->production.lhs == action->production.lhs
+       && cg->rules[i]->production.length == action->production.length)
+      return i;
+  }
+
+  if(cg->nrules == cg->cap) {
+    HLRAction **rules = h_arena_malloc(cg->arena, 2 * cg->cap * sizeof(HLRAction *));
+    memcpy(rules, cg->rules, cg->nrules * sizeof(HLRAction *));
+    cg->rules = rules;
+    cg->cap *= 2;
+  }
+  cg->rules[cg->nrules] = (HLRAction *)action;
+  return cg->nrules++;
+}
+
+// number the reductions found in a row; returns false on unknown symbols
+static bool collect_rules(HLRCodegen *cg, const HStringMap *m)
+{
+  const HLRAction *leaves[2] = {m->epsilon_branch, m->end_branch};
+  for(size_t i=0; i<2; i++) {
+    const HLRAction *a = leaves[i];
+    if(a && a->type == HLR_REDUCE) {
+      if(a->production.lhs != cg->start
+         && h_cg_symbol_id(cg->syms, a->production.lhs) == H_CG_NOSYM)
+        return false;
+      rule_number(cg, a);
+    }
+  }
+
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *n;
+  while((n = h_stringmap_next_branch(m, &i, &c))) {
+    if(!collect_rules(cg, n))
+      return false;
+  }
+
+  return true;
+}
+
+// helper for h_cg_emit_lookahead: table entries are actions
+static void emit_lraction(FILE *f, const void *value, unsigned int indent,
+                          void *env)
+{
+  const HLRAction *action = value;
+
+  assert(action->type != HLR_CONFLICT);
+  if(action->type == HLR_SHIFT)
+    fprintf(f, "%*snext = %zu;\n%*sgoto shift;\n",
+            indent, "", action->nextstate, indent, "");
+  else
+    fprintf(f, "%*srule = %zu;\n%*sgoto reduce;\n",
+            indent, "", rule_number(env, action), indent, "");
+}
+
+/* Write the table of a compiled parser as C source: a rule table, a goto
+ * function for the nonterminal shifts and a driver loop that switches over
+ * the states and their lookahead.
+ */
+int h_lr_dump_code(FILE *f, const HParser *parser, const char *prefix)
+{
+  const HLRTable *table = parser->backend_data;
+  if(!table || !h_slist_empty(table->inadeq))
+    return -1;    // conflicts are for GLR
+
+  HAllocator *mm__ = table->mm__;
+  HArena *arena = h_new_arena(mm__, 0);
+  const char *p = prefix;
+  int ret = -1;
+
+  HLRCodegen cg;
+  cg.syms = h_cg_symbols(arena, parser->desugared);
+  cg.start = table->start;
+  cg.cap = 16;
+  cg.nrules = 0;
+  cg.rules = h_arena_malloc(arena, cg.cap * sizeof(HLRAction *));
+  cg.arena = arena;
+
+  const HCGSymbols *syms = cg.syms;
+  for(size_t i=0; i<table->nrows; i++) {
+    if(table->forall[i]) {
+      assert(table->forall[i]->type == HLR_REDUCE);
+      rule_number(&cg, table->forall[i]);
+    } else if(!collect_rules(&cg, table->tmap[i])) {
+      goto done;
+    }
+  }
+
+  bool any_attrs = false;
+  for(size_t i=0; i<syms->n; i++) {
+    const HCFChoice *x = syms->syms[i];
+    any_attrs |= (x->type == HCF_CHARSET
+                  || (x->type == HCF_CHOICE && h_cg_has_attrs(x)));
+  }
+
+  h_cg_emit_preamble(f, p, "LALR", syms->n);
+  h_cg_emit_helpers(f, p, any_attrs);
+
+  // rule table; the augmented start symbol is -1
+  fprintf(f, "static const long %s_rule[][2] = {   // lhs, length\n", p);
+  for(size_t i=0; i<cg.nrules; i++) {
+    const HCFChoice *lhs = cg.rules[i]->production.lhs;
+    fprintf(f, "  {%ld, %zu},\n",
+            (lhs == cg.start)? -1L : (long)h_cg_symbol_id(syms, lhs),
+            cg.rules[i]->production.length);
+  }
+  fprintf(f, "  {0, 0}    // unused\n};\n\n");
+
+  // goto function
+  fprintf(f, "static size_t %s_goto(size_t state, long x)\n{\n  switch(x) {\n", p);
+  for(size_t i=0; i<syms->n; i++) {
+    bool any = false;
+    for(size_t j=0; j<table->nrows; j++) {
+      const HLRAction *a = h_hashtable_get(table->ntmap[j], syms->syms[i]);
+      if(a == NULL)
+        continue;
+      assert(a->type == HLR_SHIFT);
+      if(!any)
+        fprintf(f, "  case %zu:\n    switch(state) {\n", i);
+      any = true;
+      fprintf(f, "    case %zu: return %zu;\n", j, a->nextstate);
+    }
+    if(any)
+      fprintf(f, "    }\n    break;\n");
+  }
+  fprintf(f, "  }\n  return (size_t)-1;\n}\n\n");
+
+  // driver
+  fprintf(f,
+    "HParseResult *%s_parse__m(HAllocator *mm__, const uint8_t *input, size_t length)\n"
+    "{\n"
+    "  HArena *arena = h_new_arena(mm__, 0);    // will hold the results\n"
+    "  HArena *tarena = h_new_arena(mm__, 0);   // tmp, deleted after parse\n"
+    "  struct { size_t state; HParsedToken *value; } *stack;\n"
+    "  size_t cap = 64, sp = 0, pos = 0;\n"
+    "  size_t state = 0, next, rule, len;\n"
+    "  HParsedToken *tok, *v;\n"
+    "  long x;\n"
+    "\n"
+    "  stack = mm__->alloc(mm__, cap * sizeof(*stack));\n"
+    "\n"
+    "  for(;;) {\n"
+    "    switch(state) {\n", p);
+  for(size_t i=0; i<table->nrows; i++) {
+    fprintf(f, "    case %zu:\n", i);
+    if(table->forall[i])
+      emit_lraction(f, table->forall[i], 6, &cg);
+    else
+      h_cg_emit_lookahead(f, table->tmap[i], 0, 6, "goto no_parse;",
+                          emit_lraction, &cg);
+  }
+  fprintf(f,
+    "    }\n"
+    "    goto no_parse;\n"
+    "\n"
+    "  shift:\n"
+    "    tok = NULL;\n"
+    "    if(pos < length) {\n"
+    "      tok = %s_uint(arena, input[pos], pos);\n"
+    "      pos++;\n"
+    "    }\n"
+    "    goto push;\n"
+    "\n"
+    "  reduce:\n"
+    "    len = %s_rule[rule][1];\n"
+    "    tok = h_arena_malloc(arena, sizeof(HParsedToken));\n"
+    "    tok->token_type = TT_SEQUENCE;\n"
+    "    tok->seq = h_carray_new_sized(arena, len);\n"
+    "    for(size_t i=0; i<len; i++) {\n"
+    "      sp--;\n"
+    "      tok->seq->elements[len-1-i] = stack[sp].value;\n"
+    "      state = stack[sp].state;\n"
+    "    }\n"
+    "    tok->seq->used = len;\n"
+    "    v = (len > 0)? tok->seq->elements[0] : NULL;\n"
+    "    tok->index = v? v->index : pos;\n"
+    "    tok->bit_offset = v? v->bit_offset : 0;\n"
+    "\n"
+    "    x = %s_rule[rule][0];\n"
+    "    switch(x) {\n"
+    "    case -1:\n"
+    "      // the augmented start symbol; we are done\n"
+    "      tok = tok->seq->elements[0];\n"
+    "      goto accept;\n", p, p, p);
+
+  // charsets are reshaped to their single character by the LR(0) DFA
+  bool any = false;
+  for(size_t i=0; i<syms->n; i++) {
+    if(syms->syms[i]->type != HCF_CHARSET)
+      continue;
+    fprintf(f, "%s%zu:", any? " case " : "    case ", i);
+    any = true;
+  }
+  if(any) {
+    fprintf(f, "\n"
+      "      tok = tok->seq->elements[0];\n"
+      "      if(!%s_apply(arena, tarena, %s_syms[x], false, &tok))\n"
+      "        goto no_parse;\n"
+      "      break;\n", p, p);
+  }
+  any = false;
+  for(size_t i=0; i<syms->n; i++) {
+    if(syms->syms[i]->type != HCF_CHOICE || !h_cg_has_attrs(syms->syms[i]))
+      continue;
+    fprintf(f, "%s%zu:", any? " case " : "    case ", i);
+    any = true;
+  }
+  if(any) {
+    fprintf(f, "\n"
+      "      if(!%s_apply(arena, tarena, %s_syms[x], true, &tok))\n"
+      "        goto no_parse;\n"
+      "      break;\n", p, p);
+  }
+  fprintf(f,
+    "    }\n"
+    "    next = %s_goto(state, x);\n"
+    "    if(next == (size_t)-1)\n"
+    "      goto no_parse;\n"
+    "\n"
+    "  push:\n"
+    "    if(sp == cap) {\n"
+    "      cap *= 2;\n"
+    "      stack = mm__->realloc(mm__, stack, cap * sizeof(*stack));\n"
+    "    }\n"
+    "    stack[sp].state = state;\n"
+    "    stack[sp].value = tok;\n"
+    "    sp++;\n"
+    "    state = next;\n"
+    "  }\n"
+    "\n"
+    " accept:\n"
+    "  mm__->free(mm__, stack);\n"
+    "  h_delete_arena(tarena);\n"
+    "  HParseResult *res = make_result(arena, tok);\n"
+    "  res->bit_length = pos * 8;\n"
+    "  return res;\n"
+    "\n"
+    " no_parse:\n"
+    "  mm__->free(mm__, stack);\n"
+    "  h_delete_arena(tarena);\n"
+    "  h_delete_arena(arena);\n"
+    "  return NULL;\n"
+    "}\n"
+    "\n"
+    "HParseResult *%s_parse(const uint8_t *input, size_t length)\n"
+    "{\n"
+    "  return %s_parse__m(&system_allocator, input, length);\n"
+    "}\n"
+    "\n"
+    "#undef LA\n", p, p, p);
+  ret = 0;
+
+ done:
+  h_delete_arena(arena);
+  return ret;
+}
+
+
+
 /* Pretty-printers */
 
 void h_pprint_lritem(FILE *f, const HCFGrammar *g, const HLRItem *item)
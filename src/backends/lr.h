@@ -39,6 +39,9 @@ typedef struct HLRAction_ {
       size_t length;    // # of symbols in rhs
 #ifndef NDEBUG
       HCFChoice **rhs;  // NB: the rhs symbols are not needed for the parse
+#endif
+#ifdef HAMMER_PROFILE
+      size_t index;     // of the production among lhs's
 #endif
     } production;
 
@@ -53,6 +56,7 @@ typedef struct HLRTable_ {
   HStringMap **tmap;    // map lookahead strings to HLRActions, per row
   HLRAction  **forall;  // shortcut to set an action for an entire row
   HCFChoice  *start;    // start symbol
+  bool       preds;     // does the grammar have validations (h_attr_bool)?
   HSlist     *inadeq;   // indices of any inadequate states
   HArena     *arena;
   HAllocator *mm__;
@@ -73,10 +77,22 @@ typedef struct HLREngine_ {
   HSlist *stack;        // holds pairs: (saved state, semantic value)
   HInputStream input;
 
+  // contiguous replacement for 'stack' used by the deterministic driver.
+  // GLR engines share stack prefixes and keep using the list (vcap == 0).
+  size_t *vstates;      // saved states
+  HParsedToken **values;// semantic values
+  size_t vdepth, vcap;
+
+  HParsedToken *scratch;  // reusable sequence for reductions whose result
+  size_t scratchcap;      // is discarded by the reshape
+
   struct HLREngine_ *merged[2]; // ancestors merged into this engine
 
   HArena *arena;        // will hold the results
   HArena *tarena;       // tmp, deleted after parse
+#ifdef HAMMER_PROFILE
+  HProfileScope *prof;  // NULL if not profiling
+#endif
 } HLREngine;
 
 #define HLR_SUCCESS ((size_t)~0)    // parser end state
@@ -128,6 +144,8 @@ HLRTable *h_lr0_table(HCFGrammar *g, const HLRDFA *dfa);
 
 HCFChoice *h_desugar_augmented(HAllocator *mm__, HParser *parser);
 int h_lalr_compile(HAllocator* mm__, HParser* parser, const void* params);
+int h_lalr_compile_threads(HAllocator* mm__, HParser* parser,
+                           const void* params, unsigned int threads);
 void h_lalr_free(HParser *parser);
 
 const HLRAction *h_lrengine_action(const HLREngine *engine);
@@ -137,7 +155,10 @@ HParseResult *h_lr_parse(HAllocator* mm__, const HParser* parser, HInputStream*
 void h_lr_parse_start(HSuspendedParser *s);
 bool h_lr_parse_chunk(HSuspendedParser* s, HInputStream *stream);
 HParseResult *h_lr_parse_finish(HSuspendedParser *s);
+int h_lr_parse_events(HAllocator* mm__, const HParser* parser,
+                      HInputStream* stream, HParseEventSink* sink);
 HParseResult *h_glr_parse(HAllocator* mm__, const HParser* parser, HInputStream* stream);
+int h_lr_dump_code(FILE *f, const HParser *parser, const char *prefix);
 
 void h_pprint_lritem(FILE *f, const HCFGrammar *g, const HLRItem *item);
 void h_pprint_lrstate(FILE *f, const HCFGrammar *g,
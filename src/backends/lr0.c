@@ -55,9 +55,10 @@ static void expand_to_closure(HCFGrammar *g, HHashSet *items)
             // single-character item needs no further work
           }
         }
-        // if sym is a non-terminal, we need a reshape on it
-        // this seems as good a place as any to set it
-        sym->reshape = h_act_first;
+        // its value is that of the single character; h_lrengine_step
+        // takes care of that. (the desugared form is shared with the
+        // other backends, which treat charsets as terminals, so no
+        // reshape may be set on sym itself.)
       }
     }
   }
@@ -5,24 +5,31 @@
 
 // short-hand for creating lowlevel parse cache values (parse result case)
 static
-HParserCacheValue * cached_result(HParseState *state, HParseResult *result) {
+HParserCacheValue * cached_result(HParseState *state, const HParserCacheKey *k, HParseResult *result) {
   HParserCacheValue *ret = a_new(HParserCacheValue, 1);
   ret->value_type = PC_RIGHT;
   ret->right = result;
   ret->input_stream = state->input_stream;
+  memcpy(&ret->key, k, sizeof(HParserCacheKey)); // padding too; keys are hashed as bytes
   return ret;
 }
 
 // short-hand for creating lowlevel parse cache values (left recursion case)
 static
-HParserCacheValue *cached_lr(HParseState *state, HLeftRec *lr) {
-  HParserCacheValue *ret = a_new(HParserCacheValue, 1);
+HParserCacheValue *cached_lr(HParseState *state, const HParserCacheKey *k, HLeftRec *lr) {
+  HParserCacheValue *ret = cached_result(state, k, NULL);
   ret->value_type = PC_LEFT;
   ret->left = lr;
-  ret->input_stream = state->input_stream;
   return ret;
 }
 
+// updates a cache value in place to the result at the current position
+static inline void update_result(HParseState *state, HParserCacheValue *cached, HParseResult *result) {
+  cached->value_type = PC_RIGHT;
+  cached->right = result;
+  cached->input_stream = state->input_stream;
+}
+
 // Really library-internal tool to perform an uncached parse, and handle any common error-handling.
 static inline HParseResult* perform_lowlevel_parse(HParseState *state, const HParser *parser) {
   // TODO(thequux): these nested conditions are ugly. Factor this appropriately, so that it is clear which codes is executed when.
@@ -64,7 +71,7 @@ HParserCacheValue* recall(HParserCacheKey *k, HParseState *state) {
   } else { // Some heads found
     if (!cached && head->head_parser != k->parser && !h_slist_find(head->involved_set, k->parser)) {
       // Nothing in the cache, and the key parser is not involved
-      cached = cached_result(state, NULL);
+      cached = cached_result(state, k, NULL);
       cached->input_stream = k->input_pos;
     }
     if (h_slist_find(head->eval_set, k->parser)) {
@@ -73,12 +80,10 @@ HParserCacheValue* recall(HParserCacheKey *k, HParseState *state) {
       HParseResult *tmp_res = perform_lowlevel_parse(state, k->parser);
       // update the cache
       if (!cached) {
-	cached = cached_result(state, tmp_res);
-	h_hashtable_put(state->cache, k, cached);
+	cached = cached_result(state, k, tmp_res);
+	h_hashtable_put(state->cache, &cached->key, cached);
       } else {
-	cached->value_type = PC_RIGHT;
-	cached->right = tmp_res;
-	cached->input_stream = state->input_stream;
+	update_result(state, cached, tmp_res);
       }
     }
     return cached;
@@ -138,7 +143,7 @@ HParseResult* grow(HParserCacheKey *k, HParseState *state, HRecursionHead *head)
 
   if (tmp_res) {
     if (pos_lt(old_cached->input_stream, state->input_stream)) {
-      h_hashtable_put(state->cache, k, cached_result(state, tmp_res));
+      update_result(state, old_cached, tmp_res);
       return grow(k, state, head);
     } else {
       // we're done with growing, we can remove data from the recursion head
@@ -166,7 +171,9 @@ HParseResult* lr_answer(HParserCacheKey *k, HParseState *state, HLeftRec *growab
     }
     else {
       // update cache
-      h_hashtable_put(state->cache, k, cached_result(state, growable->seed));
+      HParserCacheValue *cached = h_hashtable_get(state->cache, k);
+      assert(cached != NULL);
+      update_result(state, cached, growable->seed);
       if (!growable->seed)
 	return NULL;
       else
@@ -179,45 +186,80 @@ HParseResult* lr_answer(HParserCacheKey *k, HParseState *state, HLeftRec *growab
 
 /* Warth's recursion. Hi Alessandro! */
 HParseResult* h_do_parse(const HParser* parser, HParseState *state) {
-  HParserCacheKey *key = a_new(HParserCacheKey, 1);
-  key->input_pos = state->input_stream; key->parser = parser;
+  // only for lookups; what goes into the cache is the copy in its value
+  HParserCacheKey key;
+  memset(&key, 0, sizeof(HParserCacheKey));
+  key.input_pos = state->input_stream; key.parser = parser;
   HParserCacheValue *m = NULL;
+#ifdef HAMMER_PROFILE
+  HProfileEntry *prof = NULL;
+  HProfileTimer timer;
+  if (state->profile) {
+    prof = h_profile_entry(state->profile, H_PROFILE_PARSER, parser, 0, parser);
+    prof->count++;
+  }
+#endif
   if (parser->vtable->higher) {
-    m = recall(key, state);
+    m = recall(&key, state);
   }
   // check to see if there is already a result for this object...
   if (!m) {
+    h_limit_steps(&state->input_stream, 1);
+#ifdef HAMMER_PROFILE
+    if (prof) {
+      if (parser->vtable->higher)
+        prof->memo_misses++;
+      h_profile_start(state->profile, &timer);
+    }
+#endif
     // It doesn't exist, so create a dummy result to cache
     HLeftRec *base = NULL;
-    // But only cache it now if there's some chance it could grow; primitive parsers can't
+    HParserCacheValue *cached = NULL;
+    // But only cache anything if there's some chance it could grow; primitive
+    // parsers can't, and are never looked up
     if (parser->vtable->higher) {
       base = a_new(HLeftRec, 1);
       base->seed = NULL; base->rule = parser; base->head = NULL;
       h_slist_push(state->lr_stack, base);
       // cache it
-      h_hashtable_put(state->cache, key, cached_lr(state, base));
+      cached = cached_lr(state, &key, base);
+      h_hashtable_put(state->cache, &cached->key, cached);
       // parse the input
     }
     HParseResult *tmp_res = perform_lowlevel_parse(state, parser);
+#ifdef HAMMER_PROFILE
+    if (prof) {
+      h_profile_stop(state->profile, prof, &timer);
+      if (tmp_res)
+        prof->bytes += (h_input_stream_pos(&state->input_stream)
+                        - h_input_stream_pos(&key.input_pos)) / 8;
+      else
+        prof->backtracks++;
+    }
+#endif
     if (parser->vtable->higher) {
       // the base variable has passed equality tests with the cache
       h_slist_pop(state->lr_stack);
-      // update the cached value to our new position
-      HParserCacheValue *cached = h_hashtable_get(state->cache, key);
-      assert(cached != NULL);
+      // update the cached value to our new position; it stays the value
+      // of key, as every lookup of key meanwhile found it
       cached->input_stream = state->input_stream;
     }
     // setupLR, used below, mutates the LR to have a head if appropriate, so we check to see if we have one
     if (!base || NULL == base->head) {
-      h_hashtable_put(state->cache, key, cached_result(state, tmp_res));
+      if (cached)
+        update_result(state, cached, tmp_res);
       return tmp_res;
     } else {
       base->seed = tmp_res;
-      HParseResult *res = lr_answer(key, state, base);
+      HParseResult *res = lr_answer(&cached->key, state, base);
       return res;
     }
   } else {
     // it exists!
+#ifdef HAMMER_PROFILE
+    if (prof)
+      prof->memo_hits++;
+#endif
     state->input_stream = m->input_stream;
     if (PC_LEFT == m->value_type) {
       setupLR(parser, state, m->left);
@@ -229,13 +271,17 @@ HParseResult* h_do_parse(const HParser* parser, HParseState *state) {
 }
 
 int h_packrat_compile(HAllocator* mm__, HParser* parser, const void* params) {
+  uintptr_t flags = (uintptr_t)params;
   parser->backend = PB_PACKRAT;
+  // the only state there is: non-NULL if actions are deferred
+  parser->backend_data = (void*)(flags & H_PACKRAT_DEFER_ACTIONS);
   return 0; // No compilation necessary, and everything should work
 	    // out of the box.
 }
 
 void h_packrat_free(HParser *parser) {
   parser->backend = PB_PACKRAT; // revert to default, oh that's us
+  parser->backend_data = NULL;
 }
 
 static uint32_t cache_key_hash(const void* key) {
@@ -253,8 +299,7 @@ static bool pos_equal(const void* key1, const void* key2) {
   return memcmp(key1, key2, sizeof(HInputStream)) == 0;
 }
 
-HParseResult *h_packrat_parse(HAllocator* mm__, const HParser* parser, HInputStream *input_stream) {
-  HArena * arena = h_new_arena(mm__, 0);
+HParseState *h_packrat_state_new(HArena *arena, const HInputStream *input_stream) {
   HParseState *parse_state = a_new_(arena, HParseState, 1);
   parse_state->cache = h_hashtable_new(arena, cache_key_equal, // key_equal_func
 				       cache_key_hash); // hash_func
@@ -262,11 +307,38 @@ HParseResult *h_packrat_parse(HAllocator* mm__, const HParser* parser, HInputStr
   parse_state->lr_stack = h_slist_new(arena);
   parse_state->recursion_heads = h_hashtable_new(arena, pos_equal, pos_hash);
   parse_state->arena = arena;
-  HParseResult *res = h_do_parse(parser, parse_state);
+  parse_state->byte_tokens = NULL;
+  parse_state->defer_actions = false;
+  parse_state->forced = NULL;
+#ifdef HAMMER_PROFILE
+  parse_state->profile = NULL;
+#endif
+  return parse_state;
+}
+
+void h_packrat_state_free(HParseState *parse_state) {
   h_slist_free(parse_state->lr_stack);
   h_hashtable_free(parse_state->recursion_heads);
-  // tear down the parse state
   h_hashtable_free(parse_state->cache);
+  if (parse_state->forced)
+    h_hashset_free(parse_state->forced);
+}
+
+HParseResult *h_packrat_parse(HAllocator* mm__, const HParser* parser, HInputStream *input_stream) {
+  HArena * arena = h_new_arena(mm__, 0);
+  HParseState *parse_state = h_packrat_state_new(arena, input_stream);
+  parse_state->defer_actions = (parser->backend_data != NULL);
+#ifdef HAMMER_PROFILE
+  parse_state->profile = h_profile_begin(mm__, parser);
+#endif
+  HParseResult *res = h_do_parse(parser, parse_state);
+  if (res && parse_state->defer_actions)
+    res->ast = h_force_actions(parse_state, res->ast);
+#ifdef HAMMER_PROFILE
+  h_profile_end(parse_state->profile);
+#endif
+  // tear down the parse state
+  h_packrat_state_free(parse_state);
   if (!res)
     h_delete_arena(parse_state->arena);
 
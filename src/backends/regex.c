@@ -3,6 +3,7 @@
 #include <assert.h>
 #include "../internal.h"
 #include "../parsers/parser_internal.h"
+#include "../codegen.h"
 #include "regex.h"
 
 #undef a_new
@@ -31,7 +32,7 @@ typedef struct HRVMThread_ {
   uint16_t ip;
 } HRVMThread;
 
-HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace, const uint8_t *input, int len);
+HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace, const HInputStream *input, int len);
 
 HRVMTrace *invert_trace(HRVMTrace *trace) {
   HRVMTrace *last = NULL;
@@ -50,7 +51,7 @@ HRVMTrace *invert_trace(HRVMTrace *trace) {
   return last;
 }
 
-void* h_rvm_run__m(HAllocator *mm__, HRVMProg *prog, const uint8_t* input, size_t len) {
+void* h_rvm_run__m(HAllocator *mm__, HRVMProg *prog, const HInputStream* input, size_t len) {
   HArena *arena = h_new_arena(mm__, 0);
   HSArray *heads_n = h_sarray_new(mm__, prog->length), // Both of these contain HRVMTrace*'s
     *heads_p = h_sarray_new(mm__, prog->length);
@@ -76,7 +77,7 @@ void* h_rvm_run__m(HAllocator *mm__, HRVMProg *prog, const uint8_t* input, size_
   size_t off = 0;
   int live_threads = 1; // May be redundant
   for (off = 0; off <= len; off++) {
-    uint8_t ch = ((off == len) ? 0 : input[off]);
+    uint8_t ch = ((off == len) ? 0 : h_input_byte(input, off));
     /* scope */ {
       HSArray *heads_t;
       heads_t = heads_n;
@@ -88,6 +89,9 @@ void* h_rvm_run__m(HAllocator *mm__, HRVMProg *prog, const uint8_t* input, size_
     if (!live_threads) {
       goto match_fail;
     }
+    if (off == len)
+      h_limit_end(input);
+    h_limit_steps(input, live_threads);
     live_threads = 0;
     HRVMTrace *tr_head;
     H_SARRAY_FOREACH_KV(tr_head,ip_s,heads_p) {
@@ -164,6 +168,8 @@ void* h_rvm_run__m(HAllocator *mm__, HRVMProg *prog, const uint8_t* input, size_
   }
   // No accept was reached.
  match_fail:
+  h_sarray_free(heads_n);
+  h_sarray_free(heads_p);
   if (ret_trace == NULL) {
     // No match found; definite failure.
     h_delete_arena(arena);
@@ -195,7 +201,7 @@ bool svm_stack_ensure_cap(HAllocator *mm__, HSVMContext *ctx, size_t addl) {
   return true;
 }
 
-HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace, const uint8_t *input, int len) {
+HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace, const HInputStream *input, int len) {
   // orig_prog is only used for the action table
   HSVMContext ctx;
   HArena *arena = h_new_arena(mm__, 0);
@@ -237,8 +243,15 @@ HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace,
       // TODO: Will need to copy if bit_offset is nonzero
       assert(tmp_res->bit_offset == 0);
 	
-      tmp_res->bytes.token = input + tmp_res->index;
       tmp_res->bytes.len = cur->input_pos - tmp_res->index;
+      if (input->input) {
+	tmp_res->bytes.token = input->input + tmp_res->index;
+      } else {
+	// scattered input; the bytes need not be contiguous
+	uint8_t *bytes = h_arena_malloc(arena, tmp_res->bytes.len);
+	h_iov_copy(input->iov, bytes, tmp_res->index, tmp_res->bytes.len);
+	tmp_res->bytes.token = bytes;
+      }
       break;
     case SVM_ACCEPT:
       assert(ctx.stack_count <= 1);
@@ -250,10 +263,12 @@ HParseResult *run_trace(HAllocator *mm__, HRVMProg *orig_prog, HRVMTrace *trace,
       }
       res->bit_length = cur->input_pos * 8;
       res->arena = arena;
+      h_free(ctx.stack);
       return res;
     }
   }
  fail:
+  h_free(ctx.stack);
   h_delete_arena(arena);
   return NULL;
 }
@@ -386,13 +401,216 @@ static int h_regex_compile(HAllocator *mm__, HParser* parser, const void* params
 }
 
 static HParseResult *h_regex_parse(HAllocator* mm__, const HParser* parser, HInputStream *input_stream) {
-  return h_rvm_run__m(mm__, (HRVMProg*)parser->backend_data, input_stream->input, input_stream->length);
+  return h_rvm_run__m(mm__, (HRVMProg*)parser->backend_data, input_stream, input_stream->length);
+}
+
+/* Generating C code: the program is determinized into a DFA whose states are
+ * the sets of threads waiting after a STEP instruction. Semantic actions are
+ * not part of the DFA, so the generated code only recognizes input; it does
+ * not run validations either and may accept input that h_parse rejects.
+ */
+
+#define RVM_DFA_MAX_STATES 1024
+
+typedef struct {
+  size_t n;
+  uint16_t *ips;    // sorted
+} HRVMThreadSet;
+
+static bool eq_threadset(const void *p, const void *q)
+{
+  const HRVMThreadSet *a=p, *b=q;
+  return (a->n == b->n && memcmp(a->ips, b->ips, a->n * sizeof(uint16_t)) == 0);
+}
+
+static HHashValue hash_threadset(const void *p)
+{
+  const HRVMThreadSet *a = p;
+  HHashValue hash = a->n;
+  for(size_t i=0; i<a->n; i++)
+    hash = hash * 33 + a->ips[i];
+  return hash;
+}
+
+// run the threads of 'set' over one input position like h_rvm_run__m does.
+// marks the threads reaching a STEP in 'next'; returns true if one accepts.
+static bool rvm_dfa_step(const HRVMProg *prog, const HRVMThreadSet *set,
+                         uint8_t ch, bool eof, uint8_t *seen, uint8_t *next,
+                         uint16_t *work)
+{
+  size_t top = 0;
+  bool accept = false;
+
+  memset(seen, 0, prog->length);
+  memset(next, 0, prog->length);
+  for(size_t i=0; i<set->n; i++)
+    work[top++] = set->ips[i];
+
+  while(top > 0) {
+    uint16_t ip = work[--top];
+    if(seen[ip])
+      continue;
+    seen[ip] = 1;
+
+    uint16_t arg = prog->insns[ip].arg;
+    switch(prog->insns[ip].op) {
+    case RVM_ACCEPT:
+      accept = true;
+      break;
+    case RVM_MATCH:
+      if(ch >= (arg & 0xff) && ch <= ((arg >> 8) & 0xff))
+        work[top++] = ip + 1;
+      break;
+    case RVM_GOTO:
+      work[top++] = arg;
+      break;
+    case RVM_FORK:
+      work[top++] = arg;
+      work[top++] = ip + 1;
+      break;
+    case RVM_EOF:
+      if(eof)
+        work[top++] = ip + 1;
+      break;
+    case RVM_STEP:
+      next[ip + 1] = 1;
+      break;
+    default:  // PUSH, ACTION, CAPTURE
+      work[top++] = ip + 1;
+      break;
+    }
+  }
+
+  return accept;
+}
+
+static int h_regex_dump_code(FILE *f, const HParser *parser, const char *prefix)
+{
+  const HRVMProg *prog = parser->backend_data;
+  HAllocator *mm__ = prog->allocator;
+  HArena *arena = h_new_arena(mm__, 0);
+  const char *p = prefix;
+  int ret = -1;
+
+  uint8_t *seen = a_new(uint8_t, prog->length);
+  uint8_t *next = a_new(uint8_t, prog->length);
+  uint16_t *work = a_new(uint16_t, 2 * prog->length + 1);
+
+  HHashTable *index = h_hashtable_new(arena, eq_threadset, hash_threadset);
+  HRVMThreadSet **states = a_new(HRVMThreadSet *, RVM_DFA_MAX_STATES);
+  // transitions (-1 if no thread survives) and accepting characters;
+  // accept[i][256] is for the end of input
+  int32_t (*trans)[256] = h_arena_malloc(arena, RVM_DFA_MAX_STATES * sizeof(*trans));
+  bool (*accept)[257] = h_arena_malloc(arena, RVM_DFA_MAX_STATES * sizeof(*accept));
+  size_t nstates = 1;
+
+  states[0] = a_new(HRVMThreadSet, 1);
+  states[0]->n = 1;
+  states[0]->ips = a_new(uint16_t, 1);
+  states[0]->ips[0] = 0;
+  h_hashtable_put(index, states[0], (void *)(uintptr_t)1);
+
+  // subset construction
+  for(size_t i=0; i<nstates; i++) {
+    // at the end of input, the VM runs once more with a 0 character
+    accept[i][256] = rvm_dfa_step(prog, states[i], 0, true, seen, next, work);
+
+    for(unsigned int c=0; c<256; c++) {
+      accept[i][c] = rvm_dfa_step(prog, states[i], c, false, seen, next, work);
+
+      HRVMThreadSet t = {0, work};
+      for(size_t ip=0; ip<prog->length; ip++) {
+        if(next[ip])
+          work[t.n++] = ip;
+      }
+      if(t.n == 0) {
+        trans[i][c] = -1;
+        continue;
+      }
+
+      uintptr_t j = (uintptr_t)h_hashtable_get(index, &t);
+      if(j == 0) {
+        if(nstates == RVM_DFA_MAX_STATES)
+          goto done;      // too big to be worth emitting
+        HRVMThreadSet *u = a_new(HRVMThreadSet, 1);
+        u->n = t.n;
+        u->ips = a_new(uint16_t, t.n);
+        memcpy(u->ips, t.ips, t.n * sizeof(uint16_t));
+        states[nstates] = u;
+        j = ++nstates;
+        h_hashtable_put(index, u, (void *)j);
+      }
+      trans[i][c] = j - 1;
+    }
+  }
+
+  h_cg_emit_preamble(f, p, "regular", 0);
+  fprintf(f, "/* Returns the length of the longest prefix of input that the parser\n"
+             " * accepts, or -1 if there is none.\n"
+             " */\n"
+             "long %s_match(const uint8_t *input, size_t length)\n"
+             "{\n"
+             "  size_t pos = 0;\n"
+             "  long match = -1;\n", p);
+
+  // the start state is entered without a jump
+  bool *target = a_new(bool, nstates);
+  for(size_t i=0; i<nstates; i++) {
+    for(unsigned int c=0; c<256; c++) {
+      if(trans[i][c] >= 0)
+        target[trans[i][c]] = true;
+    }
+  }
+
+  for(size_t i=0; i<nstates; i++) {
+    fputc('\n', f);
+    if(target[i])
+      fprintf(f, " d%zu:\n", i);
+    fprintf(f, "  if(pos == length) {\n");
+    if(accept[i][256])
+      fprintf(f, "    match = pos;\n");
+    fprintf(f, "    goto done;\n  }\n  switch(input[pos++]) {\n");
+
+    // characters with the same effect share one case
+    bool done_[256] = {false};
+    for(unsigned int c=0; c<256; c++) {
+      if(done_[c] || (trans[i][c] < 0 && !accept[i][c]))
+        continue;
+      unsigned int count = 0;
+      fprintf(f, " ");
+      for(unsigned int d=c; d<256; d++) {
+        if(trans[i][d] != trans[i][c] || accept[i][d] != accept[i][c])
+          continue;
+        done_[d] = true;
+        fprintf(f, "%s case ", (count > 0 && count % 8 == 0)? "\n " : "");
+        h_cg_emit_byte(f, d);
+        fputc(':', f);
+        count++;
+      }
+      fputc('\n', f);
+      if(accept[i][c])
+        fprintf(f, "    match = pos - 1;\n");
+      if(trans[i][c] < 0)
+        fprintf(f, "    goto done;\n");
+      else
+        fprintf(f, "    goto d%d;\n", (int)trans[i][c]);
+    }
+    fprintf(f, "  default:\n    goto done;\n  }\n");
+  }
+  fprintf(f, "\n done:\n  return match;\n}\n\n#undef LA\n");
+  ret = 0;
+
+ done:
+  h_delete_arena(arena);
+  return ret;
 }
 
 HParserBackendVTable h__regex_backend_vtable = {
   .compile = h_regex_compile,
   .parse = h_regex_parse,
-  .free = h_regex_free
+  .free = h_regex_free,
+
+  .dump_code = h_regex_dump_code
 };
 
 #ifndef NDEBUG
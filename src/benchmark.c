@@ -11,7 +11,8 @@ static const char* HParserBackendNames[] = {
   "Regular",
   "LL(k)",
   "LALR",
-  "GLR"
+  "GLR",
+  "Earley"
 };
 
 /*
@@ -25,9 +26,13 @@ static const char* HParserBackendNames[] = {
 
   h_benchmark_report(stdout, results);
 
+  or, for other programs to read, with:
+
+  h_benchmark_report_format(stdout, results, H_BENCHMARK_JSON);
+
   or just generate code to make the parser run as fast as possible with:
 
-  h_benchmark_dump_optimized_code(stdout, results);
+  h_benchmark_dump_optimized_code(stdout, parser, results);
 
 */
 
@@ -35,6 +40,71 @@ HBenchmarkResults *h_benchmark(HParser* parser, HParserTestcase* testcases) {
   return h_benchmark__m(&system_allocator, parser, testcases);
 }
 
+// Each sample times a batch of parses that lasts at least SAMPLE_NS, so
+// that the clock's resolution does not matter. A case is sampled until
+// CASE_NS have passed, but at least MIN_SAMPLES times.
+#define SAMPLE_NS   10000
+#define CASE_NS     100000000
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 10000
+
+static int cmp_time(const void *p, const void *q) {
+  size_t a = *(const size_t *)p, b = *(const size_t *)q;
+  return (a > b) - (a < b);
+}
+
+// times the parses of one test case; samples has room for MAX_SAMPLES
+static void benchmark_case(HAllocator *mm__, HParser *parser, const HParserTestcase *tc,
+                           HCaseResult *cr, size_t *samples) {
+  struct HStopWatch stopwatch;
+  int64_t time_diff;
+  size_t batch, n = 0;
+  int64_t total = 0;
+
+  // The first parse warms up the caches, and tells us the memory one needs
+  HAllocator *counting = h_counting_allocator_new(mm__, 0);
+  HParseResult *res = h_parse__m(counting ? counting : mm__, parser, tc->input, tc->length);
+  HArenaStats stats = {0, 0};
+  HAllocatorStats mem;
+  memset(&mem, 0, sizeof(mem));
+  if (res)
+    h_parse_result_stats(res, &stats);
+  h_parse_result_free(res);
+  if (counting) {
+    h_counting_allocator_stats(counting, &mem);
+    h_counting_allocator_free(counting);
+  }
+
+  for (batch = 1; ; batch *= 2) {
+    h_platform_stopwatch_reset(&stopwatch);
+    for (size_t cur = 0; cur < batch; cur++)
+      h_parse_result_free(h_parse(parser, tc->input, tc->length));
+    time_diff = h_platform_stopwatch_ns(&stopwatch);
+    if (time_diff >= SAMPLE_NS)
+      break;
+  }
+  while (n < MAX_SAMPLES && (total < CASE_NS || n < MIN_SAMPLES)) {
+    h_platform_stopwatch_reset(&stopwatch);
+    for (size_t cur = 0; cur < batch; cur++)
+      h_parse_result_free(h_parse(parser, tc->input, tc->length));
+    time_diff = h_platform_stopwatch_ns(&stopwatch);
+    samples[n++] = time_diff / batch;
+    total += time_diff;
+  }
+  qsort(samples, n, sizeof(size_t), cmp_time);
+
+  cr->success = true;
+  cr->parse_time = total / (n * batch);
+  cr->length = tc->length;
+  cr->median_time = samples[n / 2];
+  cr->p99_time = samples[(n * 99 + 99) / 100 - 1];
+  cr->n_samples = n;
+  cr->arena_used = stats.used;
+  cr->arena_wasted = stats.wasted;
+  cr->peak_bytes = mem.peak;
+  cr->allocs = mem.allocs + mem.reallocs;
+}
+
 HBenchmarkResults *h_benchmark__m(HAllocator* mm__, HParser* parser, HParserTestcase* testcases) {
   // For now, just output the results to stderr
   HParserTestcase* tc = testcases;
@@ -42,25 +112,28 @@ HBenchmarkResults *h_benchmark__m(HAllocator* mm__, HParser* parser, HParserTest
   HBenchmarkResults *ret = h_new(HBenchmarkResults, 1);
   ret->len = PB_MAX-PB_MIN+1;
   ret->results = h_new(HBackendResults, ret->len);
+  size_t *samples = h_new(size_t, MAX_SAMPLES);
 
   for (backend = PB_MIN; backend <= PB_MAX; backend++) {
     ret->results[backend].backend = backend;
+    ret->results[backend].n_testcases = 0;
+    ret->results[backend].failed_testcases = 0;
+    ret->results[backend].cases = NULL;
     // Step 1: Compile grammar for given parser...
-    if (h_compile(parser, backend, NULL) == -1) {
+    struct HStopWatch stopwatch;
+    h_platform_stopwatch_reset(&stopwatch);
+    int compiled = h_compile(parser, backend, NULL);
+    ret->results[backend].compile_time = h_platform_stopwatch_ns(&stopwatch);
+    if (compiled == -1) {
       // backend inappropriate for grammar...
       fprintf(stderr, "Compiling for %s failed\n", HParserBackendNames[backend]);
       ret->results[backend].compile_success = false;
-      ret->results[backend].n_testcases = 0;
-      ret->results[backend].failed_testcases = 0;
-      ret->results[backend].cases = NULL;
       continue;
     }
     fprintf(stderr, "Compiled for %s\n", HParserBackendNames[backend]);
     ret->results[backend].compile_success = true;
     int tc_failed = 0;
-    // Step 1: verify all test cases.
-    ret->results[backend].n_testcases = 0;
-    ret->results[backend].failed_testcases = 0;
+    // Step 2: verify all test cases.
     for (tc = testcases; tc->input != NULL; tc++) {
       ret->results[backend].n_testcases++;
       HParseResult *res = h_parse(parser, tc->input, tc->length);
@@ -70,7 +143,8 @@ HBenchmarkResults *h_benchmark__m(HAllocator* mm__, HParser* parser, HParserTest
       } else
         res_unamb = NULL;
       if ((res_unamb == NULL && tc->output_unambiguous != NULL)
-          || (res_unamb != NULL && strcmp(res_unamb, tc->output_unambiguous) != 0)) {
+          || (res_unamb != NULL && (tc->output_unambiguous == NULL
+                                    || strcmp(res_unamb, tc->output_unambiguous) != 0))) {
         // test case failed...
         fprintf(stderr, "Parsing with %s failed\n", HParserBackendNames[backend]);
         // We want to run all testcases, for purposes of generating a
@@ -89,42 +163,133 @@ HBenchmarkResults *h_benchmark__m(HAllocator* mm__, HParser* parser, HParserTest
       continue;
     }
 
+    // Step 3: time them.
     ret->results[backend].cases = h_new(HCaseResult, ret->results[backend].n_testcases);
+    memset(ret->results[backend].cases, 0, ret->results[backend].n_testcases * sizeof(HCaseResult));
     size_t cur_case = 0;
+    for (tc = testcases; tc->input != NULL; tc++)
+      benchmark_case(mm__, parser, tc, &ret->results[backend].cases[cur_case++], samples);
+  }
+  h_free(samples);
+  return ret;
+}
 
-    for (tc = testcases; tc->input != NULL; tc++) {
-      // The goal is to run each testcase for at least 50ms each
-      int count = 1, cur;
-      int64_t time_diff;
-      do {
-        count *= 2; // Yes, this means that the first run will run the function twice. This is fine, as we want multiple runs anyway.
-        struct HStopWatch stopwatch;
-        h_platform_stopwatch_reset(&stopwatch);
-        for (cur = 0; cur < count; cur++) {
-          h_parse_result_free(h_parse(parser, tc->input, tc->length));
-        }
-        time_diff = h_platform_stopwatch_ns(&stopwatch);
-      } while (time_diff < 100000000);
-      ret->results[backend].cases[cur_case].parse_time = (time_diff / count);
-      ret->results[backend].cases[cur_case].length = tc->length;
-      cur_case++;
+// in MB/s, at the median time
+static double throughput(const HCaseResult *cr) {
+  return cr->median_time ? cr->length * 1e3 / cr->median_time : 0;
+}
+
+static void report_text(FILE* stream, HBenchmarkResults* result) {
+  for (size_t i=0; i<result->len; ++i) {
+    HBackendResults *br = &result->results[i];
+    if (!br->compile_success) {
+      fprintf(stream, "Skipping %s because grammar did not compile for it (gave up after %.1f us)\n",
+              HParserBackendNames[i], br->compile_time / 1e3);
+      continue;
+    }
+    if (br->cases == NULL) {
+      fprintf(stream, "Skipping %s because %zu of %zu cases failed\n",
+              HParserBackendNames[i], br->failed_testcases, br->n_testcases);
+      continue;
+    }
+    fprintf(stream, "Backend %zd (%s), compiled in %.1f us ... \n", i, HParserBackendNames[i],
+            br->compile_time / 1e3);
+    for (size_t j=0; j<br->n_testcases; ++j) {
+      HCaseResult *cr = &br->cases[j];
+      fprintf(stream, "Case %zd: %zd ns/parse (median %zd, p99 %zd), %.2f MB/s, "
+              "arena %zd bytes used, %zd wasted, peak %zd bytes in %zd allocations\n",
+              j, cr->parse_time, cr->median_time, cr->p99_time, throughput(cr),
+              cr->arena_used, cr->arena_wasted, cr->peak_bytes, cr->allocs);
     }
   }
-  return ret;
 }
 
-void h_benchmark_report(FILE* stream, HBenchmarkResults* result) {
+static void report_json(FILE* stream, HBenchmarkResults* result) {
+  fprintf(stream, "{\"backends\": [");
+  for (size_t i=0; i<result->len; ++i) {
+    HBackendResults *br = &result->results[i];
+    fprintf(stream, "%s\n  {\"backend\": \"%s\", \"compiled\": %s, \"compile_ns\": %zu, "
+            "\"cases\": %zu, \"failed\": %zu, \"results\": [", i ? "," : "",
+            HParserBackendNames[i], br->compile_success ? "true" : "false",
+            br->compile_time, br->n_testcases, br->failed_testcases);
+    for (size_t j=0; br->cases && j<br->n_testcases; ++j) {
+      HCaseResult *cr = &br->cases[j];
+      fprintf(stream, "%s\n    {\"case\": %zu, \"length\": %zu, \"mean_ns\": %zu, "
+              "\"median_ns\": %zu, \"p99_ns\": %zu, \"samples\": %zu, \"mb_per_s\": %.3f, "
+              "\"arena_used\": %zu, \"arena_wasted\": %zu, \"peak_bytes\": %zu, "
+              "\"allocs\": %zu}", j ? "," : "",
+              j, cr->length, cr->parse_time, cr->median_time, cr->p99_time,
+              cr->n_samples, throughput(cr), cr->arena_used, cr->arena_wasted,
+              cr->peak_bytes, cr->allocs);
+    }
+    fprintf(stream, "]}");
+  }
+  fprintf(stream, "\n]}\n");
+}
+
+static void report_csv(FILE* stream, HBenchmarkResults* result) {
+  fprintf(stream, "backend,compiled,compile_ns,case,length,mean_ns,median_ns,p99_ns,"
+          "samples,mb_per_s,arena_used,arena_wasted,peak_bytes,allocs\n");
   for (size_t i=0; i<result->len; ++i) {
-    if (result->results[i].cases == NULL) {
-      fprintf(stream, "Skipping %s because grammar did not compile for it\n", HParserBackendNames[i]);
-    } else {
-      fprintf(stream, "Backend %zd (%s) ... \n", i, HParserBackendNames[i]);
+    HBackendResults *br = &result->results[i];
+    if (br->cases == NULL) {
+      // a row without the case columns, to record the compile time
+      fprintf(stream, "%s,%d,%zu,,,,,,,,,,,\n", HParserBackendNames[i],
+              br->compile_success, br->compile_time);
+      continue;
+    }
+    for (size_t j=0; j<br->n_testcases; ++j) {
+      HCaseResult *cr = &br->cases[j];
+      fprintf(stream, "%s,%d,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.3f,%zu,%zu,%zu,%zu\n",
+              HParserBackendNames[i], br->compile_success, br->compile_time, j,
+              cr->length, cr->parse_time, cr->median_time, cr->p99_time,
+              cr->n_samples, throughput(cr), cr->arena_used, cr->arena_wasted,
+              cr->peak_bytes, cr->allocs);
     }
-    for (size_t j=0; j<result->results[i].n_testcases; ++j) {
-      if (result->results[i].cases == NULL) {
+  }
+}
+
+void h_benchmark_report(FILE* stream, HBenchmarkResults* result) {
+  report_text(stream, result);
+}
+
+void h_benchmark_report_format(FILE* stream, HBenchmarkResults* result, HBenchmarkFormat format) {
+  switch (format) {
+  case H_BENCHMARK_JSON: report_json(stream, result); break;
+  case H_BENCHMARK_CSV:  report_csv(stream, result); break;
+  default:               report_text(stream, result); break;
+  }
+}
+
+void h_benchmark_dump_optimized_code(FILE* stream, HParser* parser, HBenchmarkResults* result) {
+  // Try the backends that passed all testcases, fastest first, until one
+  // of them can generate code. Backends fail before writing anything.
+  bool tried[PB_MAX+1] = {false};
+  for (;;) {
+    size_t best = result->len, best_time = 0;
+    for (size_t i=0; i<result->len; ++i) {
+      HBackendResults *br = &result->results[i];
+      if (br->cases == NULL || tried[i])
         continue;
+      size_t time = 0;
+      for (size_t j=0; j<br->n_testcases; ++j)
+        time += br->cases[j].parse_time;
+      if (best == result->len || time < best_time) {
+        best = i;
+        best_time = time;
       }
-      fprintf(stream, "Case %zd: %zd ns/parse, %zd ns/byte\n", j,  result->results[i].cases[j].parse_time, result->results[i].cases[j].parse_time / result->results[i].cases[j].length);
+    }
+    if (best == result->len) {
+      fprintf(stderr, "No backend can generate code for this parser\n");
+      return;
+    }
+    tried[best] = true;
+
+    HParserBackend backend = result->results[best].backend;
+    if (h_compile(parser, backend, NULL) == 0
+        && h_dump_code(stream, parser, "h_optimized") == 0) {
+      fprintf(stderr, "Generated code for %s\n", HParserBackendNames[backend]);
+      return;
     }
   }
 }
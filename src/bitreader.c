@@ -17,6 +17,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "internal.h"
 #include "hammer.h"
 #include "test_suite.h"
@@ -26,7 +28,125 @@
 #define LDB(range,i) (((i)>>LSB(range))&((1<<(MSB(range)-LSB(range)+1))-1))
 
 
+// the segment that holds byte i. reads mostly go forward, so try the last
+// segment and its successors before searching.
+static size_t iov_segment(HInputVector *iov, size_t i) {
+  size_t s = iov->hint;
+  if (i >= iov->offsets[s]) {
+    for (int tries = 0; tries < 4 && s < iov->n; tries++, s++) {
+      if (i < iov->offsets[s+1])
+        return iov->hint = s;
+    }
+  }
+  size_t lo = 0, hi = iov->n;   // offsets[lo] <= i < offsets[hi]
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (iov->offsets[mid] <= i)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  // skip empty segments
+  while (iov->offsets[lo+1] <= i)
+    lo++;
+  return iov->hint = lo;
+}
+
+uint8_t h_iov_byte(HInputVector *iov, size_t i) {
+  size_t s = iov_segment(iov, i);
+  return ((const uint8_t*)iov->iov[s].iov_base)[i - iov->offsets[s]];
+}
+
+void h_iov_copy(HInputVector *iov, uint8_t *dst, size_t i, size_t n) {
+  while (n > 0) {
+    size_t s = iov_segment(iov, i);
+    size_t len = iov->offsets[s+1] - i;
+    if (len > n)
+      len = n;
+    memcpy(dst, (const uint8_t*)iov->iov[s].iov_base + (i - iov->offsets[s]), len);
+    dst += len;
+    i += len;
+    n -= len;
+  }
+}
+
+// loads of 8 bytes, in either byte order, whatever the host's.
+#if defined(_MSC_VER)
+#define HOST_LITTLE_ENDIAN 1
+#define bswap64(x) _byteswap_uint64(x)
+#elif defined(__GNUC__) || defined(__clang__)
+#define HOST_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define bswap64(x) __builtin_bswap64(x)
+#endif
+
+static inline uint64_t load_be64(const uint8_t *p) {
+#ifdef bswap64
+  uint64_t w;
+  memcpy(&w, p, 8);
+  return HOST_LITTLE_ENDIAN ? bswap64(w) : w;
+#else
+  uint64_t w = 0;
+  for (int i = 0; i < 8; i++)
+    w = (w << 8) | p[i];
+  return w;
+#endif
+}
+
+static inline uint64_t load_le64(const uint8_t *p) {
+#ifdef bswap64
+  uint64_t w;
+  memcpy(&w, p, 8);
+  return HOST_LITTLE_ENDIAN ? w : bswap64(w);
+#else
+  uint64_t w = 0;
+  for (int i = 7; i >= 0; i--)
+    w = (w << 8) | p[i];
+  return w;
+#endif
+}
+
+// the next count bits at p, skipping the first bit_offset, as one big- or
+// little-endian number. p must have 9 readable bytes.
+static inline uint64_t read_window(const uint8_t *p, int bit_offset, int count, bool big_endian) {
+  if (count == 0)
+    return 0;
+  if (big_endian) {
+    // the next 64 bits, first bit at the top
+    uint64_t w = load_be64(p) << bit_offset;
+    if (bit_offset > 0)
+      w |= p[8] >> (8 - bit_offset);
+    return w >> (64 - count);
+  } else {
+    // the next 64 bits, first bit at the bottom
+    uint64_t w = load_le64(p) >> bit_offset;
+    if (bit_offset > 0)
+      w |= (uint64_t)p[8] << (64 - bit_offset);
+    return count == 64 ? w : w & ((UINT64_C(1) << count) - 1);
+  }
+}
+
+// whether the bits can be read as one number in the byte order of the input
+static inline bool single_order(const HInputStream *state, int count) {
+  if (state->margin != 0)
+    return false;
+  if (state->bit_offset == 0 && (count & 0x7) == 0)
+    return true;
+  return !(state->endianness & BYTE_BIG_ENDIAN) == !(state->endianness & BIT_BIG_ENDIAN);
+}
+
 int64_t h_read_bits(HInputStream* state, int count, char signed_p) {
+  if (state->input && state->length - state->index >= 9 && count > 0 && single_order(state, count)) {
+    // the common case: well clear of the end, and no need to assemble the
+    // result from pieces.
+    uint64_t v = read_window(state->input + state->index, state->bit_offset, count,
+                             state->endianness & BYTE_BIG_ENDIAN);
+    state->index += (state->bit_offset + count) / 8;
+    state->bit_offset = (state->bit_offset + count) % 8;
+    if (signed_p && count < 64 && (v >> (count - 1)))
+      v |= ~UINT64_C(0) << count;  // sign extension
+    return (int64_t)v;
+  }
+
   // BUG: Does not 
   int64_t out = 0;
   int offset = 0;
@@ -47,24 +167,49 @@ int64_t h_read_bits(HInputStream* state, int count, char signed_p) {
 	final_shift = 0;
       count = bits_left;
       state->overrun = true;
+      h_limit_end(state);
     } else
       final_shift = 0;
   }
-  
-  if ((state->bit_offset & 0x7) == 0 && (count & 0x7) == 0 && (state->margin == 0)) {
-    // fast path
-    if (state->endianness & BYTE_BIG_ENDIAN) {
-      while (count > 0) {
-	count -= 8;
-	out = (out << 8) | state->input[state->index++];
-      }
+
+  // in[i - base] is byte i of the input, and avail bytes can be read from
+  // in at the current position. a scattered input is read in place while
+  // the read stays within a segment, and gathered into buf otherwise.
+  const uint8_t *in = state->input;
+  size_t base = 0;
+  size_t avail = state->length - state->index;
+  uint8_t buf[16];
+  if (!in && count > 0) {
+    size_t n = (state->bit_offset + state->margin + count + 7) / 8;
+    if (n > state->length - state->index)
+      n = state->length - state->index;
+    size_t s = iov_segment(state->iov, state->index);
+    base = state->iov->offsets[s];
+    if (state->index + n <= state->iov->offsets[s+1]) {
+      in = state->iov->iov[s].iov_base;
+      avail = state->iov->offsets[s+1] - state->index;
     } else {
-      int i;
-      for (i = 0; count > 0; i += 8) {
-	count -= 8;
-	out |= (int64_t)state->input[state->index++] << i;
-      }
+      h_iov_copy(state->iov, buf, state->index, n);
+      in = buf;
+      base = state->index;
+      avail = n;
+    }
+  }
+#define input(i) in[(i) - base]
+
+  if (single_order(state, count)) {
+    // as above, but near the end of the input, or scattered; the window
+    // comes from a zero-padded copy if need be.
+    const uint8_t *p = count > 0 ? &input(state->index) : buf;
+    uint8_t tail[9];
+    if (avail < 9 && count > 0) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p, avail);
+      p = tail;
     }
+    out = read_window(p, state->bit_offset, count, state->endianness & BYTE_BIG_ENDIAN);
+    state->index += (state->bit_offset + count) / 8;
+    state->bit_offset = (state->bit_offset + count) % 8;
   } else {
     while (count) {
       int segment, segment_len;
@@ -72,25 +217,25 @@ int64_t h_read_bits(HInputStream* state, int count, char signed_p) {
       if (state->endianness & BIT_BIG_ENDIAN) {
 	if (count + state->bit_offset + state->margin >= 8) {
 	  segment_len = 8 - state->bit_offset - state->margin;
-	  segment = (state->input[state->index] >> state->margin) & ((1 << segment_len) - 1);
+	  segment = (input(state->index) >> state->margin) & ((1 << segment_len) - 1);
 	  state->index++;
 	  state->bit_offset = 0;
 	  state->margin = 0;
 	} else {
 	  segment_len = count;
 	  state->bit_offset += count;
-	  segment = (state->input[state->index] >> (8 - state->bit_offset)) & ((1 << segment_len) - 1);
+	  segment = (input(state->index) >> (8 - state->bit_offset)) & ((1 << segment_len) - 1);
 	}
       } else { // BIT_LITTLE_ENDIAN
 	if (count + state->bit_offset + state->margin >= 8) {
 	  segment_len = 8 - state->bit_offset - state->margin;
-	  segment = (state->input[state->index] >> state->bit_offset) & ((1 << segment_len) - 1);
+	  segment = (input(state->index) >> state->bit_offset) & ((1 << segment_len) - 1);
 	  state->index++;
 	  state->bit_offset = 0;
 	  state->margin = 0;
 	} else {
 	  segment_len = count;
-	  segment = (state->input[state->index] >> state->bit_offset) & ((1 << segment_len) - 1);
+	  segment = (input(state->index) >> state->bit_offset) & ((1 << segment_len) - 1);
 	  state->bit_offset += segment_len;
 	}
       }
@@ -105,6 +250,7 @@ int64_t h_read_bits(HInputStream* state, int count, char signed_p) {
       count -= segment_len;
     }
   }
+#undef input
   out <<= final_shift;
   return (out ^ msb) - msb; // perform sign extension
 }
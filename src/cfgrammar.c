@@ -23,6 +23,8 @@ HCFGrammar *h_cfgrammar_new(HAllocator *mm__)
   g->first  = NULL;
   g->follow = NULL;
   g->kmax   = 0;    // will be increased as needed by ensure_k
+  g->first1 = NULL;
+  g->follow1 = NULL;
 
   HStringMap *eps = h_stringmap_new(g->arena);
   h_stringmap_put_epsilon(eps, INSET);
@@ -31,6 +33,20 @@ HCFGrammar *h_cfgrammar_new(HAllocator *mm__)
   return g;
 }
 
+HCFGrammar *h_cfgrammar_fork(const HCFGrammar *g)
+{
+  HCFGrammar *f = h_cfgrammar_new(g->mm__);
+
+  // NB: nts and geneps live in g's arena; they are read-only from here on.
+  f->start  = g->start;
+  f->nts    = g->nts;
+  f->geneps = g->geneps;
+  f->first1 = g->first1;
+  f->follow1 = g->follow1;
+
+  return f;
+}
+
 void h_cfgrammar_free(HCFGrammar *g)
 {
   HAllocator *mm__ = g->mm__;
@@ -77,6 +93,7 @@ HCFGrammar *h_cfgrammar_(HAllocator* mm__, HCFChoice *desugared)
     nt->pred = NULL;
     nt->action = NULL;
     nt->reshape = h_act_first;
+    nt->parser = NULL;
     h_hashset_put(g->nts, nt);
     g->start = nt;
   } else {
@@ -193,6 +210,23 @@ bool h_derives_epsilon_seq(HCFGrammar *g, HCFChoice **s)
   return true;
 }
 
+bool h_cfgrammar_has_preds(const HCFGrammar *g)
+{
+  size_t i;
+  HHashTableEntry *hte;
+  for (i=0; i < g->nts->capacity; i++) {
+    for (hte = &g->nts->contents[i]; hte; hte = hte->next) {
+      if (hte->key == NULL) {
+        continue;
+      }
+      if (((const HCFChoice *)hte->key)->pred) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 /* Populate the geneps member of g; no-op if called multiple times. */
 static void collect_geneps(HCFGrammar *g)
 {
@@ -238,7 +272,10 @@ HStringMap *h_stringmap_new(HArena *a)
   HStringMap *m = h_arena_malloc(a, sizeof(HStringMap));
   m->epsilon_branch = NULL;
   m->end_branch = NULL;
-  m->char_branches = h_hashtable_new(a, h_eq_ptr, h_hash_ptr);
+  m->chars = NULL;
+  m->branches = NULL;
+  m->nbranches = 0;
+  m->capacity = 0;
   m->arena = a;
   return m;
 }
@@ -255,7 +292,60 @@ void h_stringmap_put_epsilon(HStringMap *m, void *v)
 
 void h_stringmap_put_after(HStringMap *m, uint8_t c, HStringMap *ends)
 {
-  h_hashtable_put(m->char_branches, (void *)char_key(c), ends);
+  assert(ends != NULL);
+
+  if (m->chars == NULL && m->nbranches > 0) {   // dense
+    if (!m->branches[c]) {
+      m->nbranches++;
+    }
+    m->branches[c] = ends;
+    return;
+  }
+
+  // find the position of c; appending is the common case
+  size_t i = m->nbranches;
+  if (i > 0 && m->chars[i-1] >= c) {
+    for (i=0; m->chars[i] < c; i++);
+    if (m->chars[i] == c) {
+      m->branches[i] = ends;
+      return;
+    }
+  }
+
+  if (m->nbranches == H_STRINGMAP_SPARSE) {
+    // switch to a direct table
+    HStringMap **branches = h_arena_malloc(m->arena, 256 * sizeof(HStringMap *));
+    memset(branches, 0, 256 * sizeof(HStringMap *));
+    for (size_t j=0; j < m->nbranches; j++) {
+      branches[m->chars[j]] = m->branches[j];
+    }
+    branches[c] = ends;
+    m->chars = NULL;
+    m->branches = branches;
+    m->capacity = 256;
+    m->nbranches++;
+    return;
+  }
+
+  if (m->nbranches == m->capacity) {
+    size_t cap = m->capacity ? 2 * m->capacity : 4;
+    uint8_t *chars = h_arena_malloc(m->arena, cap);
+    HStringMap **branches = h_arena_malloc(m->arena, cap * sizeof(HStringMap *));
+    if (m->nbranches > 0) {
+      memcpy(chars, m->chars, m->nbranches);
+      memcpy(branches, m->branches, m->nbranches * sizeof(HStringMap *));
+    }
+    m->chars = chars;
+    m->branches = branches;
+    m->capacity = cap;
+  }
+
+  memmove(m->chars + i + 1, m->chars + i, m->nbranches - i);
+  memmove(m->branches + i + 1, m->branches + i,
+          (m->nbranches - i) * sizeof(HStringMap *));
+  m->chars[i] = c;
+  m->branches[i] = ends;
+  m->nbranches++;
 }
 
 void h_stringmap_put_char(HStringMap *m, uint8_t c, void *v)
@@ -265,19 +355,6 @@ void h_stringmap_put_char(HStringMap *m, uint8_t c, void *v)
   h_stringmap_put_after(m, c, node);
 }
 
-// helper for h_stringmap_update
-static void *combine_stringmap(void *v1, const void *v2)
-{
-  HStringMap *m1 = v1;
-  const HStringMap *m2 = v2;
-  if (!m1) {
-    m1 = h_stringmap_new(m2->arena);
-  }
-  h_stringmap_update(m1, m2);
-
-  return m1;
-}
-
 /* Note: Does *not* reuse submaps from n in building m. */
 void h_stringmap_update(HStringMap *m, const HStringMap *n)
 {
@@ -287,7 +364,19 @@ void h_stringmap_update(HStringMap *m, const HStringMap *n)
   if (n->end_branch) {
     m->end_branch = n->end_branch;
   }
-  h_hashtable_merge(combine_stringmap, m->char_branches, n->char_branches);
+
+  // NB: new submaps go into m's arena, which need not be n's.
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *n_;
+  while ((n_ = h_stringmap_next_branch(n, &i, &c))) {
+    HStringMap *m_ = h_stringmap_get_char(m, c);
+    if (!m_) {
+      m_ = h_stringmap_new(m->arena);
+      h_stringmap_put_after(m, c, m_);
+    }
+    h_stringmap_update(m_, n_);
+  }
 }
 
 HStringMap *h_stringmap_copy(HArena *a, const HStringMap *m)
@@ -319,19 +408,12 @@ void h_stringmap_replace(HStringMap *m, void *old, void *new)
     }
   }
 
-  // iterate over m->char_branches
-  const HHashTable *ht = m->char_branches;
-  for (size_t i=0; i < ht->capacity; i++) {
-    for (HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
-      if (hte->key == NULL) {
-        continue;
-      }
-
-      HStringMap *m_ = hte->value;
-      if (m_) {
-        h_stringmap_replace(m_, old, new);
-      }
-    }
+  // iterate over the branches of m
+  size_t i = 0;
+  uint8_t c;
+  HStringMap *m_;
+  while ((m_ = h_stringmap_next_branch(m, &i, &c))) {
+    h_stringmap_replace(m_, old, new);
   }
 }
 
@@ -361,7 +443,7 @@ void *h_stringmap_get_lookahead(const HStringMap *m, HInputStream lookahead)
 
     // note the lookahead stream is passed by value, i.e. a copy.
     // reading bits from it does not consume them from the real input.
-    uint8_t c = h_read_bits(&lookahead, 8, false);
+    uint8_t c = h_read_byte(&lookahead);
     
     if (lookahead.overrun) {        // end of chunk
       if (lookahead.last_chunk) {   // end of input
@@ -393,9 +475,211 @@ bool h_stringmap_empty(const HStringMap *m)
 {
   return (m->epsilon_branch == NULL
           && m->end_branch == NULL
-          && h_hashtable_empty(m->char_branches));
+          && m->nbranches == 0);
+}
+
+/* Bitset representation of first_1 and follow_1 */
+
+static inline void termset_add(HTermSet *s, unsigned int x)
+{
+  s->w[x / 64] |= (uint64_t)1 << (x % 64);
+}
+
+static inline bool termset_has(const HTermSet *s, unsigned int x)
+{
+  return (s->w[x / 64] >> (x % 64)) & 1;
+}
+
+// add the elements of t, except "", to s. returns whether s changed.
+static inline bool termset_union(HTermSet *s, const HTermSet *t)
+{
+  static const uint64_t eps = (uint64_t)1 << (H_TERMSET_EPSILON % 64);
+  uint64_t changed = 0;
+  for (size_t i=0; i<5; i++) {
+    uint64_t w = t->w[i];
+    if (i == H_TERMSET_EPSILON / 64) {
+      w &= ~eps;
+    }
+    changed |= w & ~s->w[i];
+    s->w[i] |= w;
+  }
+  return (changed != 0);
+}
+
+// the number of NT x in g, or NOT_NT if x is not a NT of g
+#define NOT_NT ((size_t)-1)
+static inline size_t nt_number(const HCFGrammar *g, const HCFChoice *x)
+{
+  if (x->type != HCF_CHOICE || !h_hashset_present(g->nts, x)) {
+    return NOT_NT;
+  }
+  return (uintptr_t)h_hashtable_get(g->nts, x);
+}
+
+// add first_1(x) to s. first gives the (current) sets of the NTs.
+static void termset_add_first(const HCFGrammar *g, const HTermSet *first,
+                              HTermSet *s, const HCFChoice *x)
+{
+  const unsigned int bits = sizeof(*x->charset) * 8;
+
+  switch(x->type) {
+  case HCF_END:
+    termset_add(s, H_TERMSET_END);
+    break;
+  case HCF_CHAR:
+    termset_add(s, x->chr);
+    break;
+  case HCF_CHARSET:
+    for (unsigned int i=0; i < 256 / bits; i++) {
+      s->w[i * bits / 64] |= (uint64_t)x->charset[i] << (i * bits % 64);
+    }
+    break;
+  default:  // HCF_CHOICE
+    termset_union(s, &first[nt_number(g, x)]);
+  }
+}
+
+// add first_1(x_1 ... x_n) to s, where x_1 ... x_n = seq.
+// returns whether s changed.
+static bool termset_add_first_seq(const HCFGrammar *g, const HTermSet *first,
+                                  HTermSet *s, HCFChoice **seq)
+{
+  HTermSet t = {{0}};
+  for (; *seq; seq++) {
+    termset_add_first(g, first, &t, *seq);
+    if (!h_derives_epsilon((HCFGrammar *)g, *seq)) {
+      break;
+    }
+  }
+  bool changed = termset_union(s, &t);
+  if (*seq == NULL && !termset_has(s, H_TERMSET_EPSILON)) {
+    termset_add(s, H_TERMSET_EPSILON);
+    changed = true;
+  }
+  return changed;
+}
+
+// walk the rhs of a production backwards, adding to the follow set of each
+// symbol occurrence what can follow it there. if x is NULL, this is done for
+// all NTs, into follow; otherwise only for x, into s. a is the number of the
+// production's lhs. returns whether any set changed.
+static bool termset_follow_rhs(const HCFGrammar *g, HCFChoice **items, size_t a,
+                               const HCFChoice *x, HTermSet *s, HTermSet *follow)
+{
+  bool changed = false;
+  size_t n = 0;
+  while (items[n]) {
+    n++;
+  }
+
+  // tail = first_1(items[j+1..n-1])
+  HTermSet tail = {{0}};
+  termset_add(&tail, H_TERMSET_EPSILON);
+  for (size_t j=n; j-- > 0; ) {
+    const HCFChoice *y = items[j];
+    HTermSet *fy = NULL;
+    if (x == NULL) {
+      size_t i = nt_number(g, y);
+      fy = (i == NOT_NT) ? NULL : &follow[i];
+    } else if (y == x) {
+      fy = s;
+    }
+    if (fy) {
+      changed |= termset_union(fy, &tail);
+      if (termset_has(&tail, H_TERMSET_EPSILON)) {
+        changed |= termset_union(fy, &follow[a]);
+      }
+    }
+
+    if (!h_derives_epsilon((HCFGrammar *)g, y)) {
+      memset(&tail, 0, sizeof(HTermSet));
+    }
+    termset_add_first(g, g->first1, &tail, y);
+  }
+
+  return changed;
 }
 
+/* Compute first_1 and follow_1 of all NTs; no-op if called multiple times.
+ * Unlike the general (k>1) case, this iterates to the fixpoint, so the sets
+ * are complete also for recursive NTs.
+ */
+static void collect_sets1(HCFGrammar *g)
+{
+  if (g->first1 != NULL) {
+    return;
+  }
+
+  size_t n = g->nts->used;
+  const HCFChoice **nts = h_arena_malloc(g->arena, n * sizeof(HCFChoice *));
+  size_t i;
+  HHashTableEntry *hte;
+  for (i=0; i < g->nts->capacity; i++) {
+    for (hte = &g->nts->contents[i]; hte; hte = hte->next) {
+      if (hte->key == NULL) {
+        continue;
+      }
+      nts[(uintptr_t)hte->value] = hte->key;
+    }
+  }
+
+  HTermSet *first = h_arena_malloc(g->arena, n * sizeof(HTermSet));
+  HTermSet *follow = h_arena_malloc(g->arena, n * sizeof(HTermSet));
+  memset(first, 0, n * sizeof(HTermSet));
+  memset(follow, 0, n * sizeof(HTermSet));
+
+  bool changed;
+  do {
+    changed = false;
+    for (i=0; i<n; i++) {
+      for (HCFSequence **p = nts[i]->seq; *p; p++) {
+        changed |= termset_add_first_seq(g, first, &first[i], (*p)->items);
+      }
+    }
+  } while (changed);
+  g->first1 = first;
+
+  termset_add(&follow[nt_number(g, g->start)], H_TERMSET_END);
+  do {
+    changed = false;
+    for (i=0; i<n; i++) {
+      for (HCFSequence **p = nts[i]->seq; *p; p++) {
+        changed |= termset_follow_rhs(g, (*p)->items, i, NULL, NULL, follow);
+      }
+    }
+  } while (changed);
+  g->follow1 = follow;
+}
+
+// does s contain an NT that is not in g?
+static bool any_foreign_nt(const HCFGrammar *g, HCFChoice **s)
+{
+  for (; *s; s++) {
+    if (nt_number(g, *s) == NOT_NT && (*s)->type == HCF_CHOICE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void stringmap_put_termset(HStringMap *m, const HTermSet *s)
+{
+  if (termset_has(s, H_TERMSET_EPSILON)) {
+    h_stringmap_put_epsilon(m, INSET);
+  }
+  if (termset_has(s, H_TERMSET_END)) {
+    h_stringmap_put_end(m, INSET);
+  }
+  for (unsigned int c=0; c<256; c++) {
+    if (s->w[c / 64] == 0) {
+      c += 63;      // skip empty word
+    } else if (termset_has(s, c)) {
+      h_stringmap_put_char(m, c, INSET);
+    }
+  }
+}
+
+
 const HStringMap *h_first(size_t k, HCFGrammar *g, const HCFChoice *x)
 {
   HStringMap *ret;
@@ -416,6 +700,15 @@ const HStringMap *h_first(size_t k, HCFGrammar *g, const HCFChoice *x)
   assert(ret != NULL);
   h_hashtable_put(g->first[k], x, ret);
 
+  // fast path: k=1 via bitsets
+  if (k == 1 && (x->type != HCF_CHOICE || nt_number(g, x) != NOT_NT)) {
+    collect_sets1(g);
+    HTermSet set = {{0}};
+    termset_add_first(g, g->first1, &set, x);
+    stringmap_put_termset(ret, &set);
+    return ret;
+  }
+
   switch(x->type) {
   case HCF_END:
     h_stringmap_put_end(ret, INSET);
@@ -462,6 +755,16 @@ const HStringMap *h_first_seq(size_t k, HCFGrammar *g, HCFChoice **s)
   if (*s == NULL) {
     return g->singleton_epsilon;
   }
+  // fast path: k=1 via bitsets
+  if (k == 1 && s[1] != NULL && !any_foreign_nt(g, s)) {
+    collect_sets1(g);
+    HTermSet set = {{0}};
+    termset_add_first_seq(g, g->first1, &set, s);
+    HStringMap *ret = h_stringmap_new(g->arena);
+    stringmap_put_termset(ret, &set);
+    return ret;
+  }
+
   // first_k(X tail) = { a b | a <- first_k(X), b <- first_l(tail), l=k-|a| }
 
   HCFChoice *x = s[0];
@@ -492,7 +795,7 @@ static bool is_singleton_epsilon(const HStringMap *m)
 {
   return ( m->epsilon_branch
            && !m->end_branch
-           && h_hashtable_empty(m->char_branches) );
+           && m->nbranches == 0 );
 }
 
 static bool any_string_shorter(size_t k, const HStringMap *m)
@@ -503,19 +806,14 @@ static bool any_string_shorter(size_t k, const HStringMap *m)
   if (m->epsilon_branch) {
     return true;
   }
-  // iterate over m->char_branches
-  const HHashTable *ht = m->char_branches;
-  for (size_t i=0; i < ht->capacity; i++) {
-    for (HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
-      if (hte->key == NULL) {
-        continue;
-      }
-      HStringMap *m_ = hte->value;
-
-      // check subtree for strings shorter than k-1
-      if (any_string_shorter(k-1, m_)) {
-        return true;
-      }
+  // iterate over the branches of m
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *m_;
+  while ((m_ = h_stringmap_next_branch(m, &i, &c))) {
+    // check subtree for strings shorter than k-1
+    if (any_string_shorter(k-1, m_)) {
+      return true;
     }
   }
 
@@ -533,15 +831,12 @@ static void remove_all_shorter(size_t k, HStringMap *m)
     return;
   }
 
-  // iterate over m->char_branches
-  const HHashTable *ht = m->char_branches;
-  for (size_t i=0; i < ht->capacity; i++) {
-    for (HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
-      if (hte->key == NULL) {
-        continue;
-      }
-      remove_all_shorter(k-1, hte->value);      // recursion into subtree
-    }
+  // iterate over the branches of m
+  size_t i = 0;
+  uint8_t c;
+  HStringMap *m_;
+  while ((m_ = h_stringmap_next_branch(m, &i, &c))) {
+    remove_all_shorter(k-1, m_);        // recursion into subtree
   }
 }
 
@@ -579,6 +874,36 @@ const HStringMap *h_follow(size_t k, HCFGrammar *g, const HCFChoice *x)
   assert(ret != NULL);
   h_hashtable_put(g->follow[k], x, ret);
 
+  // fast path: k=1 via bitsets
+  if (k == 1) {
+    collect_sets1(g);
+    size_t i = nt_number(g, x);
+    if (i != NOT_NT) {
+      stringmap_put_termset(ret, &g->follow1[i]);
+    } else {
+      // not a NT, so not covered by g->follow1; go through its occurances
+      HTermSet set = {{0}};
+      if (x == g->start) {
+        termset_add(&set, H_TERMSET_END);
+      }
+      HHashTableEntry *hte;
+      for (i=0; i < g->nts->capacity; i++) {
+        for (hte = &g->nts->contents[i]; hte; hte = hte->next) {
+          if (hte->key == NULL) {
+            continue;
+          }
+          const HCFChoice *a = hte->key;
+          for (HCFSequence **p = a->seq; *p; p++) {
+            termset_follow_rhs(g, (*p)->items, (uintptr_t)hte->value,
+                               x, &set, g->follow1);
+          }
+        }
+      }
+      stringmap_put_termset(ret, &set);
+    }
+    return ret;
+  }
+
   // if X is the start symbol, the end token is in its follow set
   if (x == g->start) {
     h_stringmap_put_end(ret, INSET);
@@ -621,6 +946,20 @@ HStringMap *h_predict(size_t k, HCFGrammar *g,
 {
   HStringMap *ret = h_stringmap_new(g->arena);
 
+  // fast path: k=1 via bitsets
+  size_t a = nt_number(g, A);
+  if (k == 1 && a != NOT_NT && !any_foreign_nt(g, rhs->items)) {
+    collect_sets1(g);
+    HTermSet set = {{0}};
+    termset_add_first_seq(g, g->first1, &set, rhs->items);
+    if (termset_has(&set, H_TERMSET_EPSILON)) {
+      termset_union(&set, &g->follow1[a]);
+      set.w[H_TERMSET_EPSILON / 64] &= ~((uint64_t)1 << (H_TERMSET_EPSILON % 64));
+    }
+    stringmap_put_termset(ret, &set);
+    return ret;
+  }
+
   // predict_k(A -> rhs) =
   //   { ab | a <- first_k(rhs), b <- follow_k(A), |ab|=k }
   
@@ -653,26 +992,19 @@ static void stringset_extend(HCFGrammar *g, HStringMap *ret,
     h_stringmap_put_end(ret, INSET);
   }
 
-  // iterate over as->char_branches
-  const HHashTable *ht = as->char_branches;
-  for(size_t i=0; i < ht->capacity; i++) {
-    for(HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
-      if (hte->key == NULL) {
-        continue;
-      }
-      uint8_t c = key_char((HCharKey)hte->key);
-      
-      // follow the branch to find the set { a' | t a' <- as }
-      HStringMap *as_ = (HStringMap *)hte->value;
-
-      // now the elements of ret that begin with t are given by
-      // t { a b | a <- as_, b <- f_l(tail), l=k-|a|-1 }
-      // so we can use recursion over k
-      HStringMap *ret_ = h_stringmap_new(g->arena);
-      h_stringmap_put_after(ret, c, ret_);
-
-      stringset_extend(g, ret_, k-1, as_, f, tail);
-    }
+  // iterate over the branches of as
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *as_;
+  while ((as_ = h_stringmap_next_branch(as, &i, &c))) {
+    // as_ is the set { a' | t a' <- as } where t=c.
+    // now the elements of ret that begin with t are given by
+    // t { a b | a <- as_, b <- f_l(tail), l=k-|a|-1 }
+    // so we can use recursion over k
+    HStringMap *ret_ = h_stringmap_new(g->arena);
+    h_stringmap_put_after(ret, c, ret_);
+
+    stringset_extend(g, ret_, k-1, as_, f, tail);
   }
 }
 
@@ -937,38 +1269,30 @@ pprint_stringmap_elems(FILE *file, bool first, char *prefix, size_t n, char sep,
     }
   }
 
-  // iterate over map->char_branches
-  HHashTable *ht = map->char_branches;
-  size_t i;
-  HHashTableEntry *hte;
-  for(i=0; i < ht->capacity; i++) {
-    for(hte = &ht->contents[i]; hte; hte = hte->next) {
-      if (hte->key == NULL) {
-        continue;
-      }
-      uint8_t c = key_char((HCharKey)hte->key);
-      HStringMap *ends = hte->value;
-
-      size_t n_ = n;
-      switch(c) {
-      case '$':  prefix[n_++] = '\\'; prefix[n_++] = '$'; break;
-      case '"':  prefix[n_++] = '\\'; prefix[n_++] = '"'; break;
-      case '\\': prefix[n_++] = '\\'; prefix[n_++] = '\\'; break;
-      case '\b': prefix[n_++] = '\\'; prefix[n_++] = 'b'; break;
-      case '\t': prefix[n_++] = '\\'; prefix[n_++] = 't'; break;
-      case '\n': prefix[n_++] = '\\'; prefix[n_++] = 'n'; break;
-      case '\r': prefix[n_++] = '\\'; prefix[n_++] = 'r'; break;
-      default:
-        if (isprint(c)) {
-          prefix[n_++] = c;
-	} else {
-          n_ += sprintf(prefix+n_, "\\x%.2X", c);
-	}
+  // iterate over the branches of map
+  size_t i = 0;
+  uint8_t c;
+  const HStringMap *ends;
+  while ((ends = h_stringmap_next_branch(map, &i, &c))) {
+    size_t n_ = n;
+    switch(c) {
+    case '$':  prefix[n_++] = '\\'; prefix[n_++] = '$'; break;
+    case '"':  prefix[n_++] = '\\'; prefix[n_++] = '"'; break;
+    case '\\': prefix[n_++] = '\\'; prefix[n_++] = '\\'; break;
+    case '\b': prefix[n_++] = '\\'; prefix[n_++] = 'b'; break;
+    case '\t': prefix[n_++] = '\\'; prefix[n_++] = 't'; break;
+    case '\n': prefix[n_++] = '\\'; prefix[n_++] = 'n'; break;
+    case '\r': prefix[n_++] = '\\'; prefix[n_++] = 'r'; break;
+    default:
+      if (isprint(c)) {
+        prefix[n_++] = c;
+      } else {
+        n_ += sprintf(prefix+n_, "\\x%.2X", c);
       }
-
-      first = pprint_stringmap_elems(file, first, prefix, n_,
-                                     sep, valprint, env, ends);
     }
+
+    first = pprint_stringmap_elems(file, first, prefix, n_,
+                                   sep, valprint, env, ends);
   }
 
   return first;
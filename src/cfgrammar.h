@@ -3,6 +3,18 @@
 #include "internal.h"
 
 
+/* Sets of strings of length at most 1 over the input characters and the end
+ * token ($), as bitsets. Used to compute first_1 and follow_1 sets, the
+ * common case, without going through HStringMaps; see h_first and h_follow.
+ */
+#define H_TERMSET_END     256
+#define H_TERMSET_EPSILON 257
+
+typedef struct HTermSet_ {
+  uint64_t w[5];        // bits 0-255: characters, then $ and ""
+} HTermSet;
+
+
 typedef struct HCFGrammar_ {
   HCFChoice   *start;   // start symbol (nonterminal)
   HHashSet    *nts;     // HCFChoices, each representing the alternative
@@ -11,6 +23,9 @@ typedef struct HCFGrammar_ {
   HHashTable  **first;  // memoized first sets of the grammar's symbols
   HHashTable  **follow; // memoized follow sets of the grammar's NTs
   size_t      kmax;     // maximum lookahead depth allocated
+  HTermSet    *first1;  // first_1 sets of the NTs, indexed by NT number
+  HTermSet    *follow1; // follow_1 sets of the NTs, indexed by NT number
+                        // (both NULL until needed)
   HArena      *arena;
   HAllocator  *mm__;
 
@@ -28,14 +43,22 @@ static inline HCharKey char_key(uint8_t c) { return (0x100 | c); }
 static inline uint8_t key_char(HCharKey k) { return (0xFF & k); }
 
 /* Mapping strings of input tokens to arbitrary values (or serving as a set).
- * Common prefixes are folded into a tree of HHashTables, branches labeled with
- * input tokens.
+ * Common prefixes are folded into a tree, branches labeled with input tokens.
  * Each path through the tree represents the string along its branches.
+ *
+ * A node with few branches keeps their labels sorted in 'chars', parallel to
+ * 'branches'. Above H_STRINGMAP_SPARSE branches, chars is NULL and branches
+ * becomes a table indexed directly by input token.
  */
+#define H_STRINGMAP_SPARSE 32
+
 typedef struct HStringMap_ {
   void *epsilon_branch;         // points to leaf value
   void *end_branch;             // points to leaf value
-  HHashTable *char_branches;    // maps to inner nodes (HStringMaps)
+  uint8_t *chars;               // labels of the branches, sorted; NULL if dense
+  struct HStringMap_ **branches;// inner nodes (HStringMaps)
+  uint16_t nbranches;           // number of branches
+  uint16_t capacity;            // allocated size of chars and branches
   HArena *arena;
 } HStringMap;
 
@@ -54,7 +77,49 @@ bool h_stringmap_present_epsilon(const HStringMap *m);
 bool h_stringmap_empty(const HStringMap *m);
 
 static inline HStringMap *h_stringmap_get_char(const HStringMap *m, const uint8_t c)
- { return h_hashtable_get(m->char_branches, (void *)char_key(c)); }
+{
+  if (m->chars == NULL) {
+    return m->nbranches ? m->branches[c] : NULL;
+  }
+  // binary search
+  size_t lo = 0, hi = m->nbranches;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (m->chars[mid] < c) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < m->nbranches && m->chars[lo] == c) ? m->branches[lo] : NULL;
+}
+
+/* Iterate over the branches of m in ascending order of their labels:
+ *
+ *   size_t i = 0; uint8_t c; HStringMap *n;
+ *   while ((n = h_stringmap_next_branch(m, &i, &c))) { ... }
+ */
+static inline HStringMap *h_stringmap_next_branch(const HStringMap *m, size_t *i,
+                                                  uint8_t *c)
+{
+  if (m->chars == NULL) {
+    if (m->nbranches == 0) {
+      return NULL;
+    }
+    for (; *i < 256; (*i)++) {
+      if (m->branches[*i]) {
+        *c = *i;
+        return m->branches[(*i)++];
+      }
+    }
+    return NULL;
+  }
+  if (*i >= m->nbranches) {
+    return NULL;
+  }
+  *c = m->chars[*i];
+  return m->branches[(*i)++];
+}
 
 // dummy return value used by h_stringmap_get_lookahead when out of input
 #define NEED_INPUT ((void *)-1)
@@ -69,6 +134,14 @@ HCFGrammar *h_cfgrammar_(HAllocator* mm__, HCFChoice *start);
 
 HCFGrammar *h_cfgrammar_new(HAllocator *mm__);
 
+/* Create a view of g with its own arena and (empty) first/follow memo tables.
+ * The fork shares the nonterminals of g, and first_1/follow_1 sets if already
+ * computed; g must outlive it. Used to run
+ * the first/follow computations on several threads at once, each with its
+ * own fork; g itself must not be used concurrently.
+ */
+HCFGrammar *h_cfgrammar_fork(const HCFGrammar *g);
+
 /* Frees the given grammar and associated data.
  * Does *not* free parsers' CFG forms as created by h_desugar.
  */
@@ -80,6 +153,9 @@ bool h_derives_epsilon(HCFGrammar *g, const HCFChoice *symbol);
 /* Does the sentential form s derive the empty string? s NULL-terminated. */
 bool h_derives_epsilon_seq(HCFGrammar *g, HCFChoice **s);
 
+/* Does any nonterminal of g have a validation (h_attr_bool)? */
+bool h_cfgrammar_has_preds(const HCFGrammar *g);
+
 /* Compute first_k set of symbol x. Memoized. */
 const HStringMap *h_first(size_t k, HCFGrammar *g, const HCFChoice *x);
 
@@ -0,0 +1,219 @@
+/* Helpers for emitting compiled parsers as C source */
+
+#include <assert.h>
+#include <ctype.h>
+#include "cfgrammar.h"
+#include "codegen.h"
+
+
+/* Symbol numbering */
+
+static void number_symbols(HCGSymbols *s, size_t *cap, HCFChoice *x)
+{
+  if(x == NULL || h_hashtable_present(s->ids, x))
+    return;
+
+  if(s->n == *cap) {
+    HCFChoice **syms = h_arena_malloc(s->arena, 2 * *cap * sizeof(HCFChoice *));
+    memcpy(syms, s->syms, s->n * sizeof(HCFChoice *));
+    s->syms = syms;
+    *cap *= 2;
+  }
+  s->syms[s->n++] = x;
+  h_hashtable_put(s->ids, x, (void *)(uintptr_t)s->n);
+
+  if(x->type == HCF_CHOICE) {
+    for(HCFSequence **p = x->seq; *p; p++) {
+      for(HCFChoice **y = (*p)->items; *y; y++)
+        number_symbols(s, cap, *y);
+    }
+  }
+}
+
+HCGSymbols *h_cg_symbols(HArena *arena, HCFChoice *root)
+{
+  HCGSymbols *s = h_arena_malloc(arena, sizeof(HCGSymbols));
+  size_t cap = 16;
+
+  s->arena = arena;
+  s->ids = h_hashtable_new(arena, h_eq_ptr, h_hash_ptr);
+  s->syms = h_arena_malloc(arena, cap * sizeof(HCFChoice *));
+  s->n = 0;
+  number_symbols(s, &cap, root);
+
+  return s;
+}
+
+size_t h_cg_symbol_id(const HCGSymbols *s, const HCFChoice *x)
+{
+  uintptr_t id = (uintptr_t)h_hashtable_get(s->ids, x);
+  return id ? id - 1 : H_CG_NOSYM;
+}
+
+// called from generated code; see <prefix>_bind() in h_cg_emit_preamble.
+int h_codegen_bind(const HParser *parser, HCFChoice **syms, size_t n)
+{
+  HCFChoice *root = h_desugar(&system_allocator, NULL, parser);
+  if(root == NULL)
+    return -1;
+
+  HArena *arena = h_new_arena(&system_allocator, 0);
+  HCGSymbols *s = h_cg_symbols(arena, root);
+  int ret = -1;
+  if(s->n == n) {
+    memcpy(syms, s->syms, n * sizeof(HCFChoice *));
+    ret = 0;
+  }
+  h_delete_arena(arena);
+  return ret;
+}
+
+
+/* Emitting code */
+
+void h_cg_emit_byte(FILE *f, uint8_t c)
+{
+  if(isprint(c) && c != '\'' && c != '\\')
+    fprintf(f, "'%c'", c);
+  else
+    fprintf(f, "0x%02x", c);
+}
+
+void h_cg_emit_preamble(FILE *f, const char *prefix, const char *backend,
+                        size_t nsyms)
+{
+  fprintf(f, "/* Generated by hammer from a parser compiled with the %s backend.\n"
+             " * Do not edit.\n", backend);
+  if(nsyms > 0) {
+    fprintf(f, " *\n"
+               " * Call %s_bind() once with the parser this file was generated from;\n"
+               " * it attaches the grammar's semantic actions. %s_parse() then\n"
+               " * behaves like h_parse() on that parser.\n", prefix, prefix);
+  }
+  fprintf(f, " */\n"
+             "#include <hammer/hammer.h>\n"
+             "#include <hammer/internal.h>\n"
+             "#include <hammer/parsers/parser_internal.h>\n"
+             "\n"
+             "#define LA(d) (pos + (d) < length ? (int)input[pos + (d)] : -1)\n"
+             "\n");
+
+  if(nsyms > 0) {
+    fprintf(f, "static HCFChoice *%s_syms[%zu];\n"
+               "\n"
+               "int %s_bind(const HParser *parser)\n"
+               "{\n"
+               "  return h_codegen_bind(parser, %s_syms, %zu);\n"
+               "}\n"
+               "\n", prefix, nsyms, prefix, prefix, nsyms);
+  }
+}
+
+void h_cg_emit_helpers(FILE *f, const char *prefix, bool apply)
+{
+  fprintf(f,
+    "static HParsedToken *%s_uint(HArena *arena, uint8_t c, size_t pos)\n"
+    "{\n"
+    "  HParsedToken *tok = h_arena_malloc(arena, sizeof(HParsedToken));\n"
+    "  tok->token_type = TT_UINT;\n"
+    "  tok->uint = c;\n"
+    "  tok->index = pos;\n"
+    "  tok->bit_offset = 0;\n"
+    "  return tok;\n"
+    "}\n"
+    "\n", prefix);
+  if(!apply)
+    return;
+  fprintf(f,
+    "static bool %s_apply(HArena *arena, HArena *tarena, const HCFChoice *x,\n"
+    "%*sbool reshape, HParsedToken **tok)\n"
+    "{\n"
+    "  HParsedToken *t = *tok;\n"
+    "\n"
+    "  if(reshape && x->reshape) {\n"
+    "    HParsedToken *r = x->reshape(make_result(arena, t), x->user_data);\n"
+    "    if(r && t) {\n"
+    "      r->index = t->index;\n"
+    "      r->bit_offset = t->bit_offset;\n"
+    "    }\n"
+    "    t = r;\n"
+    "  }\n"
+    "  if(x->pred && !x->pred(make_result(tarena, t), x->user_data))\n"
+    "    return false;\n"
+    "  if(x->action)\n"
+    "    t = (HParsedToken *)x->action(make_result(arena, t), x->user_data);\n"
+    "\n"
+    "  *tok = t;\n"
+    "  return true;\n"
+    "}\n"
+    "\n", prefix, (int)strlen(prefix) + 19, "");
+}
+
+void h_cg_emit_charset(FILE *f, const char *prefix, size_t id, HCharset cs)
+{
+  fprintf(f, "static const uint8_t %s_cs%zu[32] = {", prefix, id);
+  for(unsigned int i=0; i<32; i++) {
+    uint8_t b = 0;
+    for(unsigned int j=0; j<8; j++) {
+      if(charset_isset(cs, i*8 + j))
+        b |= 1 << j;
+    }
+    fprintf(f, "%s0x%02x", (i%8 == 0)? "\n  " : " ", b);
+    if(i < 31)
+      fputc(',', f);
+  }
+  fprintf(f, "\n};\n");
+}
+
+void h_cg_emit_lookahead(FILE *f, const HStringMap *m, size_t depth,
+                         unsigned int indent, const char *fail,
+                         HCGLeafFunc leaf, void *env)
+{
+  if(m->epsilon_branch) {
+    leaf(f, m->epsilon_branch, indent, env);
+    return;
+  }
+
+  fprintf(f, "%*sswitch(LA(%zu)) {\n", indent, "", depth);
+  if(m->end_branch) {
+    fprintf(f, "%*scase -1:\n", indent, "");
+    leaf(f, m->end_branch, indent+2, env);
+  }
+
+  // characters leading directly to the same value share one case
+  bool done[256] = {false};
+  for(unsigned int c=0; c<256; c++) {
+    const HStringMap *n = h_stringmap_get_char(m, c);
+    if(n == NULL || done[c])
+      continue;
+
+    if(n->epsilon_branch) {
+      unsigned int count = 0;
+      fprintf(f, "%*s", indent, "");
+      for(unsigned int d=c; d<256; d++) {
+        const HStringMap *o = h_stringmap_get_char(m, d);
+        if(o == NULL || o->epsilon_branch != n->epsilon_branch)
+          continue;
+        done[d] = true;
+        if(count > 0 && count % 8 == 0)
+          fprintf(f, "\n%*s", indent, "");
+        else if(count > 0)
+          fputc(' ', f);
+        fprintf(f, "case ");
+        h_cg_emit_byte(f, d);
+        fputc(':', f);
+        count++;
+      }
+      fputc('\n', f);
+      leaf(f, n->epsilon_branch, indent+2, env);
+    } else {
+      fprintf(f, "%*scase ", indent, "");
+      h_cg_emit_byte(f, c);
+      fprintf(f, ":\n");
+      h_cg_emit_lookahead(f, n, depth+1, indent+2, fail, leaf, env);
+    }
+  }
+
+  fprintf(f, "%*sdefault:\n%*s%s\n", indent, "", indent+2, "", fail);
+  fprintf(f, "%*s}\n", indent, "");
+}
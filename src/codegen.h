@@ -0,0 +1,64 @@
+/* Helpers for emitting compiled parsers as C source */
+
+#ifndef HAMMER_CODEGEN__H
+#define HAMMER_CODEGEN__H
+
+#include <stdio.h>
+#include "internal.h"
+
+struct HStringMap_;   // see cfgrammar.h
+
+
+/* The symbols of a desugared grammar, numbered in depth-first order from the
+ * parser's desugared form. Generated code refers to symbols by these numbers
+ * and recovers their semantic actions at run time via h_codegen_bind, which
+ * repeats the numbering on the original parser.
+ */
+typedef struct HCGSymbols_ {
+  HCFChoice  **syms;    // array of size n, indexed by symbol number
+  size_t     n;
+  HHashTable *ids;      // maps symbols to (number + 1)
+  HArena     *arena;
+} HCGSymbols;
+
+#define H_CG_NOSYM ((size_t)-1)
+
+HCGSymbols *h_cg_symbols(HArena *arena, HCFChoice *root);
+size_t h_cg_symbol_id(const HCGSymbols *s, const HCFChoice *x);
+
+/* Does x carry a reshape, validation or semantic action? */
+static inline bool h_cg_has_attrs(const HCFChoice *x)
+  { return (x->reshape || x->pred || x->action); }
+
+
+/* Emit the common preamble of a generated file: includes, the symbol array
+ * and <prefix>_bind(). nsyms may be 0 if the code needs no bindings.
+ */
+void h_cg_emit_preamble(FILE *f, const char *prefix, const char *backend,
+                        size_t nsyms);
+
+/* Emit the helpers shared by the context-free drivers: <prefix>_uint(),
+ * which makes the token for an input character, and, if 'apply' is set,
+ * <prefix>_apply(), which runs the reshape, validation and action of a symbol
+ * on a token exactly like the LL(k) and LR drivers do.
+ */
+void h_cg_emit_helpers(FILE *f, const char *prefix, bool apply);
+
+/* Emit a 256-bit charset as a static byte array called <prefix>_cs<id>. */
+void h_cg_emit_charset(FILE *f, const char *prefix, size_t id, HCharset cs);
+
+/* Emit a nested switch over the lookahead LA(depth), LA(depth+1), ... that
+ * follows the given string map. 'leaf' emits the code for a value found in
+ * the map and must not fall through; 'fail' is the statement used for
+ * lookahead not in the map.
+ */
+typedef void (*HCGLeafFunc)(FILE *f, const void *value, unsigned int indent,
+                            void *env);
+void h_cg_emit_lookahead(FILE *f, const struct HStringMap_ *m, size_t depth,
+                         unsigned int indent, const char *fail,
+                         HCGLeafFunc leaf, void *env);
+
+/* Emit a C character literal (or integer) for byte c. */
+void h_cg_emit_byte(FILE *f, uint8_t c);
+
+#endif
@@ -0,0 +1,152 @@
+/* An allocator that counts the calls of another; see h_counting_allocator_new. */
+
+#include <stddef.h>
+#include <string.h>
+#include "internal.h"
+
+// Every block starts with its size, so that free knows how much it returns.
+typedef union {
+  size_t size;
+  max_align_t align;
+} HCountHeader;
+
+typedef struct {
+  HAllocator allocator; // must be first; the functions get a pointer to it
+  HAllocator *backing;
+  size_t limit;
+  struct HMutex lock;   // guards stats
+  HAllocatorStats stats;
+} HCountingAllocator;
+
+static size_t bucket(size_t size) {
+  size_t b = 0;
+  while (b < H_ALLOCATOR_BUCKETS - 1 && size > ((size_t)16 << b))
+    b++;
+  return b;
+}
+
+// Reserves an allocation of size bytes replacing one of old bytes, if the
+// limit allows it. Called under the lock.
+static bool account(HCountingAllocator *ca, size_t old, size_t size) {
+  HAllocatorStats *st = &ca->stats;
+  if (ca->limit && size > old && st->bytes - old + size > ca->limit) {
+    st->failures++;
+    return false;
+  }
+  st->bytes = st->bytes - old + size;
+  return true;
+}
+
+// Counts a reserved allocation of size bytes, once the backing allocator
+// has made it.
+static void record(HCountingAllocator *ca, size_t size) {
+  HAllocatorStats *st = &ca->stats;
+  h_platform_mutex_lock(&ca->lock);
+  st->total += size;
+  if (st->bytes > st->peak)
+    st->peak = st->bytes;
+  st->histogram[bucket(size)]++;
+  h_platform_mutex_unlock(&ca->lock);
+}
+
+static void *counting_alloc(HAllocator *allocator, size_t size) {
+  HCountingAllocator *ca = (HCountingAllocator *)allocator;
+  h_platform_mutex_lock(&ca->lock);
+  ca->stats.allocs++;
+  bool ok = account(ca, 0, size);
+  h_platform_mutex_unlock(&ca->lock);
+  if (!ok)
+    return NULL;
+
+  HCountHeader *h = ca->backing->alloc(ca->backing, sizeof(HCountHeader) + size);
+  if (!h) {
+    h_platform_mutex_lock(&ca->lock);
+    ca->stats.failures++;
+    ca->stats.bytes -= size;
+    h_platform_mutex_unlock(&ca->lock);
+    return NULL;
+  }
+  record(ca, size);
+  h->size = size;
+  return h + 1;
+}
+
+static void *counting_realloc(HAllocator *allocator, void *ptr, size_t size) {
+  HCountingAllocator *ca = (HCountingAllocator *)allocator;
+  if (!ptr)
+    return counting_alloc(allocator, size);
+  HCountHeader *h = (HCountHeader *)ptr - 1;
+  size_t old = h->size;
+
+  h_platform_mutex_lock(&ca->lock);
+  ca->stats.reallocs++;
+  bool ok = account(ca, old, size);
+  h_platform_mutex_unlock(&ca->lock);
+  if (!ok)
+    return NULL;
+
+  HCountHeader *nh = ca->backing->realloc(ca->backing, h, sizeof(HCountHeader) + size);
+  if (!nh) {
+    // the old block is still there
+    h_platform_mutex_lock(&ca->lock);
+    ca->stats.failures++;
+    ca->stats.bytes = ca->stats.bytes - size + old;
+    h_platform_mutex_unlock(&ca->lock);
+    return NULL;
+  }
+  record(ca, size);
+  nh->size = size;
+  return nh + 1;
+}
+
+static void counting_free(HAllocator *allocator, void *ptr) {
+  HCountingAllocator *ca = (HCountingAllocator *)allocator;
+  size_t size = 0;
+  if (ptr) {
+    HCountHeader *h = (HCountHeader *)ptr - 1;
+    size = h->size;
+    ca->backing->free(ca->backing, h);
+  }
+  h_platform_mutex_lock(&ca->lock);
+  ca->stats.frees++;
+  ca->stats.bytes -= size;
+  h_platform_mutex_unlock(&ca->lock);
+}
+
+HAllocator *h_counting_allocator_new(HAllocator *backing, size_t limit) {
+  if (!backing)
+    backing = &system_allocator;
+  HAllocator *mm__ = backing;
+  HCountingAllocator *ca = h_new(HCountingAllocator, 1);
+  if (!ca)
+    return NULL;
+  memset(ca, 0, sizeof(HCountingAllocator));
+  ca->allocator.alloc = counting_alloc;
+  ca->allocator.realloc = counting_realloc;
+  ca->allocator.free = counting_free;
+  ca->backing = backing;
+  ca->limit = limit;
+  h_platform_mutex_init(&ca->lock);
+  return &ca->allocator;
+}
+
+void h_counting_allocator_free(HAllocator *counting) {
+  HCountingAllocator *ca = (HCountingAllocator *)counting;
+  HAllocator *mm__ = ca->backing;
+  h_platform_mutex_destroy(&ca->lock);
+  h_free(ca);
+}
+
+void h_counting_allocator_stats(HAllocator *counting, HAllocatorStats *stats) {
+  HCountingAllocator *ca = (HCountingAllocator *)counting;
+  h_platform_mutex_lock(&ca->lock);
+  *stats = ca->stats;
+  h_platform_mutex_unlock(&ca->lock);
+}
+
+void h_counting_allocator_reset_peak(HAllocator *counting) {
+  HCountingAllocator *ca = (HCountingAllocator *)counting;
+  h_platform_mutex_lock(&ca->lock);
+  ca->stats.peak = ca->stats.bytes;
+  h_platform_mutex_unlock(&ca->lock);
+}
@@ -15,6 +15,9 @@ HCFChoice *h_desugar(HAllocator *mm__, HCFStack *stk__, const HParser *parser) {
     assert(parser->vtable->desugar != NULL);
     ((HParser *)parser)->desugared = nstk__->prealloc;
     parser->vtable->desugar(mm__, nstk__, parser->env);
+    // if the desugaring only refers to another parser's (h_indirect), the
+    // outer parser is the one that gets named.
+    parser->desugared->parser = parser;
     if (stk__ == NULL) {
       h_cfstack_free(mm__, nstk__);
     }
@@ -38,7 +38,8 @@
 // the other macro variants that stays close to an abstract PEG or BNF grammar.
 // The latter goal is more specifically enabled by H_ARULE, H_VRULE, and their
 // combinations as they allow the definition of syntax to be given without
-// intermingling it with the semantic specifications.
+// intermingling it with the semantic specifications. All variants also
+// name the parser after the rule, for h_profile_report.
 //
 // H_ARULE defines a variable just like H_RULE but attaches a semantic action
 // to the result of the parser via h_action. The action is expected to be
@@ -59,22 +60,27 @@
 // the user_data pointer.  In cases where both an attr_bool and an
 // action are used, the same userdata pointer is given to both.
 
-#define H_RULE(rule, def)  HParser *rule = def
-#define H_ARULE(rule, def) HParser *rule = h_action(def, act_ ## rule, NULL)
+#define H_RULE(rule, def)  HParser *rule = h_name_parser(def, #rule)
+#define H_ARULE(rule, def) HParser *rule = \
+    h_name_parser(h_action(def, act_ ## rule, NULL), #rule)
 #define H_VRULE(rule, def) HParser *rule = \
-    h_attr_bool(def, validate_ ## rule, NULL)
+    h_name_parser(h_attr_bool(def, validate_ ## rule, NULL), #rule)
 #define H_VARULE(rule, def) HParser *rule = \
-    h_attr_bool(h_action(def, act_ ## rule, NULL), validate_ ## rule, NULL)
+    h_name_parser(h_attr_bool(h_action(def, act_ ## rule, NULL), \
+                              validate_ ## rule, NULL), #rule)
 #define H_AVRULE(rule, def) HParser *rule = \
-    h_action(h_attr_bool(def, validate_ ## rule, NULL), act_ ## rule, NULL)
+    h_name_parser(h_action(h_attr_bool(def, validate_ ## rule, NULL), \
+                           act_ ## rule, NULL), #rule)
 #define H_ADRULE(rule, def, data) HParser *rule =       \
-    h_action(def, act_ ## rule, data)
+    h_name_parser(h_action(def, act_ ## rule, data), #rule)
 #define H_VDRULE(rule, def, data) HParser *rule =       \
-    h_attr_bool(def, validate_ ## rule, data)
+    h_name_parser(h_attr_bool(def, validate_ ## rule, data), #rule)
 #define H_VADRULE(rule, def, data) HParser *rule =              \
-    h_attr_bool(h_action(def, act_ ## rule, data), validate_ ## rule, data)
+    h_name_parser(h_attr_bool(h_action(def, act_ ## rule, data),  \
+                              validate_ ## rule, data), #rule)
 #define H_AVDRULE(rule, def, data) HParser *rule =              \
-    h_action(h_attr_bool(def, validate_ ## rule, data), act_ ## rule, data)
+    h_name_parser(h_action(h_attr_bool(def, validate_ ## rule, data), \
+                           act_ ## rule, data), #rule)
 
 
 //
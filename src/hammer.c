@@ -31,6 +31,7 @@ static HParserBackendVTable *backends[PB_MAX + 1] = {
   &h__llk_backend_vtable,
   &h__lalr_backend_vtable,
   &h__glr_backend_vtable,
+  &h__earley_backend_vtable,
 };
 
 
@@ -64,6 +65,134 @@ HParseResult* h_parse__m(HAllocator* mm__, const HParser* parser, const uint8_t*
   return backends[parser->backend]->parse(mm__, parser, &input_stream);
 }
 
+HParseResult* h_parse_limited(const HParser* parser, const uint8_t* input, size_t length,
+                              const HParseLimits* limits, HParseStatus* status) {
+  return h_parse_limited__m(&system_allocator, parser, input, length, limits, status);
+}
+HParseResult* h_parse_limited__m(HAllocator* mm__, const HParser* parser, const uint8_t* input,
+                                 size_t length, const HParseLimits* limits, HParseStatus* status) {
+  HParseLimiter *l = h_limiter_new(mm__, limits, length);
+  if (!l) {
+    if (status)
+      *status = H_PARSE_OUT_OF_MEMORY;
+    return NULL;
+  }
+  HInputStream input_stream = {
+    .pos = 0,
+    .index = 0,
+    .bit_offset = 0,
+    .overrun = 0,
+    .endianness = DEFAULT_ENDIANNESS,
+    .length = l->cut ? limits->max_lookahead : length,
+    .input = input,
+    .last_chunk = true,
+    .limiter = l
+  };
+
+  // the limits unwind the parse to here
+  HParseResult *res = NULL;
+  HParseStatus why;
+  if (setjmp(l->abort) == 0) {
+    res = backends[parser->backend]->parse(&l->allocator, parser, &input_stream);
+    why = res ? H_PARSE_OK : H_PARSE_NO_MATCH;
+  } else {
+    h_limiter_unwind(l);
+    why = l->why;
+  }
+  h_limiter_release(l);
+  if (status)
+    *status = why;
+  return res;
+}
+
+HParseResult* h_parse_iov(const HParser* parser, const struct iovec* iov, size_t n) {
+  return h_parse_iov__m(&system_allocator, parser, iov, n);
+}
+HParseResult* h_parse_iov__m(HAllocator* mm__, const HParser* parser, const struct iovec* iov, size_t n) {
+  HInputVector vec = {.iov = iov, .n = n, .hint = 0};
+  vec.offsets = h_new(size_t, n + 1);
+  if (!vec.offsets)
+    return NULL;
+  vec.offsets[0] = 0;
+  for (size_t i = 0; i < n; i++)
+    vec.offsets[i+1] = vec.offsets[i] + iov[i].iov_len;
+
+  HInputStream input_stream = {
+    .pos = 0,
+    .index = 0,
+    .bit_offset = 0,
+    .overrun = 0,
+    .endianness = DEFAULT_ENDIANNESS,
+    .length = vec.offsets[n],
+    .input = NULL,
+    .iov = &vec,
+    .last_chunk = true
+  };
+  // a single segment is just contiguous input
+  if (n == 1) {
+    input_stream.input = iov[0].iov_base;
+    input_stream.iov = NULL;
+  }
+
+  HParseResult *res = backends[parser->backend]->parse(mm__, parser, &input_stream);
+  h_free(vec.offsets);
+  return res;
+}
+
+HParseResult* h_parse_file(const HParser* parser, const char* path, unsigned int flags) {
+  return h_parse_file__m(&system_allocator, parser, path, flags);
+}
+
+typedef struct {
+  void *addr;
+  size_t length;
+} HFileMapping;
+
+static void unmap_file(void *env) {
+  HFileMapping *m = env;
+  h_platform_unmap_file(m->addr, m->length);
+}
+
+HParseResult* h_parse_file__m(HAllocator* mm__, const HParser* parser, const char* path, unsigned int flags) {
+  HFileMapping m;
+  if (h_platform_map_file(path, flags, &m.addr, &m.length) != 0)
+    return NULL;
+
+  HParseResult *res = h_parse__m(mm__, parser, m.addr, m.length);
+  if (res) {
+    // the result may point into the mapping
+    HFileMapping *mp = h_arena_malloc(res->arena, sizeof(HFileMapping));
+    if (mp) {
+      *mp = m;
+      if (h_arena_on_delete(res->arena, unmap_file, mp) == 0)
+        return res;
+    }
+    h_parse_result_free(res);
+    res = NULL;
+  }
+  h_platform_unmap_file(m.addr, m.length);
+  return res;
+}
+
+int h_parse_events(const HParser* parser, const uint8_t* input, size_t length, HParseEventSink* sink) {
+  return h_parse_events__m(&system_allocator, parser, input, length, sink);
+}
+int h_parse_events__m(HAllocator* mm__, const HParser* parser, const uint8_t* input, size_t length, HParseEventSink* sink) {
+  if (!backends[parser->backend]->parse_events)
+    return -1;
+  HInputStream input_stream = {
+    .pos = 0,
+    .index = 0,
+    .bit_offset = 0,
+    .overrun = 0,
+    .endianness = DEFAULT_ENDIANNESS,
+    .length = length,
+    .input = input,
+    .last_chunk = true
+  };
+  return backends[parser->backend]->parse_events(mm__, parser, &input_stream, sink);
+}
+
 void h_parse_result_free__m(HAllocator *alloc, HParseResult *result) {
   h_parse_result_free(result);
 }
@@ -73,6 +202,10 @@ void h_parse_result_free(HParseResult *result) {
   h_delete_arena(result->arena);
 }
 
+void h_parse_result_stats(const HParseResult *result, HArenaStats *stats) {
+  h_allocator_stats(result->arena, stats);
+}
+
 bool h_false(void* env) {
   (void)env;
   return false;
@@ -93,13 +226,90 @@ int h_compile(HParser* parser, HParserBackend backend, const void* params) {
 }
 
 int h_compile__m(HAllocator* mm__, HParser* parser, HParserBackend backend, const void* params) {
+  HCompileParams cp = {.backend_params = params, .threads = 1};
+  return h_compile_params__m(mm__, parser, backend, &cp);
+}
+
+int h_compile_params(HParser* parser, HParserBackend backend, const HCompileParams* params) {
+  return h_compile_params__m(&system_allocator, parser, backend, params);
+}
+
+// desugaring memoizes on the sub-parsers, which different top-level parsers
+// may share, so only one compilation runs at a time.
+static struct HOnce compile_once = H_PLATFORM_ONCE_INIT;
+static struct HMutex compile_lock;
+
+static void init_compile_lock(void) {
+  h_platform_mutex_init(&compile_lock);
+}
+
+int h_compile_params__m(HAllocator* mm__, HParser* parser, HParserBackend backend, const HCompileParams* params) {
+  const void *backend_params = params ? params->backend_params : NULL;
+  unsigned int threads = params ? params->threads : 1;
+
+  h_platform_once(&compile_once, init_compile_lock);
+  h_platform_mutex_lock(&compile_lock);
   backends[parser->backend]->free(parser);
-  int ret = backends[backend]->compile(mm__, parser, params);
+  int ret;
+  if (threads > 1 && backends[backend]->compile_threads)
+    ret = backends[backend]->compile_threads(mm__, parser, backend_params, threads);
+  else
+    ret = backends[backend]->compile(mm__, parser, backend_params);
   if (!ret)
     parser->backend = backend;
+  h_platform_mutex_unlock(&compile_lock);
   return ret;
 }
 
+HCompiledParser* h_compile_shared(const HParser* parser, HParserBackend backend, const HCompileParams* params) {
+  return h_compile_shared__m(&system_allocator, parser, backend, params);
+}
+
+HCompiledParser* h_compile_shared__m(HAllocator* mm__, const HParser* parser, HParserBackend backend, const HCompileParams* params) {
+  HCompiledParser *cp = h_new(HCompiledParser, 1);
+  if (!cp)
+    return NULL;
+  cp->mm__ = mm__;
+  // the copy shares the sub-parsers (and the desugared form, if any), but
+  // not the backend state of the original.
+  cp->parser = *parser;
+  cp->parser.backend = PB_PACKRAT;
+  cp->parser.backend_data = NULL;
+  if (h_compile_params__m(mm__, &cp->parser, backend, params) != 0) {
+    h_free(cp);
+    return NULL;
+  }
+  return cp;
+}
+
+HParseResult* h_compiled_parse(const HCompiledParser* cp, const uint8_t* input, size_t length) {
+  return h_parse__m(&system_allocator, &cp->parser, input, length);
+}
+HParseResult* h_compiled_parse__m(HAllocator* mm__, const HCompiledParser* cp, const uint8_t* input, size_t length) {
+  return h_parse__m(mm__, &cp->parser, input, length);
+}
+
+HSuspendedParser* h_compiled_parse_start(const HCompiledParser* cp) {
+  return h_parse_start__m(&system_allocator, &cp->parser);
+}
+HSuspendedParser* h_compiled_parse_start__m(HAllocator* mm__, const HCompiledParser* cp) {
+  return h_parse_start__m(mm__, &cp->parser);
+}
+
+void h_compiled_parser_free(HCompiledParser* cp) {
+  if (cp == NULL)
+    return;
+  HAllocator *mm__ = cp->mm__;
+  backends[cp->parser.backend]->free(&cp->parser);
+  h_free(cp);
+}
+
+int h_dump_code(FILE* stream, const HParser* parser, const char* prefix) {
+  if(!backends[parser->backend]->dump_code)
+    return -1;
+  return backends[parser->backend]->dump_code(stream, parser, prefix);
+}
+
 
 HSuspendedParser* h_parse_start(const HParser* parser) {
   return h_parse_start__m(&system_allocator, parser);
@@ -46,7 +46,8 @@ typedef enum HParserBackend_ {
   PB_LLk,
   PB_LALR,
   PB_GLR,
-  PB_MAX = PB_GLR
+  PB_EARLEY,
+  PB_MAX = PB_EARLEY
 } HParserBackend;
 
 typedef enum HTokenType_ {
@@ -63,6 +64,11 @@ typedef enum HTokenType_ {
   TT_MAX
 } HTokenType;
 
+/**
+ * The elements of a sequence are not necessarily distinct: the repetition
+ * of a single-byte parser, as in h_many(h_ch_range('a', 'z')), may use the
+ * same token for all equal bytes. Copy a token before modifying it.
+ */
 typedef struct HCountedArray_ {
   size_t capacity;
   size_t used;
@@ -138,6 +144,7 @@ typedef struct HParser_ {
   void* backend_data;
   void *env;
   HCFChoice *desugared; /* if the parser can be desugared, its desugared form */
+  const char *name;     /* see h_name_parser; NULL if unnamed */
 } HParser;
 
 typedef struct HSuspendedParser_ HSuspendedParser;
@@ -198,11 +205,24 @@ typedef struct HCaseResult_ {
   HResultTiming timestamp;
 #endif
   size_t length;
+  // The times below are per parse, in nsec, over samples of at least 10 us
+  // of parsing each; parse_time above is the mean.
+  size_t median_time;
+  size_t p99_time;
+  size_t n_samples;
+  // The memory of one parse's result arena (see h_allocator_stats)
+  size_t arena_used;
+  size_t arena_wasted;
+  // All the memory of one parse, scratch included: the most it had
+  // allocated at once, and its calls of alloc and realloc
+  size_t peak_bytes;
+  size_t allocs;
 } HCaseResult;
 
 typedef struct HBackendResults_ {
   HParserBackend backend;
   bool compile_success;
+  size_t compile_time; // in nsec, also if the compilation failed
   size_t n_testcases;
   size_t failed_testcases; // actually a count...
   HCaseResult *cases;
@@ -212,6 +232,12 @@ typedef struct HBenchmarkResults_ {
   size_t len;
   HBackendResults *results;
 } HBenchmarkResults;
+
+typedef enum HBenchmarkFormat_ {
+  H_BENCHMARK_TEXT,
+  H_BENCHMARK_JSON,
+  H_BENCHMARK_CSV, // one row per backend and case
+} HBenchmarkFormat;
 // }}}
 
 // {{{ Preprocessor definitions
@@ -267,6 +293,168 @@ typedef struct HBenchmarkResults_ {
  */
 HAMMER_FN_DECL(HParseResult*, h_parse, const HParser* parser, const uint8_t* input, size_t length);
 
+struct iovec; // from <sys/uio.h>
+
+/**
+ * Like h_parse, with the input given as the concatenation of the [n]
+ * segments [iov], such as the fragments of a received packet. The segments
+ * are read in place; reads within a segment cost about as much as with
+ * h_parse, and only reads across a boundary take a slower path.
+ *
+ * TT_BYTES tokens from the regular backend that span a boundary are copied
+ * into the result's arena.
+ */
+HAMMER_FN_DECL(HParseResult*, h_parse_iov, const HParser* parser, const struct iovec* iov, size_t n);
+
+/** Hints for h_parse_file about how the input will be read. */
+typedef enum HFileFlags_ {
+  H_FILE_SEQUENTIAL = 1 << 0, // read ahead aggressively, drop pages once read
+  H_FILE_HUGEPAGES  = 1 << 1, // use huge pages where the system allows it
+  H_FILE_WILLNEED   = 1 << 2, // start reading the whole file in right away
+} HFileFlags;
+
+/**
+ * Like h_parse, with the contents of the file at [path] as input. The file
+ * is mapped into memory rather than read, so it is paged in as the parser
+ * gets to it. [flags] is a combination of HFileFlags, or 0.
+ *
+ * TT_BYTES tokens point into the mapping, which stays in place until the
+ * result is freed. The file must not be truncated in the meantime.
+ *
+ * Returns NULL if the parse fails or the file cannot be mapped.
+ */
+HAMMER_FN_DECL(HParseResult*, h_parse_file, const HParser* parser, const char* path, unsigned int flags);
+
+/**
+ * Callbacks for h_parse_events; any of them may be NULL. A rule is named by
+ * the parser it was made from, and positions are byte offsets into the
+ * input; a rule that matched bytes [start, end) gets exit_rule(sink, rule,
+ * start, end).
+ */
+typedef struct HParseEventSink_ {
+  void (*enter_rule)(struct HParseEventSink_* sink, const HParser* rule, size_t pos);
+  void (*exit_rule)(struct HParseEventSink_* sink, const HParser* rule, size_t start, size_t end);
+  void (*terminal)(struct HParseEventSink_* sink, uint8_t byte, size_t pos);
+  void* user_data;
+} HParseEventSink;
+
+/**
+ * Parse [input] with [parser] like h_parse, but report the derivation to
+ * [sink] as it is found instead of building a parse tree. Semantic actions
+ * are not run, and parsers with validations (h_attr_bool) are not supported.
+ *
+ * Every parser in the grammar that is not a terminal (a single byte, as from
+ * h_ch or h_in) is a rule; an h_indirect rule is named by the indirect
+ * parser. The rules and terminals of the derivation are reported in input
+ * order, each rule's exit_rule after those of its parts. With the LL(k)
+ * backend, enter_rule comes before the rule's parts; with the LALR backend,
+ * which only recognizes a rule at its end, right before exit_rule.
+ *
+ * No parse tree is kept, so the memory used grows only with the parse
+ * stack, that is, with how deeply rules are nested; for grammars that keep
+ * it bounded, it does not depend on the size of the input. For LALR, the
+ * stack also holds repetitions (h_many), whose desugaring nests to the
+ * right, so it grows with the number of their elements.
+ *
+ * Returns 0 if the input parses, or -1 if it does not or the backend
+ * cannot report events (only LL(k) and LALR can). When the parse fails, the
+ * events up to that point have been reported.
+ */
+HAMMER_FN_DECL(int, h_parse_events, const HParser* parser, const uint8_t* input, size_t length, HParseEventSink* sink);
+
+/**
+ * Limits for h_parse_limited. A limit of 0 is no limit.
+ */
+typedef struct HParseLimits_ {
+  size_t max_memory;            // bytes the parse may have allocated at once
+  size_t max_steps;             // steps of the backend; see h_parse_limited
+  size_t max_lookahead;         // bytes of the input the parse may read
+} HParseLimits;
+
+/**
+ * How a parse with h_parse_limited ended.
+ */
+typedef enum HParseStatus_ {
+  H_PARSE_OK,
+  H_PARSE_NO_MATCH,             // the input does not parse
+  H_PARSE_OUT_OF_MEMORY,        // the allocator returned NULL
+  H_PARSE_MEMORY_LIMIT,
+  H_PARSE_STEP_LIMIT,
+  H_PARSE_LOOKAHEAD_LIMIT,
+} HParseStatus;
+
+/**
+ * Parse [input] with [parser] like h_parse, but give up as soon as the parse
+ * exceeds one of [limits], or an allocation fails. The parse is then
+ * unwound, everything it allocated is freed, and NULL is returned. Unless
+ * [status] is NULL, it is set to why the parse ended.
+ *
+ * The steps counted are packrat's parser invocations that miss the memo,
+ * the threads the regular expression backend runs for each input byte,
+ * the steps of the LL(k) and LR engines (of each GLR engine), and the
+ * Earley items.
+ * A parse that would read more than [max_lookahead] bytes of the input,
+ * or look for its end there, ends at that point.
+ *
+ * Semantic actions and validations are unwound along with the backend, so
+ * they must not hold resources of their own across allocations. Only
+ * contiguous input, on one thread, is supported.
+ */
+HAMMER_FN_DECL(HParseResult*, h_parse_limited, const HParser* parser, const uint8_t* input, size_t length, const HParseLimits* limits, HParseStatus* status);
+
+/**
+ * Options for h_parse_batch.
+ */
+typedef struct HBatchParams_ {
+  unsigned int threads;         // how many threads parse; 0 = 1
+  size_t grain;                 // inputs handed to a thread at a time; 0 = automatic
+} HBatchParams;
+
+/**
+ * Parse each of the [n] inputs [inputs][i] (of [lengths][i] bytes) on its
+ * own, as if by h_parse, and store the results in order in [results][i].
+ * [params] may be NULL for the defaults.
+ *
+ * The inputs are parsed by a pool of threads, the calling thread included.
+ * Blocks of [grain] inputs are handed out one at a time, so a thread that
+ * finishes early takes over work the others have not started. Each parse
+ * has its own arena and memo tables, and each result must be freed with
+ * h_parse_result_free. With more than one thread, the parser must not be
+ * compiled meanwhile, and the allocator must be thread-safe.
+ *
+ * Returns the number of inputs that parsed successfully.
+ */
+HAMMER_FN_DECL(size_t, h_parse_batch, const HParser* parser, const uint8_t* const* inputs, const size_t* lengths, size_t n, HParseResult** results, const HBatchParams* params);
+
+/**
+ * Options for h_parse_split.
+ */
+typedef struct HSplitParams_ {
+  unsigned int threads;         // how many threads parse; 0 = 1
+  size_t chunks;                // pieces to split the input into; 0 = 4 per thread
+  const HParser* resync;        // matches the end of a record; NULL = skip length prefixes
+} HSplitParams;
+
+/**
+ * Parse [input] with [parser], which should be h_many(record) or
+ * h_many1(record), on several threads. The result is that of h_parse with
+ * the packrat backend; for any other parser, h_parse_split is h_parse.
+ *
+ * The input is split into pieces at candidate record boundaries, which are
+ * found at the first position after a piece's nominal start where
+ * [params]->resync matches, or, if there is no resync parser and record is
+ * an h_length_value, by reading the length fields from the start and
+ * skipping over the values. The records of each piece are parsed on their
+ * own, and the pieces are joined in order. A piece whose start turns out
+ * not to be a record boundary (because the previous record runs past it)
+ * is discarded, and its records are parsed again where they really start.
+ * If [parser] was compiled with H_PACKRAT_DEFER_ACTIONS, the actions run
+ * once the pieces are joined, and only for the records in the result.
+ *
+ * With more than one thread, the allocator must be thread-safe.
+ */
+HAMMER_FN_DECL(HParseResult*, h_parse_split, const HParser* parser, const uint8_t* input, size_t length, const HSplitParams* params);
+
 /**
  * Initialize a parser for iteratively consuming an input stream in chunks.
  * This is only supported by some backends.
@@ -288,6 +476,50 @@ bool h_parse_chunk(HSuspendedParser* s, const uint8_t* input, size_t length);
  */
 HParseResult* h_parse_finish(HSuspendedParser* s);
 
+/**
+ * A source of input for h_parse_source. Sources can be layered: a decoder
+ * reads the input of the source below it, as needed, and passes on the
+ * decoded bytes.
+ *
+ * To write a source, embed this struct at the start of your own.
+ */
+typedef struct HInputSource_ {
+  /**
+   * Read up to [n] bytes into [buf]. Returns how many were read (fewer than
+   * [n] only if the input ends there), 0 at the end of the input, and -1 on
+   * an error such as malformed encoded input.
+   */
+  long (*read)(struct HInputSource_* src, uint8_t* buf, size_t n);
+  /** Free the source, and the source it reads from, if any. */
+  void (*free)(struct HInputSource_* src);
+} HInputSource;
+
+/** The [length] bytes at [input], which must stay valid while in use. */
+HAMMER_FN_DECL(HInputSource*, h_source_buffer, const uint8_t* input, size_t length);
+/** The contents of [f], from the current position on. [f] is not closed. */
+HAMMER_FN_DECL(HInputSource*, h_source_file, FILE* f);
+/** Base64 (RFC 4648) decoding of [inner]. Whitespace is skipped. */
+HAMMER_FN_DECL(HInputSource*, h_source_base64, HInputSource* inner);
+/** Hexadecimal decoding of [inner], two digits per byte. Whitespace is skipped. */
+HAMMER_FN_DECL(HInputSource*, h_source_hex, HInputSource* inner);
+/**
+ * Decompression of [inner], a zlib or gzip stream. Returns NULL if hammer
+ * was built without zlib support (scons --with-zlib).
+ */
+HAMMER_FN_DECL(HInputSource*, h_source_inflate, HInputSource* inner);
+/** Free [src], and the sources below it. */
+void h_source_free(HInputSource* src);
+
+/**
+ * Parse the input read from [src], which is not freed.
+ *
+ * With a backend that supports iterative parsing, the input is read and
+ * parsed in chunks of a few kilobytes, and reading stops as soon as the
+ * parser needs no more input. With other backends, all of the input is read
+ * before parsing. A read error makes the parse fail.
+ */
+HAMMER_FN_DECL(HParseResult*, h_parse_source, const HParser* parser, HInputSource* src);
+
 /**
  * Given a string, returns a parser that parses that string value. 
  * 
@@ -721,6 +953,109 @@ HAMMER_FN_DECL(HParser*, h_bind, const HParser *p, HContinuation k, void *env);
  */
 HAMMER_FN_DECL(void, h_parse_result_free, HParseResult *result);
 
+/**
+ * The memory of an HParseResult: the bytes its tokens take up, and the
+ * rest of the blocks they are in (see h_allocator_stats). The memory a
+ * backend only needed while parsing is not counted; to see that, parse
+ * with a counting allocator (see h_counting_allocator_new).
+ */
+void h_parse_result_stats(const HParseResult *result, HArenaStats *stats);
+
+#ifndef SWIG
+/**
+ * A token of a packed parse tree, made by h_pack_token.
+ *
+ * The tokens of a tree are stored in one block, in pre-order: a sequence's
+ * elements, and theirs, follow it directly. Instead of an HCountedArray, a
+ * sequence has the offsets (in tokens, from itself) of its elements, which
+ * are stored after the tokens. bit_length is not kept.
+ */
+typedef struct HPackedToken_ {
+  uint16_t token_type;  // an HTokenType; TT_INVALID for a NULL element
+  char bit_offset;
+  uint32_t len;         // TT_SEQUENCE: number of elements; TT_BYTES: of bytes
+  uint32_t size;        // tokens in the subtree rooted here, this one included
+  uint32_t elements;    // TT_SEQUENCE: offset in bytes from here to the
+                        // offsets of the elements. serialised TT_BYTES and
+                        // user types: offset in bytes from here to the data
+  union {
+    const uint8_t *bytes;
+    int64_t sint;
+    uint64_t uint;
+    double dbl;
+    float flt;
+    void *user;         // the same pointer as in the HParsedToken
+  };
+  size_t index;
+} HPackedToken;
+
+/**
+ * Copy the tree rooted at [tok] into a single block, which is freed with
+ * h_packed_token_free. TT_BYTES tokens still point to the input.
+ *
+ * Returns NULL if [tok] is NULL, if the tree has too many tokens or a
+ * byte string is too long for the 32-bit sizes, or if a user token type
+ * does not fit in 16 bits.
+ */
+HAMMER_FN_DECL(HPackedToken*, h_pack_token, const HParsedToken* tok);
+HAMMER_FN_DECL(void, h_packed_token_free, HPackedToken* tok);
+
+/** Like h_seq_len and h_seq_index, for a packed TT_SEQUENCE token. */
+size_t h_packed_seq_len(const HPackedToken* p);
+const HPackedToken* h_packed_seq_index(const HPackedToken* p, size_t i);
+
+/**
+ * Convert the packed tree rooted at [p] back to HParsedTokens, allocated
+ * from [arena]; h_write_result_unamb gives the same for both.
+ */
+HParsedToken* h_unpack_token(HArena* arena, const HPackedToken* p);
+
+/**
+ * Serialise the tree rooted at [tok] into one buffer, which can be sent to
+ * another process (of the same build of hammer on the same architecture)
+ * and read there in place. The buffer is freed with the allocator's free;
+ * its length is stored in [*length].
+ *
+ * The buffer holds the tree as packed by h_pack_token, with the byte
+ * strings and the values of user token types copied in. User token types
+ * need a serialiser, see h_set_token_type_serializer; they are identified
+ * by name, so both sides need not allocate them in the same order.
+ *
+ * Returns NULL if [tok] is NULL, if a token has a user type without a
+ * serialiser, or if the tree is too large to pack.
+ */
+HAMMER_FN_DECL(uint8_t*, h_serialize_token, const HParsedToken* tok, size_t* length);
+
+/**
+ * Check a received buffer and return the root of the tree in it, to be
+ * walked with h_packed_seq_len and h_packed_seq_index. [buf] must be
+ * aligned to 8 bytes and outlive the tokens.
+ *
+ * Every offset in the buffer is checked, so a walk of the tree stays
+ * inside it whatever the buffer holds. Returns NULL if the buffer is
+ * malformed or from an incompatible build.
+ */
+const HPackedToken* h_read_serialized(const uint8_t* buf, size_t length);
+
+/// The bytes of a serialised TT_BYTES token, or the serialised value of a
+/// user type; tok->len is their length.
+const uint8_t* h_serialized_data(const HPackedToken* tok);
+
+/// The name of a user token type as numbered in the process that wrote the
+/// buffer [buf], which h_read_serialized accepted. NULL if not a user type.
+const char* h_serialized_type_name(const uint8_t* buf, HTokenType token_type);
+
+/**
+ * Rebuild the tree in a serialised buffer as HParsedTokens, allocated from
+ * [arena]. Byte strings point into [buf]. User token types are mapped to
+ * the local numbers of their names, and read with their serialisers.
+ *
+ * Returns NULL if the buffer is malformed, or a user type is unknown here
+ * or has no read() function.
+ */
+HParsedToken* h_deserialize_token(HArena* arena, const uint8_t* buf, size_t length);
+#endif // SWIG
+
 // Some debugging aids
 /**
  * Format token into a compact unambiguous form. Useful for parser test cases.
@@ -742,6 +1077,102 @@ void h_pprint(FILE* stream, const HParsedToken* tok, int indent, int delta);
  */
 HAMMER_FN_DECL(int, h_compile, HParser* parser, HParserBackend backend, const void* params);
 
+/**
+ * Flags for the packrat backend, passed to h_compile as [params], cast to
+ * a pointer the way the LL(k) backend takes its k:
+ *
+ *   h_compile(p, PB_PACKRAT, (void *)H_PACKRAT_DEFER_ACTIONS);
+ *
+ * With H_PACKRAT_DEFER_ACTIONS, h_action does not call its action when its
+ * sub-parser succeeds, but records the call in the memo table. Once the
+ * whole parse has succeeded, the actions in the result are called, each
+ * inner one before the outer one, so an action that is backtracked over
+ * never runs. Predicates (h_attr_bool), h_int_range, h_length_value,
+ * h_permutation and h_bind continuations still see the results of the
+ * actions below them; those are called as soon as they are needed.
+ */
+typedef enum HPackratFlags_ {
+  H_PACKRAT_DEFER_ACTIONS = 1,
+} HPackratFlags;
+
+/**
+ * Further options for h_compile_params.
+ */
+typedef struct HCompileParams_ {
+  const void* backend_params; // passed to the backend as [params] to h_compile
+  unsigned int threads;       // how many threads may build the tables; 0 = 1
+} HCompileParams;
+
+/**
+ * Like h_compile, with the options in [params] (NULL for the defaults).
+ *
+ * With more than one thread, the LL(k) backend computes the table rows of
+ * several nonterminals, and the LALR and GLR backends the lookahead of several
+ * inadequate LR(0) states, at the same time. The resulting tables are the
+ * same as with a single thread. The allocator must be thread-safe in that case.
+ *
+ * Returns -1 if grammar cannot be compiled with the specified options; 0 otherwise.
+ */
+HAMMER_FN_DECL(int, h_compile_params, HParser* parser, HParserBackend backend, const HCompileParams* params);
+
+/**
+ * A parser compiled for one backend, which cannot be changed afterwards.
+ *
+ * h_compile changes the parser it is given, so a parser must not be
+ * (re)compiled while another thread parses with it or with any parser
+ * containing it. A compiled parser has its own copy of the top-level
+ * parser and its own tables, and any number of threads may call
+ * h_compiled_parse or h_compiled_parse_start on it at the same time, as
+ * long as the allocators they pass are thread-safe (the system allocator
+ * is). The same holds for h_parse on a parser that no thread compiles.
+ *
+ * Semantic actions, predicates and h_bind continuations run on the parsing
+ * thread and must be reentrant themselves. The token type registry may be
+ * used from any thread.
+ */
+typedef struct HCompiledParser_ HCompiledParser;
+
+/**
+ * Compile [parser] for [backend] with the options in [params] (NULL for the
+ * defaults), leaving [parser] itself unchanged. Compilations are serialized,
+ * since they fill caches in the sub-parsers they share.
+ *
+ * Returns NULL if the grammar cannot be compiled with the specified options.
+ */
+HAMMER_FN_DECL(HCompiledParser*, h_compile_shared, const HParser* parser, HParserBackend backend, const HCompileParams* params);
+
+/**
+ * Like h_parse, with a compiled parser.
+ */
+HAMMER_FN_DECL(HParseResult*, h_compiled_parse, const HCompiledParser* cp, const uint8_t* input, size_t length);
+
+/**
+ * Like h_parse_start, with a compiled parser. The result refers to [cp],
+ * which must not be freed before h_parse_finish.
+ */
+HAMMER_FN_DECL(HSuspendedParser*, h_compiled_parse_start, const HCompiledParser* cp);
+
+/**
+ * Free the tables of a compiled parser. No thread may still be using it.
+ */
+void h_compiled_parser_free(HCompiledParser* cp);
+
+/**
+ * Write C source for a specialized version of the parser, as compiled by
+ * its current backend, to the given stream. All global names in the code
+ * start with [prefix].
+ *
+ * For the LL(k) and LALR backends, the code defines [prefix]_bind(parser)
+ * and [prefix]_parse(input, length); after binding it to the original
+ * parser, [prefix]_parse gives the same results as h_parse. For the regular
+ * backend, it defines [prefix]_match(input, length), which only recognizes
+ * the input and returns the length of the longest accepted prefix or -1;
+ * it does not run semantic actions or validations.
+ *
+ * Returns -1 if the backend cannot generate code for the parser; 0 otherwise.
+ */
+int h_dump_code(FILE* stream, const HParser* parser, const char* prefix);
+
 /**
  * TODO: Document me
  */
@@ -775,7 +1206,72 @@ HParsedToken *h_act_ignore(const HParseResult *p, void* userdata);
 // {{{ Benchmark functions
 HAMMER_FN_DECL(HBenchmarkResults *, h_benchmark, HParser* parser, HParserTestcase* testcases);
 void h_benchmark_report(FILE* stream, HBenchmarkResults* results);
-//void h_benchmark_dump_optimized_code(FILE* stream, HBenchmarkResults* results);
+void h_benchmark_report_format(FILE* stream, HBenchmarkResults* results, HBenchmarkFormat format);
+void h_benchmark_dump_optimized_code(FILE* stream, HParser* parser, HBenchmarkResults* results);
+// }}}
+
+// {{{ Profiling
+/**
+ * Per-parser profiling. The counting is compiled in only if hammer is
+ * built with HAMMER_PROFILE defined (scons --with-profile); otherwise
+ * these functions do nothing and h_profile_enable returns false. Even
+ * then, nothing is counted until h_profile_enable(true).
+ *
+ * The packrat backend counts every parser it runs. LL(k) counts each
+ * production it expands. LALR counts each production it reduces and each
+ * state it enters. The counts are kept for each parse and added to the
+ * totals when the parse ends, so parses on several threads may be
+ * profiled at once. Work that h_many hands to other threads is not
+ * counted.
+ */
+typedef enum HProfileKind_ {
+  H_PROFILE_PARSER,     // a parser run by the packrat backend
+  H_PROFILE_PRODUCTION, // a production expanded by LL(k) or reduced by LALR
+  H_PROFILE_STATE,      // a state of an LALR table
+} HProfileKind;
+
+typedef struct HProfileEntry_ {
+  HProfileKind kind;
+  const HParser *parser;  // H_PROFILE_PARSER: the parser itself. PRODUCTION:
+                          // the parser of the nonterminal, or NULL for one
+                          // made up by the backend. STATE: the parser parsed
+                          // with.
+  const char *name;       // the name of parser, if any
+  size_t index;           // PRODUCTION: which of the nonterminal's
+                          // productions. STATE: the state number.
+  uint64_t count;         // calls, expansions, reductions or entries
+  // the rest are for H_PROFILE_PARSER only
+  uint64_t memo_hits;     // calls answered from the memo table
+  uint64_t memo_misses;   // calls of a memoizing parser that were not
+  uint64_t backtracks;    // calls that failed, so the caller backs up
+  uint64_t bytes;         // consumed by calls that ran and succeeded
+  int64_t ns;             // time in calls that ran, callees included
+  int64_t self_ns;        // the same with the callees' time taken out
+} HProfileEntry;
+
+/// Start or stop counting. Returns false if profiling is not compiled in.
+bool h_profile_enable(bool on);
+
+/// Forget all counts.
+void h_profile_reset(void);
+
+/**
+ * Copy up to [n] entries into [entries], most expensive first: parsers by
+ * self_ns, then productions and states by count. Returns the number of
+ * entries there are, which may be more than [n].
+ */
+size_t h_profile_entries(HProfileEntry* entries, size_t n);
+
+/// Print the entries as tables, most expensive first, naming parsers
+/// by h_name_parser.
+void h_profile_report(FILE* stream);
+
+/**
+ * Give [p] a name for profiles, unless it has one; returns [p]. The H_RULE
+ * macros in glue.h name their parsers after their variables.
+ */
+HParser* h_name_parser(HParser* p, const char* name);
+const char* h_get_parser_name(const HParser* p);
 // }}}
 
 // {{{ Token type registry
@@ -787,6 +1283,32 @@ HTokenType h_get_token_type_number(const char* name);
 
 /// Get the name associated with token_type. Returns NULL if the token type is unkown
 const char* h_get_token_type_name(HTokenType token_type);
+
+/**
+ * How h_serialize_token and h_deserialize_token handle the value of a
+ * user token type.
+ *
+ * write() is called twice per token: once with a NULL buf to learn the
+ * size of the serialised value, then with a buf of [len] >= that size. It
+ * returns the size, or (size_t)-1 if the token cannot be serialised.
+ *
+ * read() returns the token's user pointer, allocated from arena, for a
+ * serialised value, or NULL if it is malformed. The value is at the
+ * start of buf; it need not be aligned beyond 8 bytes.
+ */
+typedef struct HTokenSerializer_ {
+  size_t (*write)(const HParsedToken* tok, uint8_t* buf, size_t len, void* env);
+  void* (*read)(HArena* arena, const uint8_t* buf, size_t len, void* env);
+  void* env;
+} HTokenSerializer;
+
+/// Set the serialiser of a token type allocated with h_allocate_token_type.
+/// ser is not copied and must outlive its use. Returns -1 if the token type
+/// is unknown.
+int h_set_token_type_serializer(HTokenType token_type, const HTokenSerializer* ser);
+
+/// Get the serialiser of token_type, or NULL if it has none.
+const HTokenSerializer* h_get_token_type_serializer(HTokenType token_type);
 // }}}
 
 #ifdef __cplusplus
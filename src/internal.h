@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <setjmp.h>
 #include "hammer.h"
 #include "platform.h"
 
@@ -69,9 +70,18 @@ extern HAllocator system_allocator;
 typedef struct HCFStack_ HCFStack;
 
 
+// Input made up of several segments, for h_parse_iov.
+typedef struct HInputVector_ {
+  const struct iovec *iov;
+  size_t n;
+  size_t *offsets;      // offsets[i] is the position of segment i; offsets[n] the total
+  size_t hint;          // segment of the last access
+} HInputVector;
+
 typedef struct HInputStream_ {
   // This should be considered to be a really big value type.
-  const uint8_t *input;
+  const uint8_t *input; // NULL if the input is scattered
+  HInputVector *iov;    // the segments of a scattered input, or NULL
   size_t pos;  // position of this chunk in a multi-chunk stream
   size_t index;
   size_t length;
@@ -81,6 +91,7 @@ typedef struct HInputStream_ {
   char endianness;
   bool overrun;
   bool last_chunk;
+  struct HParseLimiter_ *limiter; // under h_parse_limited, else NULL
 } HInputStream;
 
 typedef struct HSlistNode_ {
@@ -142,9 +153,10 @@ static inline void h_sarray_clear(HSArray *arr) {
 #define H__INTVAR(pfx) H__APPEND(intvar__##pfx##__,__COUNTER__)
 
 #define H_SARRAY_FOREACH_KV_(var,idx,arr,intvar)			\
-  for (size_t intvar = 0, idx = (var = (arr)->nodes[(arr)->nodes[intvar].elem].content,(arr)->nodes[intvar].elem); \
-       intvar < (arr)->used;						\
-       idx = (arr)->nodes[intvar].elem, var = (arr)->nodes[(arr)->nodes[intvar].elem].content, intvar=intvar+1)
+  for (size_t intvar = 0, idx = 0;					\
+       intvar < (arr)->used &&						\
+	 (idx = (arr)->nodes[intvar].elem, var = (arr)->nodes[idx].content, true); \
+       intvar++)
 
 #define H_SARRAY_FOREACH_KV(var,index,arr) H_SARRAY_FOREACH_KV_(var,index,arr,H__INTVAR(idx))
 #define H_SARRAY_FOREACH_V(var,arr) H_SARRAY_FOREACH_KV_(var,H__INTVAR(elem),arr,H__INTVAR(idx))
@@ -171,6 +183,20 @@ static inline void charset_set(HCharset cs, uint8_t pos, int val) {
     : cs[pos / (sizeof(*cs)*8)] & ~(1 << (pos % (sizeof(*cs)*8)));
 }
 
+// a charset, prepared for finding the longest prefix of an input that is
+// in it; see span.c.
+typedef struct HSpanTable_ {
+  uint8_t member[256];
+  uint8_t lo[16], hi[16];       // by the low and high nibble of a byte
+  size_t (*scan)(const struct HSpanTable_ *t, const uint8_t *p, size_t n);
+} HSpanTable;
+
+void h_span_table_init(HSpanTable *t, HCharset cs);
+// the number of bytes at the start of p[0..n) that are in the set
+static inline size_t h_span(const HSpanTable *t, const uint8_t *p, size_t n) {
+  return t->scan(t, p, n);
+}
+
 typedef unsigned int HHashValue;
 typedef HHashValue (*HHashFunc)(const void* key);
 typedef bool (*HEqualFunc)(const void* key1, const void* key2);
@@ -194,7 +220,7 @@ typedef struct HHashTable_ {
 /* The state of the parser.
  *
  * Members:
- *   cache - a hash table describing the state of the parse, including partial HParseResult's. It's a hash table from HParserCacheKey to HParserCacheValue. 
+ *   cache - a hash table describing the state of the parse, including partial HParseResult's. It's a hash table from HParserCacheKey to HParserCacheValue. Only higher-order parsers are cached, since only they are looked up. 
  *   input_stream - the input stream at this state.
  *   arena - the arena that has been allocated for the parse this state is in.
  *   lr_stack - a stack of HLeftRec's, used in Warth's recursion
@@ -210,6 +236,17 @@ struct HParseState_ {
   HSlist *lr_stack;
   HHashTable *recursion_heads;
   HSlist *symbol_table; // its contents are HHashTables
+  HParsedToken **byte_tokens; // shared TT_UINT tokens for runs of bytes, by value
+  bool defer_actions;         // h_action leaves placeholders; see h_force_actions
+  HHashTable *forced;         // sequences h_force_actions has been through
+#ifdef HAMMER_PROFILE
+  struct HProfileScope_ *profile; // NULL if not profiling
+#endif
+};
+
+struct HCompiledParser_ {
+  HAllocator *mm__;             // of the tables
+  HParser parser;               // private copy of the top-level parser
 };
 
 struct HSuspendedParser_ {
@@ -226,6 +263,9 @@ struct HSuspendedParser_ {
 
 typedef struct HParserBackendVTable_ {
   int (*compile)(HAllocator *mm__, HParser* parser, const void* params);
+  int (*compile_threads)(HAllocator *mm__, HParser* parser, const void* params,
+                         unsigned int threads);
+    // optional. like compile, but may use up to the given number of threads.
   HParseResult* (*parse)(HAllocator *mm__, const HParser* parser, HInputStream* stream);
   void (*free)(HParser* parser);
 
@@ -238,6 +278,13 @@ typedef struct HParserBackendVTable_ {
   HParseResult *(*parse_finish)(HSuspendedParser *s);
     // parse_finish must free s->backend_state.
     // parse_finish will not be called before parse_chunk reports done.
+
+  int (*dump_code)(FILE *f, const HParser *parser, const char *prefix);
+    // optional. writes C source for the compiled parser, see h_dump_code.
+
+  int (*parse_events)(HAllocator *mm__, const HParser *parser,
+                      HInputStream *stream, HParseEventSink *sink);
+    // optional. see h_parse_events.
 } HParserBackendVTable;
 
 
@@ -290,7 +337,8 @@ typedef struct HLeftRec_ {
 
 /* Tagged union for values in the cache: either HLeftRec's (Left) or 
  * HParseResult's (Right).
- * Includes the position (input_stream) to advance to after using this value.
+ * Includes the position (input_stream) to advance to after using this value,
+ * and the key it is cached under, so that one allocation holds both.
  */
 typedef struct HParserCacheValue_t {
   HParserCacheValueType value_type;
@@ -299,6 +347,7 @@ typedef struct HParserCacheValue_t {
     HParseResult *right;
   };
   HInputStream input_stream;
+  HParserCacheKey key;
 } HParserCacheValue;
 
 // This file provides the logical inverse of bitreader.c
@@ -322,17 +371,78 @@ extern HParserBackendVTable h__packrat_backend_vtable;
 extern HParserBackendVTable h__llk_backend_vtable;
 extern HParserBackendVTable h__lalr_backend_vtable;
 extern HParserBackendVTable h__glr_backend_vtable;
+extern HParserBackendVTable h__earley_backend_vtable;
 // }}}
 
 // TODO(thequux): Set symbol visibility for these functions so that they aren't exported.
 
 int64_t h_read_bits(HInputStream* state, int count, char signed_p);
+uint8_t h_iov_byte(HInputVector *iov, size_t i);
+void h_iov_copy(HInputVector *iov, uint8_t *dst, size_t i, size_t n);
+// byte i of the input, which may be scattered
+static inline uint8_t h_input_byte(const HInputStream* state, size_t i) {
+  return state->input ? state->input[i] : h_iov_byte(state->iov, i);
+}
+// h_read_bits(state, 8, false), without the call when on a byte boundary
+static inline uint8_t h_read_byte(HInputStream* state) {
+  if (state->bit_offset == 0 && state->margin == 0 && state->input && state->index < state->length)
+    return state->input[state->index++];
+  return h_read_bits(state, 8, false);
+}
+
+// The limits of a parse under h_parse_limited, and the allocator that all
+// of its memory comes from; see limits.c. The backends count their steps
+// with h_limit_steps, and call h_limit_end where they find the end of
+// their input. Either may unwind the parse to h_parse_limited.
+typedef union HLimitBlock_ HLimitBlock;
+typedef struct HParseLimiter_ {
+  HAllocator allocator;         // must be first
+  HAllocator *backing;
+  size_t steps_left;            // SIZE_MAX for no limit
+  size_t bytes, max_bytes;      // max_bytes 0 for no limit
+  bool cut;                     // the input stream ends before the input
+  bool done;                    // the parse returned; no more limits
+  HLimitBlock *blocks;          // all the memory allocated, in a list
+  HParseStatus why;             // the limit the parse was unwound for
+  jmp_buf abort;
+} HParseLimiter;
+
+H_MSVC_DECLSPEC(noreturn)
+void h_limit_abort(HParseLimiter *l, HParseStatus why) H_GCC_ATTRIBUTE((noreturn));
+// A limiter for a parse of length bytes, or NULL if out of memory. Once the
+// parse is over, unwound or not, it is released; it is then freed along
+// with the last of the memory of the result.
+HParseLimiter *h_limiter_new(HAllocator *mm__, const HParseLimits *limits, size_t length);
+void h_limiter_unwind(HParseLimiter *l); // frees all the memory
+void h_limiter_release(HParseLimiter *l);
+static inline void h_limit_steps(const HInputStream *in, size_t n) {
+  HParseLimiter *l = in->limiter;
+  if (l) {
+    if (l->steps_left < n)
+      h_limit_abort(l, H_PARSE_STEP_LIMIT);
+    l->steps_left -= n;
+  }
+}
+static inline void h_limit_end(const HInputStream *in) {
+  if (in->limiter && in->limiter->cut)
+    h_limit_abort(in->limiter, H_PARSE_LOOKAHEAD_LIMIT);
+}
+
 static inline size_t h_input_stream_pos(HInputStream* state) {
   return state->index * 8 + state->bit_offset + state->margin;
 }
 // need to decide if we want to make this public. 
 HParseResult* h_do_parse(const HParser* parser, HParseState *state);
 void put_cached(HParseState *ps, const HParser *p, HParseResult *cached);
+// A packrat parse state over input_stream that allocates from arena, for
+// parsing separate parts of one input.
+HParseState *h_packrat_state_new(HArena *arena, const HInputStream *input_stream);
+void h_packrat_state_free(HParseState *state);
+// With state->defer_actions, h_action only records what to call. This calls
+// the actions recorded in tok, innermost first, and returns tok with their
+// results in place (without state->defer_actions, tok as it is). Parsers that look at a sub-parser's AST while parsing
+// have to call it first.
+const HParsedToken *h_force_actions(HParseState *state, const HParsedToken *tok);
 
 static inline
 HParser *h_new_parser(HAllocator *mm__, const HParserVtable *vt, void *env) {
@@ -345,6 +455,39 @@ HParser *h_new_parser(HAllocator *mm__, const HParserVtable *vt, void *env) {
 
 HCFChoice *h_desugar(HAllocator *mm__, HCFStack *stk__, const HParser *parser);
 
+#ifdef HAMMER_PROFILE
+// The counts of one parse, added to the totals by h_profile_end. begin
+// returns NULL unless profiling is enabled; end accepts NULL, the others
+// need a scope.
+typedef struct HProfileScope_ HProfileScope;
+HProfileScope *h_profile_begin(HAllocator *mm__, const HParser *root);
+void h_profile_end(HProfileScope *scope);
+// the entry for (kind, key, index), made if new. key tells apart what the
+// entry counts: the parser, a nonterminal's HCFChoice, or an LR table.
+HProfileEntry *h_profile_entry(HProfileScope *scope, HProfileKind kind,
+                               const void *key, size_t index, const HParser *parser);
+const HParser *h_profile_root(const HProfileScope *scope);
+// around a call whose time is counted. stop adds the time since start to
+// entry, and to its self_ns less the time of calls timed in between.
+typedef struct {
+  int64_t start;
+  int64_t outer_children;
+} HProfileTimer;
+void h_profile_start(HProfileScope *scope, HProfileTimer *t);
+void h_profile_stop(HProfileScope *scope, HProfileEntry *entry, const HProfileTimer *t);
+#endif
+
+// Used by code from h_dump_code to find the symbols of the original grammar.
+int h_codegen_bind(const HParser *parser, HCFChoice **syms, size_t n);
+
+// Runs fn(env, worker, i) for i = 0..n-1 on up to 'threads' threads, the
+// calling thread included. 'worker' (< threads) numbers the thread a call runs
+// on, for indexing per-thread state. Once a call returns nonzero, no further
+// calls are started. Returns -1 if any call failed, 0 otherwise.
+int h_parallel_for(unsigned int threads, size_t n,
+                   int (*fn)(void *env, unsigned int worker, size_t i),
+                   void *env);
+
 HCountedArray *h_carray_new_sized(HArena * arena, size_t size);
 HCountedArray *h_carray_new(HArena * arena);
 void h_carray_append(HCountedArray *array, void* item);
@@ -407,6 +550,7 @@ struct HCFChoice_ {
   HAction action;
   HPredicate pred;
   void* user_data;
+  const HParser *parser; // the parser this is the desugared form of, if any
 };
 
 struct HCFSequence_ {
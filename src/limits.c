@@ -0,0 +1,123 @@
+/* Parsing with limits on memory and time; see h_parse_limited. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "internal.h"
+
+// Every block the parse allocates is in a list, so that they can all be
+// freed when it is unwound.
+union HLimitBlock_ {
+  struct {
+    HLimitBlock *prev, *next;
+    size_t size;
+  } h;
+  max_align_t align;
+};
+
+static void link_block(HParseLimiter *l, HLimitBlock *b, size_t size) {
+  b->h.size = size;
+  b->h.prev = NULL;
+  b->h.next = l->blocks;
+  if (l->blocks)
+    l->blocks->h.prev = b;
+  l->blocks = b;
+  l->bytes += size;
+}
+
+static void unlink_block(HParseLimiter *l, HLimitBlock *b) {
+  if (b->h.prev)
+    b->h.prev->h.next = b->h.next;
+  else
+    l->blocks = b->h.next;
+  if (b->h.next)
+    b->h.next->h.prev = b->h.prev;
+  l->bytes -= b->h.size;
+}
+
+void h_limit_abort(HParseLimiter *l, HParseStatus why) {
+  l->why = why;
+  longjmp(l->abort, 1);
+}
+
+// Once the parse has returned, the limiter only serves the result, without
+// limits, and goes when the last of its memory does.
+static void *limit_alloc(HAllocator *allocator, size_t size) {
+  HParseLimiter *l = (HParseLimiter *)allocator;
+  if (!l->done && l->max_bytes && size > l->max_bytes - l->bytes)
+    h_limit_abort(l, H_PARSE_MEMORY_LIMIT);
+  HLimitBlock *b = l->backing->alloc(l->backing, sizeof(HLimitBlock) + size);
+  if (!b) {
+    if (!l->done)
+      h_limit_abort(l, H_PARSE_OUT_OF_MEMORY);
+    return NULL;
+  }
+  link_block(l, b, size);
+  return b + 1;
+}
+
+static void *limit_realloc(HAllocator *allocator, void *ptr, size_t size) {
+  HParseLimiter *l = (HParseLimiter *)allocator;
+  if (!ptr)
+    return limit_alloc(allocator, size);
+  HLimitBlock *b = (HLimitBlock *)ptr - 1;
+  if (!l->done && l->max_bytes && size > b->h.size
+      && size - b->h.size > l->max_bytes - l->bytes)
+    h_limit_abort(l, H_PARSE_MEMORY_LIMIT);
+
+  // the block may move, so it leaves the list meanwhile
+  size_t old = b->h.size;
+  unlink_block(l, b);
+  HLimitBlock *nb = l->backing->realloc(l->backing, b, sizeof(HLimitBlock) + size);
+  if (!nb) {
+    link_block(l, b, old);
+    if (!l->done)
+      h_limit_abort(l, H_PARSE_OUT_OF_MEMORY);
+    return NULL;
+  }
+  link_block(l, nb, size);
+  return nb + 1;
+}
+
+static void limit_free(HAllocator *allocator, void *ptr) {
+  HParseLimiter *l = (HParseLimiter *)allocator;
+  if (!ptr)
+    return;
+  HLimitBlock *b = (HLimitBlock *)ptr - 1;
+  unlink_block(l, b);
+  l->backing->free(l->backing, b);
+  if (l->done && !l->blocks) {
+    HAllocator *mm__ = l->backing;
+    h_free(l);
+  }
+}
+
+HParseLimiter *h_limiter_new(HAllocator *mm__, const HParseLimits *limits, size_t length) {
+  HParseLimiter *l = h_new(HParseLimiter, 1);
+  if (!l)
+    return NULL;
+  memset(l, 0, sizeof(HParseLimiter));
+  l->allocator.alloc = limit_alloc;
+  l->allocator.realloc = limit_realloc;
+  l->allocator.free = limit_free;
+  l->backing = mm__;
+  l->steps_left = limits->max_steps ? limits->max_steps : SIZE_MAX;
+  l->max_bytes = limits->max_memory;
+  l->cut = limits->max_lookahead && limits->max_lookahead < length;
+  return l;
+}
+
+void h_limiter_unwind(HParseLimiter *l) {
+  while (l->blocks) {
+    HLimitBlock *b = l->blocks;
+    unlink_block(l, b);
+    l->backing->free(l->backing, b);
+  }
+}
+
+void h_limiter_release(HParseLimiter *l) {
+  HAllocator *mm__ = l->backing;
+  l->done = true;
+  if (!l->blocks)
+    h_free(l);
+}
@@ -0,0 +1,484 @@
+/* Packed parse trees: all tokens in one block, in pre-order. The same
+ * layout, with the byte strings and user values copied in, serves as a
+ * binary serialisation that can be read in place. */
+
+#include <assert.h>
+#include <string.h>
+#include "hammer.h"
+#include "internal.h"
+
+typedef struct {
+  HAllocator *mm__;
+  bool serial;                  // h_serialize_token rather than h_pack_token
+  size_t ntokens, nelems;       // counted, then used so far
+  size_t ndata;                 // serial: bytes of values, likewise
+  HTokenType *types;            // serial: user types seen
+  size_t ntypes, types_cap;
+  HPackedToken *tokens;
+  uint32_t *elems;              // right behind the tokens
+  uint8_t *data;                // serial: the values
+} HPacker;
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+static bool is_builtin(HTokenType tt) {
+  switch (tt) {
+  case TT_NONE:
+  case TT_BYTES:
+  case TT_SINT:
+  case TT_UINT:
+  case TT_SEQUENCE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool add_type(HPacker *pk, HTokenType tt) {
+  HAllocator *mm__ = pk->mm__;
+  for (size_t i = 0; i < pk->ntypes; i++)
+    if (pk->types[i] == tt)
+      return true;
+  if (pk->ntypes == pk->types_cap) {
+    size_t cap = pk->types_cap ? 2 * pk->types_cap : 4;
+    HTokenType *types = mm__->realloc(mm__, pk->types, cap * sizeof(HTokenType));
+    if (!types)
+      return false;
+    pk->types = types;
+    pk->types_cap = cap;
+  }
+  pk->types[pk->ntypes++] = tt;
+  return true;
+}
+
+// the serialised size of a user value, or (size_t)-1
+static size_t user_size(const HParsedToken *tok) {
+  const HTokenSerializer *ser = h_get_token_type_serializer(tok->token_type);
+  if (!ser || !ser->write)
+    return (size_t)-1;
+  return ser->write(tok, NULL, 0, ser->env);
+}
+
+// count the tokens and sequence elements under tok, and for serialisation
+// the size of their values. false if something is too large to pack, or
+// cannot be serialised.
+static bool count_tokens(HPacker *pk, const HParsedToken *tok) {
+  pk->ntokens++;
+  if (!tok)
+    return true;
+  if (tok->token_type > UINT16_MAX)
+    return false;
+  if (pk->serial && !is_builtin(tok->token_type)) {
+    if (tok->token_type < TT_USER || !add_type(pk, tok->token_type))
+      return false;
+    size_t n = user_size(tok);
+    if (n == (size_t)-1 || n > UINT32_MAX)
+      return false;
+    pk->ndata = ALIGN8(pk->ndata) + n;
+    return true;
+  }
+  if (tok->token_type == TT_BYTES) {
+    pk->ndata += tok->bytes.len;
+    return tok->bytes.len <= UINT32_MAX;
+  }
+  if (tok->token_type != TT_SEQUENCE)
+    return true;
+  pk->nelems += tok->seq->used;
+  for (size_t i = 0; i < tok->seq->used; i++)
+    if (!count_tokens(pk, tok->seq->elements[i]))
+      return false;
+  return true;
+}
+
+static bool pack(HPacker *pk, const HParsedToken *tok) {
+  HPackedToken *p = &pk->tokens[pk->ntokens++];
+  memset(p, 0, sizeof(HPackedToken));
+  if (!tok) {
+    p->token_type = TT_INVALID;
+    p->size = 1;
+    return true;
+  }
+
+  p->token_type = tok->token_type;
+  p->bit_offset = tok->bit_offset;
+  p->index = tok->index;
+  switch (tok->token_type) {
+  case TT_BYTES:
+    p->len = tok->bytes.len;
+    if (pk->serial) {
+      uint8_t *data = pk->data + pk->ndata;
+      if (p->len > 0)
+        memcpy(data, tok->bytes.token, p->len);
+      p->elements = data - (uint8_t *)p;
+      pk->ndata += p->len;
+    } else {
+      p->bytes = tok->bytes.token;
+    }
+    break;
+  case TT_SINT:
+    p->sint = tok->sint;
+    break;
+  case TT_UINT:
+    p->uint = tok->uint;
+    break;
+  case TT_SEQUENCE: {
+    uint32_t *elems = pk->elems + pk->nelems;
+    p->len = tok->seq->used;
+    p->elements = (const uint8_t *)elems - (const uint8_t *)p;
+    pk->nelems += p->len;
+    for (size_t i = 0; i < p->len; i++) {
+      elems[i] = &pk->tokens[pk->ntokens] - p;
+      if (!pack(pk, tok->seq->elements[i]))
+        return false;
+    }
+    break;
+  }
+  default:
+    if (pk->serial && tok->token_type != TT_NONE) {
+      // a user value; count_tokens reserved its size
+      const HTokenSerializer *ser = h_get_token_type_serializer(tok->token_type);
+      size_t n = user_size(tok);
+      uint8_t *data = pk->data + ALIGN8(pk->ndata);
+      if (n == (size_t)-1 || ser->write(tok, data, n, ser->env) != n)
+        return false;
+      p->len = n;
+      p->elements = data - (uint8_t *)p;
+      pk->ndata = ALIGN8(pk->ndata) + n;
+      break;
+    }
+    // TT_NONE has no value; the widest member carries whatever a user type
+    // keeps in the union
+    p->uint = tok->uint;
+    break;
+  }
+  p->size = &pk->tokens[pk->ntokens] - p;
+  return true;
+}
+
+HPackedToken* h_pack_token(const HParsedToken* tok) {
+  return h_pack_token__m(&system_allocator, tok);
+}
+HPackedToken* h_pack_token__m(HAllocator* mm__, const HParsedToken* tok) {
+  if (!tok)
+    return NULL;
+  HPacker pk = {.mm__ = mm__, .serial = false};
+  if (!count_tokens(&pk, tok))
+    return NULL;
+  size_t ntokens = pk.ntokens, nelems = pk.nelems;
+  // every offset into the block has to fit in 32 bits
+  if (nelems > UINT32_MAX / sizeof(uint32_t)
+      || ntokens > (UINT32_MAX - nelems * sizeof(uint32_t)) / sizeof(HPackedToken))
+    return NULL;
+
+  size_t size = ntokens * sizeof(HPackedToken) + nelems * sizeof(uint32_t);
+  HPackedToken *tokens = mm__->alloc(mm__, size);
+  if (!tokens)
+    return NULL;
+  pk.tokens = tokens;
+  pk.elems = (uint32_t *)(tokens + ntokens);
+  pk.ntokens = pk.nelems = 0;
+  pack(&pk, tok);
+  assert(pk.ntokens == ntokens && pk.nelems == nelems);
+  return tokens;
+}
+
+void h_packed_token_free(HPackedToken* tok) {
+  h_packed_token_free__m(&system_allocator, tok);
+}
+void h_packed_token_free__m(HAllocator* mm__, HPackedToken* tok) {
+  if (tok)
+    h_free(tok);
+}
+
+size_t h_packed_seq_len(const HPackedToken* p) {
+  assert(p != NULL);
+  assert(p->token_type == TT_SEQUENCE);
+  return p->len;
+}
+
+const HPackedToken* h_packed_seq_index(const HPackedToken* p, size_t i) {
+  assert(p != NULL);
+  assert(p->token_type == TT_SEQUENCE);
+  assert(i < p->len);
+  const uint32_t *elems = (const uint32_t *)((const uint8_t *)p + p->elements);
+  const HPackedToken *elem = p + elems[i];
+  return elem->token_type == TT_INVALID ? NULL : elem;
+}
+
+HParsedToken* h_unpack_token(HArena* arena, const HPackedToken* p) {
+  if (!p)
+    return NULL;
+  HParsedToken *tok = h_arena_malloc(arena, sizeof(HParsedToken));
+  tok->token_type = p->token_type;
+  tok->index = p->index;
+  tok->bit_length = 0;
+  tok->bit_offset = p->bit_offset;
+  switch (p->token_type) {
+  case TT_BYTES:
+    tok->bytes.token = p->bytes;
+    tok->bytes.len = p->len;
+    break;
+  case TT_SINT:
+    tok->sint = p->sint;
+    break;
+  case TT_UINT:
+    tok->uint = p->uint;
+    break;
+  case TT_SEQUENCE:
+    tok->seq = h_carray_new_sized(arena, p->len);
+    for (size_t i = 0; i < p->len; i++)
+      h_carray_append(tok->seq, h_unpack_token(arena, h_packed_seq_index(p, i)));
+    break;
+  default:
+    tok->uint = p->uint;
+    break;
+  }
+  return tok;
+}
+
+
+/* Serialisation
+ *
+ * A buffer is laid out as
+ *
+ *   header | tokens | element offsets | user types | pad to 8 | values | names
+ *
+ * where the tokens and element offsets are those of h_pack_token, and the
+ * values are the bytes of TT_BYTES tokens and the serialised user values,
+ * each of the latter aligned to 8 bytes. All of it is in the writer's byte
+ * order; the magic number and token size reject a buffer from a different
+ * architecture or version.
+ */
+
+#define SERIAL_MAGIC 0x48414d52   // "HAMR"
+#define SERIAL_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t token_size;          // sizeof(HPackedToken)
+  uint32_t length;              // of the whole buffer
+  uint32_t ntokens;
+  uint32_t nelems;
+  uint32_t ntypes;
+} HSerialHeader;
+
+typedef struct {
+  uint32_t token_type;          // as numbered by the writer
+  uint32_t name;                // offset in the buffer of its NUL-terminated name
+  uint32_t name_len;
+} HSerialType;
+
+uint8_t* h_serialize_token(const HParsedToken* tok, size_t* length) {
+  return h_serialize_token__m(&system_allocator, tok, length);
+}
+uint8_t* h_serialize_token__m(HAllocator* mm__, const HParsedToken* tok, size_t* length) {
+  if (!tok)
+    return NULL;
+  uint8_t *buf = NULL;
+  HPacker pk = {.mm__ = mm__, .serial = true};
+  if (!count_tokens(&pk, tok))
+    goto out;
+  size_t ntokens = pk.ntokens, nelems = pk.nelems, ndata = pk.ndata;
+
+  size_t types = sizeof(HSerialHeader) + ntokens * sizeof(HPackedToken)
+                 + nelems * sizeof(uint32_t);
+  size_t types_end = types + pk.ntypes * sizeof(HSerialType);
+  size_t data = ALIGN8(types_end);
+  size_t size = data + ndata;
+  for (size_t i = 0; i < pk.ntypes; i++)
+    size += strlen(h_get_token_type_name(pk.types[i])) + 1;
+  // every offset into the buffer has to fit in 32 bits
+  if (size > UINT32_MAX)
+    goto out;
+
+  buf = mm__->alloc(mm__, size);
+  if (!buf)
+    goto out;
+  HSerialHeader *hdr = (HSerialHeader *)buf;
+  hdr->magic = SERIAL_MAGIC;
+  hdr->version = SERIAL_VERSION;
+  hdr->token_size = sizeof(HPackedToken);
+  hdr->length = size;
+  hdr->ntokens = ntokens;
+  hdr->nelems = nelems;
+  hdr->ntypes = pk.ntypes;
+
+  pk.tokens = (HPackedToken *)(buf + sizeof(HSerialHeader));
+  pk.elems = (uint32_t *)(pk.tokens + ntokens);
+  pk.data = buf + data;
+  pk.ntokens = pk.nelems = pk.ndata = 0;
+  // the padding is sent too; do not leak whatever the allocator left there
+  memset(buf + types_end, 0, size - types_end);
+  if (!pack(&pk, tok)) {
+    h_free(buf);
+    buf = NULL;
+    goto out;
+  }
+  assert(pk.ntokens == ntokens && pk.nelems == nelems && pk.ndata == ndata);
+
+  HSerialType *st = (HSerialType *)(buf + types);
+  size_t name = data + ndata;
+  for (size_t i = 0; i < pk.ntypes; i++) {
+    const char *s = h_get_token_type_name(pk.types[i]);
+    st[i].token_type = pk.types[i];
+    st[i].name = name;
+    st[i].name_len = strlen(s);
+    memcpy(buf + name, s, st[i].name_len + 1);
+    name += st[i].name_len + 1;
+  }
+  assert(name == size);
+  *length = size;
+
+ out:
+  if (pk.types)
+    h_free(pk.types);
+  return buf;
+}
+
+static const HSerialType* serial_type(const uint8_t *buf, HTokenType token_type) {
+  const HSerialHeader *hdr = (const HSerialHeader *)buf;
+  const HSerialType *st = (const HSerialType *)(buf + sizeof(HSerialHeader)
+                                                + hdr->ntokens * sizeof(HPackedToken)
+                                                + hdr->nelems * sizeof(uint32_t));
+  for (size_t i = 0; i < hdr->ntypes; i++)
+    if (st[i].token_type == token_type)
+      return &st[i];
+  return NULL;
+}
+
+const HPackedToken* h_read_serialized(const uint8_t* buf, size_t length) {
+  const HSerialHeader *hdr = (const HSerialHeader *)buf;
+  if (!buf || (uintptr_t)buf % 8 != 0 || length < sizeof(HSerialHeader))
+    return NULL;
+  if (hdr->magic != SERIAL_MAGIC || hdr->version != SERIAL_VERSION
+      || hdr->token_size != sizeof(HPackedToken) || hdr->length != length
+      || hdr->ntokens == 0)
+    return NULL;
+
+  // each count is checked against length before it is multiplied, so the
+  // region boundaries cannot overflow
+  if (hdr->ntokens > length / sizeof(HPackedToken))
+    return NULL;
+  size_t elems = sizeof(HSerialHeader) + hdr->ntokens * sizeof(HPackedToken);
+  if (elems > length || hdr->nelems > (length - elems) / sizeof(uint32_t))
+    return NULL;
+  size_t types = elems + hdr->nelems * sizeof(uint32_t);
+  if (hdr->ntypes > (length - types) / sizeof(HSerialType))
+    return NULL;
+  size_t data = ALIGN8(types + hdr->ntypes * sizeof(HSerialType));
+  if (data > length)
+    return NULL;
+
+  const HSerialType *st = (const HSerialType *)(buf + types);
+  for (size_t i = 0; i < hdr->ntypes; i++) {
+    if (st[i].token_type < TT_USER || st[i].token_type > UINT16_MAX
+        || st[i].name < data || st[i].name >= length
+        || st[i].name_len >= length - st[i].name
+        || buf[st[i].name + st[i].name_len] != '\0')
+      return NULL;
+  }
+
+  const HPackedToken *tokens = (const HPackedToken *)(buf + sizeof(HSerialHeader));
+  if (tokens[0].size != hdr->ntokens || tokens[0].token_type == TT_INVALID)
+    return NULL;
+  for (size_t i = 0; i < hdr->ntokens; i++) {
+    const HPackedToken *p = &tokens[i];
+    size_t off = (const uint8_t *)p - buf + p->elements;
+    if (p->size == 0 || p->size > hdr->ntokens - i)
+      return NULL;
+    switch (p->token_type) {
+    case TT_SEQUENCE: {
+      // the element offsets are in their region, and each element's subtree
+      // is inside this one's
+      if (off < elems || off > types || off % sizeof(uint32_t) != 0
+          || p->len > (types - off) / sizeof(uint32_t))
+        return NULL;
+      const uint32_t *offsets = (const uint32_t *)(buf + off);
+      for (size_t j = 0; j < p->len; j++) {
+        if (offsets[j] == 0 || offsets[j] >= p->size
+            || p[offsets[j]].size > p->size - offsets[j])
+          return NULL;
+      }
+      continue;
+    }
+    case TT_INVALID:
+    case TT_NONE:
+    case TT_SINT:
+    case TT_UINT:
+      break;
+    default:
+      if (p->token_type != TT_BYTES && !serial_type(buf, p->token_type))
+        return NULL;
+      if (off < data || off > length || p->len > length - off)
+        return NULL;
+      break;
+    }
+    if (p->size != 1)
+      return NULL;
+  }
+  return tokens;
+}
+
+const uint8_t* h_serialized_data(const HPackedToken* tok) {
+  assert(tok != NULL);
+  assert(tok->token_type == TT_BYTES || tok->token_type >= TT_USER);
+  return (const uint8_t *)tok + tok->elements;
+}
+
+const char* h_serialized_type_name(const uint8_t* buf, HTokenType token_type) {
+  const HSerialType *st = serial_type(buf, token_type);
+  return st ? (const char *)buf + st->name : NULL;
+}
+
+static HParsedToken* deserialize(HArena *arena, const uint8_t *buf, const HPackedToken *p,
+                                 bool *ok) {
+  if (!p)
+    return NULL;
+  HParsedToken *tok = h_arena_malloc(arena, sizeof(HParsedToken));
+  tok->token_type = p->token_type;
+  tok->index = p->index;
+  tok->bit_length = 0;
+  tok->bit_offset = p->bit_offset;
+  switch (p->token_type) {
+  case TT_NONE:
+    break;
+  case TT_BYTES:
+    tok->bytes.token = h_serialized_data(p);
+    tok->bytes.len = p->len;
+    break;
+  case TT_SINT:
+    tok->sint = p->sint;
+    break;
+  case TT_UINT:
+    tok->uint = p->uint;
+    break;
+  case TT_SEQUENCE:
+    tok->seq = h_carray_new_sized(arena, p->len);
+    for (size_t i = 0; i < p->len && *ok; i++)
+      h_carray_append(tok->seq, deserialize(arena, buf, h_packed_seq_index(p, i), ok));
+    break;
+  default: {
+    // h_read_serialized made sure the writer named it
+    HTokenType tt = h_get_token_type_number(h_serialized_type_name(buf, p->token_type));
+    const HTokenSerializer *ser = h_get_token_type_serializer(tt);
+    tok->token_type = tt;
+    tok->user = NULL;
+    if (ser && ser->read)
+      tok->user = ser->read(arena, h_serialized_data(p), p->len, ser->env);
+    if (!tok->user)
+      *ok = false;
+    break;
+  }
+  }
+  return tok;
+}
+
+HParsedToken* h_deserialize_token(HArena* arena, const uint8_t* buf, size_t length) {
+  const HPackedToken *root = h_read_serialized(buf, length);
+  if (!root)
+    return NULL;
+  bool ok = true;
+  HParsedToken *tok = deserialize(arena, buf, root, &ok);
+  return ok ? tok : NULL;
+}
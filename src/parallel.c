@@ -0,0 +1,150 @@
+/* Spreading independent work items over threads */
+
+#include "internal.h"
+
+typedef struct HParallelJob_ {
+  struct HMutex lock;
+  size_t next;          // index of the next item to hand out
+  size_t n;
+  int ret;
+  int (*fn)(void *env, unsigned int worker, size_t i);
+  void *env;
+} HParallelJob;
+
+typedef struct HParallelWorker_ {
+  struct HThread thread;
+  HParallelJob *job;
+  unsigned int id;
+} HParallelWorker;
+
+static void run_worker(void *worker_)
+{
+  HParallelWorker *w = worker_;
+  HParallelJob *job = w->job;
+
+  for(;;) {
+    h_platform_mutex_lock(&job->lock);
+    size_t i = job->next++;
+    h_platform_mutex_unlock(&job->lock);
+    if(i >= job->n)
+      break;
+
+    if(job->fn(job->env, w->id, i) != 0) {
+      // fail; stop handing out items
+      h_platform_mutex_lock(&job->lock);
+      job->ret = -1;
+      job->next = job->n;
+      h_platform_mutex_unlock(&job->lock);
+      break;
+    }
+  }
+}
+
+int h_parallel_for(unsigned int threads, size_t n,
+                   int (*fn)(void *env, unsigned int worker, size_t i),
+                   void *env)
+{
+  if(threads > n)
+    threads = n;
+
+  if(threads <= 1) {
+    for(size_t i=0; i<n; i++) {
+      if(fn(env, 0, i) != 0)
+        return -1;
+    }
+    return 0;
+  }
+
+  HParallelJob job = {.next = 0, .n = n, .ret = 0, .fn = fn, .env = env};
+  h_platform_mutex_init(&job.lock);
+
+  // worker 0 is the calling thread. if a thread cannot be started, the
+  // others (and in the worst case the calling thread alone) do its share.
+  HAllocator *mm__ = &system_allocator;
+  HParallelWorker *workers = h_new(HParallelWorker, threads);
+  bool *started = h_new(bool, threads);
+  for(unsigned int i=0; i<threads; i++) {
+    workers[i].job = &job;
+    workers[i].id = i;
+    started[i] = (i > 0
+                  && h_platform_thread_create(&workers[i].thread,
+                                              run_worker, &workers[i]) == 0);
+  }
+
+  run_worker(&workers[0]);
+
+  for(unsigned int i=1; i<threads; i++) {
+    if(started[i])
+      h_platform_thread_join(&workers[i].thread);
+  }
+
+  h_free(started);
+  h_free(workers);
+  h_platform_mutex_destroy(&job.lock);
+  return job.ret;
+}
+
+typedef struct HBatchJob_ {
+  HAllocator *mm__;
+  const HParser *parser;
+  const uint8_t *const *inputs;
+  const size_t *lengths;
+  size_t n;
+  size_t grain;
+  HParseResult **results;
+  size_t *succeeded;            // per worker
+} HBatchJob;
+
+// parse the block of inputs starting at i*grain
+static int parse_block(void *env, unsigned int worker, size_t i)
+{
+  HBatchJob *job = env;
+  size_t end = (i + 1) * job->grain;
+  if(end > job->n)
+    end = job->n;
+
+  for(size_t j = i * job->grain; j < end; j++) {
+    job->results[j] = h_parse__m(job->mm__, job->parser,
+                                 job->inputs[j], job->lengths[j]);
+    if(job->results[j])
+      job->succeeded[worker]++;
+  }
+  return 0;
+}
+
+size_t h_parse_batch(const HParser* parser, const uint8_t* const* inputs, const size_t* lengths,
+                     size_t n, HParseResult** results, const HBatchParams* params) {
+  return h_parse_batch__m(&system_allocator, parser, inputs, lengths, n, results, params);
+}
+
+size_t h_parse_batch__m(HAllocator* mm__, const HParser* parser, const uint8_t* const* inputs,
+                        const size_t* lengths, size_t n, HParseResult** results,
+                        const HBatchParams* params) {
+  unsigned int threads = params && params->threads > 0 ? params->threads : 1;
+  size_t grain = params ? params->grain : 0;
+
+  if(grain == 0) {
+    // enough blocks per thread that the threads finish at about the same
+    // time, but not so many that handing them out costs noticeably.
+    grain = n / ((size_t)threads * 16);
+    if(grain < 1)
+      grain = 1;
+    if(grain > 256)
+      grain = 256;
+  }
+
+  HBatchJob job = {
+    .mm__ = mm__, .parser = parser, .inputs = inputs, .lengths = lengths,
+    .n = n, .grain = grain, .results = results,
+  };
+  job.succeeded = h_new(size_t, threads);
+  memset(job.succeeded, 0, threads * sizeof(size_t));
+
+  h_parallel_for(threads, (n + grain - 1) / grain, parse_block, &job);
+
+  size_t ret = 0;
+  for(unsigned int i=0; i<threads; i++)
+    ret += job.succeeded[i];
+  h_free(job.succeeded);
+  return ret;
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include "parser_internal.h"
 
 typedef struct {
@@ -7,12 +8,33 @@ typedef struct {
   void* user_data;
 } HParseAction;
 
+// A deferred action: the payload of a TT_RESERVED_1 token standing in for
+// the action's result until h_force_actions calls it.
+typedef struct {
+  const HParseAction *a;
+  HParseResult *arg;            // the result of a->p
+  const HParsedToken *value;    // what the action returned, once done
+  bool done;
+} HDeferredAction;
+
 static HParseResult* parse_action(void *env, HParseState *state) {
   HParseAction *a = (HParseAction*)env;
   if (a->p && a->action) {
     HParseResult *tmp = h_do_parse(a->p, state);
     //HParsedToken *tok = a->action(h_do_parse(a->p, state));
     if(tmp) {
+      if (state->defer_actions) {
+	// the memo keeps this result, and the action runs at most once, if
+	// the final parse tree contains it.
+	HDeferredAction *d = a_new(HDeferredAction, 1);
+	d->a = a;
+	d->arg = tmp;
+	d->value = NULL;
+	d->done = false;
+	HTokenResult *ret = make_token_result(state->arena, TT_RESERVED_1);
+	ret->token.user = d;
+	return &ret->result;
+      }
       HParsedToken *tok = (HParsedToken*)a->action(tmp, a->user_data);
       return make_result(state->arena, tok);
     } else
@@ -21,6 +43,51 @@ static HParseResult* parse_action(void *env, HParseState *state) {
     return NULL;
 }
 
+static const HParsedToken *force_deferred(HParseState *state, HDeferredAction *d) {
+  if (!d->done) {
+    d->arg->ast = h_force_actions(state, d->arg->ast);
+    HParsedToken *tok = (HParsedToken*)d->a->action(d->arg, d->a->user_data);
+    // as perform_lowlevel_parse would have done to the result
+    if (tok && tok->bit_length != 0)
+      tok->bit_length = d->arg->bit_length;
+    d->value = tok;
+    d->done = true;
+  }
+  return d->value;
+}
+
+const HParsedToken *h_force_actions(HParseState *state, const HParsedToken *tok) {
+  if (!tok || !state->defer_actions)
+    return tok;
+  if (tok->token_type == TT_RESERVED_1)
+    return force_deferred(state, tok->user);
+  if (tok->token_type != TT_SEQUENCE)
+    return tok;
+
+  // memoized results are shared, so a sequence may be reached again.
+  if (!state->forced)
+    state->forced = h_hashset_new(state->arena, h_eq_ptr, h_hash_ptr);
+  if (h_hashset_present(state->forced, tok->seq))
+    return tok;
+  h_hashset_put(state->forced, tok->seq);
+
+  // as the sequence parsers do, leave out elements that came back NULL
+  HCountedArray *seq = tok->seq;
+  size_t used = 0;
+  for (size_t i = 0; i < seq->used; i++) {
+    HParsedToken *elem = seq->elements[i];
+    if (elem && elem->token_type == TT_RESERVED_1) {
+      elem = (HParsedToken*)force_deferred(state, elem->user);
+      if (!elem)
+	continue;
+    } else
+      elem = (HParsedToken*)h_force_actions(state, elem);
+    seq->elements[used++] = elem;
+  }
+  seq->used = used;
+  return tok;
+}
+
 static void desugar_action(HAllocator *mm__, HCFStack *stk__, void *env) {
   HParseAction *a = (HParseAction*)env;
 
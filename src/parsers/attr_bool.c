@@ -10,6 +10,8 @@ typedef struct {
 static HParseResult* parse_attr_bool(void *env, HParseState *state) {
   HAttrBool *a = (HAttrBool*)env;
   HParseResult *res = h_do_parse(a->p, state);
+  if (res)
+    res->ast = h_force_actions(state, res->ast);
   if (res && res->ast) {
     if (a->pred(res, a->user_data))
       return res;
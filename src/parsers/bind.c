@@ -38,6 +38,7 @@ static HParseResult *parse_bind(void *be_, HParseState *state) {
     HParseResult *res = h_do_parse(be->p, state);
     if(!res)
         return NULL;
+    res->ast = h_force_actions(state, res->ast);
 
     // create a temporary arena allocator for the continuation
     HArena *arena = h_new_arena(be->mm__, 0);
@@ -50,6 +51,9 @@ static HParseResult *parse_bind(void *be_, HParseState *state) {
     }
 
     res = h_do_parse(kx, state);
+    // deferred actions of kx live in the arena too, so they run now
+    if(res)
+        res->ast = h_force_actions(state, res->ast);
 
     h_delete_arena(arena);
     return res;
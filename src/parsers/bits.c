@@ -8,13 +8,12 @@ struct bits_env {
 
 static HParseResult* parse_bits(void* env, HParseState *state) {
   struct bits_env *env_ = env;
-  HParsedToken *result = a_new(HParsedToken, 1);
-  result->token_type = (env_->signedp ? TT_SINT : TT_UINT);
+  HTokenResult *ret = make_token_result(state->arena, env_->signedp ? TT_SINT : TT_UINT);
   if (env_->signedp)
-    result->sint = h_read_bits(&state->input_stream, env_->length, true);
+    ret->token.sint = h_read_bits(&state->input_stream, env_->length, true);
   else
-    result->uint = h_read_bits(&state->input_stream, env_->length, false);
-  return make_result(state->arena, result);
+    ret->token.uint = h_read_bits(&state->input_stream, env_->length, false);
+  return &ret->result;
 }
 
 static HParsedToken *reshape_bits(const HParseResult *p, void* signedp_p) {
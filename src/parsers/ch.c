@@ -4,11 +4,11 @@
 
 static HParseResult* parse_ch(void* env, HParseState *state) {
   uint8_t c = (uint8_t)(uintptr_t)(env);
-  uint8_t r = (uint8_t)h_read_bits(&state->input_stream, 8, false);
+  uint8_t r = h_read_byte(&state->input_stream);
   if (c == r) {
-    HParsedToken *tok = a_new(HParsedToken, 1);    
-    tok->token_type = TT_UINT; tok->uint = r;
-    return make_result(state->arena, tok);
+    HTokenResult *ret = make_token_result(state->arena, TT_UINT);
+    ret->token.uint = r;
+    return &ret->result;
   } else {
     return NULL;
   }
@@ -41,7 +41,7 @@ static bool ch_ctrvm(HRVMProg *prog, void* env) {
   return true;
 }
 
-static const HParserVtable ch_vt = {
+const HParserVtable ch_vt = {
   .parse = parse_ch,
   .isValidRegular = h_true,
   .isValidCF = h_true,
@@ -4,13 +4,13 @@
 #include "parser_internal.h"
 
 static HParseResult* parse_charset(void *env, HParseState *state) {
-  uint8_t in = h_read_bits(&state->input_stream, 8, false);
+  uint8_t in = h_read_byte(&state->input_stream);
   HCharset cs = (HCharset)env;
 
   if (charset_isset(cs, in)) {
-    HParsedToken *tok = a_new(HParsedToken, 1);
-    tok->token_type = TT_UINT; tok->uint = in;
-    return make_result(state->arena, tok);    
+    HTokenResult *ret = make_token_result(state->arena, TT_UINT);
+    ret->token.uint = in;
+    return &ret->result;
   } else
     return NULL;
 }
@@ -70,7 +70,7 @@ static bool cs_ctrvm(HRVMProg *prog, void *env) {
   return true;
 }
 
-static const HParserVtable charset_vt = {
+const HParserVtable charset_vt = {
   .parse = parse_charset,
   .isValidRegular = h_true,
   .isValidCF = h_true,
@@ -143,9 +143,5 @@ HParser* h_choice__ma(HAllocator* mm__, void *args[]) {
   }
 
   s->len = len;
-  HParser *ret = h_new(HParser, 1);
-  ret->vtable = &choice_vt; 
-  ret->env = (void*)s;
-  ret->backend = PB_MIN;
-  return ret;
+  return h_new_parser(mm__, &choice_vt, s);
 }
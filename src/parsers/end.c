@@ -2,6 +2,7 @@
 
 static HParseResult* parse_end(void *env, HParseState *state) {
   if (state->input_stream.index == state->input_stream.length) {
+    h_limit_end(&state->input_stream);
     HParseResult *ret = a_new(HParseResult, 1);
     ret->ast = NULL;
     return ret;
@@ -25,10 +25,5 @@ HParser* h_epsilon_p() {
   return h_epsilon_p__m(&system_allocator);
 }
 HParser* h_epsilon_p__m(HAllocator* mm__) {
-  HParser *epsilon_p = h_new(HParser, 1);
-  epsilon_p->desugared = NULL;
-  epsilon_p->backend_data = NULL;
-  epsilon_p->backend = 0;
-  epsilon_p->vtable = &epsilon_vt;
-  return epsilon_p;
+  return h_new_parser(mm__, &epsilon_vt, NULL);
 }
@@ -10,6 +10,8 @@ typedef struct {
 static HParseResult* parse_int_range(void *env, HParseState *state) {
   HRange *r_env = (HRange*)env;
   HParseResult *ret = h_do_parse(r_env->p, state);
+  if (ret)
+    ret->ast = h_force_actions(state, ret->ast);
   if (!ret || !ret->ast)
     return NULL;
   switch(ret->ast->token_type) {
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include "parser_internal.h"
 
 // TODO: split this up.
@@ -6,10 +7,58 @@ typedef struct {
   const HParser *p, *sep;
   size_t count;
   bool min_p;
+  HSpanTable *span;     // if p matches one byte from a set, and sep is NULL
 } HRepeat;
 
+// the run of elements that each match one byte, found in one scan. the
+// result, and where the stream is left, are as if the elements had been
+// parsed one at a time.
+static HParseResult *parse_span(HRepeat *env_, HParseState *state) {
+  HInputStream *in = &state->input_stream;
+  size_t limit = in->length - in->index;
+  if (!env_->min_p && env_->count < limit)
+    limit = env_->count;
+  size_t n = h_span(env_->span, in->input + in->index, limit);
+  // only a scan that wanted more input than there is looked for its end
+  if (n == in->length - in->index && (env_->min_p || n < env_->count))
+    h_limit_end(in);
+  if (n < env_->count) {
+    in->index += n;
+    return NULL;
+  }
+
+  // the elements of the run differ only in their value, so equal ones can
+  // share a token.
+  if (!state->byte_tokens) {
+    state->byte_tokens = a_new(HParsedToken*, 256);
+    memset(state->byte_tokens, 0, 256 * sizeof(HParsedToken*));
+  }
+  HCountedArray *seq = h_carray_new_sized(state->arena, n);
+  for (size_t i = 0; i < n; i++) {
+    uint8_t b = in->input[in->index + i];
+    HParsedToken *tok = state->byte_tokens[b];
+    if (!tok) {
+      tok = a_new(HParsedToken, 1);
+      memset(tok, 0, sizeof(HParsedToken));
+      tok->token_type = TT_UINT;
+      tok->uint = b;
+      state->byte_tokens[b] = tok;
+    }
+    seq->elements[i] = tok;
+  }
+  seq->used = n;
+  in->index += n;
+
+  HTokenResult *res = make_token_result(state->arena, TT_SEQUENCE);
+  res->token.seq = seq;
+  return &res->result;
+}
+
 static HParseResult *parse_many(void* env, HParseState *state) {
   HRepeat *env_ = (HRepeat*) env;
+  if (env_->span && state->input_stream.input &&
+      state->input_stream.bit_offset == 0 && state->input_stream.margin == 0)
+    return parse_span(env_, state);
   HCountedArray *seq = h_carray_new_sized(state->arena, (env_->count > 0 ? env_->count : 4));
   size_t count = 0;
   HInputStream bak;
@@ -31,10 +80,9 @@ static HParseResult *parse_many(void* env, HParseState *state) {
     goto err;
  succ:
   ; // necessary for the label to be here...
-  HParsedToken *res = a_new(HParsedToken, 1);
-  res->token_type = TT_SEQUENCE;
-  res->seq = seq;
-  return make_result(state->arena, res);
+  HTokenResult *res = make_token_result(state->arena, TT_SEQUENCE);
+  res->token.seq = seq;
+  return &res->result;
  err0:
   if (count >= env_->count) {
     state->input_stream = bak;
@@ -202,6 +250,24 @@ static const HParserVtable many_vt = {
   .higher = true,
 };
 
+// a span table for p, if it is a single-byte parser
+static HSpanTable *element_span(HAllocator *mm__, const HParser *p) {
+  HCharset cs;
+  if (p->vtable == &charset_vt) {
+    cs = (HCharset)p->env;
+  } else if (p->vtable == &ch_vt) {
+    cs = new_charset(mm__);
+    charset_set(cs, (uint8_t)(uintptr_t)p->env, 1);
+  } else {
+    return NULL;
+  }
+  HSpanTable *span = h_new(HSpanTable, 1);
+  h_span_table_init(span, cs);
+  if (p->vtable == &ch_vt)
+    h_free(cs);
+  return span;
+}
+
 HParser* h_many(const HParser* p) {
   return h_many__m(&system_allocator, p);
 }
@@ -211,6 +277,7 @@ HParser* h_many__m(HAllocator* mm__, const HParser* p) {
   env->sep = NULL;
   env->count = 0;
   env->min_p = true;
+  env->span = element_span(mm__, p);
   return h_new_parser(mm__, &many_vt, env);
 }
 
@@ -223,6 +290,7 @@ HParser* h_many1__m(HAllocator* mm__, const HParser* p) {
   env->sep = NULL;
   env->count = 1;
   env->min_p = true;
+  env->span = element_span(mm__, p);
   return h_new_parser(mm__, &many_vt, env);
 }
 
@@ -235,6 +303,7 @@ HParser* h_repeat_n__m(HAllocator* mm__, const HParser* p, const size_t n) {
   env->sep = NULL;
   env->count = n;
   env->min_p = false;
+  env->span = element_span(mm__, p);
   return h_new_parser(mm__, &many_vt, env);
 }
 
@@ -247,6 +316,7 @@ HParser* h_sepBy__m(HAllocator* mm__, const HParser* p, const HParser* sep) {
   env->sep = sep;
   env->count = 0;
   env->min_p = true;
+  env->span = NULL;
   return h_new_parser(mm__, &many_vt, env);
 }
 
@@ -259,6 +329,7 @@ HParser* h_sepBy1__m(HAllocator* mm__, const HParser* p, const HParser* sep) {
   env->sep = sep;
   env->count = 1;
   env->min_p = true;
+  env->span = NULL;
   return h_new_parser(mm__, &many_vt, env);
 }
 
@@ -272,6 +343,7 @@ static HParseResult* parse_length_value(void *env, HParseState *state) {
   HParseResult *len = h_do_parse(lv->length, state);
   if (!len)
     return NULL;
+  len->ast = h_force_actions(state, len->ast);
   if (len->ast->token_type != TT_UINT)
     h_platform_errx(1, "Length parser must return an unsigned integer");
   // TODO: allocate this using public functions
@@ -299,3 +371,228 @@ HParser* h_length_value__m(HAllocator* mm__, const HParser* length, const HParse
   env->value = value;
   return h_new_parser(mm__, &length_value_vt, env);
 }
+
+// {{{ parallel parsing of a top-level repetition
+
+typedef struct {
+  size_t start;                 // byte offset of a candidate record boundary
+  HArena *arena;
+  HCountedArray *elems;
+  size_t count;                 // records parsed, including those without AST
+  HInputStream end;             // where the last record ended
+  bool failed;                  // no further record at end
+} HSplitChunk;
+
+typedef struct {
+  HAllocator *mm__;
+  const HRepeat *repeat;
+  const HParser *resync;
+  HInputStream input;           // all of the input, at offset 0
+  HSplitChunk *chunks;
+  size_t n;
+  bool defer_actions;           // as H_PACKRAT_DEFER_ACTIONS; the records
+                                // kept are forced once joined
+} HSplitJob;
+
+#define NO_BOUNDARY ((size_t)-1)
+
+// find the start of chunk k (> 0) with the resync parser
+static int find_boundary(void *env, unsigned int worker, size_t k) {
+  HSplitJob *job = env;
+  size_t length = job->input.length;
+  size_t limit = (k + 1) * length / job->n;
+
+  if (k == 0)
+    return 0;                   // chunk 0 starts at the start
+  job->chunks[k].start = NO_BOUNDARY;
+  HArena *arena = h_new_arena(job->mm__, 0);
+  HParseState *state = h_packrat_state_new(arena, &job->input);
+  for (size_t q = k * length / job->n; q < limit; q++) {
+    state->input_stream = job->input;
+    state->input_stream.index = q;
+    if (h_do_parse(job->resync, state) && state->input_stream.bit_offset == 0) {
+      job->chunks[k].start = state->input_stream.index;
+      break;
+    }
+  }
+  h_packrat_state_free(state);
+  h_delete_arena(arena);
+  return 0;
+}
+
+// find the chunk starts by skipping from one length field to the next,
+// assuming that all values in a record have the width of the first one.
+static void skip_lengths(HSplitJob *job, const HLenVal *lv) {
+  size_t length = job->input.length;
+  size_t k = 1;
+
+  for (size_t i = 1; i < job->n; i++)
+    job->chunks[i].start = NO_BOUNDARY;
+  HArena *arena = h_new_arena(job->mm__, 0);
+  HParseState *state = h_packrat_state_new(arena, &job->input);
+  while (k < job->n && state->input_stream.index < length) {
+    HInputStream *s = &state->input_stream;
+    if (s->bit_offset == 0 && s->index >= k * length / job->n)
+      job->chunks[k++].start = s->index;
+
+    HParseResult *len = h_do_parse(lv->length, state);
+    if (!len || len->ast->token_type != TT_UINT)
+      break;
+    if (len->ast->uint == 0)
+      continue;
+    size_t before = h_input_stream_pos(s);
+    if (!h_do_parse(lv->value, state))
+      break;
+    size_t width = h_input_stream_pos(s) - before;
+    if (width == 0 || (len->ast->uint - 1) > (length * 8 - h_input_stream_pos(s)) / width)
+      break;
+    size_t pos = h_input_stream_pos(s) + (len->ast->uint - 1) * width;
+    s->index = pos / 8;
+    s->bit_offset = pos % 8;
+  }
+  h_packrat_state_free(state);
+  h_delete_arena(arena);
+}
+
+// parse the records of chunk k, up to the start of the next one
+static int parse_chunk(void *env, unsigned int worker, size_t k) {
+  HSplitJob *job = env;
+  HSplitChunk *c = &job->chunks[k];
+  size_t stop = (k + 1 < job->n) ? job->chunks[k + 1].start * 8 : (size_t)-1;
+
+  c->arena = h_new_arena(job->mm__, 0);
+  c->elems = h_carray_new(c->arena);
+  c->count = 0;
+  c->failed = false;
+  HParseState *state = h_packrat_state_new(c->arena, &job->input);
+  state->defer_actions = job->defer_actions;
+  state->input_stream.index = c->start;
+  while (h_input_stream_pos(&state->input_stream) < stop) {
+    HInputStream bak = state->input_stream;
+    HParseResult *elem = h_do_parse(job->repeat->p, state);
+    if (!elem || h_input_stream_pos(&state->input_stream) == h_input_stream_pos(&bak)) {
+      // a record that consumes nothing would repeat forever; stop there.
+      state->input_stream = bak;
+      c->failed = true;
+      break;
+    }
+    if (elem->ast)
+      h_carray_append(c->elems, (void*)elem->ast);
+    c->count++;
+  }
+  c->end = state->input_stream;
+  h_packrat_state_free(state);
+  return 0;
+}
+
+HParseResult* h_parse_split(const HParser* parser, const uint8_t* input, size_t length, const HSplitParams* params) {
+  return h_parse_split__m(&system_allocator, parser, input, length, params);
+}
+
+HParseResult* h_parse_split__m(HAllocator* mm__, const HParser* parser, const uint8_t* input, size_t length, const HSplitParams* params) {
+  const HRepeat *repeat = parser->env;
+  if (parser->vtable != &many_vt || !repeat->min_p || repeat->sep != NULL)
+    return h_parse__m(mm__, parser, input, length);
+
+  unsigned int threads = params && params->threads > 0 ? params->threads : 1;
+  HSplitJob job = {
+    .mm__ = mm__,
+    .repeat = repeat,
+    .resync = params ? params->resync : NULL,
+    .input = {
+      .input = input,
+      .length = length,
+      .endianness = BIT_BIG_ENDIAN | BYTE_BIG_ENDIAN,
+      .last_chunk = true,
+    },
+    .n = params && params->chunks > 0 ? params->chunks : 4 * threads,
+    .defer_actions = (parser->backend == PB_PACKRAT && parser->backend_data != NULL),
+  };
+  if (job.n > length)
+    job.n = length > 0 ? length : 1;
+  job.chunks = h_new(HSplitChunk, job.n);
+  memset(job.chunks, 0, job.n * sizeof(HSplitChunk));
+
+  // find candidate boundaries, and drop chunks that have none
+  if (job.resync)
+    h_parallel_for(threads, job.n, find_boundary, &job);
+  else if (repeat->p->vtable == &length_value_vt)
+    skip_lengths(&job, repeat->p->env);
+  else
+    job.n = 1;
+  size_t n = 1;
+  for (size_t k = 1; k < job.n; k++) {
+    if (job.chunks[k].start != NO_BOUNDARY && job.chunks[k].start > job.chunks[n-1].start)
+      job.chunks[n++].start = job.chunks[k].start;
+  }
+  job.n = n;
+
+  h_parallel_for(threads, job.n, parse_chunk, &job);
+
+  // join the chunks that start where the previous record ended, and parse
+  // the records between them again where they do not.
+  HArena *arena = h_new_arena(mm__, 0);
+  HCountedArray *seq = h_carray_new(arena);
+  HParseState *state = NULL;
+  HInputStream pos = job.input;
+  size_t count = 0;
+  size_t k = 0;
+  for (;;) {
+    while (k < job.n && (job.chunks[k].start < pos.index
+                         || (job.chunks[k].start == pos.index && pos.bit_offset != 0)))
+      k++;
+    if (k < job.n && job.chunks[k].start == pos.index) {
+      HSplitChunk *c = &job.chunks[k++];
+      for (size_t i = 0; i < c->elems->used; i++)
+        h_carray_append(seq, c->elems->elements[i]);
+      count += c->count;
+      pos = c->end;
+      h_arena_adopt(arena, c->arena);
+      c->arena = NULL;
+      if (c->failed)
+        break;
+      continue;
+    }
+
+    if (!state) {
+      state = h_packrat_state_new(arena, &job.input);
+      state->defer_actions = job.defer_actions;
+    }
+    state->input_stream = pos;
+    HParseResult *elem = h_do_parse(repeat->p, state);
+    if (!elem || h_input_stream_pos(&state->input_stream) == h_input_stream_pos(&pos))
+      break;
+    if (elem->ast)
+      h_carray_append(seq, (void*)elem->ast);
+    count++;
+    pos = state->input_stream;
+  }
+  for (size_t i = 0; i < job.n; i++) {
+    if (job.chunks[i].arena)
+      h_delete_arena(job.chunks[i].arena);
+  }
+  h_free(job.chunks);
+
+  if (count < repeat->count) {
+    if (state)
+      h_packrat_state_free(state);
+    h_delete_arena(arena);
+    return NULL;
+  }
+  HTokenResult *res = make_token_result(arena, TT_SEQUENCE);
+  res->token.seq = seq;
+  res->result.bit_length = h_input_stream_pos(&pos);
+  // only the actions of the records in the result run, as in h_parse
+  if (job.defer_actions) {
+    if (!state) {
+      state = h_packrat_state_new(arena, &job.input);
+      state->defer_actions = true;
+    }
+    res->result.ast = h_force_actions(state, res->result.ast);
+  }
+  if (state)
+    h_packrat_state_free(state);
+  return &res->result;
+}
+
+// }}}
@@ -7,9 +7,7 @@ static HParseResult* parse_optional(void* env, HParseState* state) {
   if (res0)
     return res0;
   state->input_stream = bak;
-  HParsedToken *ast = a_new(HParsedToken, 1);
-  ast->token_type = TT_NONE;
-  return make_result(state->arena, ast);
+  return &make_token_result(state->arena, TT_NONE)->result;
 }
 
 static bool opt_isValidRegular(void *env) {
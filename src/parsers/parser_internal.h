@@ -10,6 +10,10 @@
 #include "../backends/regex.h"
 #include "../backends/contextfree.h"
 
+// the single-byte parsers, which h_many and friends recognise
+extern const HParserVtable ch_vt;
+extern const HParserVtable charset_vt;
+
 #define a_new_(arena, typ, count) ((typ*)h_arena_malloc((arena), sizeof(typ)*(count)))
 #define a_new(typ, count) a_new_(state->arena, typ, count)
 // we can create a_new0 if necessary. It would allocate some memory and immediately zero it out.
@@ -22,6 +26,23 @@ static inline HParseResult* make_result(HArena *arena, HParsedToken *tok) {
   return ret;
 }
 
+// A result and its token, allocated together; see make_token_result.
+typedef struct HTokenResult_ {
+  HParseResult result;
+  HParsedToken token;
+} HTokenResult;
+
+// Like make_result on a new token of the given type, with one allocation
+// instead of two. The arena zeroes the rest of the token.
+static inline HTokenResult* make_token_result(HArena *arena, HTokenType type) {
+  HTokenResult *ret = h_arena_malloc(arena, sizeof(HTokenResult));
+  ret->token.token_type = type;
+  ret->result.ast = &ret->token;
+  ret->result.arena = arena;
+  ret->result.bit_length = 0;
+  return ret;
+}
+
 // return token size in bits...
 static inline size_t token_length(HParseResult *pr) {
   if (pr) {
@@ -30,8 +30,10 @@ static int parse_permutation_tail(const HSequence *s,
       match = h_do_parse(ps[i], state);
 
       // save result
-      if(match)
+      if(match) {
+	match->ast = h_force_actions(state, match->ast);
 	seq->elements[i] = (void *)match->ast;
+      }
 
       // treat empty optionals (TT_NONE) like failure here
       if(match && match->ast && match->ast->token_type == TT_NONE)
@@ -86,10 +88,9 @@ static HParseResult *parse_permutation(void *env, HParseState *state)
     // success
     // return the sequence of results
     seq->used = n;
-    HParsedToken *tok = a_new(HParsedToken, 1);
-    tok->token_type  = TT_SEQUENCE;
-    tok->seq = seq;
-    return make_result(state->arena, tok);
+    HTokenResult *ret = make_token_result(state->arena, TT_SEQUENCE);
+    ret->token.seq = seq;
+    return &ret->result;
   } else {
     // no parse
     // XXX free seq
@@ -172,9 +173,5 @@ HParser* h_permutation__ma(HAllocator* mm__, void *args[]) {
   }
 
   s->len = len;
-  HParser *ret = h_new(HParser, 1);
-  ret->vtable = &permutation_vt; 
-  ret->env = (void*)s;
-  ret->backend = PB_MIN;
-  return ret;
+  return h_new_parser(mm__, &permutation_vt, s);
 }
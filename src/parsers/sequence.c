@@ -20,9 +20,9 @@ static HParseResult* parse_sequence(void *env, HParseState *state) {
 	h_carray_append(seq, (void*)tmp->ast);
     }
   }
-  HParsedToken *tok = a_new(HParsedToken, 1);
-  tok->token_type = TT_SEQUENCE; tok->seq = seq;
-  return make_result(state->arena, tok);
+  HTokenResult *ret = make_token_result(state->arena, TT_SEQUENCE);
+  ret->token.seq = seq;
+  return &ret->result;
 }
 
 static bool sequence_isValidRegular(void *env) {
@@ -160,9 +160,5 @@ HParser* h_sequence__ma(HAllocator* mm__, void *args[]) {
   }
 
   s->len = len;
-  HParser *ret = h_new(HParser, 1);
-  ret->vtable = &sequence_vt; 
-  ret->env = (void*)s; 
-  ret->backend = PB_MIN;
-  return ret;
+  return h_new_parser(mm__, &sequence_vt, s);
 }
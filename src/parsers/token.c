@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 #include "parser_internal.h"
 
 typedef struct {
@@ -8,15 +9,32 @@ typedef struct {
 
 static HParseResult* parse_token(void *env, HParseState *state) {
   HToken *t = (HToken*)env;
+  HInputStream *in = &state->input_stream;
+  if (in->input && in->bit_offset == 0 && in->margin == 0 && in->length - in->index >= t->len) {
+    // byte-aligned, and all of it there: compare it in one go
+    const uint8_t *p = in->input + in->index;
+    if (memcmp(p, t->str, t->len) != 0) {
+      // leave the stream where the byte-wise comparison would have
+      int i = 0;
+      while (p[i] == t->str[i])
+        i++;
+      in->index += i + 1;
+      return NULL;
+    }
+    in->index += t->len;
+    HTokenResult *ret = make_token_result(state->arena, TT_BYTES);
+    ret->token.bytes.token = t->str; ret->token.bytes.len = t->len;
+    return &ret->result;
+  }
   for (int i=0; i<t->len; ++i) {
-    uint8_t chr = (uint8_t)h_read_bits(&state->input_stream, 8, false);
+    uint8_t chr = h_read_byte(&state->input_stream);
     if (t->str[i] != chr) {
       return NULL;
     }
   }
-  HParsedToken *tok = a_new(HParsedToken, 1);
-  tok->token_type = TT_BYTES; tok->bytes.token = t->str; tok->bytes.len = t->len;
-  return make_result(state->arena, tok);
+  HTokenResult *ret = make_token_result(state->arena, TT_BYTES);
+  ret->token.bytes.token = t->str; ret->token.bytes.len = t->len;
+  return &ret->result;
 }
 
 
@@ -7,7 +7,7 @@ static HParseResult* parse_whitespace(void* env, HParseState *state) {
   HInputStream bak;
   do {
     bak = state->input_stream;
-    c = h_read_bits(&state->input_stream, 8, false);
+    c = h_read_byte(&state->input_stream);
     if (state->input_stream.overrun)
       break;
   } while (isspace((int)c));
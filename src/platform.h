@@ -9,6 +9,7 @@
 #include "compiler_specifics.h"
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* String Formatting */
@@ -36,7 +37,38 @@ void h_platform_stopwatch_reset(struct HStopWatch* stopwatch);
 /* return difference between last reset point and now */
 int64_t h_platform_stopwatch_ns(struct HStopWatch* stopwatch);
 
-/* Platform dependent definitions for HStopWatch */
+/* Threads */
+
+struct HThread; /* forward definition */
+struct HMutex; /* forward definition */
+struct HOnce; /* forward definition, initialize with H_PLATFORM_ONCE_INIT */
+
+/* start fn(arg) on a new thread. returns 0 on success, -1 on failure. */
+int h_platform_thread_create(struct HThread* thread, void (*fn)(void*), void* arg);
+
+/* wait for a thread started by h_platform_thread_create to finish */
+void h_platform_thread_join(struct HThread* thread);
+
+void h_platform_mutex_init(struct HMutex* mutex);
+void h_platform_mutex_lock(struct HMutex* mutex);
+void h_platform_mutex_unlock(struct HMutex* mutex);
+void h_platform_mutex_destroy(struct HMutex* mutex);
+
+/* call fn() exactly once per HOnce, no matter how many threads get here */
+void h_platform_once(struct HOnce* once, void (*fn)(void));
+
+/* Atomic pointer access, for readers that do not take the writer's lock.
+ * a load sees everything the storing thread wrote before the store. */
+void* h_platform_atomic_load(void* const* p);
+void h_platform_atomic_store(void** p, void* value);
+
+/* map the file at path into memory, read-only, and apply the HFileFlags
+ * hints in flags. an empty file gives *addr NULL and *length 0.
+ * returns 0 on success, -1 on error. */
+int h_platform_map_file(const char* path, unsigned int flags, void** addr, size_t* length);
+void h_platform_unmap_file(void* addr, size_t length);
+
+/* Platform dependent definitions for HStopWatch, HThread, HMutex and HOnce */
 #if defined(_MSC_VER)
 
 #ifndef WIN32_LEAN_AND_MEAN
@@ -50,15 +82,53 @@ struct HStopWatch {
   LARGE_INTEGER start;
 };
 
+struct HThread {
+  HANDLE handle;
+  void (*fn)(void*);
+  void* arg;
+};
+
+struct HMutex {
+  CRITICAL_SECTION cs;
+};
+
+struct HOnce {
+  INIT_ONCE once;
+};
+
+/* for h_parse_iov; the same layout as WSABUF is not needed */
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#define H_PLATFORM_ONCE_INIT { INIT_ONCE_STATIC_INIT }
+
 #else
 /* Unix like platforms */
 
+#include <pthread.h>
+#include <sys/uio.h>
 #include <time.h>
 
 struct HStopWatch {
   struct timespec start;
 };
 
+struct HThread {
+  pthread_t handle;
+  void (*fn)(void*);
+  void* arg;
+};
+
+struct HMutex {
+  pthread_mutex_t m;
+};
+
+struct HOnce {
+  pthread_once_t once;
+};
+#define H_PLATFORM_ONCE_INIT { PTHREAD_ONCE_INIT }
+
 #endif
 
 #endif
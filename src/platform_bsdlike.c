@@ -4,7 +4,13 @@
 #include <stdio.h>
 
 #include <err.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hammer.h"
 
 #ifdef __MACH__
 #include <mach/clock.h>
@@ -81,3 +87,86 @@ int64_t h_platform_stopwatch_ns(struct HStopWatch* stopwatch) {
   return (ts_now.tv_sec - stopwatch->start.tv_sec) * 1000000000
           + (ts_now.tv_nsec - stopwatch->start.tv_nsec);
 }
+
+static void *thread_main(void *thread_) {
+  struct HThread *thread = thread_;
+  thread->fn(thread->arg);
+  return NULL;
+}
+
+int h_platform_thread_create(struct HThread* thread, void (*fn)(void*), void* arg) {
+  thread->fn = fn;
+  thread->arg = arg;
+  return pthread_create(&thread->handle, NULL, thread_main, thread) ? -1 : 0;
+}
+
+void h_platform_thread_join(struct HThread* thread) {
+  pthread_join(thread->handle, NULL);
+}
+
+void h_platform_mutex_init(struct HMutex* mutex) {
+  pthread_mutex_init(&mutex->m, NULL);
+}
+
+void h_platform_mutex_lock(struct HMutex* mutex) {
+  pthread_mutex_lock(&mutex->m);
+}
+
+void h_platform_mutex_unlock(struct HMutex* mutex) {
+  pthread_mutex_unlock(&mutex->m);
+}
+
+void h_platform_mutex_destroy(struct HMutex* mutex) {
+  pthread_mutex_destroy(&mutex->m);
+}
+
+void h_platform_once(struct HOnce* once, void (*fn)(void)) {
+  pthread_once(&once->once, fn);
+}
+
+void* h_platform_atomic_load(void* const* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void h_platform_atomic_store(void** p, void* value) {
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+int h_platform_map_file(const char* path, unsigned int flags, void** addr, size_t* length) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+  *length = st.st_size;
+  *addr = NULL;
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  void *p = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);                    // the mapping keeps its own reference
+  if (p == MAP_FAILED)
+    return -1;
+
+  // the hints are only hints; failure to apply them is not an error.
+  if (flags & H_FILE_SEQUENTIAL)
+    madvise(p, *length, MADV_SEQUENTIAL);
+  if (flags & H_FILE_WILLNEED)
+    madvise(p, *length, MADV_WILLNEED);  // reads ahead without blocking
+#ifdef MADV_HUGEPAGE
+  if (flags & H_FILE_HUGEPAGES)
+    madvise(p, *length, MADV_HUGEPAGE);
+#endif
+  *addr = p;
+  return 0;
+}
+
+void h_platform_unmap_file(void* addr, size_t length) {
+  if (length > 0)
+    munmap(addr, length);
+}
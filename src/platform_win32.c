@@ -1,4 +1,5 @@
 #include "platform.h"
+#include "hammer.h"
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -59,3 +60,88 @@ int64_t h_platform_stopwatch_ns(struct HStopWatch* stopwatch) {
 
   return 1000000000 * (now.QuadPart - stopwatch->start.QuadPart) / stopwatch->qpf.QuadPart;
 }
+
+static DWORD WINAPI thread_main(LPVOID thread_) {
+  struct HThread *thread = thread_;
+  thread->fn(thread->arg);
+  return 0;
+}
+
+int h_platform_thread_create(struct HThread* thread, void (*fn)(void*), void* arg) {
+  thread->fn = fn;
+  thread->arg = arg;
+  thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+  return thread->handle ? 0 : -1;
+}
+
+void h_platform_thread_join(struct HThread* thread) {
+  WaitForSingleObject(thread->handle, INFINITE);
+  CloseHandle(thread->handle);
+}
+
+void h_platform_mutex_init(struct HMutex* mutex) {
+  InitializeCriticalSection(&mutex->cs);
+}
+
+void h_platform_mutex_lock(struct HMutex* mutex) {
+  EnterCriticalSection(&mutex->cs);
+}
+
+void h_platform_mutex_unlock(struct HMutex* mutex) {
+  LeaveCriticalSection(&mutex->cs);
+}
+
+void h_platform_mutex_destroy(struct HMutex* mutex) {
+  DeleteCriticalSection(&mutex->cs);
+}
+
+static BOOL CALLBACK once_main(PINIT_ONCE once, PVOID fn, PVOID *ctx) {
+  ((void (*)(void))fn)();
+  return TRUE;
+}
+
+void h_platform_once(struct HOnce* once, void (*fn)(void)) {
+  InitOnceExecuteOnce(&once->once, once_main, (PVOID)fn, NULL);
+}
+
+void* h_platform_atomic_load(void* const* p) {
+  void *value = *(void* volatile const*)p;
+  MemoryBarrier();
+  return value;
+}
+
+void h_platform_atomic_store(void** p, void* value) {
+  InterlockedExchangePointer(p, value);
+}
+
+int h_platform_map_file(const char* path, unsigned int flags, void** addr, size_t* length) {
+  // huge pages need SeLockMemoryPrivilege and cannot map files; ignore them.
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            (flags & H_FILE_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return -1;
+  }
+  *length = (size_t)size.QuadPart;
+  *addr = NULL;
+  if (*length == 0) {
+    CloseHandle(file);
+    return 0;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL)
+    return -1;
+  *addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);         // the view keeps its own reference
+  return *addr ? 0 : -1;
+}
+
+void h_platform_unmap_file(void* addr, size_t length) {
+  if (length > 0)
+    UnmapViewOfFile(addr);
+}
@@ -0,0 +1,277 @@
+/* Per-parser profiling counts; see h_profile_enable. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "hammer.h"
+#include "internal.h"
+
+HParser* h_name_parser(HParser* p, const char* name) {
+  if (p && !p->name)
+    p->name = name;
+  return p;
+}
+
+const char* h_get_parser_name(const HParser* p) {
+  return p ? p->name : NULL;
+}
+
+#ifdef HAMMER_PROFILE
+
+typedef struct {
+  HProfileKind kind;
+  const void *key;
+  size_t index;
+} HProfileKey;
+
+struct HProfileScope_ {
+  HAllocator *mm__;
+  HArena *arena;
+  HHashTable *entries;          // HProfileKey -> HProfileEntry
+  const HParser *root;
+  struct HStopWatch sw;
+  int64_t children;             // time of the calls timed inside the current one
+};
+
+static struct HOnce prof_once = H_PLATFORM_ONCE_INIT;
+static struct HMutex prof_lock;
+static void *prof_on;           // non-NULL if enabled; atomic
+static HArena *prof_arena;      // the totals; under prof_lock
+static HHashTable *prof_totals;
+
+static void init_lock(void) {
+  h_platform_mutex_init(&prof_lock);
+}
+
+static bool key_eq(const void *p, const void *q) {
+  const HProfileKey *a = p, *b = q;
+  return a->kind == b->kind && a->key == b->key && a->index == b->index;
+}
+
+static HHashValue key_hash(const void *p) {
+  const HProfileKey *k = p;
+  return h_hash_ptr(k->key) ^ (HHashValue)(k->index * 31 + k->kind);
+}
+
+// the entry of table for key, made in arena if new
+static HProfileEntry *entry(HArena *arena, HHashTable *table, const HProfileKey *key) {
+  HProfileEntry *e = h_hashtable_get(table, key);
+  if (!e) {
+    HProfileKey *k = h_arena_malloc(arena, sizeof(HProfileKey));
+    *k = *key;
+    e = h_arena_malloc(arena, sizeof(HProfileEntry));
+    memset(e, 0, sizeof(HProfileEntry));
+    e->kind = key->kind;
+    e->index = key->index;
+    h_hashtable_put(table, k, e);
+  }
+  return e;
+}
+
+HProfileScope *h_profile_begin(HAllocator *mm__, const HParser *root) {
+  if (!h_platform_atomic_load(&prof_on))
+    return NULL;
+  HProfileScope *scope = h_new(HProfileScope, 1);
+  scope->mm__ = mm__;
+  scope->arena = h_new_arena(mm__, 0);
+  scope->entries = h_hashtable_new(scope->arena, key_eq, key_hash);
+  scope->root = root;
+  scope->children = 0;
+  h_platform_stopwatch_reset(&scope->sw);
+  return scope;
+}
+
+HProfileEntry *h_profile_entry(HProfileScope *scope, HProfileKind kind,
+                               const void *key, size_t index, const HParser *parser) {
+  HProfileKey k = {.kind = kind, .key = key, .index = index};
+  HProfileEntry *e = entry(scope->arena, scope->entries, &k);
+  e->parser = parser;
+  e->name = parser ? parser->name : NULL;
+  return e;
+}
+
+const HParser *h_profile_root(const HProfileScope *scope) {
+  return scope->root;
+}
+
+void h_profile_start(HProfileScope *scope, HProfileTimer *t) {
+  t->outer_children = scope->children;
+  scope->children = 0;
+  t->start = h_platform_stopwatch_ns(&scope->sw);
+}
+
+void h_profile_stop(HProfileScope *scope, HProfileEntry *e, const HProfileTimer *t) {
+  int64_t ns = h_platform_stopwatch_ns(&scope->sw) - t->start;
+  e->ns += ns;
+  e->self_ns += ns - scope->children;
+  scope->children = t->outer_children + ns;
+}
+
+void h_profile_end(HProfileScope *scope) {
+  if (!scope)
+    return;
+  HAllocator *mm__ = scope->mm__;
+
+  h_platform_once(&prof_once, init_lock);
+  h_platform_mutex_lock(&prof_lock);
+  if (!prof_totals) {
+    prof_arena = h_new_arena(&system_allocator, 0);
+    prof_totals = h_hashtable_new(prof_arena, key_eq, key_hash);
+  }
+  const HHashTable *ht = scope->entries;
+  for (size_t i = 0; i < ht->capacity; i++) {
+    for (const HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
+      if (hte->key == NULL)
+        continue;
+      const HProfileEntry *e = hte->value;
+      HProfileEntry *total = entry(prof_arena, prof_totals, hte->key);
+      total->parser = e->parser;
+      total->name = e->name;
+      total->count += e->count;
+      total->memo_hits += e->memo_hits;
+      total->memo_misses += e->memo_misses;
+      total->backtracks += e->backtracks;
+      total->bytes += e->bytes;
+      total->ns += e->ns;
+      total->self_ns += e->self_ns;
+    }
+  }
+  h_platform_mutex_unlock(&prof_lock);
+
+  h_delete_arena(scope->arena);
+  h_free(scope);
+}
+
+bool h_profile_enable(bool on) {
+  h_platform_atomic_store(&prof_on, on ? (void *)&prof_on : NULL);
+  return true;
+}
+
+void h_profile_reset(void) {
+  h_platform_once(&prof_once, init_lock);
+  h_platform_mutex_lock(&prof_lock);
+  if (prof_arena)
+    h_delete_arena(prof_arena);
+  prof_arena = NULL;
+  prof_totals = NULL;
+  h_platform_mutex_unlock(&prof_lock);
+}
+
+// most expensive first; see h_profile_entries
+static int cmp_cost(const void *p, const void *q) {
+  const HProfileEntry *a = p, *b = q;
+  if (a->kind != b->kind)
+    return a->kind < b->kind ? -1 : 1;
+  if (a->kind == H_PROFILE_PARSER && a->self_ns != b->self_ns)
+    return a->self_ns > b->self_ns ? -1 : 1;
+  if (a->count != b->count)
+    return a->count > b->count ? -1 : 1;
+  if (a->index != b->index)
+    return a->index < b->index ? -1 : 1;
+  return 0;
+}
+
+// all entries, sorted, in a malloc'd array
+static HProfileEntry *sorted_entries(size_t *n) {
+  h_platform_once(&prof_once, init_lock);
+  h_platform_mutex_lock(&prof_lock);
+  size_t used = prof_totals ? prof_totals->used : 0;
+  HProfileEntry *all = malloc((used ? used : 1) * sizeof(HProfileEntry));
+  size_t k = 0;
+  if (all && prof_totals) {
+    const HHashTable *ht = prof_totals;
+    for (size_t i = 0; i < ht->capacity; i++) {
+      for (const HHashTableEntry *hte = &ht->contents[i]; hte; hte = hte->next) {
+        if (hte->key != NULL)
+          all[k++] = *(const HProfileEntry *)hte->value;
+      }
+    }
+  }
+  h_platform_mutex_unlock(&prof_lock);
+  if (all)
+    qsort(all, k, sizeof(HProfileEntry), cmp_cost);
+  *n = k;
+  return all;
+}
+
+size_t h_profile_entries(HProfileEntry* entries, size_t n) {
+  size_t used;
+  HProfileEntry *all = sorted_entries(&used);
+  if (!all)
+    return 0;
+  memcpy(entries, all, (n < used ? n : used) * sizeof(HProfileEntry));
+  free(all);
+  return used;
+}
+
+static const char *entry_name(const HProfileEntry *e, char *buf, size_t len) {
+  if (e->name)
+    return e->name;
+  if (e->parser)
+    snprintf(buf, len, "(parser %p)", (const void *)e->parser);
+  else
+    snprintf(buf, len, "(internal)");
+  return buf;
+}
+
+void h_profile_report(FILE* stream) {
+  size_t n;
+  HProfileEntry *all = sorted_entries(&n);
+  if (!all)
+    return;
+  char buf[64];
+  HProfileKind kind = H_PROFILE_PARSER;
+  bool header = false;
+
+  for (size_t i = 0; i < n; i++) {
+    const HProfileEntry *e = &all[i];
+    if (e->kind != kind || !header) {
+      kind = e->kind;
+      header = true;
+      switch (kind) {
+      case H_PROFILE_PARSER:
+        fprintf(stream, "%-24s %10s %10s %10s %10s %12s %10s %10s\n", "Parser (packrat)",
+                "calls", "memo hits", "misses", "backtracks", "bytes", "total ms", "self ms");
+        break;
+      case H_PROFILE_PRODUCTION:
+        fprintf(stream, "%-24s %10s %10s\n", "Production (LL/LALR)", "#", "count");
+        break;
+      case H_PROFILE_STATE:
+        fprintf(stream, "%-24s %10s %10s\n", "State (LALR)", "state", "entered");
+        break;
+      }
+    }
+    const char *name = entry_name(e, buf, sizeof(buf));
+    switch (kind) {
+    case H_PROFILE_PARSER:
+      fprintf(stream, "%-24s %10llu %10llu %10llu %10llu %12llu %10.3f %10.3f\n", name,
+              (unsigned long long)e->count, (unsigned long long)e->memo_hits,
+              (unsigned long long)e->memo_misses, (unsigned long long)e->backtracks,
+              (unsigned long long)e->bytes, e->ns / 1e6, e->self_ns / 1e6);
+      break;
+    case H_PROFILE_PRODUCTION:
+    case H_PROFILE_STATE:
+      fprintf(stream, "%-24s %10zu %10llu\n", name, e->index, (unsigned long long)e->count);
+      break;
+    }
+  }
+  free(all);
+}
+
+#else // !HAMMER_PROFILE
+
+bool h_profile_enable(bool on) {
+  return false;
+}
+
+void h_profile_reset(void) {
+}
+
+size_t h_profile_entries(HProfileEntry* entries, size_t n) {
+  return 0;
+}
+
+void h_profile_report(FILE* stream) {
+  fprintf(stream, "Profiling is not compiled in; build hammer with HAMMER_PROFILE.\n");
+}
+
+#endif
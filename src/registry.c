@@ -15,21 +15,33 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <search.h>
 #include <stdlib.h>
+#include <string.h>
 #include "hammer.h"
 #include "internal.h"
 
+/* The registry is shared by all threads. Allocations take tt_lock; lookups
+ * take no lock at all. Entries are never moved or freed once published, so
+ * a reader needs only an atomic load of each pointer it follows. */
+
 typedef struct Entry_ {
   const char* name;
   HTokenType value;
+  struct Entry_ *next;          // in the same bucket
+  const HTokenSerializer *ser;  // atomic; NULL until set
 } Entry;
 
-static void *tt_registry = NULL;
-static Entry** tt_by_id = NULL;
-static unsigned int tt_by_id_sz = 0;
 #define TT_START TT_USER
-static HTokenType tt_next = TT_START;
+#define TT_BUCKETS 256          // name hash chains, newest entry first
+#define TT_SEG_SIZE 256         // entries by number, in segments that never move
+#define TT_SEGS 1024
+
+static Entry* tt_buckets[TT_BUCKETS];
+static Entry** tt_by_id[TT_SEGS];
+static HTokenType tt_next = TT_START;   // only accessed under tt_lock
+
+static struct HOnce tt_once = H_PLATFORM_ONCE_INIT;
+static struct HMutex tt_lock;
 
 /*
   // TODO: These are for the extension registry, which does not yet have a good name.
@@ -40,55 +52,95 @@ static int ext_next = 0;
 */
 
 
-static int compare_entries(const void* v1, const void* v2) {
-  const Entry *e1 = (Entry*)v1, *e2 = (Entry*)v2;
-  return strcmp(e1->name, e2->name);
+static void init_lock(void) {
+  h_platform_mutex_init(&tt_lock);
 }
 
-HTokenType h_allocate_token_type(const char* name) {
-  Entry* new_entry = (&system_allocator)->alloc(&system_allocator, sizeof(*new_entry));
-  if (!new_entry) {
-    return TT_INVALID;
+static Entry* lookup(const char* name) {
+  Entry *e = h_platform_atomic_load((void **)&tt_buckets[h_djbhash((const uint8_t*)name, strlen(name)) % TT_BUCKETS]);
+  for (; e != NULL; e = e->next) {
+    if (strcmp(e->name, name) == 0)
+      return e;
   }
-  new_entry->name = name;
-  new_entry->value = 0;
-  Entry* probe = *(Entry**)tsearch(new_entry, &tt_registry, compare_entries);
-  if (probe->value != 0) {
+  return NULL;
+}
+
+HTokenType h_allocate_token_type(const char* name) {
+  h_platform_once(&tt_once, init_lock);
+  h_platform_mutex_lock(&tt_lock);
+
+  HTokenType ret = TT_INVALID;
+  Entry *probe = lookup(name);
+  if (probe != NULL) {
     // Token type already exists...
     // TODO: treat this as a bug?
+    ret = probe->value;
+    goto out;
+  }
+
+  // new value
+  size_t id = tt_next - TT_START;
+  if (id >= (size_t)TT_SEGS * TT_SEG_SIZE)
+    goto out;
+  Entry **seg = tt_by_id[id / TT_SEG_SIZE];
+  if (seg == NULL) {
+    seg = calloc(TT_SEG_SIZE, sizeof(*seg));
+    if (!seg)
+      goto out;
+    h_platform_atomic_store((void **)&tt_by_id[id / TT_SEG_SIZE], seg);
+  }
+  Entry* new_entry = (&system_allocator)->alloc(&system_allocator, sizeof(*new_entry));
+  if (!new_entry)
+    goto out;
+  new_entry->name = strdup(name); // drop ownership of name
+  if (!new_entry->name) {
     (&system_allocator)->free(&system_allocator, new_entry);
-    return probe->value;
-  } else {
-    // new value
-    probe->name = strdup(probe->name); // drop ownership of name
-    probe->value = tt_next++;
-    if ((probe->value - TT_START) >= tt_by_id_sz) {
-      if (tt_by_id_sz == 0) {
-	tt_by_id = malloc(sizeof(*tt_by_id) * ((tt_by_id_sz = (tt_next - TT_START) * 16)));
-      } else {
-	tt_by_id = realloc(tt_by_id, sizeof(*tt_by_id) * ((tt_by_id_sz *= 2)));
-      }
-      if (!tt_by_id) {
-	return TT_INVALID;
-      }
-    }
-    assert(probe->value - TT_START < tt_by_id_sz);
-    tt_by_id[probe->value - TT_START] = probe;
-    return probe->value;
+    goto out;
   }
+  new_entry->value = tt_next++;
+  new_entry->ser = NULL;
+  Entry **bucket = &tt_buckets[h_djbhash((const uint8_t*)name, strlen(name)) % TT_BUCKETS];
+  new_entry->next = *bucket;
+  // publish the entry only once it is complete
+  h_platform_atomic_store((void **)&seg[id % TT_SEG_SIZE], new_entry);
+  h_platform_atomic_store((void **)bucket, new_entry);
+  ret = new_entry->value;
+
+ out:
+  h_platform_mutex_unlock(&tt_lock);
+  return ret;
 }
 HTokenType h_get_token_type_number(const char* name) {
-  Entry e;
-  e.name = name;
-  Entry **ret = (Entry**)tfind(&e, &tt_registry, compare_entries);
-  if (ret == NULL)
+  Entry *e = lookup(name);
+  if (e == NULL)
     return 0;
   else
-    return (*ret)->value;
+    return e->value;
 }
-const char* h_get_token_type_name(HTokenType token_type) {
-  if (token_type >= tt_next || token_type < TT_START)
+static Entry* lookup_id(HTokenType token_type) {
+  if (token_type < TT_START)
     return NULL;
-  else
-    return tt_by_id[token_type - TT_START]->name;
+  size_t id = token_type - TT_START;
+  if (id >= (size_t)TT_SEGS * TT_SEG_SIZE)
+    return NULL;
+  Entry **seg = h_platform_atomic_load((void **)&tt_by_id[id / TT_SEG_SIZE]);
+  if (seg == NULL)
+    return NULL;
+  return h_platform_atomic_load((void **)&seg[id % TT_SEG_SIZE]);
+}
+const char* h_get_token_type_name(HTokenType token_type) {
+  Entry *e = lookup_id(token_type);
+  return e ? e->name : NULL;
+}
+
+int h_set_token_type_serializer(HTokenType token_type, const HTokenSerializer* ser) {
+  Entry *e = lookup_id(token_type);
+  if (e == NULL)
+    return -1;
+  h_platform_atomic_store((void **)&e->ser, (void *)ser);
+  return 0;
+}
+const HTokenSerializer* h_get_token_type_serializer(HTokenType token_type) {
+  Entry *e = lookup_id(token_type);
+  return e ? h_platform_atomic_load((void * const *)&e->ser) : NULL;
 }
@@ -0,0 +1,409 @@
+/* Input sources for Hammer: pull-based, stackable decoders.
+ *
+ * h_parse_source reads a bounded buffer at a time from the top source and
+ * feeds it to the chunked parsing interface; each decoder layer in turn
+ * reads from the source below it only as much as it needs.
+ */
+
+#include <string.h>
+#ifdef HAMMER_ZLIB
+#include <zlib.h>
+#endif
+#include "hammer.h"
+#include "internal.h"
+
+#define SOURCE_BUFSIZE 4096
+
+// {{{ sources that do not decode
+
+typedef struct {
+  HInputSource src;
+  HAllocator *mm__;
+  const uint8_t *input;
+  size_t length;
+  size_t pos;
+} HBufferSource;
+
+static long buffer_read(HInputSource *src, uint8_t *buf, size_t n) {
+  HBufferSource *s = (HBufferSource*)src;
+  if (n > s->length - s->pos)
+    n = s->length - s->pos;
+  memcpy(buf, s->input + s->pos, n);
+  s->pos += n;
+  return n;
+}
+
+static void buffer_free(HInputSource *src) {
+  HBufferSource *s = (HBufferSource*)src;
+  HAllocator *mm__ = s->mm__;
+  h_free(s);
+}
+
+HInputSource* h_source_buffer(const uint8_t* input, size_t length) {
+  return h_source_buffer__m(&system_allocator, input, length);
+}
+HInputSource* h_source_buffer__m(HAllocator* mm__, const uint8_t* input, size_t length) {
+  HBufferSource *s = h_new(HBufferSource, 1);
+  if (!s)
+    return NULL;
+  s->src.read = buffer_read;
+  s->src.free = buffer_free;
+  s->mm__ = mm__;
+  s->input = input;
+  s->length = length;
+  s->pos = 0;
+  return &s->src;
+}
+
+typedef struct {
+  HInputSource src;
+  HAllocator *mm__;
+  FILE *f;
+} HFileSource;
+
+static long file_read(HInputSource *src, uint8_t *buf, size_t n) {
+  HFileSource *s = (HFileSource*)src;
+  size_t r = fread(buf, 1, n, s->f);
+  if (r == 0 && ferror(s->f))
+    return -1;
+  return r;
+}
+
+static void file_free(HInputSource *src) {
+  HFileSource *s = (HFileSource*)src;
+  HAllocator *mm__ = s->mm__;
+  h_free(s);
+}
+
+HInputSource* h_source_file(FILE* f) {
+  return h_source_file__m(&system_allocator, f);
+}
+HInputSource* h_source_file__m(HAllocator* mm__, FILE* f) {
+  HFileSource *s = h_new(HFileSource, 1);
+  if (!s)
+    return NULL;
+  s->src.read = file_read;
+  s->src.free = file_free;
+  s->mm__ = mm__;
+  s->f = f;
+  return &s->src;
+}
+
+// }}}
+
+// {{{ decoding layers
+
+// what all layers have in common: the source they read from, and a buffer
+// of its output.
+typedef struct {
+  HInputSource src;
+  HAllocator *mm__;
+  HInputSource *inner;
+  uint8_t in[SOURCE_BUFSIZE];
+  size_t inpos, inlen;
+  bool eof;
+} HLayer;
+
+#define LAYER_EOF (-1)
+#define LAYER_ERROR (-2)
+
+static void layer_init(HLayer *l, HAllocator *mm__, HInputSource *inner,
+                       long (*read)(HInputSource*, uint8_t*, size_t),
+                       void (*free_)(HInputSource*)) {
+  l->src.read = read;
+  l->src.free = free_;
+  l->mm__ = mm__;
+  l->inner = inner;
+  l->inpos = l->inlen = 0;
+  l->eof = false;
+}
+
+// refill the buffer if it is empty. returns false at the end or on an error.
+static bool layer_fill(HLayer *l, bool *error) {
+  if (l->inpos < l->inlen)
+    return true;
+  if (l->eof)
+    return false;
+  long r = l->inner->read(l->inner, l->in, sizeof(l->in));
+  if (r <= 0) {
+    l->eof = true;
+    *error = (r < 0);
+    return false;
+  }
+  l->inpos = 0;
+  l->inlen = r;
+  return true;
+}
+
+// the next byte from the inner source, LAYER_EOF or LAYER_ERROR
+static int layer_getc(HLayer *l) {
+  bool error = false;
+  if (!layer_fill(l, &error))
+    return error ? LAYER_ERROR : LAYER_EOF;
+  return l->in[l->inpos++];
+}
+
+// the next byte that is not whitespace
+static int layer_getc_nows(HLayer *l) {
+  int c;
+  do {
+    c = layer_getc(l);
+  } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+  return c;
+}
+
+static void layer_free(HInputSource *src) {
+  HLayer *l = (HLayer*)src;
+  HAllocator *mm__ = l->mm__;
+  l->inner->free(l->inner);
+  h_free(l);
+}
+
+// base64 (RFC 4648), ignoring whitespace
+
+typedef struct {
+  HLayer layer;
+  uint8_t out[3];
+  size_t outpos, outlen;
+  bool padded;          // seen the end of the data
+} HBase64Source;
+
+static int base64_value(int c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+// decode the next four characters into s->out. returns false at the end.
+static bool base64_quantum(HBase64Source *s, bool *error) {
+  int v[4];
+  int npad = 0;
+
+  for (int i = 0; i < 4; i++) {
+    int c = layer_getc_nows(&s->layer);
+    if (c == LAYER_ERROR || (c == LAYER_EOF && i > 0) || (c != LAYER_EOF && s->padded)) {
+      *error = true;
+      return false;
+    }
+    if (c == LAYER_EOF)
+      return false;
+    if (c == '=' && i >= 2) {
+      npad++;
+      v[i] = 0;
+      continue;
+    }
+    v[i] = base64_value(c);
+    if (v[i] < 0 || npad > 0) {   // not base64, or data after padding
+      *error = true;
+      return false;
+    }
+  }
+
+  uint32_t bits = (v[0] << 18) | (v[1] << 12) | (v[2] << 6) | v[3];
+  s->out[0] = bits >> 16;
+  s->out[1] = bits >> 8;
+  s->out[2] = bits;
+  s->outpos = 0;
+  s->outlen = 3 - npad;
+  s->padded = (npad > 0);
+  return true;
+}
+
+static long base64_read(HInputSource *src, uint8_t *buf, size_t n) {
+  HBase64Source *s = (HBase64Source*)src;
+  size_t len = 0;
+  bool error = false;
+
+  while (len < n) {
+    if (s->outpos == s->outlen && !base64_quantum(s, &error))
+      break;
+    while (len < n && s->outpos < s->outlen)
+      buf[len++] = s->out[s->outpos++];
+  }
+  return error ? -1 : (long)len;
+}
+
+HInputSource* h_source_base64(HInputSource* inner) {
+  return h_source_base64__m(&system_allocator, inner);
+}
+HInputSource* h_source_base64__m(HAllocator* mm__, HInputSource* inner) {
+  HBase64Source *s = h_new(HBase64Source, 1);
+  if (!s)
+    return NULL;
+  layer_init(&s->layer, mm__, inner, base64_read, layer_free);
+  s->outpos = s->outlen = 0;
+  s->padded = false;
+  return &s->layer.src;
+}
+
+// hexadecimal, two digits per byte, ignoring whitespace
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static long hex_read(HInputSource *src, uint8_t *buf, size_t n) {
+  HLayer *l = (HLayer*)src;
+  size_t len = 0;
+
+  while (len < n) {
+    int hi = layer_getc_nows(l);
+    if (hi == LAYER_EOF)
+      break;
+    int lo = layer_getc_nows(l);
+    if (hex_value(hi) < 0 || hex_value(lo) < 0)
+      return -1;                // includes odd digits and errors below
+    buf[len++] = (hex_value(hi) << 4) | hex_value(lo);
+  }
+  return len;
+}
+
+HInputSource* h_source_hex(HInputSource* inner) {
+  return h_source_hex__m(&system_allocator, inner);
+}
+HInputSource* h_source_hex__m(HAllocator* mm__, HInputSource* inner) {
+  HLayer *l = h_new(HLayer, 1);
+  if (!l)
+    return NULL;
+  layer_init(l, mm__, inner, hex_read, layer_free);
+  return &l->src;
+}
+
+// zlib and gzip streams
+
+#ifdef HAMMER_ZLIB
+typedef struct {
+  HLayer layer;
+  z_stream zs;
+  bool end;             // seen the end of the compressed data
+} HInflateSource;
+
+static long inflate_read(HInputSource *src, uint8_t *buf, size_t n) {
+  HInflateSource *s = (HInflateSource*)src;
+  HLayer *l = &s->layer;
+
+  s->zs.next_out = buf;
+  s->zs.avail_out = n;
+  while (s->zs.avail_out > 0 && !s->end) {
+    bool error = false;
+    if (s->zs.avail_in == 0) {
+      if (!layer_fill(l, &error))
+        return -1;              // error, or compressed data cut short
+      s->zs.next_in = l->in + l->inpos;
+      s->zs.avail_in = l->inlen - l->inpos;
+      l->inpos = l->inlen;      // now owned by zs
+    }
+    int ret = inflate(&s->zs, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END)
+      s->end = true;
+    else if (ret != Z_OK)
+      return -1;
+  }
+  return n - s->zs.avail_out;
+}
+
+static void inflate_free(HInputSource *src) {
+  HInflateSource *s = (HInflateSource*)src;
+  inflateEnd(&s->zs);
+  layer_free(src);
+}
+#endif
+
+HInputSource* h_source_inflate(HInputSource* inner) {
+  return h_source_inflate__m(&system_allocator, inner);
+}
+HInputSource* h_source_inflate__m(HAllocator* mm__, HInputSource* inner) {
+#ifdef HAMMER_ZLIB
+  HInflateSource *s = h_new(HInflateSource, 1);
+  if (!s)
+    return NULL;
+  layer_init(&s->layer, mm__, inner, inflate_read, inflate_free);
+  memset(&s->zs, 0, sizeof(s->zs));
+  s->end = false;
+  // 15 + 32: the largest window, and detect the zlib or gzip header
+  if (inflateInit2(&s->zs, 15 + 32) != Z_OK) {
+    h_free(s);
+    return NULL;
+  }
+  return &s->layer.src;
+#else
+  return NULL;
+#endif
+}
+
+// }}}
+
+void h_source_free(HInputSource* src) {
+  if (src)
+    src->free(src);
+}
+
+HParseResult* h_parse_source(const HParser* parser, HInputSource* src) {
+  return h_parse_source__m(&system_allocator, parser, src);
+}
+
+HParseResult* h_parse_source__m(HAllocator* mm__, const HParser* parser, HInputSource* src) {
+  HSuspendedParser *s = h_parse_start__m(mm__, parser);
+  if (s) {
+    uint8_t *buf = h_new(uint8_t, SOURCE_BUFSIZE);
+    bool error = false;
+    for (;;) {
+      long r = buf ? src->read(src, buf, SOURCE_BUFSIZE) : -1;
+      if (r <= 0) {
+        error = (r < 0);
+        break;
+      }
+      if (h_parse_chunk(s, buf, r))
+        break;                  // no need to read any further
+    }
+    HParseResult *res = h_parse_finish(s);
+    if (buf)
+      h_free(buf);
+    if (error) {
+      h_parse_result_free(res);
+      return NULL;
+    }
+    return res;
+  }
+
+  // the backend cannot parse incrementally; read all of the input, in
+  // pieces, and parse that.
+  HArena *arena = h_new_arena(mm__, 0);
+  struct iovec *iov = NULL;
+  size_t n = 0, cap = 0;
+  HParseResult *res = NULL;
+  for (;;) {
+    if (n == cap) {
+      cap = cap ? 2 * cap : 16;
+      struct iovec *iov2 = mm__->realloc(mm__, iov, cap * sizeof(struct iovec));
+      if (!iov2)
+        goto out;
+      iov = iov2;
+    }
+    uint8_t *buf = h_arena_malloc(arena, SOURCE_BUFSIZE);
+    long r = src->read(src, buf, SOURCE_BUFSIZE);
+    if (r < 0)
+      goto out;
+    if (r == 0)
+      break;
+    iov[n].iov_base = buf;
+    iov[n].iov_len = r;
+    n++;
+  }
+  res = h_parse_iov__m(mm__, parser, iov, n);
+ out:
+  if (iov)
+    h_free(iov);
+  // the result may point into the input
+  if (res)
+    h_arena_adopt(res->arena, arena);
+  else
+    h_delete_arena(arena);
+  return res;
+}
@@ -0,0 +1,104 @@
+/* Scanning runs of bytes from a set, for repetitions of charsets.
+ *
+ * A set is classified with two 16-entry tables, indexed by the low and
+ * high nibble of a byte: the byte is in the set iff the entries share a
+ * bit. Each bit stands for one distinct set of low nibbles, so this is
+ * exact whenever the high nibbles call for at most 8 of those -- which
+ * covers ranges, unions of a few ranges and most character classes. The
+ * lookups are one shuffle each, 16 or 32 bytes at a time.
+ */
+
+#include <string.h>
+#include "internal.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SPAN_X86 1
+#include <immintrin.h>
+#endif
+
+static size_t span_scalar(const HSpanTable *t, const uint8_t *p, size_t n) {
+  size_t i = 0;
+  while (i + 4 <= n && t->member[p[i]] && t->member[p[i+1]] && t->member[p[i+2]] && t->member[p[i+3]])
+    i += 4;
+  while (i < n && t->member[p[i]])
+    i++;
+  return i;
+}
+
+#ifdef SPAN_X86
+__attribute__((target("ssse3")))
+static size_t span_ssse3(const HSpanTable *t, const uint8_t *p, size_t n) {
+  const __m128i lo = _mm_loadu_si128((const __m128i *)t->lo);
+  const __m128i hi = _mm_loadu_si128((const __m128i *)t->hi);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+    __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    __m128i out = _mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128());
+    unsigned int mask = _mm_movemask_epi8(out);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+  return i + span_scalar(t, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t span_avx2(const HSpanTable *t, const uint8_t *p, size_t n) {
+  const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t->lo));
+  const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t->hi));
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble));
+    __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i out = _mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256());
+    unsigned int mask = _mm256_movemask_epi8(out);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+  return i + span_scalar(t, p + i, n - i);
+}
+#endif
+
+void h_span_table_init(HSpanTable *t, HCharset cs) {
+  for (int b = 0; b < 256; b++)
+    t->member[b] = charset_isset(cs, b);
+  t->scan = span_scalar;
+
+  // one bucket per distinct set of low nibbles
+  uint16_t buckets[8];
+  int nbuckets = 0;
+  memset(t->lo, 0, sizeof(t->lo));
+  memset(t->hi, 0, sizeof(t->hi));
+  for (int h = 0; h < 16; h++) {
+    uint16_t lows = 0;
+    for (int l = 0; l < 16; l++)
+      lows |= t->member[h << 4 | l] << l;
+    if (lows == 0)
+      continue;
+    int k;
+    for (k = 0; k < nbuckets && buckets[k] != lows; k++)
+      ;
+    if (k == nbuckets) {
+      if (nbuckets == 8)
+        return;                 // not representable; stay scalar
+      buckets[nbuckets++] = lows;
+      for (int l = 0; l < 16; l++)
+        if (lows & (1 << l))
+          t->lo[l] |= 1 << k;
+    }
+    t->hi[h] = 1 << k;
+  }
+
+#ifdef SPAN_X86
+  // this may run before the constructor that would otherwise do it
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    t->scan = span_avx2;
+  else if (__builtin_cpu_supports("ssse3"))
+    t->scan = span_ssse3;
+#endif
+}
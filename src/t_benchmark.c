@@ -1,5 +1,9 @@
 #include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "hammer.h"
+#include "platform.h"
 #include "test_suite.h"
 
 HParserTestcase testcases[] = {
@@ -15,8 +19,346 @@ static void test_benchmark_1() {
 
   HBenchmarkResults *res = h_benchmark(parser, testcases);
   h_benchmark_report(stderr, res);
+  for (size_t i = 0; i < res->len; i++) {
+    HBackendResults *br = &res->results[i];
+    g_check_cmp_int(br->compile_success, ==, true);
+    for (size_t j = 0; br->cases && j < br->n_testcases; j++) {
+      g_check_cmp_uint64(br->cases[j].n_samples, >=, 5);
+      g_check_cmp_uint64(br->cases[j].median_time, <=, br->cases[j].p99_time);
+      g_check_cmp_uint64(br->cases[j].arena_used, >, 0);
+      g_check_cmp_uint64(br->cases[j].peak_bytes, >=, br->cases[j].arena_used);
+      g_check_cmp_uint64(br->cases[j].allocs, >, 0);
+    }
+  }
+
+  for (HBenchmarkFormat f = H_BENCHMARK_TEXT; f <= H_BENCHMARK_CSV; f++) {
+    FILE *out = tmpfile();
+    h_benchmark_report_format(out, res, f);
+    g_check_cmp_int(ftell(out), >, 0);
+    fclose(out);
+  }
+
+  FILE *code = tmpfile();
+  h_benchmark_dump_optimized_code(code, parser, res);
+  fclose(code);
+}
+
+/* Grammars for the compile-time benchmark */
+
+// from t_grammar.c
+static HParser *grammar_example_1(void) {
+  HParser *c = h_many(h_ch('x'));
+  HParser *q = h_sequence(c, h_ch('y'), NULL);
+  return h_choice(q, h_end_p(), NULL);
+}
+
+// E -> E '-' T | T ;  T -> '(' E ')' | 'n'   (examples/ties.c, cfExample)
+static HParser *grammar_expr(void) {
+  HParser *n = h_ch('n');
+  HParser *E = h_indirect();
+  HParser *T = h_choice(h_sequence(h_ch('('), E, h_ch(')'), NULL), n, NULL);
+  h_bind_indirect(E, h_choice(h_sequence(E, h_ch('-'), T, NULL), T, NULL));
+  return E;
+}
+
+// examples/base64.c
+static HParser *grammar_base64(void) {
+  HParser *digit = h_ch_range(0x30, 0x39);
+  HParser *alpha = h_choice(h_ch_range(0x41, 0x5a), h_ch_range(0x61, 0x7a), NULL);
+  HParser *bsfdig = h_choice(alpha, digit, h_ch('+'), h_ch('/'), NULL);
+  HParser *bsfdig_4bit = h_choice(
+    h_ch('A'), h_ch('E'), h_ch('I'), h_ch('M'), h_ch('Q'), h_ch('U'),
+    h_ch('Y'), h_ch('c'), h_ch('g'), h_ch('k'), h_ch('o'), h_ch('s'),
+    h_ch('w'), h_ch('0'), h_ch('4'), h_ch('8'), NULL);
+  HParser *bsfdig_2bit = h_choice(h_ch('A'), h_ch('Q'), h_ch('g'), h_ch('w'), NULL);
+  HParser *equals = h_ch('=');
+  HParser *quads = h_many(h_sequence(bsfdig, bsfdig, bsfdig, bsfdig, NULL));
+  HParser *b64_2 = h_sequence(bsfdig, bsfdig, bsfdig_4bit, equals, h_end_p(), NULL);
+  HParser *b64_1 = h_sequence(bsfdig, bsfdig_2bit, equals, equals, h_end_p(), NULL);
+  return h_sequence(quads, h_choice(h_end_p(), b64_2, b64_1, NULL), NULL);
+}
+
+// examples/ties.c, finkmao
+static HParser *grammar_finkmao(void) {
+  HParser *L = h_ch('L'), *R = h_ch('R'), *C = h_ch('C'), *U = h_ch('U');
+  HParser *Lnext = h_indirect(), *Rnext = h_indirect(), *Cnext = h_indirect();
+  h_bind_indirect(Lnext, h_choice(h_sequence(R, Rnext, NULL),
+                                  h_sequence(C, Cnext, NULL),
+                                  h_sequence(R, C, U, NULL), NULL));
+  h_bind_indirect(Rnext, h_choice(h_sequence(L, Lnext, NULL),
+                                  h_sequence(C, Cnext, NULL),
+                                  h_sequence(L, C, U, NULL), NULL));
+  h_bind_indirect(Cnext, h_choice(h_sequence(R, Rnext, NULL),
+                                  h_sequence(L, Lnext, NULL), NULL));
+  return h_sequence(L, Lnext, NULL);
+}
+
+// examples/ties.c, depth1
+static HParser *grammar_depth1(void) {
+  HParser *L = h_ch('L'), *R = h_ch('R'), *C = h_ch('C'), *U = h_ch('U');
+  HParser *lastR = h_indirect(), *lastL = h_indirect(), *lastC = h_indirect();
+  h_bind_indirect(lastR, h_choice(h_sequence(L, R, lastR, NULL),
+                                  h_sequence(C, R, lastR, NULL),
+                                  h_sequence(L, C, lastC, NULL),
+                                  h_sequence(L, C, U, lastC, NULL),
+                                  h_sequence(L, C, U, NULL),
+                                  h_sequence(C, L, lastL, NULL),
+                                  h_sequence(C, L, U, lastL, NULL),
+                                  h_sequence(C, L, U, NULL), NULL));
+  h_bind_indirect(lastL, h_choice(h_sequence(R, L, lastR, NULL),
+                                  h_sequence(C, L, lastR, NULL),
+                                  h_sequence(R, C, lastC, NULL),
+                                  h_sequence(R, C, U, lastC, NULL),
+                                  h_sequence(R, C, U, NULL),
+                                  h_sequence(C, R, lastR, NULL),
+                                  h_sequence(C, R, U, lastR, NULL),
+                                  h_sequence(C, R, U, NULL), NULL));
+  h_bind_indirect(lastC, h_choice(h_sequence(L, C, lastR, NULL),
+                                  h_sequence(R, C, lastR, NULL),
+                                  h_sequence(L, R, lastR, NULL),
+                                  h_sequence(L, R, U, lastR, NULL),
+                                  h_sequence(L, R, U, NULL),
+                                  h_sequence(R, L, lastL, NULL),
+                                  h_sequence(R, L, U, lastL, NULL),
+                                  h_sequence(R, L, U, NULL), NULL));
+  return h_choice(h_sequence(L, lastL, NULL),
+                  h_sequence(R, lastR, NULL),
+                  h_sequence(C, lastC, NULL), NULL);
+}
+
+// average time (ns) to compile p; *ok is set to whether it compiles
+static int64_t time_compile(HParser *p, HParserBackend backend, const void *params,
+                            bool *ok) {
+  struct HStopWatch sw;
+  int64_t ns = 0;
+  int n;
+
+  for (n = 0; n < 1000 && ns < 200000000; n++) {
+    h_platform_stopwatch_reset(&sw);
+    *ok = (h_compile(p, backend, params) == 0);
+    ns += h_platform_stopwatch_ns(&sw);
+  }
+  return ns / n;
+}
+
+static void test_benchmark_compile(void) {
+  static const struct {
+    const char *name;
+    HParser *(*grammar)(void);
+  } grammars[] = {
+    {"grammar/example_1", grammar_example_1},
+    {"expr",              grammar_expr},
+    {"examples/base64",   grammar_base64},
+    {"examples/finkmao",  grammar_finkmao},
+    {"examples/depth1",   grammar_depth1},
+  };
+  static const struct {
+    const char *name;
+    HParserBackend backend;
+    const void *params;
+  } configs[] = {
+    {"LL(1)", PB_LLk, (void *)1},
+    {"LL(2)", PB_LLk, (void *)2},
+    {"LALR",  PB_LALR, NULL},
+  };
+
+  fprintf(stderr, "\nCompile time (us)    ");
+  for (size_t j = 0; j < sizeof(configs) / sizeof(configs[0]); j++)
+    fprintf(stderr, "%10s ", configs[j].name);
+  fprintf(stderr, "\n");
+  for (size_t i = 0; i < sizeof(grammars) / sizeof(grammars[0]); i++) {
+    HParser *p = grammars[i].grammar();
+    fprintf(stderr, "%-21s", grammars[i].name);
+    for (size_t j = 0; j < sizeof(configs) / sizeof(configs[0]); j++) {
+      bool ok;
+      int64_t ns = time_compile(p, configs[j].backend, configs[j].params, &ok);
+      fprintf(stderr, "%10.1f%c", ns / 1000., ok ? ' ' : '*');
+    }
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "(* = not in the backend's grammar class; time until giving up)\n");
+}
+
+// throughput of h_parse_batch on many small messages, like examples/dns.c
+static void test_benchmark_batch(void) {
+  HParser *label = h_length_value(h_int_range(h_uint8(), 1, 63), h_uint8());
+  HParser *question = h_sequence(h_many(label), h_ch('\0'), h_uint16(), h_uint16(), NULL);
+  HParser *p = h_sequence(h_repeat_n(h_uint16(), 6), question, h_end_p(), NULL);
+  h_compile(p, PB_LALR, NULL);
+
+  static const uint8_t msg[] = {
+    0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0,
+    3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+    0, 1, 0, 1
+  };
+  enum { N = 20000 };
+  const uint8_t **inputs = malloc(N * sizeof(*inputs));
+  size_t *lengths = malloc(N * sizeof(*lengths));
+  HParseResult **results = malloc(N * sizeof(*results));
+  for (size_t i = 0; i < N; i++) {
+    inputs[i] = msg;
+    lengths[i] = sizeof(msg);
+  }
+
+  // warm up the allocator, so the first timing is not penalized
+  h_parse_batch(p, inputs, lengths, N, results, NULL);
+  for (size_t i = 0; i < N; i++)
+    h_parse_result_free(results[i]);
+
+  fprintf(stderr, "\nBatch parse (LALR)   threads  msgs/s\n");
+  for (unsigned int threads = 1; threads <= 8; threads *= 2) {
+    HBatchParams params = {.threads = threads};
+    struct HStopWatch sw;
+    h_platform_stopwatch_reset(&sw);
+    size_t ok = h_parse_batch(p, inputs, lengths, N, results, &params);
+    int64_t ns = h_platform_stopwatch_ns(&sw);
+    g_check_cmp_int(ok, ==, N);
+    for (size_t i = 0; i < N; i++)
+      h_parse_result_free(results[i]);
+    fprintf(stderr, "%28u %8.0f\n", threads, N * 1e9 / (ns ? ns : 1));
+  }
+
+  free(inputs);
+  free(lengths);
+  free(results);
+}
+
+// throughput of the byte-level primitives, repeated over a long input
+static void test_benchmark_primitives(void) {
+  static const uint8_t word[16] = "abcdefghijklmnop";
+  enum { LEN = 1 << 14 };
+  uint8_t *input = malloc(LEN);
+  for (size_t i = 0; i < LEN; i++)
+    input[i] = word[i % 16];
+
+  static const struct {
+    const char *name;
+    HParserBackend backend;
+  } backends[] = {
+    {"packrat", PB_PACKRAT},
+    {"llk", PB_LLk},
+    {"lalr", PB_LALR},
+  };
+  const char *names[] = {"h_token(16)", "h_ch", "h_ch_range", "h_in", "h_not_in"};
+
+  fprintf(stderr, "\nPrimitives (MB/s)    ");
+  for (size_t j = 0; j < sizeof(backends) / sizeof(backends[0]); j++)
+    fprintf(stderr, "%10s ", backends[j].name);
+  fprintf(stderr, "\n");
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    fprintf(stderr, "%-21s", names[i]);
+    for (size_t j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+      // a fresh parser for each backend; the primitives match all of input
+      HParser *prim;
+      switch (i) {
+      case 0: prim = h_token(word, 16); break;
+      case 1: prim = h_ch('a'); memset(input, 'a', LEN); break;
+      case 2: prim = h_ch_range('a', 'p'); break;
+      case 3: prim = h_in(word, 16); break;
+      default: prim = h_not_in((const uint8_t *)"\n", 1); break;
+      }
+      HParser *p = h_sequence(h_many(prim), h_end_p(), NULL);
+      if (h_compile(p, backends[j].backend, NULL) != 0) {
+        fprintf(stderr, "%10s ", "-");
+        continue;
+      }
+      int64_t ns = 0;
+      int reps;
+      for (reps = 0; reps < 20 && ns < 200000000; reps++) {
+        struct HStopWatch sw;
+        h_platform_stopwatch_reset(&sw);
+        HParseResult *res = h_parse(p, input, LEN);
+        ns += h_platform_stopwatch_ns(&sw);
+        g_check_cmp_ptr(res, !=, NULL);
+        h_parse_result_free(res);
+      }
+      fprintf(stderr, "%10.1f ", reps * LEN * 1e3 / (ns ? ns : 1));
+      for (size_t k = 0; k < LEN; k++)
+        input[k] = word[k % 16];
+    }
+    fprintf(stderr, "\n");
+  }
+  free(input);
+}
+
+// h_serialize_token against h_write_result_unamb, on one large parse tree
+static void test_benchmark_serialize(void) {
+  HParser *kv = h_sequence(h_many1(h_ch_range('a', 'z')), h_ch('='),
+                           h_choice(h_int_range(h_uint8(), '0', '9'),
+                                    h_token((const uint8_t *)"yes", 3), NULL), NULL);
+  HParser *p = h_sequence(h_sepBy(kv, h_ch(';')), h_end_p(), NULL);
+  h_compile(p, PB_LALR, NULL);
+  enum { N = 20000 };
+  static const char *entries[] = {"ab=1", "c=yes", "def=7", "ghij=yes"};
+  char *input = malloc(N * 10);
+  size_t len = 0;
+  for (size_t i = 0; i < N; i++)
+    len += sprintf(input + len, "%s%s", i ? ";" : "", entries[i % 4]);
+  HParseResult *res = h_parse(p, (const uint8_t *)input, len);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (!res) {
+    free(input);
+    return;
+  }
+
+  fprintf(stderr, "\nSerialise %d entries    us/tree    bytes\n", N);
+  struct HStopWatch sw;
+  int64_t ns;
+  int reps;
+  size_t size = 0;
+
+  for (ns = 0, reps = 0; reps < 20 && ns < 200000000; reps++) {
+    h_platform_stopwatch_reset(&sw);
+    char *s = h_write_result_unamb(res->ast);
+    ns += h_platform_stopwatch_ns(&sw);
+    size = strlen(s);
+    free(s);
+  }
+  fprintf(stderr, "%-24s%10.1f %8zu\n", "h_write_result_unamb", ns / 1e3 / reps, size);
+
+  uint8_t *buf = NULL;
+  for (ns = 0, reps = 0; reps < 20 && ns < 200000000; reps++) {
+    free(buf);
+    h_platform_stopwatch_reset(&sw);
+    buf = h_serialize_token(res->ast, &size);
+    ns += h_platform_stopwatch_ns(&sw);
+  }
+  fprintf(stderr, "%-24s%10.1f %8zu\n", "h_serialize_token", ns / 1e3 / reps, size);
+
+  // the receiving side: check the buffer, and find every entry's value
+  size_t found = 0;
+  for (ns = 0, reps = 0; reps < 20 && ns < 200000000; reps++) {
+    h_platform_stopwatch_reset(&sw);
+    const HPackedToken *root = h_read_serialized(buf, size);
+    const HPackedToken *list = h_packed_seq_index(root, 0);
+    found = 0;
+    for (size_t i = 0; i < h_packed_seq_len(list); i++) {
+      const HPackedToken *v = h_packed_seq_index(h_packed_seq_index(list, i), 2);
+      found += (v->token_type == TT_BYTES);
+    }
+    ns += h_platform_stopwatch_ns(&sw);
+  }
+  g_check_cmp_uint64(found, ==, N / 2);
+  fprintf(stderr, "%-24s%10.1f\n", "h_read_serialized+walk", ns / 1e3 / reps);
+
+  for (ns = 0, reps = 0; reps < 20 && ns < 200000000; reps++) {
+    HArena *arena = h_new_arena(&system_allocator, 0);
+    h_platform_stopwatch_reset(&sw);
+    h_deserialize_token(arena, buf, size);
+    ns += h_platform_stopwatch_ns(&sw);
+    h_delete_arena(arena);
+  }
+  fprintf(stderr, "%-24s%10.1f\n", "h_deserialize_token", ns / 1e3 / reps);
+
+  free(buf);
+  h_parse_result_free(res);
+  free(input);
 }
 
 void register_benchmark_tests(void) {
   g_test_add_func("/core/benchmark/1", test_benchmark_1);
+  g_test_add_func("/core/benchmark/compile", test_benchmark_compile);
+  g_test_add_func("/core/benchmark/batch", test_benchmark_batch);
+  g_test_add_func("/core/benchmark/primitives", test_benchmark_primitives);
+  g_test_add_func("/core/benchmark/serialize", test_benchmark_serialize);
 }
@@ -19,6 +19,24 @@ static void test_bitreader_ints(void) {
   g_check_cmp_int64(h_read_bits(&is, 64, true), ==, -0x200000000);
 }
 
+// 64 bits that straddle 9 bytes, both well clear of the end of the input
+// and right up against it
+static void test_bitreader_wide(void) {
+  static const char bytes[] = "\x01\x23\x45\x67\x89\xAB\xCD\xEF\xFE\xDC";
+  for (size_t len = 10; len >= 9; len--) {
+    HInputStream is = MK_INPUT_STREAM(bytes, len, BIT_BIG_ENDIAN | BYTE_BIG_ENDIAN);
+    g_check_cmp_int32(h_read_bits(&is, 4, false), ==, 0x0);
+    g_check_cmp_uint64(h_read_bits(&is, 64, false), ==, 0x123456789ABCDEFFULL);
+    g_check_cmp_int32(is.index, ==, 8);
+    g_check_cmp_int32(is.bit_offset, ==, 4);
+
+    HInputStream is2 = MK_INPUT_STREAM(bytes, len, BIT_LITTLE_ENDIAN | BYTE_LITTLE_ENDIAN);
+    g_check_cmp_int32(h_read_bits(&is2, 4, false), ==, 0x1);
+    g_check_cmp_uint64(h_read_bits(&is2, 64, false), ==, 0xEEFCDAB896745230ULL);
+    g_check_cmp_int64(h_read_bits(&is2, 3, true), ==, -1);
+  }
+}
+
 static void test_bitreader_be(void) {
   HInputStream is = MK_INPUT_STREAM("\x6A\x5A", 2, BIT_BIG_ENDIAN | BYTE_BIG_ENDIAN);
   g_check_cmp_int32(h_read_bits(&is, 3, false), ==, 0x03);
@@ -56,6 +74,48 @@ static void test_offset_largebits_le(void) {
   g_check_cmp_int32(h_read_bits(&is, 11, false), ==, 0x2D3);
 }
 
+// reads from scattered input must match reads from contiguous input
+static void check_iov(const uint8_t *buf, size_t len, const size_t *cuts, size_t ncuts,
+                      char endianness) {
+  struct iovec iov[16];
+  size_t offsets[17];
+  size_t prev = 0;
+  for (size_t i = 0; i <= ncuts; i++) {
+    size_t end = (i < ncuts) ? cuts[i] : len;
+    iov[i].iov_base = (void *)(buf + prev);
+    iov[i].iov_len = end - prev;
+    offsets[i] = prev;
+    prev = end;
+  }
+  offsets[ncuts + 1] = len;
+  HInputVector vec = {.iov = iov, .n = ncuts + 1, .offsets = offsets, .hint = 0};
+  HInputStream flat = MK_INPUT_STREAM(buf, len, endianness);
+  HInputStream scattered = MK_INPUT_STREAM(NULL, len, endianness);
+  scattered.iov = &vec;
+
+  static const int counts[] = {3, 8, 13, 1, 32, 7, 64, 16, 5, 2, 24, 11, 64};
+  for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    int64_t expected = h_read_bits(&flat, counts[i], false);
+    g_check_cmp_int64(h_read_bits(&scattered, counts[i], false), ==, expected);
+    g_check_cmp_int(scattered.overrun, ==, flat.overrun);
+  }
+}
+
+static void test_bitreader_iov(void) {
+  uint8_t buf[40];
+  for (size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = (uint8_t)(i * 37 + 5);
+
+  static const size_t cuts1[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+  static const size_t cuts2[] = {5, 5, 12, 29};     // with an empty segment
+  static const size_t cuts3[] = {39};
+  check_iov(buf, sizeof(buf), cuts1, 15, BIT_BIG_ENDIAN | BYTE_BIG_ENDIAN);
+  check_iov(buf, sizeof(buf), cuts1, 15, BIT_LITTLE_ENDIAN | BYTE_LITTLE_ENDIAN);
+  check_iov(buf, sizeof(buf), cuts2, 4, BIT_BIG_ENDIAN | BYTE_BIG_ENDIAN);
+  check_iov(buf, sizeof(buf), cuts2, 4, BIT_LITTLE_ENDIAN | BYTE_BIG_ENDIAN);
+  check_iov(buf, sizeof(buf), cuts3, 1, BIT_BIG_ENDIAN | BYTE_LITTLE_ENDIAN);
+}
+
 void register_bitreader_tests(void)  {
   g_test_add_func("/core/bitreader/be", test_bitreader_be);
   g_test_add_func("/core/bitreader/le", test_bitreader_le);
@@ -64,4 +124,6 @@ void register_bitreader_tests(void)  {
   g_test_add_func("/core/bitreader/offset-largebits-be", test_offset_largebits_be);
   g_test_add_func("/core/bitreader/offset-largebits-le", test_offset_largebits_le);
   g_test_add_func("/core/bitreader/ints", test_bitreader_ints);
+  g_test_add_func("/core/bitreader/wide", test_bitreader_wide);
+  g_test_add_func("/core/bitreader/iov", test_bitreader_iov);
 }
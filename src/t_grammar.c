@@ -37,7 +37,46 @@ static void test_example_1(void) {
   g_check_followset_present(1, g, c, "y");
 }
 
+static void test_example_2(void) {
+  // E -> E '-' T | T ;  T -> '(' E ')' | 'n'
+  HParser *n = h_ch('n');
+  HParser *E = h_indirect();
+  HParser *T = h_choice(h_sequence(h_ch('('), E, h_ch(')'), NULL), n, NULL);
+  h_bind_indirect(E, h_choice(h_sequence(E, h_ch('-'), T, NULL), T, NULL));
+  HCFGrammar *g = h_cfgrammar(&system_allocator, E);
+
+  g_check_firstset_present(1, g, E, "n");
+  g_check_firstset_present(1, g, E, "(");
+  g_check_firstset_absent(1, g, E, "-");
+
+  g_check_followset_present(1, g, T, "$");
+  g_check_followset_present(1, g, T, "-");
+  g_check_followset_present(1, g, T, ")");
+  g_check_followset_absent(1, g, T, "n");
+}
+
+static void test_wide_sets(void) {
+  // sets with many branches per node
+  HParser *c = h_ch_range(0x20, 0x7e);
+  HParser *p = h_sequence(c, c, h_ch(';'), NULL);
+  HCFGrammar *g = h_cfgrammar(&system_allocator, p);
+
+  g_check_firstset_present(1, g, p, " ");
+  g_check_firstset_present(1, g, p, "~");
+  g_check_firstset_absent(1, g, p, "\x7f");
+  g_check_firstset_present(2, g, p, "ab");
+  g_check_firstset_present(2, g, p, "~ ");
+  g_check_firstset_absent(2, g, p, "a\x7f");
+  g_check_firstset_present(3, g, p, "Z!;");
+  g_check_firstset_absent(3, g, p, "Z!!");
+  g_check_followset_present(2, g, c, "a;");
+  g_check_followset_present(2, g, c, ";$");
+  g_check_followset_absent(2, g, c, "aa");
+}
+
 void register_grammar_tests(void) {
   g_test_add_func("/core/grammar/end", test_end);
   g_test_add_func("/core/grammar/example_1", test_example_1);
+  g_test_add_func("/core/grammar/example_2", test_example_2);
+  g_test_add_func("/core/grammar/wide_sets", test_wide_sets);
 }
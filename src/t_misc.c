@@ -1,7 +1,15 @@
 #include <glib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef HAMMER_ZLIB
+#include <zlib.h>
+#endif
 #include "test_suite.h"
 #include "hammer.h"
+#include "glue.h"
 
 static void test_tt_user(void) {
   g_check_cmp_int32(TT_USER, >, TT_NONE);
@@ -29,7 +37,918 @@ static void test_tt_registry(void) {
   g_check_cmp_int32(h_get_token_type_number("com.upstandinghackers.test.unkown_token_type"), ==, 0);
 }
 
+// dump the code for p into buf, which holds "" if there is none
+static int dump_code_params(HParser *p, HParserBackend backend,
+                            const HCompileParams *params, char *buf, size_t size) {
+  int ret = h_compile_params(p, backend, params);
+  buf[0] = '\0';
+  if (ret == 0) {
+    FILE *f = tmpfile();
+    ret = h_dump_code(f, p, "test");
+    rewind(f);
+    buf[fread(buf, 1, size - 1, f)] = '\0';
+    fclose(f);
+  }
+  return ret;
+}
+
+static int dump_code(HParser *p, HParserBackend backend, char *buf, size_t size) {
+  return dump_code_params(p, backend, NULL, buf, size);
+}
+
+#ifndef HAMMER_SRC_DIR
+#define HAMMER_SRC_DIR "."
+#endif
+#ifndef HAMMER_TEST_CC
+#define HAMMER_TEST_CC "cc"
+#endif
+
+// compile dumped code as a user of the installed headers would, and
+// return the compiler's exit status
+static int compile_code(const char *code) {
+  char dir[] = "/tmp/hammer-dump-XXXXXX", path[256], src[PATH_MAX], cmd[1024];
+  const char *cc = getenv("CC") ? getenv("CC") : HAMMER_TEST_CC;
+  if (!mkdtemp(dir) || !realpath(HAMMER_SRC_DIR, src))
+    return -1;
+  // the code includes <hammer/hammer.h> and friends
+  snprintf(path, sizeof(path), "%s/hammer", dir);
+  int ret = symlink(src, path);
+  snprintf(path, sizeof(path), "%s/test.c", dir);
+  FILE *f = fopen(path, "w");
+  if (ret == 0 && f) {
+    fputs(code, f);
+    fclose(f);
+    snprintf(cmd, sizeof(cmd), "%s -std=gnu99 -I%s -c %s -o %s/test.o", cc, dir, path, dir);
+    ret = system(cmd);
+  } else
+    ret = -1;
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd) != 0)
+    g_test_message("could not remove %s", dir);
+  return ret;
+}
+
+static void test_dump_code(void) {
+  HParser *p = h_sequence(h_many1(h_ch_range('0', '9')), h_end_p(), NULL);
+  static char code[65536];
+
+  g_check_cmp_int(dump_code(p, PB_LLk, code, sizeof(code)), ==, 0);
+  g_check_cmp_ptr(strstr(code, "int test_bind(const HParser *parser)"), !=, NULL);
+  g_check_cmp_ptr(strstr(code, "HParseResult *test_parse(const uint8_t *input, size_t length)"), !=, NULL);
+  g_check_cmp_ptr(strstr(code, "case '0': case '1':"), !=, NULL);
+  g_check_cmp_int(compile_code(code), ==, 0);
+
+  g_check_cmp_int(dump_code(p, PB_LALR, code, sizeof(code)), ==, 0);
+  g_check_cmp_ptr(strstr(code, "static size_t test_goto(size_t state, long x)"), !=, NULL);
+  g_check_cmp_ptr(strstr(code, "HParseResult *test_parse(const uint8_t *input, size_t length)"), !=, NULL);
+  g_check_cmp_int(compile_code(code), ==, 0);
+
+  g_check_cmp_int(dump_code(p, PB_REGULAR, code, sizeof(code)), ==, 0);
+  g_check_cmp_ptr(strstr(code, "long test_match(const uint8_t *input, size_t length)"), !=, NULL);
+  g_check_cmp_ptr(strstr(code, "_bind"), ==, NULL);
+  g_check_cmp_int(compile_code(code), ==, 0);
+
+  g_check_cmp_int(dump_code(p, PB_PACKRAT, code, sizeof(code)), ==, -1);
+}
+
+// compiling on several threads must give the same tables as on one
+static void check_compile_threads(HParser *p, HParserBackend backend, const void *params,
+                                  const char *input, const char *expected) {
+  static char code1[65536], code4[65536];
+  HCompileParams cp = {.backend_params = params, .threads = 1};
+
+  g_check_cmp_int(dump_code_params(p, backend, &cp, code1, sizeof(code1)), ==, 0);
+  cp.threads = 4;
+  g_check_cmp_int(dump_code_params(p, backend, &cp, code4, sizeof(code4)), ==, 0);
+  g_check_string(code1, ==, code4);
+
+  HParseResult *res = h_parse(p, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  char *cres = h_write_result_unamb(res->ast);
+  g_check_string(cres, ==, expected);
+  free(cres);
+  h_parse_result_free(res);
+}
+
+static void test_compile_threads(void) {
+  // E -> E '-' T | T ;  T -> '(' E ')' | [0-9]+   (inadequate LR(0) states)
+  HParser *E = h_indirect();
+  HParser *T = h_choice(h_sequence(h_ch('('), E, h_ch(')'), NULL),
+                        h_many1(h_ch_range('0', '9')), NULL);
+  h_bind_indirect(E, h_choice(h_sequence(E, h_ch('-'), T, NULL), T, NULL));
+  HParser *lr = h_sequence(E, h_end_p(), NULL);
+  check_compile_threads(lr, PB_LALR, NULL, "1-(2-3)",
+                        "(((u0x31) u0x2d (u0x28 ((u0x32) u0x2d (u0x33)) u0x29)))");
+
+  // S -> A | B ;  A -> 'a' 'b' C ;  B -> 'a' 'c' C ;  C -> 'x'* 'y'
+  HParser *C = h_sequence(h_many(h_ch('x')), h_ch('y'), NULL);
+  HParser *ll = h_sequence(h_choice(h_sequence(h_ch('a'), h_ch('b'), C, NULL),
+                                    h_sequence(h_ch('a'), h_ch('c'), C, NULL),
+                                    NULL),
+                           h_end_p(), NULL);
+  check_compile_threads(ll, PB_LLk, (void *)2, "acxxy",
+                        "((u0x61 u0x63 ((u0x78 u0x78) u0x79)))");
+  check_compile_threads(ll, PB_LALR, NULL, "abxy",
+                        "((u0x61 u0x62 ((u0x78) u0x79)))");
+}
+
+// many threads parse with one compiled parser and share the token registry
+#define MT_THREADS 32
+#define MT_ITERATIONS 200
+
+typedef struct {
+  const HCompiledParser *cp;
+  unsigned int id;
+  int failures;
+} MTWorker;
+
+static const char mt_input[] = "acxxy";
+static const char mt_expected[] = "((u0x61 u0x63 ((u0x78 u0x78) u0x79)))";
+
+static gpointer mt_worker(gpointer w_) {
+  MTWorker *w = w_;
+  char name[64];
+
+  for (int i = 0; i < MT_ITERATIONS; i++) {
+    HParseResult *res = h_compiled_parse(w->cp, (const uint8_t *)mt_input, strlen(mt_input));
+    char *cres = res ? h_write_result_unamb(res->ast) : NULL;
+    if (cres == NULL || strcmp(cres, mt_expected) != 0)
+      w->failures++;
+    free(cres);
+    h_parse_result_free(res);
+
+    if (i % 20 == 0) {
+      // threads with the same id % 4 race to allocate the same names
+      snprintf(name, sizeof(name), "com.upstandinghackers.test.mt.%u.%d", w->id % 4, i);
+      HTokenType tt = h_allocate_token_type(name);
+      const char *tname = h_get_token_type_name(tt);
+      if (tt == TT_INVALID || h_get_token_type_number(name) != tt
+          || tname == NULL || strcmp(tname, name) != 0)
+        w->failures++;
+    }
+  }
+  return NULL;
+}
+
+// returns the number of failed parses and lookups
+static int run_mt_workers(const HCompiledParser *cp, unsigned int nthreads) {
+  MTWorker workers[MT_THREADS];
+  GThread *threads[MT_THREADS];
+  int failures = 0;
+
+  for (unsigned int i = 0; i < nthreads; i++) {
+    workers[i].cp = cp;
+    workers[i].id = i;
+    workers[i].failures = 0;
+    threads[i] = g_thread_new("mt_worker", mt_worker, &workers[i]);
+  }
+  for (unsigned int i = 0; i < nthreads; i++) {
+    g_thread_join(threads[i]);
+    failures += workers[i].failures;
+  }
+  return failures;
+}
+
+static void test_compile_shared(void) {
+  // S -> A | B ;  A -> 'a' 'b' C ;  B -> 'a' 'c' C ;  C -> 'x'* 'y'
+  HParser *C = h_sequence(h_many(h_ch('x')), h_ch('y'), NULL);
+  HParser *p = h_sequence(h_choice(h_sequence(h_ch('a'), h_ch('b'), C, NULL),
+                                   h_sequence(h_ch('a'), h_ch('c'), C, NULL),
+                                   NULL),
+                          h_end_p(), NULL);
+  HParserBackend backends[] = {PB_PACKRAT, PB_REGULAR, PB_LLk, PB_LALR, PB_GLR, PB_EARLEY};
+
+  for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+    HCompileParams params = {.backend_params = (void *)2, .threads = 1};
+    HCompiledParser *cp = h_compile_shared(p, backends[b], &params);
+    g_check_cmp_ptr(cp, !=, NULL);
+    // the parser itself stays as it was
+    g_check_cmp_int(p->backend, ==, PB_PACKRAT);
+    g_check_cmp_ptr(p->backend_data, ==, NULL);
+
+    gint64 start = g_get_monotonic_time();
+    g_check_cmp_int(run_mt_workers(cp, 1), ==, 0);
+    gint64 t1 = g_get_monotonic_time() - start;
+    start = g_get_monotonic_time();
+    g_check_cmp_int(run_mt_workers(cp, MT_THREADS), ==, 0);
+    gint64 tn = g_get_monotonic_time() - start;
+    g_test_message("backend %d: %.0f parses/s on 1 thread, %.0f on %d",
+                   (int)backends[b], MT_ITERATIONS * 1e6 / (t1 ? t1 : 1),
+                   MT_THREADS * MT_ITERATIONS * 1e6 / (tn ? tn : 1), MT_THREADS);
+
+    h_compiled_parser_free(cp);
+  }
+
+  HCompiledParser *cp = h_compile_shared(p, PB_LALR, NULL);
+  HSuspendedParser *s = h_compiled_parse_start(cp);
+  g_check_cmp_ptr(s, !=, NULL);
+  h_parse_chunk(s, (const uint8_t *)"acx", 3);
+  h_parse_chunk(s, (const uint8_t *)"xy", 2);
+  HParseResult *res = h_parse_finish(s);
+  g_check_cmp_ptr(res, !=, NULL);
+  char *cres = h_write_result_unamb(res->ast);
+  g_check_string(cres, ==, mt_expected);
+  free(cres);
+  h_parse_result_free(res);
+  h_compiled_parser_free(cp);
+}
+
+// a batch must give the same results, in the same order, as parsing one by one
+static void test_parse_batch(void) {
+  // 12-byte header, then length-prefixed labels up to a zero byte
+  HParser *label = h_length_value(h_int_range(h_uint8(), 1, 63), h_uint8());
+  HParser *p = h_sequence(h_repeat_n(h_uint16(), 6), h_many(label), h_ch('\0'),
+                          h_end_p(), NULL);
+  enum { N = 1000 };
+  static uint8_t buf[N][32];
+  const uint8_t *inputs[N];
+  size_t lengths[N];
+  HParseResult *results[N];
+  size_t expected = 0;
+
+  for (size_t i = 0; i < N; i++) {
+    memset(buf[i], (int)i, 12);
+    size_t len = 12;
+    for (size_t l = 0; l < i % 3; l++) {
+      buf[i][len++] = 3;
+      memcpy(&buf[i][len], "foo", 3);
+      len += 3;
+    }
+    buf[i][len++] = 0;
+    // every seventh input is cut short
+    inputs[i] = buf[i];
+    lengths[i] = (i % 7 == 0) ? len - 1 : len;
+    if (i % 7 != 0)
+      expected++;
+  }
+
+  HBatchParams params = {.threads = 4, .grain = 7};
+  g_check_cmp_int(h_parse_batch(p, inputs, lengths, N, results, &params), ==, expected);
+  for (size_t i = 0; i < N; i++) {
+    HParseResult *res = h_parse(p, inputs[i], lengths[i]);
+    if (res == NULL) {
+      g_check_cmp_ptr(results[i], ==, NULL);
+      continue;
+    }
+    g_check_cmp_ptr(results[i], !=, NULL);
+    char *c1 = h_write_result_unamb(res->ast);
+    char *c2 = h_write_result_unamb(results[i]->ast);
+    g_check_string(c1, ==, c2);
+    free(c1);
+    free(c2);
+    h_parse_result_free(res);
+    h_parse_result_free(results[i]);
+  }
+
+  // defaults: one thread
+  g_check_cmp_int(h_parse_batch(p, inputs, lengths, 10, results, NULL), ==, 8);
+  for (size_t i = 0; i < 10; i++)
+    h_parse_result_free(results[i]);
+}
+
+// splitting must not change the result of h_parse
+static void check_split(const HParser *p, const uint8_t *input, size_t length,
+                        const HParser *resync) {
+  static const HSplitParams configs[] = {
+    {.threads = 1, .chunks = 1},
+    {.threads = 1, .chunks = 7},
+    {.threads = 4, .chunks = 0},
+    {.threads = 4, .chunks = 50},
+    {.threads = 3, .chunks = 1000},
+  };
+  HParseResult *res = h_parse(p, input, length);
+  char *expected = res ? h_write_result_unamb(res->ast) : NULL;
+
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+    HSplitParams params = configs[i];
+    params.resync = resync;
+    HParseResult *sres = h_parse_split(p, input, length, &params);
+    if (res == NULL) {
+      g_check_cmp_ptr(sres, ==, NULL);
+      continue;
+    }
+    g_check_cmp_ptr(sres, !=, NULL);
+    g_check_cmp_int64(sres->bit_length, ==, res->bit_length);
+    char *cres = h_write_result_unamb(sres->ast);
+    g_check_string(cres, ==, expected);
+    free(cres);
+    h_parse_result_free(sres);
+  }
+  free(expected);
+  h_parse_result_free(res);
+}
+
+static HParsedToken *count_record(const HParseResult *p, void *user_data) {
+  ++*(size_t *)user_data;
+  return (HParsedToken *)p->ast;
+}
+
+static void test_parse_split(void) {
+  static uint8_t buf[8192];
+  size_t len;
+
+  // newline-terminated lines, some of them quoted with newlines inside, so
+  // that some candidate boundaries are wrong; the last line is incomplete.
+  HParser *plain = h_sequence(h_many(h_not_in((const uint8_t *)"\n\"", 2)), NULL);
+  HParser *quoted = h_sequence(h_ch('"'), h_many(h_not_in((const uint8_t *)"\"", 1)),
+                               h_ch('"'), NULL);
+  HParser *line = h_sequence(h_choice(quoted, plain, NULL), h_ch('\n'), NULL);
+  len = 0;
+  for (int i = 0; len < sizeof(buf) - 100; i++) {
+    if (i % 5 == 0)
+      len += sprintf((char *)buf + len, "\"%d\n%d\n\n\"\n", i, i * i);
+    else
+      len += sprintf((char *)buf + len, "line %d\n", i);
+  }
+  memcpy(buf + len, "abc", 3);
+  check_split(h_many(line), buf, len + 3, h_ch('\n'));
+  check_split(h_many1(line), buf, len + 3, h_ch('\n'));
+  check_split(h_many1(line), buf, 0, h_ch('\n'));
+  // without a way to split, the input is parsed in one piece
+  check_split(h_many(line), buf, len, NULL);
+
+  // deferred actions run once for each record of the result, and not for
+  // records of pieces that were parsed again
+  size_t calls = 0;
+  HParser *counted = h_many(h_action(line, count_record, &calls));
+  g_check_cmp_int(h_compile(counted, PB_PACKRAT, (void *)H_PACKRAT_DEFER_ACTIONS), ==, 0);
+  check_split(counted, buf, len + 3, h_ch('\n'));
+  HSplitParams split = {.threads = 1, .chunks = 50, .resync = h_ch('\n')};
+  calls = 0;
+  HParseResult *res = h_parse_split(counted, buf, len + 3, &split);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_uint64(calls, ==, res->ast->seq->used);
+    h_parse_result_free(res);
+  }
+
+  // length-prefixed frames, with an unparseable one in the middle
+  HParser *frame = h_length_value(h_uint8(), h_uint16());
+  len = 0;
+  for (int i = 0; len < sizeof(buf) - 600; i++) {
+    buf[len++] = i % 200;
+    for (int j = 0; j < i % 200; j++) {
+      buf[len++] = i;
+      buf[len++] = j;
+    }
+  }
+  check_split(h_many(frame), buf, len, NULL);
+  check_split(h_many(frame), buf, len - 1, NULL);
+  buf[len / 2] = 0xff;
+  check_split(h_many(frame), buf, len, NULL);
+
+  // anything but a repetition is just parsed
+  check_split(h_sequence(line, line, NULL), (const uint8_t *)"a\nb\n", 4, h_ch('\n'));
+}
+
+// parse what [src] reads, and check the AST; NULL if it should fail
+static void check_source(HParser *p, HInputSource *src, const char *expected) {
+  HParseResult *res = h_parse_source(p, src);
+  h_source_free(src);
+  if (expected == NULL) {
+    g_check_cmp_ptr(res, ==, NULL);
+    return;
+  }
+  g_check_cmp_ptr(res, !=, NULL);
+  char *cres = h_write_result_unamb(res->ast);
+  g_check_string(cres, ==, expected);
+  free(cres);
+  h_parse_result_free(res);
+}
+
+static void test_input_source(void) {
+  const char *abc = "((u0x61 u0x62 u0x63) u0x2e)";
+  const char *b64 = "YWJjLg==";         // "abc."
+  const char *hex = "59 57 4a 6a 4c 67 3d 3d\n";   // b64, in hex
+
+  for (int backend = PB_PACKRAT; backend <= PB_EARLEY; backend++) {
+    HParser *p = h_sequence(h_many1(h_ch_range('a', 'z')), h_ch('.'), h_end_p(), NULL);
+    if (h_compile(p, (HParserBackend)backend, NULL) != 0)
+      continue;
+    check_source(p, h_source_buffer((const uint8_t *)"abc.", 4), abc);
+    check_source(p, h_source_base64(h_source_buffer((const uint8_t *)b64, strlen(b64))), abc);
+    check_source(p, h_source_base64(h_source_hex(h_source_buffer((const uint8_t *)hex, strlen(hex)))), abc);
+    // malformed encodings are an error, not the end of the input
+    check_source(p, h_source_base64(h_source_buffer((const uint8_t *)"YWJjL!==", 8)), NULL);
+    check_source(p, h_source_base64(h_source_buffer((const uint8_t *)"YWJjLg=", 7)), NULL);
+    check_source(p, h_source_hex(h_source_buffer((const uint8_t *)"6162632", 7)), NULL);
+  }
+
+  // more input than one buffer holds
+  size_t len = 20000;
+  char *text = malloc(len + 1);
+  char *enc = malloc(2 * len + 2);
+  for (size_t i = 0; i < len; i++)
+    text[i] = 'a' + i % 26;
+  text[len - 1] = '.';
+  for (size_t i = 0; i < len; i++)
+    sprintf(enc + 2 * i, "%02x", (uint8_t)text[i]);
+  // both with chunks, and all at once
+  HParser *q = NULL;
+  static const HParserBackend backends[] = {PB_PACKRAT, PB_LALR};
+  for (size_t i = 0; i < 2; i++) {
+    q = h_sequence(h_many1(h_ch_range('a', 'z')), h_ch('.'), h_end_p(), NULL);
+    h_compile(q, backends[i], NULL);
+    HInputSource *src = h_source_hex(h_source_buffer((const uint8_t *)enc, 2 * len));
+    HParseResult *res = h_parse_source(q, src);
+    h_source_free(src);
+    g_check_cmp_ptr(res, !=, NULL);
+    if (res) {
+      g_check_cmp_int64(res->bit_length, ==, 8 * len);
+      g_check_cmp_uint64(res->ast->seq->elements[0]->seq->used, ==, len - 1);
+      h_parse_result_free(res);
+    }
+  }
+
+#ifdef HAMMER_ZLIB
+  uLongf zlen = compressBound(len);
+  uint8_t *z = malloc(zlen);
+  g_check_cmp_int(compress(z, &zlen, (const uint8_t *)text, len), ==, Z_OK);
+  HInputSource *src = h_source_inflate(h_source_buffer(z, zlen));
+  HParseResult *res = h_parse_source(q, src);
+  h_source_free(src);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_int64(res->bit_length, ==, 8 * len);
+    h_parse_result_free(res);
+  }
+  // cut short
+  check_source(q, h_source_inflate(h_source_buffer(z, zlen / 2)), NULL);
+  free(z);
+#else
+  HInputSource *src = h_source_buffer((const uint8_t *)text, len);
+  g_check_cmp_ptr(h_source_inflate(src), ==, NULL);
+  h_source_free(src);
+#endif
+  free(text);
+  free(enc);
+}
+
+static void test_parse_file(void) {
+  char path[] = "/tmp/hammer-test-XXXXXX";
+  int fd = mkstemp(path);
+  g_check_cmp_int(fd, >=, 0);
+  FILE *f = fdopen(fd, "w");
+  for (int i = 0; i < 10000; i++)
+    fprintf(f, "%d,", i);
+  fputs("end", f);
+  fclose(f);
+
+  HParser *num = h_many1(h_ch_range('0', '9'));
+  HParser *p = h_sequence(h_many(h_left(num, h_ch(','))), h_token((const uint8_t *)"end", 3), h_end_p(), NULL);
+  HParseResult *res = h_parse_file(p, path, H_FILE_SEQUENTIAL | H_FILE_HUGEPAGES | H_FILE_WILLNEED);
+  // the mapping outlives the file's name
+  unlink(path);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_uint64(res->ast->seq->elements[0]->seq->used, ==, 10000);
+    const HParsedToken *end = res->ast->seq->elements[1];
+    g_check_bytes(end->bytes.len, end->bytes.token, ==, (const uint8_t *)"end");
+    h_parse_result_free(res);
+  }
+
+  g_check_cmp_ptr(h_parse_file(p, path, 0), ==, NULL);   // no longer exists
+  g_check_cmp_ptr(h_parse_file(p, "/tmp", 0), ==, NULL); // not a file
+
+  // an empty file is empty input
+  strcpy(path, "/tmp/hammer-test-XXXXXX");
+  fd = mkstemp(path);
+  g_check_cmp_int(fd, >=, 0);
+  close(fd);
+  res = h_parse_file(h_end_p(), path, 0);
+  g_check_cmp_ptr(res, !=, NULL);
+  h_parse_result_free(res);
+  g_check_cmp_ptr(h_parse_file(p, path, 0), ==, NULL);
+  unlink(path);
+}
+
+static void test_packed_token(void) {
+  g_check_cmp_uint64(sizeof(HPackedToken), <=, 32);
+  g_check_cmp_ptr(h_pack_token(NULL), ==, NULL);
+
+  HParser *num = h_choice(h_int_range(h_uint8(), '0', '9'),
+                          h_sequence(h_ch('-'), h_many1(h_ch_range('0', '9')), NULL),
+                          h_ch('x'), NULL);
+  HParser *p = h_sequence(h_many(h_sequence(num, h_optional(h_ch(',')), NULL)),
+                          h_token((const uint8_t *)"end", 3), h_end_p(), NULL);
+  const char *input = "1,-23x,4,-5end";
+  HParseResult *res = h_parse(p, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  if (!res)
+    return;
+
+  HPackedToken *pk = h_pack_token(res->ast);
+  g_check_cmp_ptr(pk, !=, NULL);
+  g_check_cmp_uint64(pk->size, ==, 25);
+  g_check_cmp_uint64(h_packed_seq_len(pk), ==, h_seq_len(res->ast));
+  const HPackedToken *items = h_packed_seq_index(pk, 0);
+  const HParsedToken *orig = h_seq_index(res->ast, 0);
+  g_check_cmp_uint64(h_packed_seq_len(items), ==, 5);
+  for (size_t i = 0; i < h_seq_len(orig); i++) {
+    const HPackedToken *item = h_packed_seq_index(items, i);
+    const HPackedToken *comma = h_packed_seq_index(item, 1);
+    g_check_cmp_int32(comma->token_type, ==, h_seq_index(h_seq_index(orig, i), 1)->token_type);
+    // the elements of a subtree follow its root directly
+    g_check_cmp_ptr(comma + comma->size, <=, item + item->size);
+  }
+  const HPackedToken *end = h_packed_seq_index(pk, 1);
+  g_check_bytes(end->len, end->bytes, ==, (const uint8_t *)"end");
+
+  HArena *arena = h_new_arena(&system_allocator, 0);
+  char *expected = h_write_result_unamb(res->ast);
+  char *actual = h_write_result_unamb(h_unpack_token(arena, pk));
+  g_check_string(actual, ==, expected);
+  free(expected);
+  free(actual);
+  h_packed_token_free(pk);
+  h_parse_result_free(res);
+
+  // a NULL element survives the round trip
+  HParsedToken *seq = h_make_seq(arena);
+  h_seq_snoc(seq, NULL);
+  h_seq_snoc(seq, h_make_uint(arena, 7));
+  pk = h_pack_token(seq);
+  g_check_cmp_ptr(h_packed_seq_index(pk, 0), ==, NULL);
+  g_check_cmp_uint64(h_packed_seq_index(pk, 1)->uint, ==, 7);
+  HParsedToken *back = h_unpack_token(arena, pk);
+  g_check_cmp_ptr(h_seq_index(back, 0), ==, NULL);
+  g_check_cmp_uint64(h_seq_index(back, 1)->uint, ==, 7);
+  h_packed_token_free(pk);
+  h_delete_arena(arena);
+}
+
+typedef struct {
+  int32_t x, y;
+} Point;
+
+static size_t write_point(const HParsedToken *tok, uint8_t *buf, size_t len, void *env) {
+  const Point *pt = tok->user;
+  if (pt->x < 0)
+    return (size_t)-1;  // say these cannot be sent
+  if (buf)
+    memcpy(buf, pt, sizeof(Point));
+  return sizeof(Point);
+}
+
+static void *read_point(HArena *arena, const uint8_t *buf, size_t len, void *env) {
+  if (len != sizeof(Point))
+    return NULL;
+  Point *pt = h_arena_malloc(arena, sizeof(Point));
+  memcpy(pt, buf, sizeof(Point));
+  return pt;
+}
+
+static const HTokenSerializer point_serializer = {write_point, read_point, NULL};
+
+// visit every token and byte of a serialised tree, as a reader would;
+// returns the number of tokens
+static size_t walk_serialized(const HPackedToken *p, unsigned int *sum) {
+  size_t n = 1;
+  if (!p)
+    return n;
+  if (p->token_type == TT_SEQUENCE) {
+    for (size_t i = 0; i < h_packed_seq_len(p); i++)
+      n += walk_serialized(h_packed_seq_index(p, i), sum);
+  } else if (p->token_type == TT_BYTES || p->token_type >= TT_USER) {
+    const uint8_t *data = h_serialized_data(p);
+    for (size_t i = 0; i < p->len; i++)
+      *sum += data[i];
+  }
+  return n;
+}
+
+static void test_serialize(void) {
+  size_t len;
+  unsigned int sum = 0;
+  g_check_cmp_ptr(h_serialize_token(NULL, &len), ==, NULL);
+
+  HParser *kv = h_sequence(h_many1(h_ch_range('a', 'z')), h_ch('='),
+                           h_choice(h_int_range(h_uint8(), '0', '9'),
+                                    h_token((const uint8_t *)"yes", 3), NULL), NULL);
+  HParser *p = h_sequence(h_sepBy(kv, h_ch(';')), h_end_p(), NULL);
+  const char *input = "ab=1;c=yes;def=7";
+  HParseResult *res = h_parse(p, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  if (!res)
+    return;
+
+  uint8_t *buf = h_serialize_token(res->ast, &len);
+  g_check_cmp_ptr(buf, !=, NULL);
+  const HPackedToken *root = h_read_serialized(buf, len);
+  g_check_cmp_ptr(root, !=, NULL);
+  g_check_cmp_uint64(walk_serialized(root, &sum), ==, root->size);
+  const HPackedToken *yes = h_packed_seq_index(h_packed_seq_index(h_packed_seq_index(root, 0), 1), 2);
+  g_check_bytes(yes->len, h_serialized_data(yes), ==, (const uint8_t *)"yes");
+
+  HArena *arena = h_new_arena(&system_allocator, 0);
+  char *expected = h_write_result_unamb(res->ast);
+  char *actual = h_write_result_unamb(h_deserialize_token(arena, buf, len));
+  g_check_string(actual, ==, expected);
+  free(expected);
+  free(actual);
+
+  // truncated, misaligned, or from another build
+  g_check_cmp_ptr(h_read_serialized(buf, len - 1), ==, NULL);
+  uint8_t *copy = malloc(len + 8);
+  memcpy(copy + 1, buf, len);
+  g_check_cmp_ptr(h_read_serialized(copy + 1, len), ==, NULL);
+  memcpy(copy, buf, len);
+  copy[0] ^= 0xff;
+  g_check_cmp_ptr(h_read_serialized(copy, len), ==, NULL);
+
+  // whatever a corrupted buffer holds, a walk of what is accepted stays in it
+  for (size_t i = 0; i < len; i++) {
+    for (unsigned int bit = 0; bit < 8; bit++) {
+      memcpy(copy, buf, len);
+      copy[i] ^= 1 << bit;
+      const HPackedToken *r = h_read_serialized(copy, len);
+      if (r)
+        walk_serialized(r, &sum);
+    }
+  }
+  free(copy);
+  free(buf);
+  h_parse_result_free(res);
+
+  // a user type goes by name, with its serialiser
+  HTokenType tt_point = h_allocate_token_type("com.upstandinghackers.test.point");
+  HTokenType tt_other = h_allocate_token_type("com.upstandinghackers.test.unserialised");
+  Point pt = {3, -4}, bad = {-1, 0};
+  HParsedToken *seq = h_make_seq(arena);
+  HParsedToken *ut = h_make(arena, tt_point, &pt);
+  h_seq_snoc(seq, ut);
+  h_seq_snoc(seq, h_make_bytes(arena, (uint8_t *)"xy", 2));
+  g_check_cmp_ptr(h_serialize_token(seq, &len), ==, NULL);  // no serialiser yet
+  g_check_cmp_int(h_set_token_type_serializer(tt_point, &point_serializer), ==, 0);
+  g_check_cmp_ptr(h_get_token_type_serializer(tt_point), ==, &point_serializer);
+  g_check_cmp_int(h_set_token_type_serializer(TT_UINT, &point_serializer), ==, -1);
+
+  buf = h_serialize_token(seq, &len);
+  g_check_cmp_ptr(buf, !=, NULL);
+  root = h_read_serialized(buf, len);
+  g_check_cmp_ptr(root, !=, NULL);
+  const HPackedToken *up = h_packed_seq_index(root, 0);
+  g_check_string(h_serialized_type_name(buf, up->token_type), ==, "com.upstandinghackers.test.point");
+  g_check_cmp_uint64(up->len, ==, sizeof(Point));
+  g_check_cmp_uint64((uintptr_t)h_serialized_data(up) % 8, ==, 0);
+  HParsedToken *back = h_deserialize_token(arena, buf, len);
+  g_check_cmp_ptr(back, !=, NULL);
+  const Point *bp = h_seq_index(back, 0)->user;
+  g_check_cmp_int32(h_seq_index(back, 0)->token_type, ==, tt_point);
+  g_check_cmp_int32(bp->x, ==, 3);
+  g_check_cmp_int32(bp->y, ==, -4);
+  free(buf);
+
+  // a value its serialiser refuses, and a type without one
+  ut->user = &bad;
+  g_check_cmp_ptr(h_serialize_token(seq, &len), ==, NULL);
+  ut->user = &pt;
+  h_seq_snoc(seq, h_make(arena, tt_other, &pt));
+  g_check_cmp_ptr(h_serialize_token(seq, &len), ==, NULL);
+  h_delete_arena(arena);
+}
+
+// the sum of the counts of the entries of kind for parsers named name
+static uint64_t profile_count(HProfileKind kind, const char *name, const HProfileEntry **last) {
+  static HProfileEntry entries[256];
+  size_t n = h_profile_entries(entries, 256);
+  uint64_t count = 0;
+  for (size_t i = 0; i < n && i < 256; i++) {
+    if (entries[i].kind == kind && entries[i].name && strcmp(entries[i].name, name) == 0) {
+      count += entries[i].count;
+      if (last)
+        *last = &entries[i];
+    }
+  }
+  return count;
+}
+
+static void test_profile(void) {
+  H_RULE(digit, h_ch_range('0', '9'));
+  H_RULE(num, h_many1(digit));
+  H_RULE(sign, h_optional(h_ch('-')));
+  H_RULE(term, h_sequence(sign, num, NULL));
+  H_RULE(expr, h_sepBy1(term, h_ch('+')));
+  g_check_string(h_get_parser_name(num), ==, "num");
+  g_check_cmp_ptr(h_name_parser(num, "other"), ==, num);
+  g_check_string(h_get_parser_name(num), ==, "num");  // the first name stays
+  g_check_cmp_ptr(h_get_parser_name(h_ch('+')), ==, NULL);
+
+  HProfileEntry e;
+  if (!h_profile_enable(true)) {
+    // not compiled in
+    g_check_cmp_uint64(h_profile_entries(&e, 1), ==, 0);
+    return;
+  }
+  h_profile_reset();
+  const char *input = "12+-345+6";
+
+  H_RULE(packrat, h_sequence(expr, h_end_p(), NULL));
+  HParseResult *res = h_parse(packrat, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  h_parse_result_free(res);
+  const HProfileEntry *pe = NULL;
+  g_check_cmp_uint64(profile_count(H_PROFILE_PARSER, "term", &pe), ==, 3);
+  g_check_cmp_uint64(pe->memo_misses, ==, 3);
+  g_check_cmp_uint64(pe->bytes, ==, 9 - 2);
+  g_check_cmp_int64(pe->self_ns, <=, pe->ns);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PARSER, "sign", &pe), ==, 3);
+  g_check_cmp_uint64(pe->bytes, ==, 1);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PARSER, "expr", &pe), ==, 1);
+  g_check_cmp_uint64(pe->bytes, ==, 9);
+  // the most expensive parser comes first
+  g_check_cmp_uint64(h_profile_entries(&e, 1), >, 1);
+  g_check_cmp_int32(e.kind, ==, H_PROFILE_PARSER);
+  g_check_cmp_int64(e.self_ns, >=, pe->self_ns);
+
+  // LL(k) counts the productions it expands
+  h_profile_reset();
+  H_RULE(llk, h_sequence(expr, h_end_p(), NULL));
+  g_check_cmp_int(h_compile(llk, PB_LLk, (void *)1), ==, 0);
+  res = h_parse(llk, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  h_parse_result_free(res);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PRODUCTION, "sign", NULL), ==, 3);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PRODUCTION, "term", NULL), ==, 3);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PARSER, "term", NULL), ==, 0);
+
+  // LALR counts the productions it reduces, and the states it enters
+  h_profile_reset();
+  H_RULE(lalr, h_sequence(expr, h_end_p(), NULL));
+  g_check_cmp_int(h_compile(lalr, PB_LALR, NULL), ==, 0);
+  res = h_parse(lalr, (const uint8_t *)input, strlen(input));
+  g_check_cmp_ptr(res, !=, NULL);
+  h_parse_result_free(res);
+  g_check_cmp_uint64(profile_count(H_PROFILE_PRODUCTION, "digit", NULL), ==, 6);
+  g_check_cmp_uint64(profile_count(H_PROFILE_STATE, "lalr", NULL), >, 9);
+
+  FILE *f = tmpfile();
+  h_profile_report(f);
+  g_check_cmp_int(ftell(f), >, 0);
+  fclose(f);
+
+  // nothing is counted while disabled
+  uint64_t before = profile_count(H_PROFILE_STATE, "lalr", NULL);
+  h_profile_enable(false);
+  res = h_parse(lalr, (const uint8_t *)input, strlen(input));
+  h_parse_result_free(res);
+  g_check_cmp_uint64(profile_count(H_PROFILE_STATE, "lalr", NULL), ==, before);
+  h_profile_reset();
+}
+
+static void test_counting_allocator(void) {
+  HAllocator *mm = h_counting_allocator_new(&system_allocator, 0);
+  HAllocatorStats st;
+  HParser *p = h_sequence(h_many1(h_ch_range('0', '9')), h_end_p(), NULL);
+
+  HParseResult *res = h_parse__m(mm, p, (const uint8_t *)"12345", 5);
+  g_check_cmp_ptr(res, !=, NULL);
+  HArenaStats as;
+  h_parse_result_stats(res, &as);
+  g_check_cmp_uint64(as.used, >, 0);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.allocs, >, 0);
+  g_check_cmp_uint64(st.bytes, >=, as.used);
+  g_check_cmp_uint64(st.peak, >=, st.bytes);
+  size_t peak = st.peak;
+  h_parse_result_free(res);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+  g_check_cmp_uint64(st.peak, ==, peak);
+  g_check_cmp_uint64(st.failures, ==, 0);
+  size_t hist = 0;
+  for (size_t i = 0; i < H_ALLOCATOR_BUCKETS; i++)
+    hist += st.histogram[i];
+  g_check_cmp_uint64(hist, ==, st.allocs + st.reallocs);
+  h_counting_allocator_reset_peak(mm);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.peak, ==, 0);
+  h_counting_allocator_free(mm);
+
+  // past the limit, allocations fail and leave the counts as they were
+  mm = h_counting_allocator_new(&system_allocator, 100);
+  void *a = mm->alloc(mm, 50);
+  g_check_cmp_ptr(a, !=, NULL);
+  g_check_cmp_ptr(mm->alloc(mm, 60), ==, NULL);
+  a = mm->realloc(mm, a, 90);
+  g_check_cmp_ptr(a, !=, NULL);
+  g_check_cmp_ptr(mm->realloc(mm, a, 200), ==, NULL);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 90);
+  g_check_cmp_uint64(st.peak, ==, 90);
+  g_check_cmp_uint64(st.failures, ==, 2);
+  g_check_cmp_uint64(st.histogram[0], ==, 0);
+  g_check_cmp_uint64(st.histogram[2], ==, 1);  // 50, up to 64 bytes; not the refused 60
+  g_check_cmp_uint64(st.histogram[3], ==, 1);  // 90
+  mm->free(mm, a);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+  g_check_cmp_uint64(st.frees, ==, 1);
+  h_counting_allocator_free(mm);
+
+  // as do allocations that the backing allocator refuses
+  mm = h_counting_allocator_new(&system_allocator, 1000);
+  HAllocator *outer = h_counting_allocator_new(mm, 0);
+  g_check_cmp_ptr(outer->alloc(outer, 2000), ==, NULL);
+  h_counting_allocator_stats(outer, &st);
+  g_check_cmp_uint64(st.failures, ==, 1);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+  g_check_cmp_uint64(st.peak, ==, 0);
+  g_check_cmp_uint64(st.total, ==, 0);
+  g_check_cmp_uint64(st.histogram[7], ==, 0);  // 2000, up to 2048 bytes
+  h_counting_allocator_free(outer);
+  h_counting_allocator_free(mm);
+}
+
+static void test_parse_limited(void) {
+  HAllocator *mm = h_counting_allocator_new(&system_allocator, 0);
+  HAllocatorStats st;
+  HParseStatus status;
+  HParseResult *res;
+  HParseLimits none = {0, 0, 0};
+  const uint8_t *input = (const uint8_t *)"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  size_t length = strlen((const char *)input);
+  HParser *p = h_sequence(h_many(h_ch('a')), h_end_p(), NULL);
+
+  // within the limits, it is h_parse, and the result outlives the parse
+  res = h_parse_limited__m(mm, p, input, length, &none, &status);
+  g_check_cmp_int(status, ==, H_PARSE_OK);
+  g_check_cmp_ptr(res, !=, NULL);
+  h_parse_result_free(res);
+  res = h_parse_limited__m(mm, p, (const uint8_t *)"ab", 2, &none, &status);
+  g_check_cmp_int(status, ==, H_PARSE_NO_MATCH);
+  g_check_cmp_ptr(res, ==, NULL);
+
+  // past a limit, the parse is unwound and all its memory freed
+  HParseLimits memory = {.max_memory = 1000};
+  res = h_parse_limited__m(mm, p, input, length, &memory, &status);
+  g_check_cmp_int(status, ==, H_PARSE_MEMORY_LIMIT);
+  g_check_cmp_ptr(res, ==, NULL);
+  HParseLimits lookahead = {.max_lookahead = 4};
+  res = h_parse_limited__m(mm, p, input, length, &lookahead, &status);
+  g_check_cmp_int(status, ==, H_PARSE_LOOKAHEAD_LIMIT);
+  lookahead.max_lookahead = length;
+  res = h_parse_limited__m(mm, p, input, length, &lookahead, &status);
+  g_check_cmp_int(status, ==, H_PARSE_OK);
+  h_parse_result_free(res);
+  // a parser that does not look that far is not stopped
+  lookahead.max_lookahead = 4;
+  HParser *two = h_sequence(h_ch('a'), h_ch('a'), NULL);
+  res = h_parse_limited__m(mm, two, input, length, &lookahead, &status);
+  g_check_cmp_int(status, ==, H_PARSE_OK);
+  h_parse_result_free(res);
+  // nor is an exact repeat that ends at the cut
+  HParser *four = h_repeat_n(h_ch('a'), 4);
+  res = h_parse_limited__m(mm, four, input, length, &lookahead, &status);
+  g_check_cmp_int(status, ==, H_PARSE_OK);
+  h_parse_result_free(res);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+
+  // every backend counts its steps
+  HParseLimits steps = {.max_steps = 10};
+  HParser *pairs = h_sequence(h_many(h_sequence(h_ch('a'), h_ch('a'), NULL)), h_end_p(), NULL);
+  HParserBackend backends[] = {PB_PACKRAT, PB_REGULAR, PB_LLk, PB_LALR, PB_GLR, PB_EARLEY};
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    g_check_cmp_int(h_compile(pairs, backends[i], NULL), ==, 0);
+    res = h_parse_limited__m(mm, pairs, input, length, &steps, &status);
+    g_check_cmp_int(status, ==, H_PARSE_STEP_LIMIT);
+    g_check_cmp_ptr(res, ==, NULL);
+    res = h_parse_limited__m(mm, pairs, input, length, &none, &status);
+    g_check_cmp_int(status, ==, H_PARSE_OK);
+    h_parse_result_free(res);
+    res = h_parse_limited__m(mm, pairs, input, length, &lookahead, &status);
+    g_check_cmp_int(status, ==, H_PARSE_LOOKAHEAD_LIMIT);
+  }
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+
+  // an ambiguous grammar, whose parses GLR forks engines for
+  HParser *S = h_indirect();
+  h_bind_indirect(S, h_choice(h_sequence(S, S, NULL), h_ch('a'), NULL));
+  HParser *amb = h_sequence(S, h_end_p(), NULL);
+  g_check_cmp_int(h_compile(amb, PB_GLR, NULL), ==, 0);
+  steps.max_steps = 100;
+  res = h_parse_limited__m(mm, amb, input, length, &steps, &status);
+  g_check_cmp_int(status, ==, H_PARSE_STEP_LIMIT);
+  h_counting_allocator_stats(mm, &st);
+  g_check_cmp_uint64(st.bytes, ==, 0);
+  h_counting_allocator_free(mm);
+}
+
 void register_misc_tests(void) {
   g_test_add_func("/core/misc/tt_user", test_tt_user);
   g_test_add_func("/core/misc/tt_registry", test_tt_registry);
+  g_test_add_func("/core/misc/dump_code", test_dump_code);
+  g_test_add_func("/core/misc/compile_threads", test_compile_threads);
+  g_test_add_func("/core/misc/compile_shared", test_compile_shared);
+  g_test_add_func("/core/misc/parse_batch", test_parse_batch);
+  g_test_add_func("/core/misc/parse_split", test_parse_split);
+  g_test_add_func("/core/misc/input_source", test_input_source);
+  g_test_add_func("/core/misc/parse_file", test_parse_file);
+  g_test_add_func("/core/misc/packed_token", test_packed_token);
+  g_test_add_func("/core/misc/serialize", test_serialize);
+  g_test_add_func("/core/misc/profile", test_profile);
+  g_test_add_func("/core/misc/counting_allocator", test_counting_allocator);
+  g_test_add_func("/core/misc/parse_limited", test_parse_limited);
 }
@@ -1,4 +1,5 @@
 #include <glib.h>
+#include <stdlib.h>
 #include <string.h>
 #include "hammer.h"
 #include "glue.h"
@@ -284,6 +285,177 @@ static void test_xor(gconstpointer backend) {
   g_check_parse_failed(xor_, (HParserBackend)GPOINTER_TO_INT(backend), "a", 1);
 }
 
+// a repetition of a single-byte parser is scanned in one go; it must give
+// the same results as parsing one element at a time (which a choice of one
+// forces).
+static void check_many_span(HParserBackend be, HParser *(*rep)(const HParser*),
+                            HParser *elem, const uint8_t *input, size_t len) {
+  HParser *fast = h_sequence(h_bits(4, false), h_bits(4, false), rep(elem), NULL);
+  HParser *slow = h_sequence(h_bits(4, false), h_bits(4, false), rep(h_choice(elem, NULL)), NULL);
+  HParser *unaligned = h_sequence(h_bits(4, false), rep(elem), NULL);
+  HParser *unaligned_slow = h_sequence(h_bits(4, false), rep(h_choice(elem, NULL)), NULL);
+  HParser *pairs[][2] = {{fast, slow}, {unaligned, unaligned_slow}};
+  for (size_t i = 0; i < 2; i++) {
+    h_compile(pairs[i][0], be, NULL);
+    h_compile(pairs[i][1], be, NULL);
+    HParseResult *r1 = h_parse(pairs[i][0], input, len);
+    HParseResult *r2 = h_parse(pairs[i][1], input, len);
+    g_check_cmp_int(r1 == NULL, ==, r2 == NULL);
+    if (r1 && r2) {
+      g_check_cmp_int64(r1->bit_length, ==, r2->bit_length);
+      char *c1 = h_write_result_unamb(r1->ast);
+      char *c2 = h_write_result_unamb(r2->ast);
+      g_check_string(c1, ==, c2);
+      free(c1);
+      free(c2);
+    }
+    h_parse_result_free(r1);
+    h_parse_result_free(r2);
+  }
+}
+
+static HParser *repeat_37(const HParser *p) {
+  return h_repeat_n(p, 37);
+}
+
+static void test_many_charset(gconstpointer backend) {
+  HParserBackend be = (HParserBackend)GPOINTER_TO_INT(backend);
+  // every printable byte but '~'
+  uint8_t printable[94];
+  for (int i = 0; i < 94; i++)
+    printable[i] = ' ' + i;
+  // a set that needs more than 8 nibble classes
+  uint8_t scattered[16];
+  for (int i = 0; i < 16; i++)
+    scattered[i] = i * 17 + (i % 3);
+  HParser *elems[] = {
+    h_ch('a'), h_ch_range('a', 'z'), h_not_in((const uint8_t *)"\n", 1),
+    h_in(printable, sizeof(printable)), h_in(scattered, sizeof(scattered)),
+  };
+  HParser *(*reps[])(const HParser*) = {h_many, h_many1, repeat_37};
+
+  uint8_t input[100];
+  for (size_t len = 0; len <= sizeof(input); len += 7) {
+    for (size_t stop = 0; stop <= len; stop += 13) {
+      for (size_t i = 0; i < len; i++)
+        input[i] = i < stop ? 'a' + i % 3 : (i == stop ? '\n' : 'q');
+      for (size_t e = 0; e < sizeof(elems) / sizeof(elems[0]); e++)
+        for (size_t r = 0; r < 3; r++)
+          check_many_span(be, reps[r], elems[e], input, len);
+    }
+  }
+  for (size_t i = 0; i < sizeof(input); i++)
+    input[i] = scattered[i % 16];
+  check_many_span(be, h_many, elems[4], input, sizeof(input));
+
+  // equal bytes share their token
+  const HParser *word = h_many(elems[1]);
+  h_compile((HParser *)word, be, NULL);
+  HParseResult *res = h_parse(word, (const uint8_t *)"abcab", 5);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_uint64(h_seq_len(res->ast), ==, 5);
+    g_check_cmp_ptr(h_seq_index(res->ast, 0), ==, h_seq_index(res->ast, 3));
+    g_check_cmp_uint64(H_INDEX_UINT(res->ast, 4), ==, 'b');
+    h_parse_result_free(res);
+  }
+}
+
+// counts its calls in *user_data and returns the digits as a number
+static HParsedToken* count_number(const HParseResult *p, void* user_data) {
+  ++*(int*)user_data;
+  HParsedToken *ret = a_new_(p->arena, HParsedToken, 1);
+  ret->token_type = TT_UINT;
+  ret->uint = 0;
+  for (size_t i=0; i<p->ast->seq->used; ++i)
+    ret->uint = ret->uint * 10 + (H_INDEX_UINT(p->ast, i) - '0');
+  return ret;
+}
+
+static HParsedToken* act_drop(const HParseResult *p, void* user_data) {
+  return NULL;
+}
+
+static bool is_even(HParseResult *p, void* user_data) {
+  return p->ast->token_type == TT_UINT && p->ast->uint % 2 == 0;
+}
+
+static HParser* deferred_grammar(int *calls) {
+  HParser *digits = h_many1(h_ch_range('0', '9'));
+  // the alternatives parse the same number; only one result is kept
+  HParser *tagged = h_choice(h_sequence(h_action(digits, count_number, calls), h_ch('x'), NULL),
+                             h_sequence(h_action(digits, count_number, calls), h_ch('y'), NULL),
+                             h_sequence(h_int_range(h_action(digits, count_number, calls), 0, 9),
+                                        h_ch('z'), NULL),
+                             h_sequence(h_attr_bool(h_action(digits, count_number, calls), is_even, NULL),
+                                        h_ch('e'), NULL),
+                             NULL);
+  HParser *item = h_sequence(h_action(h_ch('-'), act_drop, NULL),
+                             h_action(tagged, upcase, NULL), NULL);
+  return h_sequence(h_many(item), h_end_p(), NULL);
+}
+
+// a continuation whose deferred action lives in bind's temporary arena
+static HParser *k_deferred_bind(HAllocator *mm__, const HParsedToken *p, void *env) {
+  return h_action__m(mm__, h_many1__m(mm__, h_ch_range__m(mm__, '0', '9')), count_number, env);
+}
+
+static void test_deferred_actions(gconstpointer backend) {
+  static const char *inputs[] = {"-12y-5x", "-7z", "-10y-8e-3x", "-8e-7z"};
+  void *params = (void *)H_PACKRAT_DEFER_ACTIONS;
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+    int calls = 0, deferred_calls = 0;
+    HParser *eager = deferred_grammar(&calls);
+    HParser *deferred = deferred_grammar(&deferred_calls);
+    g_check_cmp_int(h_compile(deferred, PB_PACKRAT, params), ==, 0);
+    size_t len = strlen(inputs[i]);
+    HParseResult *res = h_parse(eager, (const uint8_t *)inputs[i], len);
+    HParseResult *dres = h_parse(deferred, (const uint8_t *)inputs[i], len);
+    g_check_cmp_ptr(res, !=, NULL);
+    g_check_cmp_ptr(dres, !=, NULL);
+    if (res && dres) {
+      char *s = h_write_result_unamb(res->ast), *ds = h_write_result_unamb(dres->ast);
+      g_check_string(ds, ==, s);
+      (&system_allocator)->free(&system_allocator, s);
+      (&system_allocator)->free(&system_allocator, ds);
+      // only the numbers in the result, and those the predicates looked at
+      g_check_cmp_int(deferred_calls, <, calls);
+    }
+    h_parse_result_free(res);
+    h_parse_result_free(dres);
+  }
+
+  // a failed parse calls only the actions predicates needed
+  int calls = 0;
+  HParser *deferred = deferred_grammar(&calls);
+  h_compile(deferred, PB_PACKRAT, params);
+  HParseResult *res = h_parse(deferred, (const uint8_t *)"-12y-5x", 7);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    char *s = h_write_result_unamb(res->ast);
+    g_check_string(s, ==, "((((u0xc u0x59)) ((u0x5 u0x58))))");
+    (&system_allocator)->free(&system_allocator, s);
+    h_parse_result_free(res);
+  }
+  g_check_cmp_int(calls, ==, 2);
+  calls = 0;
+  g_check_cmp_ptr(h_parse(deferred, (const uint8_t *)"-12y-5xw", 8), ==, NULL);
+  g_check_cmp_int(calls, ==, 0);
+
+  // the actions of a bind continuation run before its parser goes
+  calls = 0;
+  HParser *bound = h_bind(h_ch('#'), k_deferred_bind, &calls);
+  h_compile(bound, PB_PACKRAT, params);
+  res = h_parse(bound, (const uint8_t *)"#42", 3);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_int(res->ast->token_type, ==, TT_UINT);
+    g_check_cmp_uint64(res->ast->uint, ==, 42);
+    h_parse_result_free(res);
+  }
+  g_check_cmp_int(calls, ==, 1);
+}
+
 static void test_many(gconstpointer backend) {
   const HParser *many_ = h_many(h_choice(h_ch('a'), h_ch('b'), NULL));
 
@@ -533,6 +705,76 @@ static void test_iterative_result_length(gconstpointer backend) {
   g_check_cmp_int64(r->bit_length, ==, 48);
 }
 
+// records events as text: "(name@pos", ")name@start-end" and the bytes
+typedef struct {
+  const HParser *rules[5];
+  const char *names[5];
+  char buf[256];
+  size_t len;
+} EventLog;
+
+static const char *event_name(HParseEventSink *sink, const HParser *rule) {
+  EventLog *log = sink->user_data;
+  for (size_t i = 0; i < 5; i++)
+    if (log->rules[i] == rule)
+      return log->names[i];
+  return "?";
+}
+
+static void log_enter(HParseEventSink *sink, const HParser *rule, size_t pos) {
+  EventLog *log = sink->user_data;
+  log->len += snprintf(log->buf + log->len, sizeof(log->buf) - log->len,
+                       "(%s@%zu", event_name(sink, rule), pos);
+}
+
+static void log_exit(HParseEventSink *sink, const HParser *rule, size_t start, size_t end) {
+  EventLog *log = sink->user_data;
+  log->len += snprintf(log->buf + log->len, sizeof(log->buf) - log->len,
+                       ")%s@%zu-%zu", event_name(sink, rule), start, end);
+}
+
+static void log_terminal(HParseEventSink *sink, uint8_t byte, size_t pos) {
+  EventLog *log = sink->user_data;
+  log->len += snprintf(log->buf + log->len, sizeof(log->buf) - log->len,
+                       "%c", byte);
+}
+
+static void test_parse_events(gconstpointer backend) {
+  HParserBackend be = (HParserBackend)GPOINTER_TO_INT(backend);
+  HParser *key = h_many1(h_ch_range('a', 'z'));
+  HParser *num = h_many1(h_ch_range('0', '9'));
+  HParser *pair = h_sequence(key, h_ch('='), num, NULL);
+  HParser *list = h_sepBy1(pair, h_ch(','));
+  HParser *p = h_sequence(list, h_end_p(), NULL);
+  if(h_compile(p, be, NULL) != 0) {
+    g_test_message("Compile failed");
+    g_test_fail();
+    return;
+  }
+
+  EventLog log = {{p, list, pair, key, num}, {"p", "list", "pair", "key", "num"}, "", 0};
+  HParseEventSink sink = {log_enter, log_exit, log_terminal, &log};
+  g_check_cmp_int(h_parse_events(p, (const uint8_t *)"ab=1,c=23", 9, &sink), ==, 0);
+  if (be == PB_LLk)
+    g_check_string(log.buf, ==, "(p@0(list@0(pair@0(key@0ab)key@0-2=(num@31)num@3-4)pair@0-4,"
+                   "(pair@5(key@5c)key@5-6=(num@723)num@7-9)pair@5-9)list@0-9)p@0-9");
+  else
+    g_check_string(log.buf, ==, "ab(key@0)key@0-2=1(num@3)num@3-4(pair@0)pair@0-4,"
+                   "c(key@5)key@5-6=23(num@7)num@7-9(pair@5)pair@5-9(list@0)list@0-9(p@0)p@0-9");
+
+  // the events up to the error are reported
+  log.len = 0;
+  log.buf[0] = '\0';
+  g_check_cmp_int(h_parse_events(p, (const uint8_t *)"ab=1,=", 6, &sink), ==, -1);
+  g_check_cmp_int(log.buf[log.len - 1], ==, ',');
+
+  // validations are not supported, and neither are the other backends
+  HParser *v = h_attr_bool(num, is_even, NULL);
+  if(h_compile(v, be, NULL) == 0)
+    g_check_cmp_int(h_parse_events(v, (const uint8_t *)"2", 1, &sink), ==, -1);
+  g_check_cmp_int(h_parse_events(h_ch('a'), (const uint8_t *)"a", 1, &sink), ==, -1);
+}
+
 static void test_result_length(gconstpointer backend) {
   HParserBackend be = (HParserBackend)GPOINTER_TO_INT(backend);
   HParser *p = h_token((uint8_t*)"foo", 3);
@@ -594,6 +836,26 @@ static void test_ambiguous(gconstpointer backend) {
   g_check_parse_failed(expr_, (HParserBackend)GPOINTER_TO_INT(backend), "d+", 2);
 }
 
+// a right recursion as long as the input, which Leo's rule handles in
+// constant space per set
+static void test_long_rightrec(gconstpointer backend) {
+  HParser *R_ = h_indirect();
+  h_bind_indirect(R_, h_choice(h_sequence(h_ch('a'), R_, NULL), h_ch('b'), NULL));
+  g_check_cmp_int(h_compile(R_, (HParserBackend)GPOINTER_TO_INT(backend), NULL), ==, 0);
+
+  size_t len = 200000;
+  uint8_t *input = malloc(len);
+  memset(input, 'a', len - 1);
+  input[len - 1] = 'b';
+  HParseResult *res = h_parse(R_, input, len);
+  g_check_cmp_ptr(res, !=, NULL);
+  if (res) {
+    g_check_cmp_uint64(res->bit_length, ==, len * 8);
+    h_parse_result_free(res);
+  }
+  free(input);
+}
+
 static void test_endianness(gconstpointer backend) {
   HParserBackend be = (HParserBackend)GPOINTER_TO_INT(backend);
 
@@ -741,8 +1003,53 @@ static void test_bind(gconstpointer backend) {
   g_check_parse_failed(p, be, "272{", 4);
 }
 
+// parse input cut into segments of the given lengths, the last taking the rest
+static char *parse_iov(const HParser *p, const char *input, const size_t *seglen, size_t n) {
+  struct iovec iov[32];
+  size_t len = strlen(input), pos = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t l = (i + 1 < n && seglen[i] < len - pos) ? seglen[i] : len - pos;
+    iov[i].iov_base = (void *)(input + pos);
+    iov[i].iov_len = l;
+    pos += l;
+  }
+  HParseResult *res = h_parse_iov(p, iov, n);
+  char *cres = res ? h_write_result_unamb(res->ast) : NULL;
+  h_parse_result_free(res);
+  return cres;
+}
+
+static void test_iov(gconstpointer backend) {
+  HParserBackend be = (HParserBackend)GPOINTER_TO_INT(backend);
+  HParser *p = h_sequence(h_token((const uint8_t *)"head", 4),
+                          h_many(h_ch_range('0', '9')), h_ch(';'), h_end_p(), NULL);
+  const char *expected = "(<68.65.61.64> (u0x30 u0x31 u0x32 u0x33) u0x3b)";
+  static const size_t bytes[] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+  static const size_t uneven[] = {2, 0, 3, 0, 1};
+  static const size_t one[] = {0};
+  char *cres;
+
+  if (h_compile(p, be, NULL) != 0) {
+    g_test_message("Compile failed");
+    g_test_fail();
+    return;
+  }
+  cres = parse_iov(p, "head0123;", bytes, 10);
+  g_check_string(cres, ==, expected);
+  free(cres);
+  cres = parse_iov(p, "head0123;", uneven, 5);
+  g_check_string(cres, ==, expected);
+  free(cres);
+  cres = parse_iov(p, "head0123;", one, 1);
+  g_check_string(cres, ==, expected);
+  free(cres);
+  g_check_cmp_ptr(parse_iov(p, "head01x;", bytes, 10), ==, NULL);
+  g_check_cmp_ptr(parse_iov(p, "hea", uneven, 5), ==, NULL);
+}
+
 void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/packrat/token", GINT_TO_POINTER(PB_PACKRAT), test_token);
+  g_test_add_data_func("/core/parser/packrat/iov", GINT_TO_POINTER(PB_PACKRAT), test_iov);
   g_test_add_data_func("/core/parser/packrat/ch", GINT_TO_POINTER(PB_PACKRAT), test_ch);
   g_test_add_data_func("/core/parser/packrat/ch_range", GINT_TO_POINTER(PB_PACKRAT), test_ch_range);
   g_test_add_data_func("/core/parser/packrat/int64", GINT_TO_POINTER(PB_PACKRAT), test_int64);
@@ -773,6 +1080,8 @@ void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/packrat/difference", GINT_TO_POINTER(PB_PACKRAT), test_difference);
   g_test_add_data_func("/core/parser/packrat/xor", GINT_TO_POINTER(PB_PACKRAT), test_xor);
   g_test_add_data_func("/core/parser/packrat/many", GINT_TO_POINTER(PB_PACKRAT), test_many);
+  g_test_add_data_func("/core/parser/packrat/many_charset", GINT_TO_POINTER(PB_PACKRAT), test_many_charset);
+  g_test_add_data_func("/core/parser/packrat/deferred_actions", GINT_TO_POINTER(PB_PACKRAT), test_deferred_actions);
   g_test_add_data_func("/core/parser/packrat/many1", GINT_TO_POINTER(PB_PACKRAT), test_many1);
   g_test_add_data_func("/core/parser/packrat/repeat_n", GINT_TO_POINTER(PB_PACKRAT), test_repeat_n);
   g_test_add_data_func("/core/parser/packrat/optional", GINT_TO_POINTER(PB_PACKRAT), test_optional);
@@ -795,6 +1104,7 @@ void register_parser_tests(void) {
   //g_test_add_data_func("/core/parser/packrat/token_position", GINT_TO_POINTER(PB_PACKRAT), test_token_position);
 
   g_test_add_data_func("/core/parser/llk/token", GINT_TO_POINTER(PB_LLk), test_token);
+  g_test_add_data_func("/core/parser/llk/iov", GINT_TO_POINTER(PB_LLk), test_iov);
   g_test_add_data_func("/core/parser/llk/ch", GINT_TO_POINTER(PB_LLk), test_ch);
   g_test_add_data_func("/core/parser/llk/ch_range", GINT_TO_POINTER(PB_LLk), test_ch_range);
   g_test_add_data_func("/core/parser/llk/int64", GINT_TO_POINTER(PB_LLk), test_int64);
@@ -836,8 +1146,10 @@ void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/llk/iterative", GINT_TO_POINTER(PB_LLk), test_iterative);
   g_test_add_data_func("/core/parser/llk/iterative/lookahead", GINT_TO_POINTER(PB_LLk), test_iterative_lookahead);
   g_test_add_data_func("/core/parser/llk/iterative/result_length", GINT_TO_POINTER(PB_LLk), test_iterative_result_length);
+  g_test_add_data_func("/core/parser/llk/parse_events", GINT_TO_POINTER(PB_LLk), test_parse_events);
 
   g_test_add_data_func("/core/parser/regex/token", GINT_TO_POINTER(PB_REGULAR), test_token);
+  g_test_add_data_func("/core/parser/regex/iov", GINT_TO_POINTER(PB_REGULAR), test_iov);
   g_test_add_data_func("/core/parser/regex/ch", GINT_TO_POINTER(PB_REGULAR), test_ch);
   g_test_add_data_func("/core/parser/regex/ch_range", GINT_TO_POINTER(PB_REGULAR), test_ch_range);
   g_test_add_data_func("/core/parser/regex/int64", GINT_TO_POINTER(PB_REGULAR), test_int64);
@@ -877,6 +1189,7 @@ void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/regex/token_position", GINT_TO_POINTER(PB_REGULAR), test_token_position);
 
   g_test_add_data_func("/core/parser/lalr/token", GINT_TO_POINTER(PB_LALR), test_token);
+  g_test_add_data_func("/core/parser/lalr/iov", GINT_TO_POINTER(PB_LALR), test_iov);
   g_test_add_data_func("/core/parser/lalr/ch", GINT_TO_POINTER(PB_LALR), test_ch);
   g_test_add_data_func("/core/parser/lalr/ch_range", GINT_TO_POINTER(PB_LALR), test_ch_range);
   g_test_add_data_func("/core/parser/lalr/int64", GINT_TO_POINTER(PB_LALR), test_int64);
@@ -919,8 +1232,10 @@ void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/lalr/iterative", GINT_TO_POINTER(PB_LALR), test_iterative);
   g_test_add_data_func("/core/parser/lalr/iterative/lookahead", GINT_TO_POINTER(PB_LALR), test_iterative_lookahead);
   g_test_add_data_func("/core/parser/lalr/iterative/result_length", GINT_TO_POINTER(PB_LALR), test_iterative_result_length);
+  g_test_add_data_func("/core/parser/lalr/parse_events", GINT_TO_POINTER(PB_LALR), test_parse_events);
 
   g_test_add_data_func("/core/parser/glr/token", GINT_TO_POINTER(PB_GLR), test_token);
+  g_test_add_data_func("/core/parser/glr/iov", GINT_TO_POINTER(PB_GLR), test_iov);
   g_test_add_data_func("/core/parser/glr/ch", GINT_TO_POINTER(PB_GLR), test_ch);
   g_test_add_data_func("/core/parser/glr/ch_range", GINT_TO_POINTER(PB_GLR), test_ch_range);
   g_test_add_data_func("/core/parser/glr/int64", GINT_TO_POINTER(PB_GLR), test_int64);
@@ -961,4 +1276,47 @@ void register_parser_tests(void) {
   g_test_add_data_func("/core/parser/glr/ambiguous", GINT_TO_POINTER(PB_GLR), test_ambiguous);
   g_test_add_data_func("/core/parser/glr/result_length", GINT_TO_POINTER(PB_GLR), test_result_length);
   g_test_add_data_func("/core/parser/glr/token_position", GINT_TO_POINTER(PB_GLR), test_token_position);
+
+  g_test_add_data_func("/core/parser/earley/token", GINT_TO_POINTER(PB_EARLEY), test_token);
+  g_test_add_data_func("/core/parser/earley/iov", GINT_TO_POINTER(PB_EARLEY), test_iov);
+  g_test_add_data_func("/core/parser/earley/ch", GINT_TO_POINTER(PB_EARLEY), test_ch);
+  g_test_add_data_func("/core/parser/earley/ch_range", GINT_TO_POINTER(PB_EARLEY), test_ch_range);
+  g_test_add_data_func("/core/parser/earley/int64", GINT_TO_POINTER(PB_EARLEY), test_int64);
+  g_test_add_data_func("/core/parser/earley/int32", GINT_TO_POINTER(PB_EARLEY), test_int32);
+  g_test_add_data_func("/core/parser/earley/int16", GINT_TO_POINTER(PB_EARLEY), test_int16);
+  g_test_add_data_func("/core/parser/earley/int8", GINT_TO_POINTER(PB_EARLEY), test_int8);
+  g_test_add_data_func("/core/parser/earley/uint64", GINT_TO_POINTER(PB_EARLEY), test_uint64);
+  g_test_add_data_func("/core/parser/earley/uint32", GINT_TO_POINTER(PB_EARLEY), test_uint32);
+  g_test_add_data_func("/core/parser/earley/uint16", GINT_TO_POINTER(PB_EARLEY), test_uint16);
+  g_test_add_data_func("/core/parser/earley/uint8", GINT_TO_POINTER(PB_EARLEY), test_uint8);
+  g_test_add_data_func("/core/parser/earley/int_range", GINT_TO_POINTER(PB_EARLEY), test_int_range);
+  g_test_add_data_func("/core/parser/earley/whitespace", GINT_TO_POINTER(PB_EARLEY), test_whitespace);
+  g_test_add_data_func("/core/parser/earley/left", GINT_TO_POINTER(PB_EARLEY), test_left);
+  g_test_add_data_func("/core/parser/earley/right", GINT_TO_POINTER(PB_EARLEY), test_right);
+  g_test_add_data_func("/core/parser/earley/middle", GINT_TO_POINTER(PB_EARLEY), test_middle);
+  g_test_add_data_func("/core/parser/earley/action", GINT_TO_POINTER(PB_EARLEY), test_action);
+  g_test_add_data_func("/core/parser/earley/in", GINT_TO_POINTER(PB_EARLEY), test_in);
+  g_test_add_data_func("/core/parser/earley/not_in", GINT_TO_POINTER(PB_EARLEY), test_not_in);
+  g_test_add_data_func("/core/parser/earley/end_p", GINT_TO_POINTER(PB_EARLEY), test_end_p);
+  g_test_add_data_func("/core/parser/earley/nothing_p", GINT_TO_POINTER(PB_EARLEY), test_nothing_p);
+  g_test_add_data_func("/core/parser/earley/sequence", GINT_TO_POINTER(PB_EARLEY), test_sequence);
+  g_test_add_data_func("/core/parser/earley/choice", GINT_TO_POINTER(PB_EARLEY), test_choice);
+  g_test_add_data_func("/core/parser/earley/many", GINT_TO_POINTER(PB_EARLEY), test_many);
+  g_test_add_data_func("/core/parser/earley/many1", GINT_TO_POINTER(PB_EARLEY), test_many1);
+  g_test_add_data_func("/core/parser/earley/optional", GINT_TO_POINTER(PB_EARLEY), test_optional);
+  g_test_add_data_func("/core/parser/earley/sepBy", GINT_TO_POINTER(PB_EARLEY), test_sepBy);
+  g_test_add_data_func("/core/parser/earley/sepBy1", GINT_TO_POINTER(PB_EARLEY), test_sepBy1);
+  g_test_add_data_func("/core/parser/earley/epsilon_p", GINT_TO_POINTER(PB_EARLEY), test_epsilon_p);
+  g_test_add_data_func("/core/parser/earley/attr_bool", GINT_TO_POINTER(PB_EARLEY), test_attr_bool);
+  g_test_add_data_func("/core/parser/earley/ignore", GINT_TO_POINTER(PB_EARLEY), test_ignore);
+  g_test_add_data_func("/core/parser/earley/leftrec", GINT_TO_POINTER(PB_EARLEY), test_leftrec);
+  g_test_add_data_func("/core/parser/earley/leftrec-ne", GINT_TO_POINTER(PB_EARLEY), test_leftrec_ne);
+  g_test_add_data_func("/core/parser/earley/rightrec", GINT_TO_POINTER(PB_EARLEY), test_rightrec);
+  g_test_add_data_func("/core/parser/earley/ambiguous", GINT_TO_POINTER(PB_EARLEY), test_ambiguous);
+  g_test_add_data_func("/core/parser/earley/long_rightrec", GINT_TO_POINTER(PB_EARLEY), test_long_rightrec);
+  g_test_add_data_func("/core/parser/earley/result_length", GINT_TO_POINTER(PB_EARLEY), test_result_length);
+  g_test_add_data_func("/core/parser/earley/token_position", GINT_TO_POINTER(PB_EARLEY), test_token_position);
+  g_test_add_data_func("/core/parser/earley/iterative", GINT_TO_POINTER(PB_EARLEY), test_iterative);
+  g_test_add_data_func("/core/parser/earley/iterative/lookahead", GINT_TO_POINTER(PB_EARLEY), test_iterative_lookahead);
+  g_test_add_data_func("/core/parser/earley/iterative/result_length", GINT_TO_POINTER(PB_EARLEY), test_iterative_result_length);
 }
@@ -151,6 +151,38 @@ static void test_cfg_many_seq(void) {
     // reshape on h_many.
 }
 
+static HParsedToken *act_zero(const HParseResult *p, void *user_data) {
+    return H_MAKE_UINT(0);
+}
+static HParsedToken *act_nest(const HParseResult *p, void *user_data) {
+    return H_MAKE_UINT(1 + H_FIELD_UINT(1));
+}
+
+static void test_lr_deep_stack(void) {
+    // the LR driver's value stack must grow past its initial size; reductions
+    // with actions and with selection reshapes must keep their values.
+    HParser *x = h_indirect();
+    h_bind_indirect(x, h_choice(h_action(h_sequence(h_ch('('), x, h_ch(')'), NULL),
+                                         act_nest, NULL),
+                                h_action(h_ch('x'), act_zero, NULL),
+                                NULL));
+    HParser *p = h_sequence(h_ignore(h_ch('<')), x, h_ignore(h_ch('>')), NULL);
+
+    uint8_t input[2*200 + 3];
+    size_t n = 0;
+    input[n++] = '<';
+    for(size_t i=0; i<200; i++)
+        input[n++] = '(';
+    input[n++] = 'x';
+    for(size_t i=0; i<200; i++)
+        input[n++] = ')';
+    input[n++] = '>';
+
+    g_check_parse_match(p, PB_LALR, input,n, "(u0xc8)");
+    g_check_parse_match(p, PB_GLR,  input,n, "(u0xc8)");
+    g_check_parse_failed(p, PB_LALR, input,n-1);
+}
+
 static uint8_t test_charset_bits__buf[256];
 static void *test_charset_bits__alloc(HAllocator *allocator, size_t size)
 {
@@ -173,6 +205,39 @@ static void test_charset_bits(void) {
     g_check_cmp_uint32(test_charset_bits__buf[32], ==, 0xAB);
 }
 
+static void test_charset_after_lalr(void) {
+    // LALR used to set a reshape on the charsets of the shared desugared
+    // form, which the backends compiled after it applied to a character.
+    HParser *p = h_sequence(h_many1(h_ch_range('a', 'z')), h_end_p(), NULL);
+
+    g_check_parse_match(p, PB_LALR,   "abc",3, "((u0x61 u0x62 u0x63))");
+    g_check_parse_match(p, PB_LLk,    "abc",3, "((u0x61 u0x62 u0x63))");
+    g_check_parse_match(p, PB_EARLEY, "abc",3, "((u0x61 u0x62 u0x63))");
+    g_check_parse_match(p, PB_GLR,    "abc",3, "((u0x61 u0x62 u0x63))");
+}
+
+static void test_regex_threads(void) {
+    // The regex VM lost the last thread waiting on each input byte, so of
+    // two alternatives that both matched a prefix, one was never resumed.
+    HParser *kw = h_choice(h_token((const uint8_t*)"abc", 3),
+                           h_token((const uint8_t*)"ab", 2), NULL);
+    HParser *p = h_sequence(h_many(h_sequence(kw, h_ch(' '), NULL)), h_end_p(), NULL);
+
+    g_check_parse_match(p, PB_REGULAR, "ab abc ",7, "(((<61.62> u0x20) (<61.62.63> u0x20)))");
+    g_check_parse_match(p, PB_REGULAR, "abc ab ",7, "(((<61.62.63> u0x20) (<61.62> u0x20)))");
+}
+
+static void test_array_ctors(void) {
+    // h_choice__a and h_sequence__a left the fields of the parser that
+    // they did not set uninitialized, such as the cached desugared form.
+    void *alts[] = {h_ch('a'), h_ch('b'), NULL};
+    void *items[] = {h_choice__a(alts), h_end_p(), NULL};
+    HParser *p = h_sequence__a(items);
+
+    g_check_parse_match(p, PB_LLk,  "b",1, "(u0x62)");
+    g_check_parse_match(p, PB_LALR, "a",1, "(u0x61)");
+}
+
 void register_regression_tests(void) {
   g_test_add_func("/core/regression/bug118", test_bug118);
   g_test_add_func("/core/regression/seq_index_path", test_seq_index_path);
@@ -180,5 +245,9 @@ void register_regression_tests(void) {
   g_test_add_func("/core/regression/llk_zero_end", test_llk_zero_end);
   g_test_add_func("/core/regression/lalr_charset_lhs", test_lalr_charset_lhs);
   g_test_add_func("/core/regression/cfg_many_seq", test_cfg_many_seq);
+  g_test_add_func("/core/regression/lr_deep_stack", test_lr_deep_stack);
   g_test_add_func("/core/regression/charset_bits", test_charset_bits);
+  g_test_add_func("/core/regression/charset_after_lalr", test_charset_after_lalr);
+  g_test_add_func("/core/regression/regex_threads", test_regex_threads);
+  g_test_add_func("/core/regression/array_ctors", test_array_ctors);
 }